@@ -103,6 +103,7 @@ struct INPUT_ARDOP_PARAMS {
   float *fdd;
   float *fddd;
   int *iflag;
+  int *dopTable;   /* blocks in the along-track doppler table, if any */
 };
 
 struct INPUT_ARDOP_PARAMS *get_input_ardop_params_struct(char *in1, char *out);
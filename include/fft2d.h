@@ -111,6 +111,27 @@ void rifft2d(float *data, int M2, int M);
 /* OUTPUTS */
 /* *data = output data array	*/
 
+int fft2dWorkSize(int M2);
+/* Number of floats of column workspace needed by the reentrant (_r) versions */
+/* of fft2d, ifft2d, rfft2d and rifft2d */
+
+void rfft2d_r(float *data, int M2, int M, float *work);
+void rifft2d_r(float *data, int M2, int M, float *work);
+/* Reentrant versions of rfft2d and rifft2d: the caller supplies the */
+/* column workspace, so several threads can transform at the same time. */
+/* fft2dInit(M2, M) must still have been called first, before any */
+/* threads are started (it is not thread safe). */
+/* INPUTS */
+/* *data = input data array	*/
+/* M2, M = as for rfft2d/rifft2d */
+/* *work = fft2dWorkSize(M2) floats of scratch space, one per thread */
+/* OUTPUTS */
+/* *data = output data array	*/
+
+void fft2d_r(float *data, int M2, int M, float *work);
+void ifft2d_r(float *data, int M2, int M, float *work);
+/* Reentrant versions of fft2d and ifft2d, as for rfft2d_r and rifft2d_r */
+
 void rspect2dprod(float *data1, float *data2, float *outdata, int N2, int N1);
 /* When multiplying a pair of 2d spectra from rfft2d care must be taken to multiply the*/
 /* four real values seperately from the complex ones. This routine does it correctly.*/
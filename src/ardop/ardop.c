@@ -57,6 +57,8 @@ void give_usage(char *name)
  *  "                         for the azimuth reference function weighting\n" */
     "   -m CAL_PARAMS   NO    Read the Elevation Angle and Gain vectors from the\n"
     "            CAL_PARAMS file to correct for the antenna gain\n"
+    "   -doptable nblocks NO  Print the doppler estimated at nblocks places\n"
+    "                         along the image\n"
     "   -debug dbg_flg  1     Debug: for options enter -debug 0\n"
     "   -log logfile       NO    Allows output to be written to a log file\n"
     "   -quiet     NO    Suppresses the output to the essential\n"
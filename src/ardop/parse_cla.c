@@ -114,6 +114,7 @@ int parse_cla(int argc,char *argv[], struct INPUT_ARDOP_PARAMS *g)
         else if (strmatch(key,"-c")) {CHK_ARG_ASP(1); strcpy(fName_doppler,GET_ARG(1));
                         read_dopplr = 1;}
         else if (strmatch(key,"-m")) {CHK_ARG_ASP(1);strcpy(g->CALPRMS,GET_ARG(1));}
+        else if (strmatch(key,"-doptable")) {CHK_ARG_ASP(1); g->dopTable = intParm(atoi(GET_ARG(1)));}
         else {printf("**Invalid option: %s\n\n",argv[currArg-1]); return 0;}
     }
     if ((strcmp(g->CALPRMS,"NO")==0)&&(cal_check==1))
@@ -357,6 +357,23 @@ typedef double solve1d_fn(void *params, double x);
 int solve1d(solve1d_fn *f, void *params, int min_x, int max_x, double acc,
             double *root);
 
+/* Prototypes from threads.c ************************************************/
+/* Number of worker threads used by the multi-threaded routines.  Defaults
+   to the number of processors online; the ASF_NUM_THREADS environment
+   variable, or asf_set_num_threads(), overrides that. */
+int asf_get_num_threads(void);
+void asf_set_num_threads(int n);
+/* Calls fn(i, thread, params) for every i in [0, count), spread over
+   asf_get_num_threads() threads, and returns when all have finished.
+   "thread" is the index of the thread making the call, useful for
+   picking per-thread scratch space.  Items may complete in any order. */
+typedef void asf_parallel_fn(int i, int thread, void *params);
+void asf_parallel_for(int count, asf_parallel_fn *fn, void *params);
+/* Same, but on at most n_threads threads (thread indices [0, n_threads)),
+   for callers whose per-thread resources limit how many may run. */
+void asf_parallel_for_n(int count, int n_threads, asf_parallel_fn *fn,
+                        void *params);
+
 // httpUtil.c
 unsigned char *download_url(const char *url, int verbose, int *length);
 int download_url_to_file(const char *url, const char *filename);
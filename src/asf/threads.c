@@ -0,0 +1,141 @@
+/* Simple thread pool support for the processing libraries.
+ *
+ * asf_parallel_for() hands out the items [0, count) one at a time to a
+ * set of worker threads (the calling thread is one of them), and returns
+ * once every item has been processed.  Each call to the work function
+ * gets the index of the thread running it, in [0, asf_get_num_threads()),
+ * so callers can set up per-thread scratch space ahead of time.
+ *
+ * The number of threads defaults to the number of processors online,
+ * and can be overridden with the ASF_NUM_THREADS environment variable,
+ * or by calling asf_set_num_threads().  asf_parallel_for_n() takes the
+ * number of threads from the caller instead, for work that has its own
+ * limit.  On Windows everything runs in the calling thread. */
+
+#include "asf.h"
+
+#ifndef win32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static int s_num_threads = 0;
+
+int asf_get_num_threads(void)
+{
+  if (s_num_threads <= 0) {
+    const char *env = getenv("ASF_NUM_THREADS");
+    int n = env ? atoi(env) : 0;
+#ifndef win32
+    if (n <= 0)
+      n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    s_num_threads = n > 0 ? n : 1;
+  }
+
+  return s_num_threads;
+}
+
+void asf_set_num_threads(int n)
+{
+  s_num_threads = n;
+}
+
+#ifndef win32
+
+typedef struct {
+  int count;               // number of items
+  int next;                // next item to hand out
+  asf_parallel_fn *fn;
+  void *params;
+  pthread_mutex_t lock;    // protects "next"
+} parallel_state_t;
+
+typedef struct {
+  parallel_state_t *state;
+  int thread;
+} parallel_worker_t;
+
+static void *parallel_worker(void *arg)
+{
+  parallel_worker_t *w = (parallel_worker_t*)arg;
+  parallel_state_t *s = w->state;
+
+  while (1) {
+    pthread_mutex_lock(&s->lock);
+    int i = s->next++;
+    pthread_mutex_unlock(&s->lock);
+
+    if (i >= s->count)
+      break;
+
+    s->fn(i, w->thread, s->params);
+  }
+
+  return NULL;
+}
+
+void asf_parallel_for(int count, asf_parallel_fn *fn, void *params)
+{
+  asf_parallel_for_n(count, asf_get_num_threads(), fn, params);
+}
+
+void asf_parallel_for_n(int count, int n_threads, asf_parallel_fn *fn,
+                        void *params)
+{
+  int i, n = n_threads;
+  if (n > count)
+    n = count;
+
+  if (n <= 1) {
+    for (i=0; i<count; ++i)
+      fn(i, 0, params);
+    return;
+  }
+
+  parallel_state_t s;
+  s.count = count;
+  s.next = 0;
+  s.fn = fn;
+  s.params = params;
+  pthread_mutex_init(&s.lock, NULL);
+
+  parallel_worker_t *workers = MALLOC(sizeof(parallel_worker_t)*n);
+  pthread_t *threads = MALLOC(sizeof(pthread_t)*n);
+
+  for (i=0; i<n; ++i) {
+    workers[i].state = &s;
+    workers[i].thread = i;
+  }
+
+  // thread #0 is this one
+  for (i=1; i<n; ++i)
+    if (pthread_create(&threads[i], NULL, parallel_worker, &workers[i]) != 0)
+      asfPrintError("Failed to create worker thread #%d\n", i);
+
+  parallel_worker(&workers[0]);
+
+  for (i=1; i<n; ++i)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&s.lock);
+  FREE(workers);
+  FREE(threads);
+}
+
+#else
+
+void asf_parallel_for(int count, asf_parallel_fn *fn, void *params)
+{
+  int i;
+  for (i=0; i<count; ++i)
+    fn(i, 0, params);
+}
+
+void asf_parallel_for_n(int count, int n_threads, asf_parallel_fn *fn,
+                        void *params)
+{
+  asf_parallel_for(count, fn, params);
+}
+
+#endif
@@ -59,60 +59,70 @@ for (i1=8*sizeof(int)-1; i1>=0; i1--){
 fftFree();
 }
 
-void fft2d(float *data, int M2, int M){
-/* Compute 2D complex fft and return results in-place	*/
-/* INPUTS */
-/* *data = input data array	*/
-/* M2 = log2 of fft size number of rows */
-/* M = log2 of fft size number of columns */
-/* OUTPUTS */
-/* *data = output data array	*/
+static void fft2d_work(float *data, int M2, int M, float *work){
+/* fft2d using the given column workspace */
 int i1;
 if((M2>0)&&(M>0)){
 	ffts(data, M, POW2(M2));
 	if (M>2)
 		for (i1=0; i1<POW2(M); i1+=4){
-			cxpose(data + i1*2, POW2(M), Array2d[M2], POW2(M2), POW2(M2), 4);
-			ffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M), 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M), work, POW2(M2), POW2(M2), 4);
+			ffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M), 4, POW2(M2));
 		}
 	else{
-		cxpose(data, POW2(M), Array2d[M2], POW2(M2), POW2(M2), POW2(M));
-		ffts(Array2d[M2], M2, POW2(M));
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M), POW2(M), POW2(M2));
+		cxpose(data, POW2(M), work, POW2(M2), POW2(M2), POW2(M));
+		ffts(work, M2, POW2(M));
+		cxpose(work, POW2(M2), data, POW2(M), POW2(M), POW2(M2));
 	}
 }
 else
 	ffts(data, M2+M, 1);
 }
 
-void ifft2d(float *data, int M2, int M){
-/* Compute 2D complex ifft and return results in-place	*/
+void fft2d(float *data, int M2, int M){
+/* Compute 2D complex fft and return results in-place	*/
 /* INPUTS */
 /* *data = input data array	*/
 /* M2 = log2 of fft size number of rows */
 /* M = log2 of fft size number of columns */
 /* OUTPUTS */
 /* *data = output data array	*/
+fft2d_work(data, M2, M, Array2d[M2]);
+}
+
+static void ifft2d_work(float *data, int M2, int M, float *work){
+/* ifft2d using the given column workspace */
 int i1;
 if((M2>0)&&(M>0)){
 	iffts(data, M, POW2(M2));
 	if (M>2)
 		for (i1=0; i1<POW2(M); i1+=4){
-			cxpose(data + i1*2, POW2(M), Array2d[M2], POW2(M2), POW2(M2), 4);
-			iffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M), 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M), work, POW2(M2), POW2(M2), 4);
+			iffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M), 4, POW2(M2));
 		}
 	else{
-		cxpose(data, POW2(M), Array2d[M2], POW2(M2), POW2(M2), POW2(M));
-		iffts(Array2d[M2], M2, POW2(M));
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M), POW2(M), POW2(M2));
+		cxpose(data, POW2(M), work, POW2(M2), POW2(M2), POW2(M));
+		iffts(work, M2, POW2(M));
+		cxpose(work, POW2(M2), data, POW2(M), POW2(M), POW2(M2));
 	}
 }
 else
 	iffts(data, M2+M, 1);
 }
 
+void ifft2d(float *data, int M2, int M){
+/* Compute 2D complex ifft and return results in-place	*/
+/* INPUTS */
+/* *data = input data array	*/
+/* M2 = log2 of fft size number of rows */
+/* M = log2 of fft size number of columns */
+/* OUTPUTS */
+/* *data = output data array	*/
+ifft2d_work(data, M2, M, Array2d[M2]);
+}
+
 int fft3dInit(int L, int M2, int M){
 	/* init for fft3d, ifft3d*/
 	/* malloc storage for 4 columns and 4 pages of 3d ffts*/
@@ -250,55 +260,40 @@ else
 			if(M==0) ifft2d(data, M3, M2);
 }
 
-void rfft2d(float *data, int M2, int M){
-/* Compute 2D real fft and return results in-place	*/
-/* First performs real fft on rows using size from M to compute positive frequencies */
-/* then performs transform on columns using size from M2 to compute wavenumbers */
-/* If you think of the result as a complex pow(2,M2) by pow(2,M-1) matrix */
-/* then the first column contains the positive wavenumber spectra of DC frequency */
-/* followed by the positive wavenumber spectra of the nyquest frequency */
-/* since these are two positive wavenumber spectra the first complex value */
-/* of each is really the real values for the zero and nyquest wavenumber packed together */
-/* All other columns contain the positive and negative wavenumber spectra of a positive frequency */
-/* See rspect2dprod for multiplying two of these spectra together- ex. for fast convolution */
-/* INPUTS */
-/* *data = input data array	*/
-/* M2 = log2 of fft size number of rows in */
-/* M = log2 of fft size number of columns in */
-/* OUTPUTS */
-/* *data = output data array	*/
+static void rfft2d_work(float *data, int M2, int M, float *work){
+/* rfft2d using the given column workspace */
 int i1;
 if((M2>0)&&(M>0)){
 	rffts(data, M, POW2(M2));
 	if (M==1){
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 	}
 	else if (M==2){
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		ffts(Array2d[M2], M2, 1);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		ffts(work, M2, 1);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
 	}
 	else{
-		cxpose(data, POW2(M)/2, Array2d[M2]+POW2(M2)*2, POW2(M2), POW2(M2), 1);
-		xpose(Array2d[M2]+POW2(M2)*2, 2, Array2d[M2], POW2(M2), POW2(M2), 2);
-		rffts(Array2d[M2], M2, 2);
-		cxpose(Array2d[M2], POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work+POW2(M2)*2, POW2(M2), POW2(M2), 1);
+		xpose(work+POW2(M2)*2, 2, work, POW2(M2), POW2(M2), 2);
+		rffts(work, M2, 2);
+		cxpose(work, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 3);
-		ffts(Array2d[M2], M2, 3);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 3);
+		ffts(work, M2, 3);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
 		for (i1=4; i1<POW2(M)/2; i1+=4){
-			cxpose(data + i1*2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 4);
-			ffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M)/2, work, POW2(M2), POW2(M2), 4);
+			ffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
 		}
 	}
 }
@@ -306,46 +301,39 @@ else
 	rffts(data, M2+M, 1);
 }
 
-void rifft2d(float *data, int M2, int M){
-/* Compute 2D real ifft and return results in-place	*/
-/* The input must be in the order as outout from rfft2d */
-/* INPUTS */
-/* *data = input data array	*/
-/* M2 = log2 of fft size number of rows out */
-/* M = log2 of fft size number of columns out */
-/* OUTPUTS */
-/* *data = output data array	*/
+static void rifft2d_work(float *data, int M2, int M, float *work){
+/* rifft2d using the given column workspace */
 int i1;
 if((M2>0)&&(M>0)){
 	if (M==1){
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2));
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2));
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 	}
 	else if (M==2){
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2)); 
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2)); 
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		iffts(Array2d[M2], M2, 1);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		iffts(work, M2, 1);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 1, POW2(M2));
 	}
 	else{
-		cxpose(data, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 1);
-		riffts(Array2d[M2], M2, 2);
-		xpose(Array2d[M2], POW2(M2), Array2d[M2]+POW2(M2)*2, 2, 2, POW2(M2));
-		cxpose(Array2d[M2]+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
+		cxpose(data, POW2(M)/2, work, POW2(M2), POW2(M2), 1);
+		riffts(work, M2, 2);
+		xpose(work, POW2(M2), work+POW2(M2)*2, 2, 2, POW2(M2));
+		cxpose(work+POW2(M2)*2, POW2(M2), data, POW2(M)/2, 1, POW2(M2));
 
-		cxpose(data + 2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 3);
-		iffts(Array2d[M2], M2, 3);
-		cxpose(Array2d[M2], POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
+		cxpose(data + 2, POW2(M)/2, work, POW2(M2), POW2(M2), 3);
+		iffts(work, M2, 3);
+		cxpose(work, POW2(M2), data + 2, POW2(M)/2, 3, POW2(M2));
 		for (i1=4; i1<POW2(M)/2; i1+=4){
-			cxpose(data + i1*2, POW2(M)/2, Array2d[M2], POW2(M2), POW2(M2), 4);
-			iffts(Array2d[M2], M2, 4);
-			cxpose(Array2d[M2], POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
+			cxpose(data + i1*2, POW2(M)/2, work, POW2(M2), POW2(M2), 4);
+			iffts(work, M2, 4);
+			cxpose(work, POW2(M2), data + i1*2, POW2(M)/2, 4, POW2(M2));
 		}
 	}
 	riffts(data, M, POW2(M2));
@@ -354,6 +342,67 @@ else
 	riffts(data, M2+M, 1);
 }
 
+void rfft2d(float *data, int M2, int M){
+/* Compute 2D real fft and return results in-place	*/
+/* First performs real fft on rows using size from M to compute positive frequencies */
+/* then performs transform on columns using size from M2 to compute wavenumbers */
+/* If you think of the result as a complex pow(2,M2) by pow(2,M-1) matrix */
+/* then the first column contains the positive wavenumber spectra of DC frequency */
+/* followed by the positive wavenumber spectra of the nyquest frequency */
+/* since these are two positive wavenumber spectra the first complex value */
+/* of each is really the real values for the zero and nyquest wavenumber packed together */
+/* All other columns contain the positive and negative wavenumber spectra of a positive frequency */
+/* See rspect2dprod for multiplying two of these spectra together- ex. for fast convolution */
+/* INPUTS */
+/* *data = input data array	*/
+/* M2 = log2 of fft size number of rows in */
+/* M = log2 of fft size number of columns in */
+/* OUTPUTS */
+/* *data = output data array	*/
+rfft2d_work(data, M2, M, Array2d[M2]);
+}
+
+void rifft2d(float *data, int M2, int M){
+/* Compute 2D real ifft and return results in-place	*/
+/* The input must be in the order as outout from rfft2d */
+/* INPUTS */
+/* *data = input data array	*/
+/* M2 = log2 of fft size number of rows out */
+/* M = log2 of fft size number of columns out */
+/* OUTPUTS */
+/* *data = output data array	*/
+rifft2d_work(data, M2, M, Array2d[M2]);
+}
+
+int fft2dWorkSize(int M2){
+/* Number of floats of column workspace needed by the reentrant (_r) versions */
+/* of fft2d, ifft2d, rfft2d and rifft2d */
+return 4*2*POW2(M2);
+}
+
+void rfft2d_r(float *data, int M2, int M, float *work){
+/* Reentrant rfft2d: the caller supplies the column workspace, so several */
+/* threads can transform at the same time.  fft2dInit(M2, M) must still */
+/* have been called first (before starting any threads) */
+/* *work = fft2dWorkSize(M2) floats of scratch space */
+rfft2d_work(data, M2, M, work);
+}
+
+void rifft2d_r(float *data, int M2, int M, float *work){
+/* Reentrant rifft2d, see rfft2d_r */
+rifft2d_work(data, M2, M, work);
+}
+
+void fft2d_r(float *data, int M2, int M, float *work){
+/* Reentrant fft2d, see rfft2d_r */
+fft2d_work(data, M2, M, work);
+}
+
+void ifft2d_r(float *data, int M2, int M, float *work){
+/* Reentrant ifft2d, see rfft2d_r */
+ifft2d_work(data, M2, M, work);
+}
+
 void rspect2dprod(float *data1, float *data2, float *outdata, int N2, int N1){
 /* When multiplying a pair of 2d spectra from rfft2d care must be taken to multiply the*/
 /* four real values seperately from the complex ones. This routine does it correctly.*/
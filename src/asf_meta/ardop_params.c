@@ -37,6 +37,7 @@ struct INPUT_ARDOP_PARAMS *get_input_ardop_params_struct(char *in1, char *out)
     ret->fdd = NULL;
     ret->fddd = NULL;
     ret->iflag = NULL;
+    ret->dopTable = NULL;
 
     return ret;
 }
@@ -537,6 +537,7 @@ typedef struct {
   meta_insar         *insar;           // Can be NULL
   meta_dem           *dem;             // Can be NULL
   meta_latlon        *latlon;          // Can be NULL
+  struct orbit_model *orbit;           // Cached, see meta_orbit_model()
     /* Deprecated elements from old metadata format.  */
   meta_state_vectors *stVec;         /* Can be NULL (check!).  */
   geo_parameters  *geo;
@@ -562,6 +563,8 @@ void meta_free(meta_parameters *meta);
  */
 /* In meta_read.c */
 meta_parameters *meta_read(const char *inName);
+void meta_read_cache_forget(const char *meta_name);
+void meta_read_cache_clear(void);
 void ddr2meta(struct DDR *ddr, meta_parameters *meta);
 
 /* In meta_copy.c: Allocates new structure and fills it will values from src */
@@ -638,6 +641,19 @@ double meta_get_dop(meta_parameters *sar,double yLine, double xSample);
 /*Return fixed-earth state vector for the given time.*/
 stateVector meta_get_stVec(meta_parameters *sar,double time_arg);
 
+/* In orbit_model.c: precomputed state vector interpolation.
+   meta_get_stVec() goes through the model cached in the metadata (see
+   meta_orbit_model()); callers that need many vectors at once can ask
+   for them in one orbit_model_get_stVecs() call.  The model is
+   read-only once built, so any number of threads may query it.  */
+typedef struct orbit_model orbit_model;
+orbit_model *orbit_model_init(meta_parameters *meta);
+void orbit_model_free(orbit_model *orbit);
+const orbit_model *meta_orbit_model(meta_parameters *meta);
+stateVector orbit_model_get_stVec(const orbit_model *orbit, double time);
+void orbit_model_get_stVecs(const orbit_model *orbit, int n,
+                            const double *times, stateVector *out);
+
 /*Return the incidence angle: this is the angle measured
   by the target between straight up and the satellite.
   Returns radians.*/
@@ -684,6 +700,38 @@ int meta_get_lineSamp(meta_parameters *meta,
                       double lat,double lon,double elev,
                       double *yLine,double *xSample);
 
+/* Geolocation accelerator for repeated meta_get_lineSamp() calls on
+images that aren't map projected: a grid of meta_get_latLon() results,
+interpolated in both directions.  meta_geo_grid_new() returns NULL if the
+image is map projected, or if the error comes out well over max_error (in
+pixels).
+Queries return non-zero for points outside the grid, and are thread
+safe.  See meta_geo_grid.c. */
+typedef struct {
+  meta_parameters *meta;      /* not owned by the grid */
+  double elev;                /* elevation the grid was built for */
+  int nl, ns;                 /* number of grid nodes */
+  double line0, samp0;        /* image position of the first node */
+  double dline, dsamp;        /* node spacing, in pixels */
+  double *lat, *lon;          /* node locations, nl*ns */
+  double lon_ref;             /* longitudes are unwrapped around this */
+  int nb_lat, nb_lon;         /* cells bucketed by lat/lon, for inverse */
+  double lat_min, lon_min, blat, blon;
+  int *bucket_start, *bucket_cells;
+  double max_error;           /* largest error found when checking */
+} meta_geo_grid;
+
+meta_geo_grid *meta_geo_grid_new(meta_parameters *meta, double elev,
+                                 double max_error);
+int meta_geo_grid_latLon(meta_geo_grid *g, double yLine, double xSamp,
+                         double *lat, double *lon);
+int meta_geo_grid_lineSamp(meta_geo_grid *g, double lat, double lon,
+                           double *yLine, double *xSamp);
+int meta_geo_grid_lineSamp_batch(meta_geo_grid *g, int n,
+                                 const double *lat, const double *lon,
+                                 double *yLine, double *xSamp);
+void meta_geo_grid_free(meta_geo_grid *g);
+
 /* Converts a given line and sample in image into time,
 slant-range, and doppler.  Works with all image types.
 */
@@ -805,6 +853,7 @@ double unpacked_deg(double angle);
 /* Size of line chunk to read or write.  */
 #define CHUNK_OF_LINES 32
 
+int data_type2sample_size(int data_type);
 int get_byte_line(FILE *file, meta_parameters *meta, int line_number,
                   unsigned char *dest);
 int get_byte_lines(FILE *file, meta_parameters *meta, int line_number,
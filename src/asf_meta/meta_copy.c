@@ -6,6 +6,17 @@ meta_state_vectors *meta_state_vectors_init(int vector_count);
 
 
 
+// Returns a freshly allocated copy of "size" bytes at "src", or NULL
+static void *copy_block(const void *src, size_t size)
+{
+  void *ret = NULL;
+  if (src) {
+    ret = MALLOC(size);
+    memcpy(ret, src, size);
+  }
+  return ret;
+}
+
 meta_parameters *meta_copy(meta_parameters *src)
 {
   meta_parameters *ret = raw_init();
@@ -40,8 +51,10 @@ meta_parameters *meta_copy(meta_parameters *src)
     ret->state_vectors = NULL;
 
   if (src->stats) {
-    if (!ret->stats) ret->stats = meta_statistics_init(src->stats->band_count);
-    memcpy(ret->stats, src->stats, sizeof(meta_stats));
+    int band_count = src->stats->band_count;
+    ret->stats = meta_statistics_init(band_count);
+    memcpy(ret->stats, src->stats,
+           sizeof(meta_statistics) + band_count*sizeof(meta_stats));
   } else
     ret->stats = NULL;
 
@@ -75,6 +88,75 @@ meta_parameters *meta_copy(meta_parameters *src)
   } else
     ret->thermal = NULL;
 
+  if (src->uavsar) {
+    if (!ret->uavsar) ret->uavsar = meta_uavsar_init();
+    memcpy(ret->uavsar, src->uavsar, sizeof(meta_uavsar));
+  } else
+    ret->uavsar = NULL;
+
+  if (src->insar) {
+    if (!ret->insar) ret->insar = meta_insar_init();
+    memcpy(ret->insar, src->insar, sizeof(meta_insar));
+  } else
+    ret->insar = NULL;
+
+  if (src->dem) {
+    if (!ret->dem) ret->dem = meta_dem_init();
+    memcpy(ret->dem, src->dem, sizeof(meta_dem));
+  } else
+    ret->dem = NULL;
+
+  if (src->calibration) {
+    meta_calibration *cal = meta_calibration_init();
+    cal->type = src->calibration->type;
+    cal->asf = copy_block(src->calibration->asf, sizeof(asf_cal_params));
+    cal->asf_scansar = copy_block(src->calibration->asf_scansar,
+                                  sizeof(asf_scansar_cal_params));
+    cal->esa = copy_block(src->calibration->esa, sizeof(esa_cal_params));
+    cal->rsat = copy_block(src->calibration->rsat, sizeof(rsat_cal_params));
+    cal->alos = copy_block(src->calibration->alos, sizeof(alos_cal_params));
+    // the tsx pointer is only valid for TerraSAR-X calibration
+    if (cal->type == tsx_cal)
+      cal->tsx = copy_block(src->calibration->tsx, sizeof(tsx_cal_params));
+    ret->calibration = cal;
+  } else
+    ret->calibration = NULL;
+
+  if (src->doppler) {
+    meta_doppler *dop = meta_doppler_init();
+    dop->type = src->doppler->type;
+    // as with calibration, only the pointer for the given type is valid
+    if (dop->type == tsx_doppler && src->doppler->tsx) {
+      int ii, n = src->doppler->tsx->doppler_count;
+      dop->tsx = copy_block(src->doppler->tsx, sizeof(tsx_doppler_params));
+      dop->tsx->dop = copy_block(src->doppler->tsx->dop,
+                                 sizeof(tsx_doppler_t)*n);
+      for (ii=0; ii<n; ii++)
+        dop->tsx->dop[ii].coefficient =
+          copy_block(src->doppler->tsx->dop[ii].coefficient,
+                     sizeof(double)*(src->doppler->tsx->dop[ii].poly_degree+1));
+    }
+    else if (dop->type == radarsat2_doppler && src->doppler->r2) {
+      int n = src->doppler->r2->doppler_count;
+      dop->r2 = copy_block(src->doppler->r2,
+                           sizeof(radarsat2_doppler_params));
+      dop->r2->centroid = copy_block(src->doppler->r2->centroid,
+                                     sizeof(double)*n);
+      dop->r2->rate = copy_block(src->doppler->r2->rate, sizeof(double)*n);
+    }
+    ret->doppler = dop;
+  } else
+    ret->doppler = NULL;
+
+  if (src->latlon) {
+    size_t sz = sizeof(float)*
+      src->general->line_count*src->general->sample_count;
+    ret->latlon = (meta_latlon *) MALLOC(sizeof(meta_latlon));
+    ret->latlon->lat = copy_block(src->latlon->lat, sz);
+    ret->latlon->lon = copy_block(src->latlon->lon, sz);
+  } else
+    ret->latlon = NULL;
+
   if (src->colormap) {
     // free default created one, if there
     if (ret->colormap) {
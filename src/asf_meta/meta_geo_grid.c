@@ -0,0 +1,427 @@
+/****************************************************************
+FUNCTION NAME:  meta_geo_grid_*
+
+DESCRIPTION:
+   Geolocation accelerator for images that are not map projected.
+
+   meta_get_lineSamp() has to search for the line and sample of
+   each point: for SAR geometry that is a Newton iteration with
+   three meta_get_latLon() calls (each interpolating the state
+   vectors) per step, for lat/lon grids a quad-tree search.  That
+   is fine for a handful of points, but slow when called for every
+   point of a geocoding grid.
+
+   meta_geo_grid_new() samples meta_get_latLon() once on a regular
+   grid of image positions (extending a bit past the image, since
+   callers often ask about points just outside of it), and then
+   answers both directions by bilinear interpolation within the
+   grid cells.  For the inverse, the cells are bucketed by latitude
+   and longitude, so a query only looks at a few cells.  The grid is
+   made denser until the error at the cell centers (compared with
+   meta_get_latLon) is below the requested bound, measured in pixels.
+   The refinement stops at MAX_CELLS cells per side, so building the
+   grid never costs more than a few tens of thousands of
+   meta_get_latLon() calls; if the bound hasn't been reached by then,
+   the most accurate grid is kept as long as it is within
+   ACCEPT_FACTOR times the bound.
+
+   Once built, the grid is read-only, so the queries can be called
+   from several threads at once.  The grid is built for a single
+   elevation.
+
+RETURN VALUE:
+   The query functions return 0 on success, and non-zero if the
+   point is outside the area covered by the grid -- callers should
+   fall back on meta_get_lineSamp()/meta_get_latLon() then.
+****************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+
+#ifndef MIN
+#  define MIN(a,b)  (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#  define MAX(a,b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+// Starting number of cells along each dimension, refined up to the maximum
+#define INITIAL_CELLS 32
+#define MAX_CELLS 128
+
+// A grid that doesn't reach the requested error bound is still used if
+// its error is within this factor of the bound
+#define ACCEPT_FACTOR 4
+
+// Cells are never made smaller than this, in pixels
+#define MIN_CELL_SIZE 4
+
+// Fraction of the image size added to each side of the grid
+#define GRID_MARGIN 0.25
+
+// At most this many cell centers (per dimension) are checked
+#define MAX_CHECKS 64
+
+static double unwrap_lon(double lon, double lon_ref)
+{
+  while (lon - lon_ref > 180) lon -= 360;
+  while (lon - lon_ref < -180) lon += 360;
+  return lon;
+}
+
+// Bilinear inversion within cell (i,j): finds u (along samples) and
+// v (along lines) in [0,1] that interpolate to lat/lon.
+static int invert_cell(meta_geo_grid *g, int i, int j, double lat, double lon,
+                       double *u_out, double *v_out)
+{
+  int k00 = i*g->ns + j, k10 = k00 + g->ns;
+  double a0 = g->lat[k00], a1 = g->lat[k00+1];
+  double a2 = g->lat[k10], a3 = g->lat[k10+1];
+  double b0 = g->lon[k00], b1 = g->lon[k00+1];
+  double b2 = g->lon[k10], b3 = g->lon[k10+1];
+  double u = 0.5, v = 0.5;
+  int iter;
+
+  for (iter=0; iter<20; ++iter) {
+    double fa = (1-u)*(1-v)*a0 + u*(1-v)*a1 + (1-u)*v*a2 + u*v*a3 - lat;
+    double fb = (1-u)*(1-v)*b0 + u*(1-v)*b1 + (1-u)*v*b2 + u*v*b3 - lon;
+    double dau = (1-v)*(a1-a0) + v*(a3-a2);
+    double dav = (1-u)*(a2-a0) + u*(a3-a1);
+    double dbu = (1-v)*(b1-b0) + v*(b3-b2);
+    double dbv = (1-u)*(b2-b0) + u*(b3-b1);
+    double det = dau*dbv - dav*dbu;
+    if (det == 0.0)
+      return FALSE;
+    double du = ( dbv*fa - dav*fb)/det;
+    double dv = (-dbu*fa + dau*fb)/det;
+    u -= du;
+    v -= dv;
+    if (fabs(du) + fabs(dv) < 1e-12)
+      break;
+  }
+
+  const double eps = 1e-9;
+  if (u < -eps || u > 1+eps || v < -eps || v > 1+eps)
+    return FALSE;
+
+  *u_out = u;
+  *v_out = v;
+  return TRUE;
+}
+
+int meta_geo_grid_latLon(meta_geo_grid *g, double yLine, double xSamp,
+                         double *lat, double *lon)
+{
+  double y = (yLine - g->line0)/g->dline;
+  double x = (xSamp - g->samp0)/g->dsamp;
+  int i = (int)floor(y), j = (int)floor(x);
+
+  // points on the last row/column of nodes belong to the last cell
+  if (i == g->nl-1 && y < g->nl-1 + 1e-9) --i;
+  if (j == g->ns-1 && x < g->ns-1 + 1e-9) --j;
+  if (i < 0 || j < 0 || i >= g->nl-1 || j >= g->ns-1)
+    return 1;
+
+  double v = y - i, u = x - j;
+  int k00 = i*g->ns + j, k10 = k00 + g->ns;
+
+  *lat = (1-u)*(1-v)*g->lat[k00] + u*(1-v)*g->lat[k00+1] +
+    (1-u)*v*g->lat[k10] + u*v*g->lat[k10+1];
+  *lon = (1-u)*(1-v)*g->lon[k00] + u*(1-v)*g->lon[k00+1] +
+    (1-u)*v*g->lon[k10] + u*v*g->lon[k10+1];
+
+  if (*lon < -180) *lon += 360;
+  if (*lon > 180) *lon -= 360;
+  return 0;
+}
+
+int meta_geo_grid_lineSamp(meta_geo_grid *g, double lat, double lon,
+                           double *yLine, double *xSamp)
+{
+  lon = unwrap_lon(lon, g->lon_ref);
+
+  int bi = (int)floor((lat - g->lat_min)/g->blat);
+  int bj = (int)floor((lon - g->lon_min)/g->blon);
+  if (bi == g->nb_lat) --bi;
+  if (bj == g->nb_lon) --bj;
+  if (bi < 0 || bj < 0 || bi >= g->nb_lat || bj >= g->nb_lon)
+    return 1;
+
+  int b = bi*g->nb_lon + bj, k;
+  for (k=g->bucket_start[b]; k<g->bucket_start[b+1]; ++k) {
+    int cell = g->bucket_cells[k];
+    int i = cell / (g->ns-1);
+    int j = cell % (g->ns-1);
+    double u, v;
+    if (invert_cell(g, i, j, lat, lon, &u, &v)) {
+      *yLine = g->line0 + (i + v)*g->dline;
+      *xSamp = g->samp0 + (j + u)*g->dsamp;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+typedef struct {
+  meta_geo_grid *g;
+  int n;
+  const double *lat, *lon;
+  double *yLine, *xSamp;
+  int *failed;
+} batch_params_t;
+
+#define BATCH_CHUNK 1024
+
+static void lineSamp_chunk(int c, int thread, void *params)
+{
+  batch_params_t *p = (batch_params_t*)params;
+  int i, end = (c+1)*BATCH_CHUNK < p->n ? (c+1)*BATCH_CHUNK : p->n;
+
+  for (i=c*BATCH_CHUNK; i<end; ++i)
+    p->failed[i] = meta_geo_grid_lineSamp(p->g, p->lat[i], p->lon[i],
+                                          &p->yLine[i], &p->xSamp[i]);
+}
+
+int meta_geo_grid_lineSamp_batch(meta_geo_grid *g, int n,
+                                 const double *lat, const double *lon,
+                                 double *yLine, double *xSamp)
+{
+  batch_params_t p;
+  int i, n_bad = 0;
+
+  p.g = g;
+  p.n = n;
+  p.lat = lat;
+  p.lon = lon;
+  p.yLine = yLine;
+  p.xSamp = xSamp;
+  p.failed = MALLOC(sizeof(int)*n);
+
+  asf_parallel_for((n + BATCH_CHUNK - 1)/BATCH_CHUNK, lineSamp_chunk, &p);
+
+  // points outside the grid go the slow way -- not in the threads,
+  // meta_get_lineSamp() isn't reentrant
+  for (i=0; i<n; ++i) {
+    if (p.failed[i] &&
+        meta_get_lineSamp(g->meta, lat[i], lon[i], g->elev,
+                          &yLine[i], &xSamp[i]) != 0)
+      ++n_bad;
+  }
+
+  FREE(p.failed);
+  return n_bad;
+}
+
+static void free_grid_arrays(meta_geo_grid *g)
+{
+  FREE(g->lat);
+  FREE(g->lon);
+  FREE(g->bucket_start);
+  FREE(g->bucket_cells);
+  g->lat = g->lon = NULL;
+  g->bucket_start = g->bucket_cells = NULL;
+}
+
+// Samples the image geolocation on an nl x ns grid of nodes, and
+// buckets the cells for the inverse lookup.
+static int build_grid(meta_geo_grid *g, int nl, int ns,
+                      double line0, double line1, double samp0, double samp1)
+{
+  meta_parameters *meta = g->meta;
+  int i, j, k;
+
+  g->nl = nl;
+  g->ns = ns;
+  g->line0 = line0;
+  g->samp0 = samp0;
+  g->dline = (line1 - line0)/(nl-1);
+  g->dsamp = (samp1 - samp0)/(ns-1);
+  g->lat = MALLOC(sizeof(double)*nl*ns);
+  g->lon = MALLOC(sizeof(double)*nl*ns);
+
+  for (i=0; i<nl; ++i) {
+    for (j=0; j<ns; ++j) {
+      k = i*ns + j;
+      if (meta_get_latLon(meta, line0 + i*g->dline, samp0 + j*g->dsamp,
+                          g->elev, &g->lat[k], &g->lon[k]) != 0 ||
+          !meta_is_valid_double(g->lat[k]) || !meta_is_valid_double(g->lon[k]))
+        return FALSE;
+    }
+  }
+
+  g->lon_ref = g->lon[(nl/2)*ns + ns/2];
+  double lat_max = -999, lon_max = -999;
+  g->lat_min = g->lon_min = 999;
+  for (k=0; k<nl*ns; ++k) {
+    g->lon[k] = unwrap_lon(g->lon[k], g->lon_ref);
+    if (g->lat[k] < g->lat_min) g->lat_min = g->lat[k];
+    if (g->lat[k] > lat_max) lat_max = g->lat[k];
+    if (g->lon[k] < g->lon_min) g->lon_min = g->lon[k];
+    if (g->lon[k] > lon_max) lon_max = g->lon[k];
+  }
+
+  // About as many buckets as there are cells
+  g->nb_lat = nl-1;
+  g->nb_lon = ns-1;
+  g->blat = (lat_max - g->lat_min)/g->nb_lat;
+  g->blon = (lon_max - g->lon_min)/g->nb_lon;
+  if (g->blat <= 0 || g->blon <= 0)
+    return FALSE;
+
+  int n_buckets = g->nb_lat*g->nb_lon;
+  int *count = CALLOC(n_buckets+1, sizeof(int));
+  int pass;
+
+  // Two passes over the cells: count the entries of each bucket, then
+  // fill them in
+  for (pass=0; pass<2; ++pass) {
+    for (i=0; i<nl-1; ++i) {
+      for (j=0; j<ns-1; ++j) {
+        int k00 = i*ns + j, k10 = k00 + ns;
+        double la0 = MIN(MIN(g->lat[k00], g->lat[k00+1]),
+                         MIN(g->lat[k10], g->lat[k10+1]));
+        double la1 = MAX(MAX(g->lat[k00], g->lat[k00+1]),
+                         MAX(g->lat[k10], g->lat[k10+1]));
+        double lo0 = MIN(MIN(g->lon[k00], g->lon[k00+1]),
+                         MIN(g->lon[k10], g->lon[k10+1]));
+        double lo1 = MAX(MAX(g->lon[k00], g->lon[k00+1]),
+                         MAX(g->lon[k10], g->lon[k10+1]));
+        int bi0 = (int)floor((la0 - g->lat_min)/g->blat);
+        int bi1 = (int)floor((la1 - g->lat_min)/g->blat);
+        int bj0 = (int)floor((lo0 - g->lon_min)/g->blon);
+        int bj1 = (int)floor((lo1 - g->lon_min)/g->blon);
+        int bi, bj;
+        if (bi1 >= g->nb_lat) bi1 = g->nb_lat-1;
+        if (bj1 >= g->nb_lon) bj1 = g->nb_lon-1;
+        for (bi=bi0; bi<=bi1; ++bi) {
+          for (bj=bj0; bj<=bj1; ++bj) {
+            int b = bi*g->nb_lon + bj;
+            if (pass == 0)
+              ++count[b];
+            else
+              g->bucket_cells[g->bucket_start[b] + count[b]++] =
+                i*(ns-1) + j;
+          }
+        }
+      }
+    }
+
+    if (pass == 0) {
+      g->bucket_start = MALLOC(sizeof(int)*(n_buckets+1));
+      g->bucket_start[0] = 0;
+      for (k=0; k<n_buckets; ++k) {
+        g->bucket_start[k+1] = g->bucket_start[k] + count[k];
+        count[k] = 0;
+      }
+      g->bucket_cells = MALLOC(sizeof(int)*g->bucket_start[n_buckets]);
+    }
+  }
+
+  FREE(count);
+  return TRUE;
+}
+
+// Largest distance, in pixels, between the cell centers and their
+// positions as found through the grid
+static double check_grid(meta_geo_grid *g)
+{
+  int si = (g->nl-1 + MAX_CHECKS-1)/MAX_CHECKS;
+  int sj = (g->ns-1 + MAX_CHECKS-1)/MAX_CHECKS;
+  double max_err = 0.0;
+  int i, j;
+
+  for (i=0; i<g->nl-1; i+=si) {
+    for (j=0; j<g->ns-1; j+=sj) {
+      double line = g->line0 + (i+0.5)*g->dline;
+      double samp = g->samp0 + (j+0.5)*g->dsamp;
+      double lat, lon, l, s;
+      if (meta_get_latLon(g->meta, line, samp, g->elev, &lat, &lon) != 0 ||
+          meta_geo_grid_lineSamp(g, lat, lon, &l, &s) != 0)
+        return 999999;
+      double err = hypot(l - line, s - samp);
+      if (err > max_err)
+        max_err = err;
+    }
+  }
+
+  return max_err;
+}
+
+meta_geo_grid *meta_geo_grid_new(meta_parameters *meta, double elev,
+                                 double max_error)
+{
+  // Map projected images have a closed form, nothing to gain
+  if (meta->projection && meta->projection->type != SCANSAR_PROJECTION)
+    return NULL;
+
+  int nl = meta->general->line_count;
+  int ns = meta->general->sample_count;
+  double line0, line1, samp0, samp1;
+
+  // Lat/lon grid metadata can't be evaluated outside of the image
+  if (meta->latlon) {
+    line0 = samp0 = 0;
+    line1 = nl-1;
+    samp1 = ns-1;
+  }
+  else {
+    line0 = -GRID_MARGIN*nl;
+    line1 = nl-1 + GRID_MARGIN*nl;
+    samp0 = -GRID_MARGIN*ns;
+    samp1 = ns-1 + GRID_MARGIN*ns;
+  }
+
+  meta_geo_grid *best = NULL;
+  int cells = INITIAL_CELLS;
+  while (1) {
+    int cl = MIN(cells, (int)((line1-line0)/MIN_CELL_SIZE));
+    int cs = MIN(cells, (int)((samp1-samp0)/MIN_CELL_SIZE));
+    if (cl < 1) cl = 1;
+    if (cs < 1) cs = 1;
+
+    meta_geo_grid *g = CALLOC(1, sizeof(meta_geo_grid));
+    g->meta = meta;
+    g->elev = elev;
+    if (build_grid(g, cl+1, cs+1, line0, line1, samp0, samp1))
+      g->max_error = check_grid(g);
+    else
+      g->max_error = 999999;
+
+    // keep the most accurate grid so far
+    if (!best || g->max_error < best->max_error) {
+      meta_geo_grid_free(best);
+      best = g;
+    }
+    else {
+      meta_geo_grid_free(g);
+    }
+
+    int finest = cells >= MAX_CELLS ||
+      (cl < cells && cs < cells); // both already at MIN_CELL_SIZE
+    if (best->max_error <= max_error || finest)
+      break;
+
+    cells *= 2;
+  }
+
+  if (best->max_error > ACCEPT_FACTOR*max_error) {
+    asfPrintStatus("Geolocation grid error %.3g pixels is over the %.3g "
+                   "limit, not using it.\n", best->max_error,
+                   ACCEPT_FACTOR*max_error);
+    meta_geo_grid_free(best);
+    return NULL;
+  }
+  if (best->max_error > max_error)
+    asfPrintStatus("Using a geolocation grid with an error of %.3g pixels "
+                   "(%.3g requested).\n", best->max_error, max_error);
+
+  return best;
+}
+
+void meta_geo_grid_free(meta_geo_grid *g)
+{
+  if (g) {
+    free_grid_arrays(g);
+    FREE(g);
+  }
+}
@@ -199,8 +199,8 @@ double meta_get_dop(meta_parameters *meta,double yLine, double xSample)
 /**********************************************************
  * meta_get_stVec:
  * Return fixed-earth state vector for the given time.
- * Steps through state vector list; then interpolates the
- * right pair.*/
+ * Interpolates the bracketing pair of state vectors, through
+ * the orbit model cached in the metadata (see orbit_model.c).*/
 stateVector meta_get_stVec(meta_parameters *meta,double time)
 {
   // No effort has been made to make this routine work with
@@ -208,8 +208,6 @@ stateVector meta_get_stVec(meta_parameters *meta,double time)
   assert (meta->projection == NULL
       || meta->projection->type != LAT_LONG_PSEUDO_PROJECTION);
 
-    int stVecNo;
-    stateVector ret;
     if (meta->state_vectors==NULL)
     {
         printf( "* ERROR in meta library function meta_get_stVec:\n"
@@ -224,16 +222,7 @@ stateVector meta_get_stVec(meta_parameters *meta,double time)
             (meta->state_vectors->vector_count != 1) ? "s" : "");
         exit(EXIT_FAILURE);
     }
-    stVecNo=0;
-    while (stVecNo < meta->state_vectors->vector_count - 2
-        && meta->state_vectors->vecs[stVecNo+1].time<time)
-        stVecNo++;
-    interp_stVec(&meta->state_vectors->vecs[stVecNo].vec,
-             meta->state_vectors->vecs[stVecNo].time,
-            &meta->state_vectors->vecs[stVecNo+1].vec,
-             meta->state_vectors->vecs[stVecNo+1].time,
-            &ret,time);
-    return ret;
+    return orbit_model_get_stVec(meta_orbit_model(meta), time);
 }
 
 /* Calculation calls */
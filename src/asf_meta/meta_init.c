@@ -207,6 +207,7 @@ meta_calibration *meta_calibration_init(void)
   cal->esa = NULL;
   cal->rsat = NULL;
   cal->alos = NULL;
+  cal->tsx = NULL;
 
   return cal;
 }
@@ -216,6 +217,7 @@ meta_doppler *meta_doppler_init(void)
   meta_doppler *dop = (meta_doppler *) MALLOC(sizeof(meta_doppler));
   dop->type = unknown_doppler;
   dop->tsx = NULL;
+  dop->r2 = NULL;
 
   return dop;
 }
@@ -442,6 +444,7 @@ meta_parameters *raw_init(void)
   meta->insar           = NULL;
   meta->dem             = NULL;
   meta->latlon          = NULL;
+  meta->orbit           = NULL;  /* Built on first use, see orbit_model.c */
 
   meta->meta_version = META_VERSION;
 
@@ -597,6 +600,8 @@ void meta_free(meta_parameters *meta)
       FREE(meta->latlon);
       meta->latlon = NULL;
     }
+    orbit_model_free(meta->orbit);
+    meta->orbit = NULL;
     if (meta->colormap) {
       FREE(meta->colormap->rgb);
       FREE(meta->colormap);
@@ -9,6 +9,21 @@
 #include "get_ceos_names.h"
 #include "meta_init.h"
 
+#include <sys/stat.h>
+
+/* Sub-second part of the modification and status change times, where the
+   platform's struct stat has it */
+#if defined(win32)
+#  define ST_MTIME_NSEC(st) 0L
+#  define ST_CTIME_NSEC(st) 0L
+#elif defined(__APPLE__) || defined(darwin)
+#  define ST_MTIME_NSEC(st) ((long)(st)->st_mtimespec.tv_nsec)
+#  define ST_CTIME_NSEC(st) ((long)(st)->st_ctimespec.tv_nsec)
+#else
+#  define ST_MTIME_NSEC(st) ((long)(st)->st_mtim.tv_nsec)
+#  define ST_CTIME_NSEC(st) ((long)(st)->st_ctim.tv_nsec)
+#endif
+
 /* Local prototypes */
 void meta_read_old(meta_parameters *meta, char *fileName);
 void meta_read_only_ddr(meta_parameters *meta, const char *ddr_name);
@@ -45,6 +60,136 @@ static int get_band_num(char *bands, int band_count, const char *channel)
 }
 
 
+/***************************************************************
+ * Parsed metadata cache:
+ * Most tools read the same .meta file several times (once to check
+ * the input, again in each library call that is handed a file name),
+ * and parsing it is by far the most expensive part of meta_read.  So
+ * we keep a pristine copy of the most recently parsed new-style
+ * metadata files, and hand out deep copies of those as long as the
+ * file on disk has not changed (same device/inode, size, and
+ * modification and status change times, to the nanosecond where the
+ * file system keeps them).  meta_write() drops the entry for any file it
+ * overwrites.  Set ASF_META_CACHE=0 in the environment to turn the
+ * cache off.  Like the parser itself, this is not thread-safe.  */
+#define META_CACHE_SIZE 32
+
+typedef struct {
+  char *meta_name;          // NULL if the slot is unused
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime, ctime;
+  long mtime_nsec, ctime_nsec;
+  unsigned long last_used;  // for least-recently-used replacement
+  meta_parameters *meta;    // pristine copy, never handed out
+} meta_cache_entry;
+
+static meta_cache_entry meta_cache[META_CACHE_SIZE];
+static unsigned long meta_cache_clock = 0;
+
+static int meta_cache_enabled(void)
+{
+  static int enabled = -1;
+  if (enabled < 0) {
+    const char *env = getenv("ASF_META_CACHE");
+    enabled = !(env && strcmp(env, "0") == 0);
+  }
+  return enabled;
+}
+
+static void meta_cache_drop(meta_cache_entry *e)
+{
+  if (e->meta_name) {
+    FREE(e->meta_name);
+    e->meta_name = NULL;
+  }
+  if (e->meta) {
+    meta_free(e->meta);
+    e->meta = NULL;
+  }
+}
+
+static int meta_cache_matches(meta_cache_entry *e, const struct stat *st)
+{
+  return e->dev == st->st_dev && e->ino == st->st_ino &&
+         e->size == st->st_size &&
+         e->mtime == st->st_mtime && e->mtime_nsec == ST_MTIME_NSEC(st) &&
+         e->ctime == st->st_ctime && e->ctime_nsec == ST_CTIME_NSEC(st);
+}
+
+static meta_parameters *meta_cache_lookup(const char *meta_name,
+                                          const struct stat *st)
+{
+  int ii;
+  for (ii=0; ii<META_CACHE_SIZE; ii++) {
+    meta_cache_entry *e = &meta_cache[ii];
+    if (e->meta_name && strcmp(e->meta_name, meta_name) == 0) {
+      if (meta_cache_matches(e, st)) {
+        e->last_used = ++meta_cache_clock;
+        return meta_copy(e->meta);
+      }
+      // stale
+      meta_cache_drop(e);
+    }
+  }
+  return NULL;
+}
+
+static void meta_cache_store(const char *meta_name, const struct stat *st,
+                             meta_parameters *meta)
+{
+  int ii, slot = 0;
+  for (ii=0; ii<META_CACHE_SIZE; ii++) {
+    if (!meta_cache[ii].meta_name) {
+      slot = ii;
+      break;
+    }
+    if (meta_cache[ii].last_used < meta_cache[slot].last_used)
+      slot = ii;
+  }
+
+  meta_cache_entry *e = &meta_cache[slot];
+  meta_cache_drop(e);
+  e->meta_name = STRDUP(meta_name);
+  e->dev = st->st_dev;
+  e->ino = st->st_ino;
+  e->size = st->st_size;
+  e->mtime = st->st_mtime;
+  e->mtime_nsec = ST_MTIME_NSEC(st);
+  e->ctime = st->st_ctime;
+  e->ctime_nsec = ST_CTIME_NSEC(st);
+  e->last_used = ++meta_cache_clock;
+  e->meta = meta_copy(meta);
+}
+
+/* Forget any cached copy of the given metadata file.  Entries are
+   matched by name, and also by device/inode so that a file written
+   through a different path to the same file is caught as well.  */
+void meta_read_cache_forget(const char *meta_name)
+{
+  int ii;
+  struct stat st;
+  int have_stat = stat(meta_name, &st) == 0;
+
+  for (ii=0; ii<META_CACHE_SIZE; ii++) {
+    meta_cache_entry *e = &meta_cache[ii];
+    if (!e->meta_name)
+      continue;
+    if (strcmp(e->meta_name, meta_name) == 0 ||
+        (have_stat && e->dev == st.st_dev && e->ino == st.st_ino))
+      meta_cache_drop(e);
+  }
+}
+
+/* Empty the metadata cache.  */
+void meta_read_cache_clear(void)
+{
+  int ii;
+  for (ii=0; ii<META_CACHE_SIZE; ii++)
+    meta_cache_drop(&meta_cache[ii]);
+}
+
 /***************************************************************
  * meta_read:
  * Reads a meta file and returns a meta structure filled with
@@ -55,9 +200,22 @@ meta_parameters *meta_read(const char *inName)
 {
   char              *meta_name      = appendExt(inName,".meta");
   char              *ddr_name       = appendExt(inName,".ddr");
-  meta_parameters   *meta           = raw_init(); /* Allocate and initialize basic structs */
+  meta_parameters   *meta;
   char **junk=NULL;
-  int junk2, ii;
+  int junk2, ii, cacheable=FALSE;
+  struct stat st;
+
+  /* Hand out a copy of a previously parsed file, if it is unchanged */
+  if (meta_cache_enabled() && stat(meta_name, &st) == 0) {
+    meta = meta_cache_lookup(meta_name, &st);
+    if (meta) {
+      FREE(ddr_name);
+      FREE(meta_name);
+      return meta;
+    }
+  }
+
+  meta = raw_init(); /* Allocate and initialize basic structs */
 
   junk = (char **) MALLOC(2*sizeof(char *));
   for (ii=0; ii<2; ii++)
@@ -78,6 +236,7 @@ meta_parameters *meta_read(const char *inName)
     }
     else {
       parse_metadata(meta, meta_name);
+      cacheable = meta_cache_enabled();
     }
   }
   // Generate metadata if CEOS files could be detected
@@ -110,6 +269,10 @@ meta_parameters *meta_read(const char *inName)
     FREE(data_name);
   }
 
+  /* The lat/lon block comes from the image file, so it is not cached */
+  if (cacheable && !meta->latlon)
+    meta_cache_store(meta_name, &st, meta);
+
   FREE(ddr_name);
   FREE(meta_name);
   free_ceos_names(NULL, junk);
@@ -164,6 +164,9 @@ void meta_write(meta_parameters *meta, const char *file_name)
   FILE *fp = FOPEN(file_name_with_extension, "w");
   char comment[256];
 
+  // whatever meta_read has cached for this file is about to go stale
+  meta_read_cache_forget(file_name_with_extension);
+
   // dump the envi header if we were told to do so, and envi supports
   // the type of data that we have
   if (dump_envi_header) {
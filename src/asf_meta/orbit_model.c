@@ -0,0 +1,198 @@
+/****************************************************************
+orbit_model:
+   A precomputed interpolation model of the state vectors in a
+metadata structure.
+
+   meta_get_stVec() fits a cubic Hermite polynomial through the pair
+of state vectors that bracket the requested time (see interp_stVec.c).
+That is cheap enough, but the geolocation and terrain correction code
+calls it millions of times per image, and for each call it used to
+search the vector list from the start and refit the polynomial.
+
+   An orbit_model does the fitting once: it holds the polynomial
+coefficients of every segment between consecutive state vectors, and
+finds the segment for a given time in constant time when the vectors
+are evenly spaced (they nearly always are).  The interpolated vectors
+are identical to those from interp_stVec().
+
+   meta_get_stVec() uses the model cached in the metadata, built on
+first use by meta_orbit_model().  The model is read-only once built,
+so any number of threads may query the same model at once.
+****************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+
+struct orbit_model {
+  int count;            // number of state vectors
+  double *time;         // [count] state vector times
+  double first_time;    // time of the first vector
+  double inv_step;      // 1/(mean spacing between vectors)
+  double *coefs;        // [count-1][3][4] Hermite coefficients
+  state_loc *vecs;      // [count] copy of the vectors it was built from
+};
+
+/* Segment lookup:
+   Returns the index of the first state vector of the segment used to
+   interpolate at the given time.  This is the first segment whose end
+   is at or past the time, or the last segment if there is none (so
+   that times outside the vectors are extrapolated from the nearest
+   segment), exactly as in the original linear search.  The initial
+   guess assumes evenly spaced vectors; the two loops only correct it,
+   so the answer is right for any increasing set of times.  */
+static int find_segment(const double *t, int count, double first_time,
+                        double inv_step, double time)
+{
+  int last = count - 2;
+  double guess = (time - first_time)*inv_step;
+  int k = guess > 0 ? (guess < last ? (int)guess : last) : 0;
+
+  while (k > 0 && t[k] >= time)
+    k--;
+  while (k < last && t[k+1] < time)
+    k++;
+
+  return k;
+}
+
+static void check_state_vectors(const meta_state_vectors *sv,
+                                const char *caller)
+{
+  if (sv == NULL)
+    asfPrintError("%s: Requested a state vector, but no state vectors "
+                  "exist in the meta file!\n", caller);
+  if (sv->vector_count < 2)
+    asfPrintError("%s: Only %d state vector%s exist in file!\n", caller,
+                  sv->vector_count, sv->vector_count != 1 ? "s" : "");
+}
+
+orbit_model *orbit_model_init(meta_parameters *meta)
+{
+  const meta_state_vectors *sv = meta->state_vectors;
+  int ii, jj;
+
+  check_state_vectors(sv, "orbit_model_init");
+
+  orbit_model *orbit = (orbit_model *) MALLOC(sizeof(orbit_model));
+  int n = orbit->count = sv->vector_count;
+  orbit->time = (double *) MALLOC(sizeof(double)*n);
+  orbit->coefs = (double *) MALLOC(sizeof(double)*(n-1)*12);
+
+  for (ii=0; ii<n; ii++)
+    orbit->time[ii] = sv->vecs[ii].time;
+  orbit->first_time = orbit->time[0];
+  orbit->vecs = (state_loc *) MALLOC(sizeof(state_loc)*n);
+  memcpy(orbit->vecs, sv->vecs, sizeof(state_loc)*n);
+  double span = orbit->time[n-1] - orbit->time[0];
+  orbit->inv_step = span > 0 ? (n - 1)/span : 0;
+
+  // Same fit as interp_stVec(): for each axis, r(0)=st1.pos,
+  // r(1)=st2.pos, r'(0)=st1.vel and r'(1)=st2.vel, with t scaled to
+  // [0,1] over the segment.
+  for (ii=0; ii<n-1; ii++) {
+    const stateVector *st1 = &sv->vecs[ii].vec;
+    const stateVector *st2 = &sv->vecs[ii+1].vec;
+    double deltaT = orbit->time[ii+1] - orbit->time[ii];
+    double A[3] = { st1->pos.x, st1->pos.y, st1->pos.z };
+    double B[3] = { st2->pos.x, st2->pos.y, st2->pos.z };
+    double Av[3] = { st1->vel.x*deltaT, st1->vel.y*deltaT, st1->vel.z*deltaT };
+    double Bv[3] = { st2->vel.x*deltaT, st2->vel.y*deltaT, st2->vel.z*deltaT };
+    double *c = &orbit->coefs[ii*12];
+    for (jj=0; jj<3; jj++) {
+      c[jj*4+0] = A[jj];
+      c[jj*4+1] = Av[jj];
+      c[jj*4+2] = 3*B[jj]-3*A[jj]-2*Av[jj]-Bv[jj];
+      c[jj*4+3] = 2*A[jj]-2*B[jj]+Av[jj]+Bv[jj];
+    }
+  }
+
+  return orbit;
+}
+
+void orbit_model_free(orbit_model *orbit)
+{
+  if (orbit) {
+    FREE(orbit->time);
+    FREE(orbit->coefs);
+    FREE(orbit->vecs);
+    FREE(orbit);
+  }
+}
+
+// Whether the model was built from the given state vectors, as they are
+// now.  Every vector is compared, so that any change to the orbit (a
+// replaced block, shifted times, or a vector edited in place) causes a
+// rebuild.  That is a few hundred bytes, far cheaper than a refit.
+static int orbit_model_matches(const orbit_model *orbit,
+                               const meta_state_vectors *sv)
+{
+  return orbit->count == sv->vector_count &&
+    memcmp(orbit->vecs, sv->vecs, sizeof(state_loc)*orbit->count) == 0;
+}
+
+/* Returns the orbit model for the state vectors in the metadata,
+   building it on the first call (and again if the state vectors have
+   changed since).  Like the other geolocation values that are set up
+   on first use, threads sharing one meta_parameters should let one
+   call happen before they start.  */
+const orbit_model *meta_orbit_model(meta_parameters *meta)
+{
+  const meta_state_vectors *sv = meta->state_vectors;
+
+  check_state_vectors(sv, "meta_orbit_model");
+  if (!meta->orbit || !orbit_model_matches(meta->orbit, sv)) {
+    orbit_model_free(meta->orbit);
+    meta->orbit = orbit_model_init(meta);
+  }
+
+  return meta->orbit;
+}
+
+static void eval_segment(const orbit_model *orbit, int k, double time,
+                         stateVector *out)
+{
+  const double *c = &orbit->coefs[k*12];
+  double deltaT = orbit->time[k+1] - orbit->time[k];
+  double t = (time - orbit->time[k])/deltaT;
+  double t2 = t*t, t3 = t2*t;
+  double r[6];
+  int ii;
+
+  for (ii=0; ii<3; ii++) {
+    const double *ci = &c[ii*4];
+    r[ii] = ci[0]+ci[1]*t+ci[2]*t2+ci[3]*t3;
+    r[ii+3] = (ci[1]+2.0*ci[2]*t+3.0*ci[3]*t2)/deltaT;
+  }
+
+  out->pos.x = r[0]; out->pos.y = r[1]; out->pos.z = r[2];
+  out->vel.x = r[3]; out->vel.y = r[4]; out->vel.z = r[5];
+}
+
+/* Fixed-earth state vector at the given time (seconds from the start of
+   the image), as meta_get_stVec() would return it.  */
+stateVector orbit_model_get_stVec(const orbit_model *orbit, double time)
+{
+  stateVector ret;
+  int k = find_segment(orbit->time, orbit->count, orbit->first_time,
+                       orbit->inv_step, time);
+  eval_segment(orbit, k, time, &ret);
+  return ret;
+}
+
+/* Batched version: fills out[i] with the state vector at times[i].
+   Consecutive times are usually close together, so the search starts
+   from the previous segment.  */
+void orbit_model_get_stVecs(const orbit_model *orbit, int n,
+                            const double *times, stateVector *out)
+{
+  int ii, k = 0, last = orbit->count - 2;
+
+  for (ii=0; ii<n; ii++) {
+    double time = times[ii];
+    // keep the previous segment if the lookup rule still picks it
+    if (ii == 0 || !((k == 0 || orbit->time[k] < time) &&
+                     (k == last || orbit->time[k+1] >= time)))
+      k = find_segment(orbit->time, orbit->count, orbit->first_time,
+                       orbit->inv_step, time);
+    eval_segment(orbit, k, time, &out[ii]);
+  }
+}
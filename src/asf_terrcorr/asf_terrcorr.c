@@ -9,7 +9,7 @@
 "          [-other-file <basename>] [-do-radiometric] [-smooth-dem-holes]\n"\
 "          [-no-match] [-offsets <range> <azimuth>]\n"\
 "          [-use-zero-offsets-if-match-fails] [-save-ground-range-dem]\n"\
-"          [-save-incidence-angles]\n"\
+"          [-save-incidence-angles] [-multiscale-match]\n"\
 "          <in_base_name> <dem_base_name> <out_base_name>\n"
 
 #define ASF_DESCRIPTION_STRING \
@@ -195,6 +195,15 @@
 "          Normally, if the coregistration fails, asf_terrcorr will abort\n"\
 "          with an error.\n"\
 "\n"\
+"     -multiscale-match\n"\
+"          Match the DEM to the SAR image coarse-to-fine: first a match of\n"\
+"          reduced resolution copies of the whole scene bounds the offset,\n"\
+"          then a set of full resolution seed squares are all matched at\n"\
+"          the same time (in parallel), and the ones that agree are\n"\
+"          combined.  The certainty of every seed square is reported.  On\n"\
+"          scenes with poor orbits this usually needs fewer iterations of\n"\
+"          DEM clipping than the default matching.\n"\
+"\n"\
 "     -save-ground-range-dem\n"\
 "          Save the ground range DEM (for radiometric terrain correction "\
 "later).\n"\
@@ -328,6 +337,7 @@ main (int argc, char *argv[])
   int if_coreg_fails_use_zero_offsets = FALSE;
   int save_ground_dem = FALSE;
   int save_incid_angles = FALSE;
+  int multiscale_matching = FALSE;
   double range_offset = 0.0;
   double azimuth_offset = 0.0;
   char *other_files[MAX_OTHER];
@@ -463,6 +473,9 @@ main (int argc, char *argv[])
     else if (strmatches(key,"-save-incidence-angles","--save_incidence-angles",NULL)) {
       save_incid_angles = TRUE;
     }
+    else if (strmatches(key,"-multiscale-match","--multiscale-match",NULL)) {
+      multiscale_matching = TRUE;
+    }
     else if (strmatches(key,"-help","--help",NULL)) {
         print_help(); // doesn't return
     }
@@ -502,7 +515,7 @@ main (int argc, char *argv[])
                               no_matching, range_offset, azimuth_offset,
                               use_gr_dem, add_speckle,
                               if_coreg_fails_use_zero_offsets, save_ground_dem,
-                              save_incid_angles);
+                              save_incid_angles, multiscale_matching);
 
   for (i=0; i<MAX_OTHER; ++i)
       if (other_files[i])
@@ -625,6 +625,9 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
     }
 
     if (!mask) {
+        // when zoomed out, use the overview pyramid if it has been built
+        int level = zoom >= 2 ? overview_level_for_zoom(ii->data_ci, zoom) : -1;
+
         int mm = 0;
         for (i=0; i<bih; ++i) {
             for (j=0; j<biw; ++j) {
@@ -638,6 +641,11 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
                     g = background_green;
                     b = background_blue;
                 }
+                else if (level >= 0) {
+                    // pyramid pixels are already averaged
+                    overview_get_rgb(ii->data_ci, level, (int)floor(l),
+                        (int)floor(s), &r, &g, &b);
+                }
                 else {
                     // here we have some averaging, that will make the
                     // images look a bit smoother when zoomed out
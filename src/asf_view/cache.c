@@ -185,8 +185,11 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
         //print_cache_size(self);
     }
 
+    // the overview pyramid builder may be reading from the client too
+    if (self->read_lock) g_mutex_lock(self->read_lock);
     self->client->read_fn(rs, rows_to_get, (void*)(self->cache[spot]),
         self->client->read_client_info, self->meta, self->client->data_type);
+    if (self->read_lock) g_mutex_unlock(self->read_lock);
 
     assert((line-rs)*self->ns + samp <= self->ns*self->rows_per_tile);
     return &self->cache[spot][((line-rs)*self->ns + samp)*ds];
@@ -195,6 +198,18 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
 void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
                          void *dest_void)
 {
+    // sf is the subsampling factor used by the full resolution path below
+    int sf = self->meta->general->line_count / thumb_size_y;
+
+    // Once the overview pyramid has been built, resampling the file
+    // again just to regenerate the thumbnail isn't necessary
+    if (!self->entire_image_fits &&
+        overview_load_thumbnail_data(self, thumb_size_x, thumb_size_y, sf,
+                                     dest_void))
+    {
+        return;
+    }
+
     if (self->entire_image_fits || !self->client->thumb_fn) {
         // Either we don't have thumbnailing support from the client,
         // or the image will fit entirely in memory.  In both cases, we
@@ -206,7 +221,6 @@ void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
         unsigned char *dest = (unsigned char*)dest_void;
 
         // this will fill the cache with the image data
-        int sf = self->meta->general->line_count / thumb_size_y;
         //assert(sf == self->meta->general->sample_count / thumb_size_x);
 
         // supress the "populating cache" msgs when loading the whole thing
@@ -224,9 +238,12 @@ void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
 
         quiet=FALSE;
     } else {
+        // thumb_fn reads through the same client handle as the pyramid
+        if (self->read_lock) g_mutex_lock(self->read_lock);
         self->client->thumb_fn(thumb_size_x, thumb_size_y,
             self->meta, self->client->read_client_info, dest_void,
             self->client->data_type);
+        if (self->read_lock) g_mutex_unlock(self->read_lock);
     }
 }
 
@@ -298,6 +315,11 @@ CachedImage * cached_image_new_from_file(
     asfPrintStatus("Fits in memory: %s\n",
         self->entire_image_fits ? "Yes" : "No");
 
+    // kick off the background build of the zoomed-out views
+    self->read_lock = NULL;
+    self->pyramid = NULL;
+    overview_pyramid_start(self);
+
     return self;
 }
 
@@ -399,9 +421,20 @@ void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
     }
 }
 
+int cached_image_data_size(CachedImage *self)
+{
+    return data_size(self);
+}
+
 void cached_image_free (CachedImage *self)
 {
     int i;
+
+    // must stop the builder before the client goes away
+    overview_pyramid_free(self);
+    if (self->read_lock)
+        g_mutex_free(self->read_lock);
+
     for (i=0; i<self->n_tiles; ++i) {
         if (self->cache[i])
             free(self->cache[i]);
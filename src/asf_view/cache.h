@@ -91,6 +91,26 @@ typedef struct {
 } ClientInterface;
 
 
+//---------------------------------------------------------------------------
+// Overview pyramid -- power-of-two reduced resolution copies of the image,
+// built once in the background, used when rendering zoomed-out views.
+// See pyramid.c.  Levels are stored as floats (1 or 3 channels), each
+// pixel the average of the corresponding full resolution block.
+typedef struct {
+  int nl, ns;               // Level dimensions
+  int factor;               // Reduction factor relative to full resolution
+  float *data;              // nchan floats per pixel
+} OverviewLevel;
+
+typedef struct {
+  int nchan;                // 1 for greyscale, 3 for RGB
+  int n_levels;             // Number of levels (finest first)
+  OverviewLevel *levels;
+  volatile int ready;       // TRUE when all levels have been built
+  volatile int cancel;      // set to stop the builder thread early
+  GThread *thread;          // builder thread
+} OverviewPyramid;
+
 //---------------------------------------------------------------------------
 // Here is the ImageCache stuff.  The global ImageCache that holds the
 // loaded image is "data_ci".  This is all private data.
@@ -111,6 +131,8 @@ typedef struct {
   ImageStatsRGB *stats_r;   // not owned by us, not populated by us
   ImageStatsRGB *stats_g;   // not owned by us, not populated by us
   ImageStatsRGB *stats_b;   // not owned by us, not populated by us
+  GMutex *read_lock;        // serializes client reads, when threaded
+  OverviewPyramid *pyramid; // NULL if image is too small to need one
 } CachedImage;
 
 CachedImage * cached_image_new_from_file(
@@ -129,5 +151,15 @@ void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
                          void *dest);
 
 void cached_image_free (CachedImage *self);
+int cached_image_data_size(CachedImage *self);
+
+// pyramid.c
+void overview_pyramid_start(CachedImage *self);
+void overview_pyramid_free(CachedImage *self);
+int overview_level_for_zoom(CachedImage *self, double zoom);
+void overview_get_rgb(CachedImage *self, int level, int line, int samp,
+                      unsigned char *r, unsigned char *g, unsigned char *b);
+int overview_load_thumbnail_data(CachedImage *self, int thumb_size_x,
+                                 int thumb_size_y, int sf, void *dest);
 
 #endif
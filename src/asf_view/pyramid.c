@@ -0,0 +1,347 @@
+#include "asf_view.h"
+
+// Overview pyramid for the large image.
+//
+// When zoomed out, make_big_image() used to sample the full resolution
+// image through the cache for every screen pixel, which meant that a
+// repaint touched most of the file.  Instead, we build (once, in a
+// background thread) a set of power-of-two reduced resolution copies of
+// the image, and render zoomed-out views from the level that matches the
+// zoom.  That way the cost of a repaint depends on the size of the
+// window, not on the size of the image.
+//
+// The finest level is chosen so that it fits in about the same amount of
+// memory as one cache tile, zooms finer than that still go through the
+// cache (they only need a screen-sized area of the image anyway).  Each
+// level pixel is the average of the corresponding block of full
+// resolution pixels, NaNs are skipped.
+
+// images smaller than this (in both dimensions) don't get a pyramid
+static const int MIN_PYRAMID_SIZE = 2048;
+
+// stop adding levels once they get this small
+static const int MIN_LEVEL_SIZE = 64;
+
+// same as the cache tile size, see cache.c
+static const double MAX_LEVEL_BYTES = 64*1024*1024;
+
+static int num_channels(CachedImage *self)
+{
+    switch (self->data_type) {
+        case GREYSCALE_FLOAT:
+        case GREYSCALE_BYTE:
+            return 1;
+        case RGB_BYTE:
+        case RGB_FLOAT:
+            return 3;
+        default:
+            assert(FALSE);
+            return 0;
+    }
+}
+
+// pull channel "k" of pixel "j" out of a buffer returned by the client
+static float raw_value(CachedImage *self, unsigned char *buf, int j, int k)
+{
+    switch (self->data_type) {
+        case GREYSCALE_FLOAT:
+            return ((float*)buf)[j];
+        case GREYSCALE_BYTE:
+            return (float)buf[j];
+        case RGB_BYTE:
+            return (float)buf[3*j+k];
+        case RGB_FLOAT:
+            return ((float*)buf)[3*j+k];
+        default:
+            assert(FALSE);
+            return 0;
+    }
+}
+
+static gboolean redraw_when_ready(gpointer data)
+{
+    // runs in the main loop -- by now the user may have loaded something
+    // else, just redraw whatever is current if it has a pyramid now
+    if (glade_xml && curr && curr->data_ci && curr->data_ci->pyramid &&
+        curr->data_ci->pyramid->ready)
+    {
+        fill_big(curr);
+    }
+    return FALSE;
+}
+
+static gpointer build_pyramid(gpointer user_data)
+{
+    CachedImage *self = (CachedImage*)user_data;
+    OverviewPyramid *pyr = self->pyramid;
+    OverviewLevel *L0 = &pyr->levels[0];
+
+    int nchan = pyr->nchan;
+    int ds = cached_image_data_size(self);
+    int f = L0->factor;
+    int i, j, k, n;
+
+    unsigned char *buf = MALLOC(ds*self->ns*f);
+    double *acc = MALLOC(sizeof(double)*L0->ns*nchan);
+    int *cnt = MALLOC(sizeof(int)*L0->ns*nchan);
+
+    // Finest level is built straight from the file, one block row
+    // (of "f" image lines) at a time
+    for (i=0; i<L0->nl; ++i) {
+        int row_start = i*f;
+        int n_rows = f;
+        if (row_start + n_rows > self->nl)
+            n_rows = self->nl - row_start;
+
+        g_mutex_lock(self->read_lock);
+        self->client->read_fn(row_start, n_rows, (void*)buf,
+            self->client->read_client_info, self->meta,
+            self->client->data_type);
+        g_mutex_unlock(self->read_lock);
+
+        if (pyr->cancel)
+            break;
+
+        for (j=0; j<L0->ns*nchan; ++j) {
+            acc[j] = 0;
+            cnt[j] = 0;
+        }
+
+        for (n=0; n<n_rows; ++n) {
+            unsigned char *row = buf + n*self->ns*ds;
+            for (j=0; j<self->ns; ++j) {
+                int jj = (j/f)*nchan;
+                for (k=0; k<nchan; ++k) {
+                    float v = raw_value(self, row, j, k);
+                    if (meta_is_valid_double(v)) {
+                        acc[jj+k] += v;
+                        ++cnt[jj+k];
+                    }
+                }
+            }
+        }
+
+        float *out = L0->data + i*L0->ns*nchan;
+        for (j=0; j<L0->ns*nchan; ++j)
+            out[j] = cnt[j] > 0 ? (float)(acc[j]/cnt[j]) : 0.0;
+    }
+
+    free(buf);
+    free(acc);
+    free(cnt);
+
+    // Each coarser level is a 2x2 average of the previous one
+    int m;
+    for (m=1; m<pyr->n_levels && !pyr->cancel; ++m) {
+        OverviewLevel *P = &pyr->levels[m-1];
+        OverviewLevel *L = &pyr->levels[m];
+        for (i=0; i<L->nl; ++i) {
+            for (j=0; j<L->ns; ++j) {
+                for (k=0; k<nchan; ++k) {
+                    double sum = 0;
+                    int a, b, c = 0;
+                    for (a=2*i; a<2*i+2 && a<P->nl; ++a) {
+                        for (b=2*j; b<2*j+2 && b<P->ns; ++b) {
+                            sum += P->data[(a*P->ns+b)*nchan+k];
+                            ++c;
+                        }
+                    }
+                    L->data[(i*L->ns+j)*nchan+k] = (float)(sum/c);
+                }
+            }
+        }
+    }
+
+    if (!pyr->cancel) {
+        pyr->ready = TRUE;
+        g_idle_add(redraw_when_ready, NULL);
+    }
+
+    return NULL;
+}
+
+void overview_pyramid_start(CachedImage *self)
+{
+    self->pyramid = NULL;
+
+    // If the whole image fits in the cache, it is read once and then
+    // rendered from memory, so the pyramid would only cost an extra
+    // pass over the file.
+    if (self->entire_image_fits)
+        return;
+
+    if (self->nl < MIN_PYRAMID_SIZE && self->ns < MIN_PYRAMID_SIZE)
+        return;
+
+    int nchan = num_channels(self);
+
+    // finest level -- the first one that fits in a cache tile's worth
+    // of memory
+    int f = 2;
+    while ((double)((self->nl+f-1)/f) * (double)((self->ns+f-1)/f) *
+           nchan * sizeof(float) > MAX_LEVEL_BYTES)
+    {
+        f *= 2;
+    }
+
+    // count levels, coarsest is the first one with both dimensions
+    // no larger than MIN_LEVEL_SIZE
+    int n_levels = 1;
+    int g = f;
+    while ((self->nl+g-1)/g > MIN_LEVEL_SIZE ||
+           (self->ns+g-1)/g > MIN_LEVEL_SIZE)
+    {
+        g *= 2;
+        ++n_levels;
+    }
+
+    OverviewPyramid *pyr = MALLOC(sizeof(OverviewPyramid));
+    pyr->nchan = nchan;
+    pyr->n_levels = n_levels;
+    pyr->levels = MALLOC(sizeof(OverviewLevel)*n_levels);
+    pyr->ready = FALSE;
+    pyr->cancel = FALSE;
+
+    int m;
+    for (m=0; m<n_levels; ++m) {
+        OverviewLevel *L = &pyr->levels[m];
+        L->factor = f;
+        L->nl = (self->nl+f-1)/f;
+        L->ns = (self->ns+f-1)/f;
+        L->data = MALLOC(sizeof(float)*L->nl*L->ns*nchan);
+        f *= 2;
+    }
+
+    asfPrintStatus("Building %d overview levels in the background "
+                   "(finest: 1/%d).\n", n_levels, pyr->levels[0].factor);
+
+    if (!g_thread_supported ()) g_thread_init (NULL);
+    self->read_lock = g_mutex_new ();
+    self->pyramid = pyr;
+
+    pyr->thread = g_thread_create (build_pyramid, self, TRUE, NULL);
+    g_assert (pyr->thread != NULL);
+
+    // keep things snappy for the user while the pyramid is built
+    g_thread_set_priority (pyr->thread, G_THREAD_PRIORITY_LOW);
+}
+
+void overview_pyramid_free(CachedImage *self)
+{
+    OverviewPyramid *pyr = self->pyramid;
+    if (!pyr)
+        return;
+
+    pyr->cancel = TRUE;
+    g_thread_join (pyr->thread);
+
+    int m;
+    for (m=0; m<pyr->n_levels; ++m)
+        free(pyr->levels[m].data);
+    free(pyr->levels);
+    free(pyr);
+
+    self->pyramid = NULL;
+}
+
+// Returns the level that should be used to render the given zoom, or -1
+// if the full resolution image (through the cache) should be used.
+int overview_level_for_zoom(CachedImage *self, double zoom)
+{
+    OverviewPyramid *pyr = self->pyramid;
+    if (!pyr || !pyr->ready)
+        return -1;
+
+    // averaging classes doesn't make sense, let the cache handle
+    // greyscale images shown through a look up table
+    if (pyr->nchan == 1 && have_lut())
+        return -1;
+
+    int m, level = -1;
+    for (m=0; m<pyr->n_levels; ++m)
+        if (pyr->levels[m].factor <= zoom)
+            level = m;
+
+    return level;
+}
+
+void overview_get_rgb(CachedImage *self, int level, int line, int samp,
+                      unsigned char *r, unsigned char *g, unsigned char *b)
+{
+    OverviewPyramid *pyr = self->pyramid;
+    OverviewLevel *L = &pyr->levels[level];
+
+    int i = line / L->factor;
+    int j = samp / L->factor;
+    if (i >= L->nl) i = L->nl-1;
+    if (j >= L->ns) j = L->ns-1;
+
+    float *p = L->data + (i*L->ns + j)*pyr->nchan;
+
+    if (pyr->nchan == 1) {
+        *r = *g = *b = (unsigned char)calc_scaled_pixel_value(self->stats, p[0]);
+    } else {
+        *r = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_r, p[0]);
+        *g = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_g, p[1]);
+        *b = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_b, p[2]);
+    }
+}
+
+static unsigned char to_byte(float v)
+{
+    if (v <= 0) return 0;
+    if (v >= 255) return 255;
+    return (unsigned char)(v + .5);
+}
+
+// Fills "dest" (in the cache's data type) with a thumbnail sampled every
+// "sf" pixels, from the coarsest overview level that is still at least
+// that fine.  Returns FALSE if the pyramid can't be used.
+int overview_load_thumbnail_data(CachedImage *self, int thumb_size_x,
+                                 int thumb_size_y, int sf, void *dest)
+{
+    OverviewPyramid *pyr = self->pyramid;
+    if (!pyr || !pyr->ready)
+        return FALSE;
+    if (pyr->nchan == 1 && have_lut())
+        return FALSE;
+
+    int m, level = -1;
+    for (m=0; m<pyr->n_levels; ++m)
+        if (pyr->levels[m].factor <= sf)
+            level = m;
+    if (level < 0)
+        return FALSE;
+
+    OverviewLevel *L = &pyr->levels[level];
+    int nchan = pyr->nchan;
+    int i, j, k;
+
+    for (i=0; i<thumb_size_y; ++i) {
+        int ii = (i*sf) / L->factor;
+        if (ii >= L->nl) ii = L->nl-1;
+        for (j=0; j<thumb_size_x; ++j) {
+            int jj = (j*sf) / L->factor;
+            if (jj >= L->ns) jj = L->ns-1;
+            float *p = L->data + (ii*L->ns + jj)*nchan;
+            int n = i*thumb_size_x + j;
+            for (k=0; k<nchan; ++k) {
+                switch (self->data_type) {
+                    case GREYSCALE_FLOAT:
+                    case RGB_FLOAT:
+                        ((float*)dest)[n*nchan+k] = p[k];
+                        break;
+                    case GREYSCALE_BYTE:
+                    case RGB_BYTE:
+                        ((unsigned char*)dest)[n*nchan+k] = to_byte(p[k]);
+                        break;
+                    default:
+                        assert(FALSE);
+                        break;
+                }
+            }
+        }
+    }
+
+    return TRUE;
+}
@@ -19,6 +19,10 @@
 #ifdef linux
 #include <unistd.h>
 #endif
+#ifndef win32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include <assert.h>
 #include <sys/types.h>
@@ -61,6 +65,7 @@ void generate_level0_thumbnail(const char *file, int size, int verbose, level_0_
                                output_format_t output_format, char *out_dir);
 int is_stf_level0(const char *file);
 int is_ceos_level0(const char *file);
+int is_ceos_thumbnail_source(const char *input_data);
 void flip_to_north_up(const char *in_file, const char *out_file);
 int is_JL0_basename(const char *what);
 long optimize_na_valid(struct INPUT_ARDOP_PARAMS *params_in);
@@ -68,6 +73,39 @@ int is_jpeg(const char *file);
 int is_tiff(const char *file);
 int is_polsarpro(const char *file);
 
+// A granule found while walking the inputs.  Thumbnails are only rendered
+// once the walk is complete, each job carries everything its thumbnail
+// generator needs so that the jobs can be run in separate processes.
+typedef struct {
+    char *file;             // file passed to the thumbnail generator
+    char *thumb;            // thumbnail that the generator will write
+    int level0;             // use generate_level0_thumbnail()
+    int size, verbose;
+    level_0_flag L0Flag;
+    float scale_factor;
+    int browseFlag, saveMetadataFlag, nPatchesFlag, nPatches;
+    output_format_t output_format;
+    char *out_dir;
+#ifndef win32
+    pid_t pid;              // worker rendering this job
+#endif
+} thumb_job_t;
+
+static thumb_job_t *thumb_jobs = NULL;
+static int num_thumb_jobs = 0;
+static int max_thumb_jobs = 0;
+
+// Regenerate thumbnails that are newer than their input (-force)
+static int force_flag = FALSE;
+
+static void queue_thumbnail(const char *file, int level0, int level,
+                            int size, int verbose, level_0_flag L0Flag,
+                            float scale_factor, int browseFlag,
+                            int saveMetadataFlag, int nPatchesFlag,
+                            int nPatches, output_format_t output_format,
+                            char *out_dir);
+static void render_thumbnails(int num_workers);
+
 int main(int argc, char *argv[])
 {
   output_format_t output_format=JPEG;
@@ -81,6 +119,7 @@ int main(int argc, char *argv[])
   int out_dir_Specified=0;
   float scale_factor=-1.0;
   int browseFlag=0;
+  int num_workers=asf_get_num_threads();
 
   // Secret command line parameter for limiting num patches processed for Level 0
   int nPatches, nPatchesFlag=0;
@@ -213,6 +252,21 @@ int main(int argc, char *argv[])
             exit(1);
         }
     }
+    else if (strmatches(key,"--workers","-workers","-w",NULL)) {
+        CHECK_ARG(1);
+        num_workers = atoi(GET_ARG(1));
+        if (num_workers < 1) {
+            if (!quietflag) {
+              fprintf(stderr,"\n**Invalid number of workers for -workers option."
+                  "  Number of workers must be 1 or greater.\n");
+              usage();
+            }
+            exit(1);
+        }
+    }
+    else if (strmatches(key,"--force","-force","-f",NULL)) {
+        force_flag=TRUE;
+    }
     else if (strmatches(key,"--",NULL)) {
         break;
     }
@@ -283,6 +337,7 @@ int main(int argc, char *argv[])
               nPatchesFlag, nPatches,
               output_format, out_dir);
   }
+  render_thumbnails(num_workers);
 
   if (fLog) fclose(fLog);
   FREE(out_dir);
@@ -364,6 +419,34 @@ meta_parameters * silent_meta_create(const char *filename)
     return ret;
 }
 
+// Returns TRUE if a CEOS thumbnail is made from this file: it must be part
+// of a (detected) CEOS pair, and for IMG/LED pairs only the leader file
+// counts, so that each granule is rendered once.
+int is_ceos_thumbnail_source(const char *input_data)
+{
+    char **inBandName = NULL, **inMetaName = NULL;
+    char baseName[512];
+    int nBands, trailer, ret;
+    ceos_file_pairs_t ceos_pair = NO_CEOS_FILE_PAIR;
+
+    ceos_pair = get_ceos_names(input_data, baseName,
+                               &inBandName, &inMetaName,
+                               &nBands, &trailer);
+    if (ceos_pair == NO_CEOS_FILE_PAIR) {
+        return FALSE;
+    }
+
+    char *file = get_filename(input_data);
+    ret = !is_ceos_level0(input_data) &&
+          !is_jpeg(input_data) && !is_tiff(input_data) &&
+          !(ceos_pair == CEOS_IMG_LED_PAIR && strncmp(file, "LED", 3) != 0);
+
+    FREE(file);
+    free_ceos_names(inBandName, inMetaName);
+
+    return ret;
+}
+
 int generate_ceos_thumbnail(const char *input_data, int size,
                             output_format_t output_format, char *out_dir,
                             int saveMetadataFlag, double scale_factor, int browseFlag)
@@ -372,29 +455,13 @@ int generate_ceos_thumbnail(const char *input_data, int size,
     char **inBandName = NULL, **inMetaName = NULL;
     char baseName[512];
     int nBands, trailer, ns, nLooks;
-    ceos_file_pairs_t ceos_pair = NO_CEOS_FILE_PAIR;
-    char *file = get_filename(input_data);
 
     //Check that input data is available
-    ceos_pair = get_ceos_names(input_data, baseName,
-                               &inBandName, &inMetaName,
-                               &nBands, &trailer);
-    if (ceos_pair == NO_CEOS_FILE_PAIR || is_ceos_level0(input_data)) {
+    if (!is_ceos_thumbnail_source(input_data)) {
         return FALSE;
     }
-    int band;
-    int not_data = 0;
-    for (band = 0; band < nBands; band++) {
-      if (is_jpeg(input_data) || is_tiff(input_data))
-      {
-        not_data = 1;
-        break;
-      }
-    }
-    not_data = (ceos_pair == CEOS_IMG_LED_PAIR && strncmp(file, "LED", 3) != 0) ? 1 : not_data;
-    if (not_data) {
-      return FALSE;
-    }
+    get_ceos_names(input_data, baseName, &inBandName, &inMetaName,
+                   &nBands, &trailer);
 
     // Input metadata
     meta_parameters *imd = silent_meta_create(inMetaName[0]);
@@ -727,10 +794,9 @@ void process_file(const char *file, int level, int size, int verbose,
     if (L0Flag == stf && is_stf_level0(file)) {
         if (get_stf_data_name(file, &inDataName)) {
             if (strcmp(file, inDataName) == 0) {
-                asfPrintStatus("%s%s\n", spaces(level), base);
-                generate_level0_thumbnail(inDataName, size, verbose, L0Flag, scale_factor, browseFlag,
-                                          saveMetadataFlag, nPatchesFlag, nPatches,
-                                          output_format, out_dir);
+                queue_thumbnail(inDataName, TRUE, level, size, verbose, L0Flag,
+                                scale_factor, browseFlag, saveMetadataFlag,
+                                nPatchesFlag, nPatches, output_format, out_dir);
             }
         }
         else {
@@ -744,17 +810,16 @@ void process_file(const char *file, int level, int size, int verbose,
         int nBands;
         /*ceos_data_ext_t data_ext = */get_ceos_data_name(file, baseName, &dataName, &nBands);
         FREE(baseName);
-        asfPrintStatus("%s%s\n", spaces(level), base);
-        generate_level0_thumbnail(*dataName, size, verbose, L0Flag, scale_factor, browseFlag,
-                                  saveMetadataFlag, nPatchesFlag, nPatches,
-                                  output_format, out_dir);
+        queue_thumbnail(*dataName, TRUE, level, size, verbose, L0Flag,
+                        scale_factor, browseFlag, saveMetadataFlag,
+                        nPatchesFlag, nPatches, output_format, out_dir);
     }
 #ifdef JL0_GO
     else if (L0Flag == jaxa_l0) {
         if (is_JL0_basename(file)) {
-            generate_level0_thumbnail(file, size, verbose, L0Flag, scale_factor, browseFlag,
-                                      saveMetadataFlag, nPatchesFlag, nPatches,
-                                      output_format, out_dir);
+            queue_thumbnail(file, TRUE, level, size, verbose, L0Flag,
+                            scale_factor, browseFlag, saveMetadataFlag,
+                            nPatchesFlag, nPatches, output_format, out_dir);
         }
         else {
             if (verbose) {
@@ -764,8 +829,14 @@ void process_file(const char *file, int level, int size, int verbose,
     }
 #endif
     else if (!is_ceos_level0(file)) {
-      generate_ceos_thumbnail(file, size, output_format, out_dir,
-                                saveMetadataFlag, scale_factor, browseFlag);
+      if (is_ceos_thumbnail_source(file)) {
+        queue_thumbnail(file, FALSE, level, size, verbose, L0Flag,
+                        scale_factor, browseFlag, saveMetadataFlag,
+                        nPatchesFlag, nPatches, output_format, out_dir);
+      }
+      else if (verbose) {
+        asfPrintStatus("%s%s (ignored)\n", spaces(level), base);
+      }
     }
     else {
         // Should never reach here
@@ -826,6 +897,201 @@ void process(const char *what, int level, int recursive, int size, int verbose,
     FREE(base);
 }
 
+// Name of the thumbnail that will be generated for "file" -- this follows
+// the naming in generate_ceos_thumbnail() and generate_level0_thumbnail()
+static char *thumbnail_name(const char *file, int level0, int browseFlag,
+                            output_format_t output_format, const char *out_dir)
+{
+    char *base, *thumb;
+
+    if (level0) {
+        base = get_basename(file);
+    }
+    else {
+        char *thumb_file = appendToBasename(file, browseFlag ? "" : "_thumb");
+        base = get_basename(thumb_file);
+        FREE(thumb_file);
+    }
+
+    thumb = MALLOC(sizeof(char)*(strlen(out_dir)+strlen(base)+16));
+    sprintf(thumb, "%s%c%s%s%s", out_dir, DIR_SEPARATOR, base,
+            level0 && !browseFlag ? "_thumb" : "",
+            output_format == TIF ? ".tif" : ".jpg");
+    FREE(base);
+
+    return thumb;
+}
+
+// A thumbnail is up to date if it was written after its input was
+static int thumbnail_up_to_date(const char *file, const char *thumb)
+{
+    struct stat in, out;
+
+    return stat(file, &in) == 0 && stat(thumb, &out) == 0 &&
+           out.st_mtime >= in.st_mtime;
+}
+
+static void queue_thumbnail(const char *file, int level0, int level,
+                            int size, int verbose, level_0_flag L0Flag,
+                            float scale_factor, int browseFlag,
+                            int saveMetadataFlag, int nPatchesFlag,
+                            int nPatches, output_format_t output_format,
+                            char *out_dir)
+{
+    int ii;
+    char *base = get_filename(file);
+    char *thumb = thumbnail_name(file, level0, browseFlag, output_format,
+                                 out_dir);
+
+    if (!force_flag && thumbnail_up_to_date(file, thumb)) {
+        if (verbose) {
+            asfPrintStatus("%s%s (up to date)\n", spaces(level), base);
+        }
+        FREE(thumb);
+        FREE(base);
+        return;
+    }
+
+    // The same granule may be reached through more than one of its files
+    for (ii=0; ii<num_thumb_jobs; ++ii) {
+        if (strcmp(thumb_jobs[ii].thumb, thumb) == 0) {
+            FREE(thumb);
+            FREE(base);
+            return;
+        }
+    }
+
+    asfPrintStatus("%s%s\n", spaces(level), base);
+    FREE(base);
+
+    if (num_thumb_jobs == max_thumb_jobs) {
+        max_thumb_jobs = max_thumb_jobs ? 2*max_thumb_jobs : 64;
+        thumb_jobs = (thumb_job_t *)
+            realloc(thumb_jobs, sizeof(thumb_job_t)*max_thumb_jobs);
+        if (!thumb_jobs) {
+            asfPrintError("Out of memory queueing thumbnails\n");
+        }
+    }
+
+    thumb_job_t *job = &thumb_jobs[num_thumb_jobs++];
+    job->file = STRDUP(file);
+    job->thumb = thumb;
+    job->level0 = level0;
+    job->size = size;
+    job->verbose = verbose;
+    job->L0Flag = L0Flag;
+    job->scale_factor = scale_factor;
+    job->browseFlag = browseFlag;
+    job->saveMetadataFlag = saveMetadataFlag;
+    job->nPatchesFlag = nPatchesFlag;
+    job->nPatches = nPatches;
+    job->output_format = output_format;
+    job->out_dir = out_dir;
+}
+
+static void render_thumbnail(thumb_job_t *job)
+{
+    if (job->level0) {
+        generate_level0_thumbnail(job->file, job->size, job->verbose,
+                                  job->L0Flag, job->scale_factor,
+                                  job->browseFlag, job->saveMetadataFlag,
+                                  job->nPatchesFlag, job->nPatches,
+                                  job->output_format, job->out_dir);
+    }
+    else {
+        generate_ceos_thumbnail(job->file, job->size, job->output_format,
+                                job->out_dir, job->saveMetadataFlag,
+                                job->scale_factor, job->browseFlag);
+    }
+}
+
+// Renders all the queued thumbnails.  With more than one worker, every
+// granule is rendered in a process of its own (up to num_workers at a
+// time), so nothing a generator leaves behind -- open files, library
+// state, temporary directories -- can affect another granule.  A granule
+// that fails is reported, and the remaining ones are still rendered.
+static void render_thumbnails(int num_workers)
+{
+    int ii, failed = 0;
+
+    if (num_thumb_jobs == 0) {
+        asfPrintStatus("\nNo thumbnails need to be generated.\n");
+        return;
+    }
+    if (num_workers > num_thumb_jobs) {
+        num_workers = num_thumb_jobs;
+    }
+    asfPrintStatus("\nGenerating %d thumbnail%s using %d worker%s ...\n",
+                   num_thumb_jobs, num_thumb_jobs > 1 ? "s" : "",
+                   num_workers, num_workers > 1 ? "s" : "");
+
+    // Workers must not race to create the output directory
+    if (strlen(thumb_jobs[0].out_dir) && !is_dir(thumb_jobs[0].out_dir)) {
+        create_dir(thumb_jobs[0].out_dir);
+    }
+
+#ifndef win32
+    if (num_workers > 1) {
+        int next = 0, running = 0;
+
+        while (next < num_thumb_jobs || running > 0) {
+            if (next < num_thumb_jobs && running < num_workers) {
+                thumb_job_t *job = &thumb_jobs[next++];
+
+                // don't let the children flush our buffered output again
+                fflush(NULL);
+                job->pid = fork();
+                if (job->pid == 0) {
+                    render_thumbnail(job);
+                    exit(EXIT_SUCCESS);
+                }
+                else if (job->pid < 0) {
+                    asfPrintError("Could not start a worker for:\n    %s\n",
+                                  job->file);
+                }
+                ++running;
+            }
+            else {
+                int status;
+                pid_t pid = waitpid(-1, &status, 0);
+                if (pid < 0) {
+                    break;
+                }
+                --running;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+                    for (ii=0; ii<next; ++ii) {
+                        if (thumb_jobs[ii].pid == pid) {
+                            asfPrintWarning("Failed to generate a thumbnail for:\n"
+                                            "    %s\n", thumb_jobs[ii].file);
+                        }
+                    }
+                    ++failed;
+                }
+            }
+        }
+    }
+    else
+#endif
+    {
+        for (ii=0; ii<num_thumb_jobs; ++ii) {
+            render_thumbnail(&thumb_jobs[ii]);
+        }
+    }
+
+    if (failed) {
+        asfPrintStatus("\n%d of %d thumbnails could not be generated.\n",
+                       failed, num_thumb_jobs);
+    }
+
+    for (ii=0; ii<num_thumb_jobs; ++ii) {
+        FREE(thumb_jobs[ii].file);
+        FREE(thumb_jobs[ii].thumb);
+    }
+    free(thumb_jobs);
+    thumb_jobs = NULL;
+    num_thumb_jobs = max_thumb_jobs = 0;
+}
+
 void generate_level0_thumbnail(const char *file, int size, int verbose, level_0_flag L0Flag,
                                double scale_factor, int browseFlag, int saveMetadataFlag,
                                int nPatchesFlag, int nPatches,
@@ -850,7 +1116,13 @@ void generate_level0_thumbnail(const char *file, int size, int verbose, level_0_
     char t_stamp[32];
     t = time(NULL);
     strftime(t_stamp, 22, "%d%b%Y-%Hh_%Mm_%Ss", localtime(&t));
+#ifndef win32
+    // several workers may start on granules with the same name at once
+    sprintf(tmp_folder, "./create_thumbs_tmp_dir_%s_%s_%d", get_basename(file), t_stamp,
+            (int)getpid());
+#else
     sprintf(tmp_folder, "./create_thumbs_tmp_dir_%s_%s", get_basename(file), t_stamp);
+#endif
     if (!is_dir(tmp_folder)) {
         create_dir(tmp_folder);
         if (!is_dir(tmp_folder)) {
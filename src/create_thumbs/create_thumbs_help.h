@@ -32,14 +32,16 @@
         TOOL_NAME" [-log <logfile>] [-quiet] [-verbose] [-size <size>]\n"\
 "                 [-recursive] [-out-dir <dir>]\n"\
 "                 [-L0 <stf|ceos|jaxa_L0>] [-output-format <tiff|jpeg>]\n"\
-"                 [-scale <scale_factor>] [-browse] [-save-metadata] [-help]\n"\
+"                 [-scale <scale_factor>] [-browse] [-save-metadata]\n"\
+"                 [-workers <n>] [-force] [-help]\n"\
 "                 <files>"
 #else
 #define TOOL_USAGE \
         TOOL_NAME" [-log <logfile>] [-quiet] [-verbose] [-size <size>]\n"\
 "                 [-recursive] [-out-dir <dir>]\n"\
 "                 [-L0 <stf|ceos>] [-output-format <tiff|jpeg>]\n"\
-"                 [-scale <scale_factor>] [-browse] [-save-metadata] [-help]\n"\
+"                 [-scale <scale_factor>] [-browse] [-save-metadata]\n"\
+"                 [-workers <n>] [-force] [-help]\n"\
 "                 <files>"
 #endif
 
@@ -55,7 +57,10 @@
 "     The generated thumbnails have the same basename as the input\n"\
 "     file but with '_thumb.jpg' or '_thumb.tif' added.  If -browse\n"\
 "     is specified, the output file name will be the basename with\n"\
-"     just '.jpg' or '.tif' added."
+"     just '.jpg' or '.tif' added.\n\n"\
+"     All the input files are located first, then the thumbnails are\n"\
+"     generated, several at a time.  Thumbnails that already exist and\n"\
+"     are newer than their input file are skipped, unless -force is used."
 
 // TOOL_INPUT is required but is allowed to be an empty string
 #ifdef  TOOL_INPUT
@@ -145,6 +150,16 @@
 "          Results in all metadata files (intermediate and final) to be saved\n"\
 "          in the output directory.\n"\
 "\n"\
+"     -workers <n> (-w)\n"\
+"          Number of thumbnails to generate at the same time.  Each one is\n"\
+"          generated in a separate process.  The default is the number of\n"\
+"          processors, or the value of the ASF_NUM_THREADS environment\n"\
+"          variable.\n"\
+"\n"\
+"     -force (-f)\n"\
+"          Regenerate all thumbnails.  Without this option, thumbnails that\n"\
+"          are newer than their input file are left alone.\n"\
+"\n"\
 "     -help\n"\
 "          Print a help page and exit."
 #else
@@ -208,6 +223,16 @@
 "          Results in all metadata files (intermediate and final) to be saved\n"\
 "          in the output directory.\n"\
 "\n"\
+"     -workers <n> (-w)\n"\
+"          Number of thumbnails to generate at the same time.  Each one is\n"\
+"          generated in a separate process.  The default is the number of\n"\
+"          processors, or the value of the ASF_NUM_THREADS environment\n"\
+"          variable.\n"\
+"\n"\
+"     -force (-f)\n"\
+"          Regenerate all thumbnails.  Without this option, thumbnails that\n"\
+"          are newer than their input file are left alone.\n"\
+"\n"\
 "     -help\n"\
 "          Print a help page and exit."
 #endif
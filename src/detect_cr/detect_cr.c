@@ -117,8 +117,8 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 			   by more than this will be deleted.*/
 #define minSNR 0.3
 #define VERSION 1.0
-#define modX(x) ((x+srcSize)%srcSize)  /* Return x, wrapped to [0..srcSize-1] */
-#define modY(y) ((y+srcSize)%srcSize)  /* Return y, wrapped to [0..srcSize-1] */
+#define modX(x) ((x+size)%size)  /* Return x, wrapped to [0..size-1] */
+#define modY(y) ((y+size)%size)  /* Return y, wrapped to [0..size-1] */
 
 #define MAX_OFFSET_SCANSAR 1000   /* 1000 m = 2x geolocation accuracy ScanSAR */
 #define MAX_OFFSET_STANDARD 200   /* 200 m = 2x geolocation accuracy standard beam */
@@ -126,7 +126,6 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 
 /*Read-only, informational globals:*/
 int lines, samples;	     /* Lines and samples of source images. */
-int srcSize;                 /* Chip size for analysis */
 
 /* usage - enter here on command-line usage error*/
 void usage(char *name)
@@ -191,16 +190,66 @@ void help_page()
   exit(EXIT_SUCCESS);
 }
 
+/* Writes the output line of a corner reflector that has been through the
+   peak search (nothing is written if fpOut is NULL).  Returns TRUE if the
+   peak is outside the accuracy threshold, in which case the search needs
+   to be repeated. */
+static int reportPeak(FILE *fpOut, meta_parameters *meta, reflector_t *cr,
+		      char *projFile, float max_dx_pix, float max_dy_pix,
+		      int retry)
+{
+  float dx_pix, dy_pix, dx_m, dy_m;
+  double posX, posY, magnitude;
+  int outside;
+
+  if (projFile) { // chips that needed geocoding
+    latLon2proj(cr->lat, cr->lon, cr->elev, projFile, &posX, &posY);
+    dx_m = cr->peakY;
+    dy_m = cr->peakX;
+    magnitude = sqrt((posX-dx_m)*(posX-dx_m) + (posY-dy_m)*(posY-dy_m));
+    outside = !retry &&
+      !(fabs(posX-dx_m) < max_dx_pix || fabs(posY-dy_m) < max_dy_pix);
+    if (fpOut)
+      fprintf(fpOut, outside ?
+	    "**%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t(%10.1f)"
+	    "\t(%10.1f)\t%10.1f\t%10.1f\t%10.1f\n" :
+	    "%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
+	    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", cr->id, cr->lat, cr->lon,
+	    cr->elev, posX, posY, dx_m, dy_m, posX-dx_m, posY-dy_m, magnitude);
+  }
+  else { // chips without geocoding
+    dx_pix = cr->peakY;
+    dy_pix = cr->peakX;
+    dx_m = dx_pix * meta->general->x_pixel_size;
+    dy_m = dy_pix * meta->general->y_pixel_size;
+    magnitude = sqrt(dx_m*dx_m + dy_m*dy_m);
+    outside = !retry &&
+      !(fabs(dx_pix) < max_dx_pix || fabs(dy_pix) < max_dy_pix);
+    if (fpOut)
+      fprintf(fpOut, outside ?
+	    "**%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t(%10.1f)"
+	    "\t(%10.1f)\t%10.1f\t%10.1f\t%10.1f\n" :
+	    "%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
+	    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", cr->id, cr->lat, cr->lon,
+	    cr->elev, cr->posY, cr->posX, cr->posY+dy_pix, cr->posX+dx_pix,
+	    dy_m, dx_m, magnitude);
+  }
+  if (fpOut)
+    fflush(fpOut);
+
+  return outside;
+}
+
 /* Start of main progam */
 int main(int argc, char *argv[])
 {
-  char szImg[255], buffer[1000], crID[10], szCrList[255], szOut[255], tmp[255];
-  char *chips=NULL, *text=NULL, *projFile=NULL;
-  int ii;
-  float dx_pix, dy_pix, dx_m, dy_m, max_dx_pix, max_dy_pix;
-  double lat, lon, elev, posX, posY, magnitude;
+  char szImg[255], buffer[1000], szCrList[255], szOut[255], tmp[255];
+  char *projFile=NULL;
+  int ii, kk, n_crs, n_retry;
+  float max_dx_pix, max_dy_pix, *firstPeakX, *firstPeakY;
   FILE *fpIn, *fpOut;
   meta_parameters *meta;
+  reflector_t *crs, **list, **retry;
   flag_indices_t flags[NUM_FLAGS];
 
   /* Set all flags to 'not set' */
@@ -258,13 +307,6 @@ int main(int argc, char *argv[])
   lines = meta->general->line_count;
   samples = meta->general->sample_count;
 
-  /* Allocate memory for flags */
-  if(flags[f_CHIPS] != FLAG_NOT_SET ||
-     flags[f_GEOCODE] != FLAG_NOT_SET)
-    chips = (char *) MALLOC(255*sizeof(char));
-  if(flags[f_TEXT] != FLAG_NOT_SET)
-    text = (char *) MALLOC(255*sizeof(char));
-
   /* Handle input and output file */
   fpIn = FOPEN(szCrList, "r");
   fpOut = FOPEN(szOut, "w");
@@ -311,103 +353,96 @@ int main(int argc, char *argv[])
     }
   }
 
+  /* Read the corner reflector location file */
+  n_crs = 0;
+  while (fgets(buffer, 1000, fpIn))
+    n_crs++;
+  FSEEK(fpIn, 0, SEEK_SET);
+  crs = (reflector_t *) CALLOC(n_crs > 0 ? n_crs : 1, sizeof(reflector_t));
+  list = (reflector_t **) MALLOC((n_crs > 0 ? n_crs : 1)*sizeof(reflector_t *));
+  retry = (reflector_t **) MALLOC((n_crs > 0 ? n_crs : 1)*sizeof(reflector_t *));
+  firstPeakX = (float *) MALLOC((n_crs > 0 ? n_crs : 1)*sizeof(float));
+  firstPeakY = (float *) MALLOC((n_crs > 0 ? n_crs : 1)*sizeof(float));
+  for (ii=0; ii<n_crs && fgets(buffer, 1000, fpIn); ii++) {
+    reflector_t *cr = &crs[ii];
+    sscanf(buffer, "%s\t%lf\t%lf\t%lf", cr->id, &cr->lat, &cr->lon, &cr->elev);
+    meta_get_lineSamp(meta, cr->lat, cr->lon, cr->elev, &cr->posY, &cr->posX);
+    cr->size = CHIP_DEFAULT_SIZE;
+  }
+  n_crs = ii;
+  FCLOSE(fpIn);
+
   printf ("Going through the list of point targets ...\n\n");
 
-  /* Loop through corner reflector location file */
-  while (fgets(buffer, 1000, fpIn))
-  {
-    srcSize = CHIP_DEFAULT_SIZE;
-    sscanf(buffer, "%s\t%lf\t%lf\t%lf", crID, &lat, &lon, &elev);
-    meta_get_lineSamp(meta, lat, lon, elev, &posY, &posX);
-    if (chips || projFile)
-      sprintf(chips, "%s_%s", szImg, crID);
-    if (text)
-      sprintf(text, "%s_%s", szImg, crID);
-
-    /* Check bounds */
-    if (!(outOfBounds(posX, posY, srcSize)))
-      {
-	// Find peak
-	printf("Checking corner reflector %s ...\n", crID);
-	findPeak(posX, posY, elev, szImg, &dy_pix, &dx_pix, chips, text, projFile);
-	if (projFile) { // chips that needed geocoding
-	  latLon2proj(lat, lon, elev, projFile, &posX, &posY);
-	  dx_m = dx_pix;
-	  dy_m = dy_pix;
-	  magnitude = sqrt((posX-dx_m)*(posX-dx_m) + (posY-dy_m)*(posY-dy_m));
-
-	  // Check peak offset
-	  if (fabs(posX-dx_m) < max_dx_pix || fabs(posY-dy_m) < max_dy_pix) {
-	    fprintf(fpOut,"%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
-		    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posX, posY, dx_m, dy_m, posX-dx_m, posY-dy_m, magnitude);
-	    fflush(fpOut);
-	  }
-	  else { // Do the analysis on a smaller window
-	    fprintf(fpOut,"**%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t(%10.1f)"
-		    "\t(%10.1f)\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posX, posY, dx_m, dy_m, posX-dx_m, posY-dy_m, magnitude);
-	    fflush(fpOut);
-	    srcSize = max_dx_pix * 2;
-	    printf("   Warning: Corner reflector %s outside the accuracy "
-		   "threshold.\n", crID);
-	    printf("            Repeating analysis with smaller chip size "
-		   "(%ix%i).\n", srcSize, srcSize);
-	    findPeak(posX, posY, elev, szImg, &dy_m, &dx_m, chips, text, 
-		     projFile);
-	    magnitude = sqrt((posX-dx_m)*(posX-dx_m) + (posY-dy_m)*(posY-dy_m));
-	    fprintf(fpOut,"%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
-		    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posX, posY, dx_m, dy_m, posX-dx_m, posY-dy_m, magnitude);
-	    fflush(fpOut);
-	  }
-	}
-	else { // chips without geocoding
-	  dx_m = dx_pix * meta->general->x_pixel_size;
-	  dy_m = dy_pix * meta->general->y_pixel_size;
-	  magnitude = sqrt(dx_m*dx_m + dy_m*dy_m);
-	  
-	  // Check peak offset
-	  if (fabs(dx_pix) < max_dx_pix || fabs(dy_pix) < max_dy_pix) {
-	    fprintf(fpOut,"%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
-		    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posY, posX, posY+dy_pix, posX+dx_pix, dy_m, dx_m, magnitude);
-	    fflush(fpOut);
-	  }
-	  else { // Do the analysis on a smaller window
-	    fprintf(fpOut,"**%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t(%10.1f)"
-		    "\t(%10.1f)\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posY, posX, posY+dy_pix, posX+dx_pix, dy_m, dx_m, magnitude);
-	    fflush(fpOut);
-	    srcSize = max_dx_pix * 2;
-	    printf("   Warning: Corner reflector %s outside the accuracy "
-		   "threshold.\n", crID);
-	    printf("            Repeating analysis with smaller chip size "
-		   "(%ix%i).\n", srcSize, srcSize);
-	    findPeak(posX, posY, elev, szImg, &dy_pix, &dx_pix, chips, text, 
-		     projFile);
-	    dx_m = dx_pix * meta->general->x_pixel_size;
-	    dy_m = dy_pix * meta->general->y_pixel_size;
-	    magnitude = sqrt(dx_m*dx_m + dy_m*dy_m);
-	    fprintf(fpOut,"%s\t%10.4lf\t%10.4lf\t%8.1lf\t%10.1f\t%10.1f\t%10.1f"
-		    "\t%10.1f\t%10.1f\t%10.1f\t%10.1f\n", crID, lat, lon, elev, 
-		    posY, posX, posY+dy_pix, posX+dx_pix, dy_m, dx_m, magnitude);
-	    fflush(fpOut);
-	  }
-	}
-      }
-    else {
-      sprintf(tmp, "   WARNING: Corner reflector %s outside the image boundaries!\n",
-	      crID);
+  /* All reflectors inside the image are searched together, with a single
+     pass through the image to extract the chips */
+  int n_list = 0;
+  for (ii=0; ii<n_crs; ii++) {
+    if (!(outOfBounds(crs[ii].posX, crs[ii].posY, CHIP_DEFAULT_SIZE))) {
+      printf("Checking corner reflector %s ...\n", crs[ii].id);
+      list[n_list++] = &crs[ii];
+    }
+  }
+  findPeaks(meta, szImg, list, n_list, flags[f_CHIPS] != FLAG_NOT_SET,
+	    flags[f_TEXT] != FLAG_NOT_SET, projFile);
+
+  /* Check the peak offsets */
+  n_retry = 0;
+  for (ii=0; ii<n_list; ii++) {
+    reflector_t *cr = list[ii];
+    firstPeakX[ii] = cr->peakX;
+    firstPeakY[ii] = cr->peakY;
+    if (reportPeak(NULL, meta, cr, projFile, max_dx_pix, max_dy_pix, FALSE)) {
+      // Do the analysis on a smaller window
+      cr->size = max_dx_pix * 2;
+      cr->repeated = TRUE;
+      printf("   Warning: Corner reflector %s outside the accuracy "
+	     "threshold.\n", cr->id);
+      printf("            Repeating analysis with smaller chip size "
+	     "(%ix%i).\n", cr->size, cr->size);
+      retry[n_retry++] = cr;
+    }
+  }
+
+  /* Repeat the search for the reflectors outside the accuracy threshold */
+  if (n_retry > 0)
+    findPeaks(meta, szImg, retry, n_retry, flags[f_CHIPS] != FLAG_NOT_SET,
+	      flags[f_TEXT] != FLAG_NOT_SET, projFile);
+
+  /* Write the results in the order of the corner reflector file */
+  for (ii=0, kk=0; ii<n_crs; ii++) {
+    reflector_t *cr = &crs[ii];
+    if (outOfBounds(cr->posX, cr->posY, CHIP_DEFAULT_SIZE)) {
+      sprintf(tmp, "   WARNING: Corner reflector %s outside the image "
+	      "boundaries!\n", cr->id);
       printf(tmp);
       fprintf(fpOut, tmp);
+      continue;
+    }
+    if (cr->repeated) {
+      // Result of the first search, followed by the repeated one
+      float peakX = cr->peakX, peakY = cr->peakY;
+      cr->peakX = firstPeakX[kk];
+      cr->peakY = firstPeakY[kk];
+      reportPeak(fpOut, meta, cr, projFile, max_dx_pix, max_dy_pix, FALSE);
+      cr->peakX = peakX;
+      cr->peakY = peakY;
     }
+    reportPeak(fpOut, meta, cr, projFile, max_dx_pix, max_dy_pix, 
+	       cr->repeated);
+    kk++;
   }
-  FCLOSE(fpIn);
   FCLOSE(fpOut);
-  FREE(meta);
 
   /* Clean up */
+  for (ii=0; ii<n_crs; ii++)
+    if (crs[ii].chip) FREE(crs[ii].chip);
+  FREE(crs);
+  FREE(list);
+  FREE(retry);
+  FREE(firstPeakX);
+  FREE(firstPeakY);
+  meta_free(meta);
   sprintf(tmp, "rm -rf tmp*");
   asfSystem(tmp);
 
@@ -423,133 +458,230 @@ bool outOfBounds(int x, int y, int srcSize)
   return FALSE;
 }
 
+static int compareChipStart(const void *a, const void *b)
+{
+  const reflector_t *cr1 = *(const reflector_t **) a;
+  const reflector_t *cr2 = *(const reflector_t **) b;
+  int y1 = (int) cr1->posY - cr1->size/2 + 1;
+  int y2 = (int) cr2->posY - cr2->size/2 + 1;
+  return (y1 > y2) - (y1 < y2);
+}
 
-/*FindPeak: 
-  This version of findPeak just determines the maxium amplitude value and checks
-  whether it is actually the peak for the neighborhood.
-*/
-bool findPeak(int x, int y, float elev, char *szImg, float *peakX, float *peakY, 
-	      char *chip, char *text, char *projFile)
+/* Extracts the chips of all the given reflectors, centered on their
+   expected location, in one pass through the image: every image line
+   that is in at least one chip is read once.  Parts of a chip outside
+   the image are set to zero. */
+static void readChips(meta_parameters *meta, char *szImg, reflector_t **crs,
+		      int n)
+{
+  FILE *fp;
+  char dataFileName[255];
+  reflector_t **sorted, **active;
+  float *buffer;
+  int ii, kk, line, next, n_active;
+
+  if (n == 0)
+    return;
+  if (meta->general->data_type > 5)
+    asfPrintError("Corner reflector detection does not work on complex "
+		  "data!\n");
+
+  sorted = (reflector_t **) MALLOC(n*sizeof(reflector_t *));
+  active = (reflector_t **) MALLOC(n*sizeof(reflector_t *));
+  memcpy(sorted, crs, n*sizeof(reflector_t *));
+  qsort(sorted, n, sizeof(reflector_t *), compareChipStart);
+  for (ii=0; ii<n; ii++) {
+    reflector_t *cr = sorted[ii];
+    if (cr->chip) FREE(cr->chip);
+    cr->lines = cr->samples = cr->size;
+    cr->chip = (float *) CALLOC(cr->size*cr->size, sizeof(float));
+  }
+
+  buffer = (float *) MALLOC(samples*sizeof(float));
+  create_name(dataFileName, szImg, ".img");
+  fp = FOPEN(dataFileName, "rb");
+
+  next = n_active = 0;
+  line = (int) sorted[0]->posY - sorted[0]->size/2 + 1;
+  if (line < 0) line = 0;
+  while (line < lines && (next < n || n_active > 0)) {
+    // Chips starting on this line become active
+    while (next < n &&
+	   (int) sorted[next]->posY - sorted[next]->size/2 + 1 <= line)
+      active[n_active++] = sorted[next++];
+    if (n_active == 0) {
+      // Skip to the start of the next chip
+      line = (int) sorted[next]->posY - sorted[next]->size/2 + 1;
+      continue;
+    }
+
+    get_float_line(fp, meta, line, buffer);
+    for (ii=0; ii<n_active; ) {
+      reflector_t *cr = active[ii];
+      int y0 = (int) cr->posY - cr->size/2 + 1;
+      int x0 = (int) cr->posX - cr->size/2 + 1;
+      float *row = &cr->chip[(line - y0)*cr->size];
+      if (line - y0 >= 0)
+	for (kk=0; kk<cr->size; kk++)
+	  if (x0+kk >= 0 && x0+kk < samples)
+	    row[kk] = buffer[x0+kk];
+      // Chips ending on this line are done
+      if (line - y0 == cr->size - 1)
+	active[ii] = active[--n_active];
+      else
+	ii++;
+    }
+    line++;
+  }
+
+  FCLOSE(fp);
+  FREE(buffer);
+  FREE(sorted);
+  FREE(active);
+}
+
+/* Writes out the chip files requested on the command line, and geocodes
+   the chip when a projection parameter file is given.  The geocoded chip
+   replaces the image chip. */
+static void writeChip(meta_parameters *meta, char *szImg, reflector_t *cr,
+		      int writeChips, int writeText, char *projFile)
 {
   FILE *fpChip, *fpText;
-  meta_parameters *meta, *metaChip, *metaText;
+  meta_parameters *metaChip;
   project_parameters_t pps;
   projection_type_t proj_type;
   datum_type_t datum;
   spheroid_type_t spheroid;
-  static float *s=NULL;
-  float max=-10000000.0;
-  char szChip[255], szText[255], szChipGeo[255];
-  int ii, kk, bestX, bestY, lines, samples;
-  float bestLocX, bestLocY;
+  char chip[255], szChip[255], szText[255], szChipGeo[255];
+  int ii, kk;
   double lat, lon;
-  
-  meta = meta_read(szImg); 
-
-  /* Allocate working arrays */
-  if (s == NULL) {
-    s = (float *)(MALLOC(srcSize*srcSize*sizeof(float)));
-  }  
-
-  /* At each corner reflector location read in a chunk of the image */
-  readSubset(szImg, srcSize, srcSize, x-srcSize/2+1, y-srcSize/2+1, s);
-  lines = srcSize;
-  samples = srcSize;
-
-  /* Write out chip if name is given */
-  if (chip && srcSize==CHIP_DEFAULT_SIZE) {
-    metaChip = meta_read(szImg);
-    metaChip->general->line_count = lines;
-    metaChip->general->sample_count = samples;
-    metaChip->general->start_line = y-srcSize/2+1;
-    metaChip->general->start_sample = x-srcSize/2+1;
-    meta_get_latLon(metaChip, lines/2, samples/2, elev, &lat, &lon);
+
+  sprintf(chip, "%s_%s", szImg, cr->id);
+
+  /* Write out chip (also needed for geocoding) and/or its text version */
+  if ((writeChips || writeText || projFile) && cr->size==CHIP_DEFAULT_SIZE) {
+    metaChip = meta_copy(meta);
+    metaChip->general->line_count = cr->lines;
+    metaChip->general->sample_count = cr->samples;
+    metaChip->general->start_line = (int) cr->posY - cr->size/2 + 1;
+    metaChip->general->start_sample = (int) cr->posX - cr->size/2 + 1;
+    meta_get_latLon(metaChip, cr->lines/2, cr->samples/2, cr->elev, 
+		    &lat, &lon);
     metaChip->general->center_latitude = lat;
     metaChip->general->center_longitude = lon;
-    
     meta_write(metaChip, chip);
-    sprintf(szChip, "%s.img", chip);
-    fpChip = FOPEN(szChip, "wb");
-    put_float_lines(fpChip, metaChip, 0, lines, s);
-    FCLOSE(fpChip);
-    meta_free(metaChip);
-    printf("Wrote '%s' to disk\n", szChip);
-  }
 
-  /* Write out text file for chip if name is given */
-  if (text && srcSize==CHIP_DEFAULT_SIZE) {
-    metaText = meta_read(szImg);
-    metaText->general->line_count = lines;
-    metaText->general->sample_count = samples;
-    metaText->general->start_line = y-srcSize/2+1;
-    metaText->general->start_sample = x-srcSize/2+1;
-    meta_get_latLon(metaText, lines/2, samples/2, elev, &lat, &lon);
-    metaText->general->center_latitude = lat;
-    metaText->general->center_longitude = lon;
-
-    meta_write(metaText, text);
-    sprintf(szText, "%s_chip.txt", text);
-    fpText = FOPEN(szText, "w");
-    for (ii=0; ii<srcSize; ii++) {
-      for (kk=0; kk<srcSize; kk++)
-	fprintf(fpText, "%12.4f\t", s[ii*srcSize+kk]);
-      fprintf(fpText, "\n");
+    if (writeChips || projFile) {
+      sprintf(szChip, "%s.img", chip);
+      fpChip = FOPEN(szChip, "wb");
+      put_float_lines(fpChip, metaChip, 0, cr->lines, cr->chip);
+      FCLOSE(fpChip);
+      printf("Wrote '%s' to disk\n", szChip);
+    }
+    if (writeText) {
+      sprintf(szText, "%s_chip.txt", chip);
+      fpText = FOPEN(szText, "w");
+      for (ii=0; ii<cr->lines; ii++) {
+	for (kk=0; kk<cr->samples; kk++)
+	  fprintf(fpText, "%12.4f\t", cr->chip[ii*cr->samples+kk]);
+	fprintf(fpText, "\n");
+      }
+      FCLOSE(fpText);
+      printf("Wrote '%s' to disk\n", szText);
     }
-    FCLOSE(fpText);
-    meta_free(metaText);
-    printf("Wrote '%s' to disk\n", szText);
+    meta_free(metaChip);
   }
 
   // Geocode to the height of the point target before analyzing when projection 
   // parameter file is passed in. Geocoded chip needs to be read in again.
   if (projFile) {
     char **err=NULL;
-    FREE(s);
-    s = NULL;
     sprintf(szChipGeo, "%s_geo", chip);
     metaChip = meta_read(chip);
     if (!parse_proj_args_file(projFile, &pps, &proj_type, &datum, &spheroid,
 			      &err)) {
       asfPrintError("%s",err);
     }
-    asf_geocode (&pps, proj_type, 0, RESAMPLE_BILINEAR, elev, datum,
+    asf_geocode (&pps, proj_type, 0, RESAMPLE_BILINEAR, cr->elev, datum,
 	 metaChip->general->x_pixel_size, NULL, chip, szChipGeo, 0.0, 0);
-    meta = meta_read(szChipGeo);
-    lines = meta->general->line_count;
-    samples= meta->general->sample_count;
-    s = (float *)(MALLOC(lines*samples*sizeof(float)));
+    meta_free(metaChip);
+
+    metaChip = meta_read(szChipGeo);
+    cr->lines = metaChip->general->line_count;
+    cr->samples = metaChip->general->sample_count;
+    cr->startX = metaChip->projection->startX;
+    cr->startY = metaChip->projection->startY;
+    cr->perX = metaChip->projection->perX;
+    cr->perY = metaChip->projection->perY;
+    FREE(cr->chip);
+    cr->chip = (float *)(MALLOC(cr->lines*cr->samples*sizeof(float)));
     sprintf(szChipGeo, "%s_geo.img", chip);    
     fpChip = FOPEN(szChipGeo, "rb");
-    get_float_lines(fpChip, metaChip, 0, lines, s);
+    get_float_lines(fpChip, metaChip, 0, cr->lines, cr->chip);
     FCLOSE(fpChip);
     meta_free(metaChip);
   }
+}
+
+typedef struct {
+  reflector_t **crs;
+  int geocoded;
+} peak_params_t;
+
+/* Determines the maximum amplitude value in a chip and refines its
+   location with topOffPeak().  Only touches the given reflector, so the
+   chips can be analyzed concurrently. */
+static void analyzePeak(int i, int thread, void *params)
+{
+  peak_params_t *p = (peak_params_t *) params;
+  reflector_t *cr = p->crs[i];
+  float max=-10000000.0;
+  float bestLocX, bestLocY;
+  int ii, kk, bestX, bestY;
 
   /* Search for the amplitude peak */
   bestX=bestY=0;
-  for (ii=0; ii<lines; ii++)
-    for (kk=0; kk<samples; kk++)
-      if (s[ii*samples+kk] > max) {
+  for (ii=0; ii<cr->lines; ii++)
+    for (kk=0; kk<cr->samples; kk++)
+      if (cr->chip[ii*cr->samples+kk] > max) {
 	bestX = ii;
 	bestY = kk;
-	max = s[ii*samples+kk];
+	max = cr->chip[ii*cr->samples+kk];
       }
   
-  topOffPeak(s,bestX,bestY,lines,&bestLocX,&bestLocY);
-  if (projFile) {
-    metaChip = meta_read(szChipGeo);
-    *peakX = metaChip->projection->startY +
-      metaChip->projection->perY * bestLocX;
-    *peakY = metaChip->projection->startX + 
-      metaChip->projection->perX * bestLocY;
-    meta_free(metaChip);
+  topOffPeak(cr->chip, bestX, bestY, cr->lines, cr->size, 
+	     &bestLocX, &bestLocY);
+  if (p->geocoded) {
+    cr->peakX = cr->startY + cr->perY * bestLocX;
+    cr->peakY = cr->startX + cr->perX * bestLocY;
   }
   else {
-    *peakX = bestLocX - srcSize/2;
-    *peakY = bestLocY - srcSize/2;
+    cr->peakX = bestLocX - cr->size/2;
+    cr->peakY = bestLocY - cr->size/2;
   }
+}
+
+/*FindPeaks: 
+  Peak search for a list of corner reflectors.  The chips of all of them
+  are read in one pass through the image; each chip's peak is then found by
+  determining the maximum amplitude value and checking whether it is
+  actually the peak for the neighborhood.  The chips are analyzed in
+  parallel; writing the chip files and geocoding are done one at a time.
+*/
+void findPeaks(meta_parameters *meta, char *szImg, reflector_t **crs, int n,
+	       int writeChips, int writeText, char *projFile)
+{
+  peak_params_t params;
+  int ii;
+
+  readChips(meta, szImg, crs, n);
+  if (writeChips || writeText || projFile)
+    for (ii=0; ii<n; ii++)
+      writeChip(meta, szImg, crs[ii], writeChips, writeText, projFile);
 
-  return TRUE;
+  params.crs = crs;
+  params.geocoded = projFile != NULL;
+  asf_parallel_for(n, analyzePeak, &params);
 }
 
 
@@ -559,7 +691,7 @@ bool findPeak(int x, int y, float elev, char *szImg, float *peakX, float *peakY,
    exact (i.e. float) top. This works by finding the peak of a parabola which 
    goes though the highest point, and the three points surrounding it.
 */
-void topOffPeak(float *peaks,int i,int j,int maxI,float *di,float *dj)
+void topOffPeak(float *peaks,int i,int j,int maxI,int size,float *di,float *dj)
 {
         float a,b,c,d;
         a=peaks[modY(j)*maxI+modX(i-1)];
@@ -4,6 +4,7 @@
 #define FLAG_SET 1
 #define FLAG_NOT_SET -1
 #include "ifm.h"
+#include "asf_meta.h"
 
 /* Index keys for all flags used in this program via a 'flags' array */
 typedef enum {
@@ -28,10 +29,26 @@ void print_error(char *msg);
 void check_return(int ret, char *msg);
 void pixel_type_flag_looker(int *flag_count, char *flags_used, char *flagName);
 
+/* A corner reflector, its image chip and the result of the peak search */
+typedef struct {
+  char id[10];
+  double lat, lon, elev;   /* Reference location */
+  double posX, posY;       /* Expected sample and line from the metadata */
+  int size;                /* Chip size for the peak search */
+  int repeated;            /* Search repeated with a different chip size */
+  float *chip;             /* Chip amplitudes, lines x samples */
+  int lines, samples;
+  double startX, startY;   /* Map coordinates of a geocoded chip */
+  double perX, perY;
+  float peakX, peakY;      /* Peak: line/sample offset from the chip center,
+			      or map y/x for geocoded chips */
+} reflector_t;
+
 /* Prototypes */
-void topOffPeak(float *peaks, int i, int j, int maxI, float *di, float *dj);
-bool findPeak(int x, int y, float elev, char *szImg, float *peakX, float *peakY, 
-	      char *chip, char *text, char *projFile);
+void topOffPeak(float *peaks, int i, int j, int maxI, int size,
+		float *di, float *dj);
+void findPeaks(meta_parameters *meta, char *szImg, reflector_t **crs, int n,
+	       int writeChips, int writeText, char *projFile);
 bool outOfBounds(int x, int y, int srcSize);
 
 #endif
@@ -159,6 +159,19 @@ int ardop(struct INPUT_ARDOP_PARAMS * params_in)
         while (params.fd-old_dop> 0.5) params.fd-=1.0;
     }
 
+/*Optionally show how the doppler varies along the image.*/
+    if (params_in->dopTable && *params_in->dopTable > 0)
+    {
+        int nBlocks=*params_in->dopTable;
+        float *a=(float *)MALLOC(sizeof(float)*nBlocks);
+        float *b=(float *)MALLOC(sizeof(float)*nBlocks);
+        float *c=(float *)MALLOC(sizeof(float)*nBlocks);
+        estdop_along_track(params.in1, 1000, nBlocks, a, b, c);
+        FREE(a);
+        FREE(b);
+        FREE(c);
+    }
+
 /*Copy fields from ARDOP_PARAMS struct to meta_parameters struct.*/
     meta->sar->image_type              = 'S';        /*Slant range image*/
     meta->sar->look_count              = params.nlooks;
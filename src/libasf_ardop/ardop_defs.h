@@ -160,6 +160,8 @@ typedef struct {
 int ardop(struct INPUT_ARDOP_PARAMS * params);
 double fftEstDop(getRec *inFile,int startLine,int xStride,int nLines);
 void estdop(char file[], int nDopLines, float *a, float *b,float *c);
+void estdop_along_track(char file[], int nDopLines, int nBlocks,
+                        float *a, float *b, float *c);
 void calc_range_ref(complexFloat *range_ref, int rangeFFT, int refLen);
 void elapse(int fnc);
 void multilook(complexFloat *patch,int n_range,int nlooks, float *pwrs);
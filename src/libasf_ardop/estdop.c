@@ -14,6 +14,12 @@ DESCRIPTION:
     Calculates the doppler centroid in % of PRF by estimating from
     the raw signal data.
 
+    The lag-one azimuth correlation is accumulated for every range
+    sample.  Signal lines are read in blocks, and each block is split
+    into strips of range samples that are accumulated on separate
+    threads.  estdop_along_track() repeats the estimate at several
+    places along the image to show how the centroid varies.
+
 RETURN VALUE:
 
 SPECIAL CONSIDERATIONS:
@@ -30,71 +36,117 @@ PROGRAM HISTORY:
 #include "ardop_defs.h"
 #include "estdop.h"
 
-void estdop(char file[],int nDopLines, float *a, float *b,float *c)
-{
 #define MULTILOOK 100
-    complexFloat        *signal, *signalNext, *dop;
-    float         *x_vec, *y_vec,*phase;
-    int           x,line,firstLine;
-    getRec *r;
-    float         t1, t2, t3;
-    long double sum;
-    float lastPhase;
+#define DOP_BLOCK_LINES 64      /* signal lines read at a time */
+#define DOP_STRIP_SAMPLES 1024  /* range samples per work item */
 
-    r=fillOutGetRec(file);
-    firstLine=(r->nLines-nDopLines)/2;
+typedef struct {
+    complexFloat *lines;        /* [nRows][nSamples] block of signal lines */
+    int nRows;                  /* lines in the block, including the
+                                   last line of the previous block */
+    int nSamples;
+    float *dopR, *dopI;         /* [nSamples] correlation sums */
+} dop_block_t;
+
+/* Adds next*conj(this) over all line pairs of the block, for one strip
+   of range samples.  Real and imaginary sums are kept in separate
+   arrays so that the inner loop vectorizes.  */
+static void dop_strip(int strip, int thread, void *params)
+{
+    dop_block_t *b = (dop_block_t *) params;
+    int x0 = strip*DOP_STRIP_SAMPLES;
+    int x1 = x0 + DOP_STRIP_SAMPLES < b->nSamples ?
+        x0 + DOP_STRIP_SAMPLES : b->nSamples;
+    float *dopR = b->dopR, *dopI = b->dopI;
+    int y, x;
+
+    for (y = 1; y < b->nRows; y++)
+    {
+        const complexFloat *s = &b->lines[(long)(y-1)*b->nSamples];
+        const complexFloat *n = &b->lines[(long)y*b->nSamples];
+        for (x = x0; x < x1; x++)
+        {
+            dopR[x] += n[x].real*s[x].real + n[x].imag*s[x].imag;
+            dopI[x] += n[x].imag*s[x].real - n[x].real*s[x].imag;
+        }
+    }
+}
 
-    signal=(complexFloat *)MALLOC(sizeof(complexFloat)*r->nSamples);
-    signalNext=(complexFloat *)MALLOC(sizeof(complexFloat)*r->nSamples);
-    dop=(complexFloat *)MALLOC(sizeof(complexFloat)*r->nSamples);
-    x_vec=(float *)MALLOC(sizeof(float)*r->nSamples);
-    y_vec=(float *)MALLOC(sizeof(float)*r->nSamples);
-    phase=(float *)MALLOC(sizeof(float)*r->nSamples);
+/* Lag-one azimuth correlation of lines firstLine .. firstLine+nDopLines-1,
+   summed into dopR/dopI.  */
+static void dop_accumulate(getRec *r, int firstLine, int nDopLines,
+                           float *dopR, float *dopI)
+{
+    dop_block_t b;
+    int nSamples = r->nSamples;
+    int nStrips = (nSamples + DOP_STRIP_SAMPLES - 1)/DOP_STRIP_SAMPLES;
+    int line, x;
+
+    b.nSamples = nSamples;
+    b.dopR = dopR;
+    b.dopI = dopI;
+    b.lines = (complexFloat *)
+        MALLOC(sizeof(complexFloat)*(DOP_BLOCK_LINES+1)*nSamples);
 
-    for (x = 0; x<r->nSamples; x++)
-        dop[x] = Czero();
+    for (x = 0; x < nSamples; x++)
+        dopR[x] = dopI[x] = 0.0;
 
-    getSignalLine(r,firstLine,signalNext,0,r->nSamples);
-    for (line = firstLine+1; line < firstLine+nDopLines; line++)
+    /* The reader is not thread safe, so the lines are read here, and
+       only the accumulation is spread over the threads.  */
+    getSignalLine(r,firstLine,b.lines,0,nSamples);
+    for (line = firstLine+1; line < firstLine+nDopLines; line += b.nRows-1)
     {
-        complexFloat *ptr = signal; signal = signalNext; signalNext = ptr;
-        getSignalLine(r,line,signalNext,0,r->nSamples);
-        for (x = 0; x<r->nSamples; x++)
-            dop[x] = Cadd(dop[x],Cmul(signalNext[x],Cconj(signal[x])));
+        int i, n = firstLine+nDopLines-line;
+        if (n > DOP_BLOCK_LINES) n = DOP_BLOCK_LINES;
+        for (i = 0; i < n; i++)
+            getSignalLine(r,line+i,&b.lines[(long)(i+1)*nSamples],0,nSamples);
+        b.nRows = n+1;
+        asf_parallel_for(nStrips, dop_strip, &b);
+
+        /* Keep the last line: it pairs with the first of the next block. */
+        memcpy(b.lines, &b.lines[(long)n*nSamples],
+               sizeof(complexFloat)*nSamples);
     }
 
-    /*Multilook the phase data along range.*/
-    for (x=0;x<r->nSamples/MULTILOOK;x++)
+    FREE(b.lines);
+}
+
+/* Multilooks the correlation in range, unwraps its phase, and fits the
+   doppler (in % of PRF) as a constant, a line, and a quadratic in range.
+   Returns the coefficients of the quadratic, and the constant average.  */
+static float dop_fit(const float *dopR, const float *dopI, int nSamples,
+                     int verbose, float *a, float *b, float *c)
+{
+    int nLooks = nSamples/MULTILOOK;
+    float *x_vec, *y_vec;
+    float t1, t2, t3;
+    long double sum;
+    float lastPhase;
+    int x;
+
+    x_vec=(float *)MALLOC(sizeof(float)*nSamples);
+    y_vec=(float *)MALLOC(sizeof(float)*nSamples);
+
+    /*Multilook the phase data along range, and phase-unwrap it.*/
+    sum = 0.0;
+    lastPhase=0;
+    for (x=0;x<nLooks;x++)
     {
         int i;
         double out_r=0.0,out_i=0.0;
         for (i=0;i<MULTILOOK;i++)
         {
-            out_r+=dop[x*MULTILOOK+i].real;
-            out_i+=dop[x*MULTILOOK+i].imag;
+            out_r+=dopR[x*MULTILOOK+i];
+            out_i+=dopI[x*MULTILOOK+i];
         }
-        dop[x].real = out_r;
-        dop[x].imag = out_i;
-    }
-
-    /*Phase-unwrap the doppler values into the "phase" array.*/
-    lastPhase=0;
-    for (x=0;x<r->nSamples/MULTILOOK;x++)
-    {
-        float nextPhase=atan2(dop[x].imag, dop[x].real)*(1.0/(2.0*pi));
+        float nextPhase=atan2((float)out_i, (float)out_r)*(1.0/(2.0*pi));
         while ((nextPhase-lastPhase)<-0.5) nextPhase+=1.0;
         while ((nextPhase-lastPhase)>0.5) nextPhase-=1.0;
-        phase[x]=nextPhase;
         lastPhase=nextPhase;
-    }
-
-    sum = 0.0;
 
-    for (x = 0; x<r->nSamples/MULTILOOK; x++)
-    {
-        sum += phase[x];
+        sum += nextPhase;
         x_vec[x] = x*MULTILOOK;
-        y_vec[x] = phase[x];
+        y_vec[x] = nextPhase;
     }
 
 // Don't output this file for now since none of our other software uses it
@@ -102,38 +154,108 @@ void estdop(char file[],int nDopLines, float *a, float *b,float *c)
 //    if (1) /*Output doppler vs. range*/
 //    {
 //        FILE *f=FOPEN("dop_vs_rng","w");
-//        for (x=0;x<r->nSamples/MULTILOOK;x++)
+//        for (x=0;x<nLooks;x++)
 //            fprintf(f,"%.0f\t%f\n",x_vec[x],y_vec[x]);
 //        fclose(f);
 //    }
 
-    sum = sum / (r->nSamples/MULTILOOK);
-    if (!quietflag) printf("   Constant Average    : y = %f\n",(float)sum);
-    if (logflag) {
+    sum = sum / nLooks;
+    if (verbose && !quietflag) printf("   Constant Average    : y = %f\n",(float)sum);
+    if (verbose && logflag) {
       sprintf(logbuf,"   Constant Average    : y = %f\n",(float)sum);
       printLog(logbuf);
     }
-    yaxb(x_vec, y_vec, r->nSamples/MULTILOOK, &t1, &t2);
-    if (!quietflag) printf("   Linear Regression   : y = %f x + %f\n",t1,t2);
-    if (logflag) {
+    yaxb(x_vec, y_vec, nLooks, &t1, &t2);
+    if (verbose && !quietflag) printf("   Linear Regression   : y = %f x + %f\n",t1,t2);
+    if (verbose && logflag) {
       sprintf(logbuf,"   Linear Regression   : y = %f x + %f\n",t1,t2);
       printLog(logbuf);
     }
-    yax2bxc(x_vec, y_vec, r->nSamples/MULTILOOK, &t1, &t2, &t3);
-    if (!quietflag) printf("   Quadratic Regression: y = %f x^2 + %f x + %f\n",t1,t2,t3);
-    if (logflag) {
+    yax2bxc(x_vec, y_vec, nLooks, &t1, &t2, &t3);
+    if (verbose && !quietflag) printf("   Quadratic Regression: y = %f x^2 + %f x + %f\n",t1,t2,t3);
+    if (verbose && logflag) {
       sprintf(logbuf,"   Quadratic Regression: y = %f x^2 + %f x + %f\n",t1,t2,t3);
       printLog(logbuf);
     }
     *a = t3; *b = t2; *c = t1;
 
-    free((void *)signal);
-    free((void *)signalNext);
-    free((void *)dop);
-    free((void *)x_vec);
-    free((void *)y_vec);
-    free((void *)phase);
+    FREE(x_vec);
+    FREE(y_vec);
+
+    return (float)sum;
+}
+
+void estdop(char file[],int nDopLines, float *a, float *b,float *c)
+{
+    getRec *r;
+    float *dopR, *dopI;
+    int firstLine;
+
+    r=fillOutGetRec(file);
+    firstLine=(r->nLines-nDopLines)/2;
+
+    dopR=(float *)MALLOC(sizeof(float)*r->nSamples);
+    dopI=(float *)MALLOC(sizeof(float)*r->nSamples);
+
+    dop_accumulate(r, firstLine, nDopLines, dopR, dopI);
+    dop_fit(dopR, dopI, r->nSamples, TRUE, a, b, c);
+
+    FREE(dopR);
+    FREE(dopI);
     freeGetRec(r);
+}
 
-    return;
- }
+/****************************************************************
+estdop_along_track:
+    Estimates the doppler as estdop() does, but over nBlocks sets of
+nDopLines lines spread evenly from the start to the end of the image.
+The quadratic coefficients for block k go to a[k], b[k] and c[k]; the
+constant terms are unwrapped from block to block.  A table of the
+centroid at near, mid and far range along the image is printed.
+*/
+void estdop_along_track(char file[], int nDopLines, int nBlocks,
+                        float *a, float *b, float *c)
+{
+    getRec *r;
+    float *dopR, *dopI;
+    int k, nSamples;
+
+    r=fillOutGetRec(file);
+    nSamples=r->nSamples;
+    if (nDopLines > r->nLines) nDopLines = r->nLines;
+
+    dopR=(float *)MALLOC(sizeof(float)*nSamples);
+    dopI=(float *)MALLOC(sizeof(float)*nSamples);
+
+    if (!quietflag) printf("   Doppler along track (%% of PRF):\n"
+                           "   %10s %10s %10s %10s\n",
+                           "Line", "Near", "Mid", "Far");
+    for (k=0; k<nBlocks; k++)
+    {
+        int firstLine = nBlocks > 1 ?
+            (int)((r->nLines-nDopLines)*k/(nBlocks-1)) :
+            (int)((r->nLines-nDopLines)/2);
+        dop_accumulate(r, firstLine, nDopLines, dopR, dopI);
+        dop_fit(dopR, dopI, nSamples, FALSE, &a[k], &b[k], &c[k]);
+
+        /* Resolve the ambiguity from the previous block. */
+        if (k > 0) {
+            while (a[k]-a[k-1]<-0.5) a[k]+=1.0;
+            while (a[k]-a[k-1]> 0.5) a[k]-=1.0;
+        }
+
+        if (!quietflag || logflag) {
+            double mid = nSamples/2, far = nSamples-1;
+            sprintf(logbuf,"   %10d %10f %10f %10f\n",
+                    firstLine + nDopLines/2, a[k],
+                    a[k] + b[k]*mid + c[k]*mid*mid,
+                    a[k] + b[k]*far + c[k]*far*far);
+            if (!quietflag) printf("%s",logbuf);
+            if (logflag) printLog(logbuf);
+        }
+    }
+
+    FREE(dopR);
+    FREE(dopI);
+    freeGetRec(r);
+}
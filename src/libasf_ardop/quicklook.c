@@ -26,8 +26,8 @@ EXTERNAL ASSOCIATES:
     The basic call sequence is:
 
 >main.c figures out the various chirp parameters and calls specan_file.c:
-    >specan_file.c (which can be make MPI-parallel by setting "MPI=1")
-     loops through each azimuth patch of data and calls
+    >specan_file.c loops through the azimuth patches of data,
+     several at a time on a pool of threads, and calls
         >specan_process_patch (in specan_patch.c) figures out
          how to break patch into patchlets, calls
             >specan_process (in specan.c)
@@ -8,9 +8,10 @@ compressing in range or azimuth-- in fact,
 this routine only does one at a time.
 */
 #include "asf.h"
-#include "asf_meta.h"
+#include "asf_meta.h"
 #include "ardop_defs.h" /* for complexFloat, cfft1d */
 #include "specan.h"
+#include "fft.h"
 
 /*Returns i mapped, mod fs, onto [-fs/2,fs/2)*/
 double mapHalf(double fs,double i);
@@ -95,6 +96,19 @@ void specan_init(specan_struct *s)
 	
 }
 
+/*Sets up the FFT tables for this dimension.  specan_process
+does not, so that several threads can process patches at once:
+call this (serially) for both dimensions before processing.*/
+void specan_fft_init(specan_struct *s)
+{
+	int m=(int)(log(s->fftLen)/log(2.0)+0.5);
+	int ret=fftInit(m);
+	if (ret!=0) {
+		sprintf(errbuf,"   ERROR: Problem %d in FFT!\n",ret);
+		printErr(errbuf);
+	}
+}
+
 /*Perform SPECAN SAR Processing.*/
 void specan_process(specan_struct *s,complexFloat *input,complexFloat *output)
 {
@@ -106,8 +120,7 @@ void specan_process(specan_struct *s,complexFloat *input,complexFloat *output)
 	for (i=0;i<len;i++)
 		xform[i]=Cmul(input[i],deramp[i]);
 	
-/*FFT:*/
-	cfft1d(len,xform,0);
+/*FFT (tables set up by specan_fft_init):*/
 	cfft1d(len,xform,-1);
 	
 /*Copy out output:*/
@@ -67,6 +67,7 @@ void write_patch(specan_patch *s,float *amp_out,FILE *outFile);
 
 /*Internal SPECAN processing routines (in specan.c)*/
 void specan_init(specan_struct *s);/*Computes calculated parameters from filled-in parameters.*/
+void specan_fft_init(specan_struct *s);/*Sets up FFT tables; call before specan_process.*/
 void specan_process(specan_struct *s,complexFloat *input,complexFloat *output);/*Perform SPECAN SAR Processing.*/
 
 
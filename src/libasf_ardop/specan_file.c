@@ -2,86 +2,48 @@
 Specan Processor implementation file.
 
 This file contains specan_file, which
-runs on the master processor to SAR process
-an entire file full of signal data to
-create an entire output amplitude file.
+SAR processes an entire file full of signal
+data to create an entire output amplitude file,
+several patches at a time.
 
 Orion Lawlor, ASF 11/98.
 */
 #include "asf.h"
-#include "asf_meta.h"
+#include "asf_meta.h"
 #include "ardop_defs.h"
 #include "specan.h"
 
-#if 0
-/* If we're doing mpi stuff do this:
-* #include "my_mpi.h"
-* #if MPI
-*/
-#define status(mess) printf mess
-
-/*Slave receive (complex) and send(amp)*/
-complexFloat *slave_recv(specan_patch *s)
-{
-	complexFloat *in;
-	status(("Slave %d receiving from master\n",get_my_rank()));
-	MPI_Recv(s,sizeof(specan_patch),MPI_BYTE,0,0,comm,&mpi_stat);
-	in=(complexFloat *)malloc(sizeof(complexFloat)*s->iWid*s->iHt);
-	MPI_Recv(in,2*s->iWid*s->iHt,MPI_FLOAT,0,0,comm,&mpi_stat);
-	return in;
-}
-void slave_send(specan_patch *s,float *amp_out)
-{
-	status(("Slave %d sending to master\n",get_my_rank()));
-	MPI_Send(amp_out,s->oWid*s->oHt,MPI_FLOAT,0,0,comm);
-}
-
-/*slave_process is called by my_mpi when the master calls us*/
-void slave_process(int command)
-{
-        specan_patch patch_storage;
-        specan_patch *s=&patch_storage;
-        complexFloat *in=slave_recv(s);
-        float *amp_out=(float *)malloc(sizeof(float)*s->oWid*s->oHt);
-        status(("Slave %d processing patch\n",get_my_rank()));
-        specan_process_patch(s,in,amp_out);
-        slave_send(s,amp_out);
-        free(amp_out);
-        free(in);
-}
+/*Patches are SAR processed by a pool of worker threads.
+Up to SPECAN_PATCHES_PER_THREAD patches per thread are read
+(serially-- the signal readers aren't thread-safe), then
+processed in parallel, then written out in order.  This
+bounds the memory used to the in-flight patch buffers.*/
+#define SPECAN_PATCHES_PER_THREAD 2
 
-/*Master send (complex) and receive (amp)*/
-void master_send(specan_patch *s,complexFloat *in,int dest)
-{
-	int slaveRank=dest+first_slave;
-	send_slave_command(dest,SLAVE_PROCESS_BEGIN);
-	status(("Master sending to slave %d\n",slaveRank));
-	MPI_Send(s,sizeof(specan_patch),MPI_BYTE,slaveRank,0,comm);
-	MPI_Send(in,2*s->iWid*s->iHt,MPI_FLOAT,slaveRank,0,comm);
-}
+typedef struct {
+	specan_patch *s;
+	complexFloat **in;/*[slot] input patch, iWid x iHt*/
+	float **amp_out;/*[slot] output patch, oWid x oHt*/
+} specan_batch;
 
-void master_recv(specan_patch *s,float *amp_out,int src)
+static void process_patch_slot(int slot,int thread,void *params)
 {
-	int slaveRank=src+first_slave;
-	status(("Master waiting on slave %d\n",slaveRank));
-	MPI_Recv(amp_out,s->oWid*s->oHt,MPI_FLOAT,slaveRank,0,comm,&mpi_stat);
+	specan_batch *b=(specan_batch *)params;
+	specan_process_patch(b->s,b->in[slot],b->amp_out[slot]);
 }
 
-
-#endif
 /*Specan_file SAR processes an entire file from
-input to output.  It only runs on the master (0).
+input to output.
 */
 void specan_file(getRec *inFile,int NnLooks,FILE *outFile, 
         specan_struct *in_rng,specan_struct *in_az,
         int *out_lines,int *out_samples)
 {
-	complexFloat *in;
-	float *amp_out;
 	specan_patch patch_storage;
 	specan_patch *s=&patch_storage;
+	specan_batch batch;
 	
-	int yPatch,nyPatch;
+	int yPatch,nyPatch,slot,nSlots;
 	
 	s->az=*in_az;
 	s->rng=*in_rng;
@@ -103,40 +65,40 @@ void specan_file(getRec *inFile,int NnLooks,FILE *outFile,
 		*out_lines,*out_samples);
 
 	init_patch(s);
+	specan_fft_init(&s->rng);
+	specan_fft_init(&s->az);
 	
-	/*Allocate buffers*/
-	in=(complexFloat *)malloc(sizeof(complexFloat)*s->iWid*s->iHt);
-	amp_out=(float *)malloc(sizeof(float)*s->oWid*s->oHt);
-
-/*Loop through the patches of input data.*/
-	for (yPatch=0;yPatch<nyPatch;yPatch++)
-	{/*Process a patch of data.*/
-#  if !MPI
-		read_patch(s,inFile,in,yPatch);
-		specan_process_patch(s,in,amp_out);
-		write_patch(s,amp_out,outFile);
-	}
-#  else /*using MPI*/
-		/*Distribute patches round-robin for processing*/
-		read_patch(s,inFile,in,yPatch);
-		master_send(s,in,yPatch%num_slaves);
-		if (yPatch>=num_slaves-1)
-		{
-		/*Pick the patches back up as they finish*/ 
-			master_recv(s,amp_out,(yPatch+1)%num_slaves);
-			write_patch(s,amp_out,outFile);
-		}
+	/*Allocate the in-flight patch buffers*/
+	nSlots=asf_get_num_threads()*SPECAN_PATCHES_PER_THREAD;
+	if (nSlots>nyPatch) nSlots=nyPatch;
+	if (nSlots<1) nSlots=1;
+	batch.s=s;
+	batch.in=(complexFloat **)MALLOC(sizeof(complexFloat *)*nSlots);
+	batch.amp_out=(float **)MALLOC(sizeof(float *)*nSlots);
+	for (slot=0;slot<nSlots;slot++)
+	{
+		batch.in[slot]=(complexFloat *)
+			MALLOC(sizeof(complexFloat)*s->iWid*s->iHt);
+		batch.amp_out[slot]=(float *)MALLOC(sizeof(float)*s->oWid*s->oHt);
 	}
 
-/*cleanup loop-- collect all outstanding patches from slaves.*/
-	for (yPatch=nyPatch;yPatch<nyPatch+num_slaves-1;yPatch++)
+/*Loop through the patches of input data, a batch at a time.*/
+	for (yPatch=0;yPatch<nyPatch;yPatch+=nSlots)
 	{
-		master_recv(s,amp_out,(yPatch+1)%num_slaves);
-		write_patch(s,amp_out,outFile);
+		int nBatch=nyPatch-yPatch;
+		if (nBatch>nSlots) nBatch=nSlots;
+		for (slot=0;slot<nBatch;slot++)
+			read_patch(s,inFile,batch.in[slot],yPatch+slot);
+		asf_parallel_for(nBatch,process_patch_slot,&batch);
+		for (slot=0;slot<nBatch;slot++)
+			write_patch(s,batch.amp_out[slot],outFile);
 	}
-#  endif /*MPI*/
 
-	free(in);
-	free(amp_out);
+	for (slot=0;slot<nSlots;slot++)
+	{
+		FREE(batch.in[slot]);
+		FREE(batch.amp_out[slot]);
+	}
+	FREE(batch.in);
+	FREE(batch.amp_out);
 }
-
@@ -1,8 +1,7 @@
 /*
 Specan Processor implementation file.
 
-These routines run on both master and slave,
-and do SAR processing on a single patch of 
+These routines do SAR processing on a single patch of 
 data in azimuth.  It does so by calling
 specan_process (in specan.c) in both range
 and azimuth, and averaging the resulting 
@@ -11,7 +10,7 @@ patchlets using specan_ml.c.
 Orion Lawlor, ASF 12/98.
 */
 #include "asf.h"
-#include "asf_meta.h"
+#include "asf_meta.h"
 #include "ardop_defs.h"
 #include "specan.h"
 #include "specan_ml.h"
@@ -40,7 +39,8 @@ void read_patch(specan_patch *s,getRec *inFile,complexFloat *in,int patchNo)
 }
 
 /*Process a single, already read-in patch
-of data using specan.
+of data using specan.  Several patches may be
+processed at once, from different threads.
 in[] is iWid x iHt
 amp_out[] is oWid x oHt*/
 void specan_process_patch(specan_patch *s,complexFloat *in,float *amp_out)
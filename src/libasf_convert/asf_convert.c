@@ -2103,7 +2103,8 @@ static int asf_convert_file(char *configFileName, int saveDEM)
 				    TRUE, // use_speckle
 				    cfg->terrain_correct->if_coreg_fails_use_zero_offsets,
 				    FALSE,
-            cfg->terrain_correct->save_incid_angles), // no ground range DEM saving
+            cfg->terrain_correct->save_incid_angles, // no ground range DEM saving
+				    FALSE), // regular (not multi-scale) matching
 		   "terrain correcting data file (asf_terrcorr)\n");
     }
     
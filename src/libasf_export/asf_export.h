@@ -85,6 +85,19 @@ typedef struct {
   hid_t *var;                   // Variable identifiers
 } h5_t;
 
+// The netCDF and HDF5 variables are written in chunks of whole lines of
+// about this size (see export_chunk_lines)
+#define EXPORT_CHUNK_BYTES (1024*1024)
+
+// Latitude/longitude fit used to generate the latitude and longitude
+// bands of the netCDF and HDF5 exports
+typedef struct {
+  quadratic_2d lat;             // Fit of latitude + 180
+  quadratic_2d lon;             // Fit of longitude, on [0,360)
+  int line_count;               // Number of lines in the image
+  int ascending;                // Ascending pass: latitude band upside down
+} latlon_fit_t;
+
 /* Structure to hold elements of the command line.  */
 typedef struct {
   /* Output format to use.  */
@@ -207,10 +220,18 @@ int meta_colormap_to_tiff_palette(unsigned short **colors, int *byte_image, meta
 netcdf_t *initialize_netcdf_file(const char *output_file, 
 				 meta_parameters *meta);
 void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md);
+void nc_put_band_lines(netcdf_t *netcdf, int band, int first_line,
+		       int n_lines, int sample_count, const float *buf);
+int export_chunk_lines(meta_parameters *md);
+void latlon_fit_init(latlon_fit_t *fit, meta_parameters *md);
+void latlon_fit_lines(const latlon_fit_t *fit, int first_line, int n_lines,
+		      int sample_count, float *lats, float *lons);
 
 // Prototypes from export_hdf.c
 h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md);
 void finalize_h5_file(h5_t *hdf);
+void h5_put_band_lines(hid_t data, int first_line, int n_lines,
+		       int sample_count, const float *buf);
 
 // Prototypes from key.c
 double spheroid_diff_from_axis (spheroid_type_t spheroid,
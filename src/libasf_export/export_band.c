@@ -1233,8 +1233,10 @@ export_band_image (const char *metadata_file_name,
   png_infop png_info_ptr;
   h5_t *h5=NULL;
   netcdf_t *netcdf=NULL;
-  float *nc = NULL;
-  float *hdf = NULL;
+  float *nc = NULL;             // chunk of lines for the netCDF output
+  float *hdf = NULL;            // chunk of lines for the HDF5 output
+  hid_t h5_band = -1;
+  int chunk_lines = 0;
   int ii,jj;
   int palette_color_tiff = 0;
   int have_look_up_table = look_up_table_name && strlen(look_up_table_name)>0;
@@ -1864,61 +1866,48 @@ export_band_image (const char *metadata_file_name,
     if (format == HDF) {
       append_ext_if_needed(output_file_name, ".h5", NULL);
       h5 = initialize_h5_file(output_file_name, md);
-      hdf = (float *) 
-	MALLOC(sizeof(float)*md->general->line_count*md->general->sample_count);
     }
     else if (format == NC) {
       append_ext_if_needed(output_file_name, ".nc", NULL);
       netcdf = initialize_netcdf_file(output_file_name, md);
-      nc = (float *)
-	MALLOC(sizeof(float)*md->general->line_count*md->general->sample_count);    }
+    }
 
+    // Copy the bands over a chunk of lines at a time
     int kk, channel;
     int band_count = md->general->band_count;
+    int line_count = md->general->line_count;
     int sample_count = md->general->sample_count;
     int offset = md->general->line_count;
+    chunk_lines = export_chunk_lines(md);
     FILE *fp = FOPEN(image_data_file_name, "rb");
-    float *float_line = (float *) MALLOC(sizeof(float) * sample_count);
+    float *chunk = (float *) MALLOC(sizeof(float)*chunk_lines*sample_count);
     for (kk=0; kk<band_count; kk++) {
-      for (ii=0; ii<md->general->line_count; ii++ ) {
-	channel = get_band_number(md->general->bands, band_count, band_name[kk]);
-	get_float_line(fp, md, ii+channel*offset, float_line);
-	if (format == HDF) {
-	  int sample;
-	  for (sample=0; sample<sample_count; sample++)
-	    hdf[ii*sample_count+sample] = float_line[sample];
-	}
-	else if (format == NC) {
-	  int sample;
-	  for (sample=0; sample<sample_count; sample++) {
-	    nc[ii*sample_count+sample] = float_line[sample];
-	  }
-	}
-	asfLineMeter(ii, md->general->line_count);
-      }
+      asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
+      channel = get_band_number(md->general->bands, band_count, band_name[kk]);
       if (format == HDF) {
-	asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
 	char dataset[50];
 	sprintf(dataset, "/data/%s_AMPLITUDE_IMAGE", band_name[kk]);
 	h5_data = H5Dopen(h5->file, dataset, H5P_DEFAULT);
-	H5Dwrite(h5_data, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, 
-		 H5P_DEFAULT, hdf);
-	H5Dclose(h5_data);
       }
-      else if (format == NC) {
-	asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
-	nc_put_var_float(netcdf->ncid, netcdf->var_id[kk], &nc[0]);
+      for (ii=0; ii<line_count; ii+=chunk_lines) {
+	int lines = line_count - ii < chunk_lines ? line_count - ii : chunk_lines;
+	asfPercentMeter((double)ii/(double)line_count);
+	get_float_lines(fp, md, ii+channel*offset, lines, chunk);
+	if (format == HDF)
+	  h5_put_band_lines(h5_data, ii, lines, sample_count, chunk);
+	else if (format == NC)
+	  nc_put_band_lines(netcdf, kk, ii, lines, sample_count, chunk);
       }
+      asfPercentMeter(1.0);
+      if (format == HDF)
+	H5Dclose(h5_data);
     }
+    FREE(chunk);
 
-    if (format == HDF) {
+    if (format == HDF)
       finalize_h5_file(h5);
-      FREE(hdf);
-    }
-    else if (format == NC) {
+    else if (format == NC)
       finalize_netcdf_file(netcdf, md);
-      FREE(nc);
-    }
     else
       asfPrintError("Impossible: unexpected format %s\n", format2str(format));
 
@@ -2386,16 +2375,21 @@ export_band_image (const char *metadata_file_name,
 	else if (format == HDF) {
 	  append_ext_if_needed (out_file, ".h5", NULL);
 	  h5 = initialize_h5_file(out_file, md);
-	  hdf = (float *) 
-	    MALLOC(sizeof(float)*md->general->line_count*
-		   md->general->sample_count);
+	  chunk_lines = export_chunk_lines(md);
+	  if (!hdf)
+	    hdf = (float *) 
+	      MALLOC(sizeof(float)*chunk_lines*md->general->sample_count);
+	  char dataset[50];
+	  sprintf(dataset, "/data/%s_AMPLITUDE_IMAGE", band_name[kk]);
+	  h5_band = H5Dopen(h5->file, dataset, H5P_DEFAULT);
 	}
         else if (format == NC) {
           append_ext_if_needed (out_file, ".nc", NULL);
 	  netcdf = initialize_netcdf_file(out_file, md);
-	  nc = (float *)
-	    MALLOC(sizeof(float)*md->general->line_count*
-		   md->general->sample_count);        
+	  chunk_lines = export_chunk_lines(md);
+	  if (!nc)
+	    nc = (float *)
+	      MALLOC(sizeof(float)*chunk_lines*md->general->sample_count);
 	}
         else {
           asfPrintError("Impossible: unexpected format %s\n", format2str(format));
@@ -2584,15 +2578,19 @@ export_band_image (const char *metadata_file_name,
                   ieee_lil32(float_line[sample]);
                 fwrite(float_line,4,sample_count,ofp);
               }
-	      else if (format == HDF) {
-		int sample;
-		for (sample=0; sample<sample_count; sample++)
-		  hdf[ii*sample_count+sample] = float_line[sample];
-	      }
-	      else if (format == NC) {
-		int sample;
-		for (sample=0; sample<sample_count; sample++) {
-		  nc[ii*sample_count+sample] = float_line[sample];
+	      else if (format == HDF || format == NC) {
+		// Collect a chunk of lines, then write it out
+		int row = ii % chunk_lines;
+		float *chunk = format == HDF ? hdf : nc;
+		memcpy(&chunk[row*sample_count], float_line,
+		       sizeof(float)*sample_count);
+		if (row == chunk_lines-1 || ii == md->general->line_count-1) {
+		  if (format == HDF)
+		    h5_put_band_lines(h5_band, ii-row, row+1, sample_count,
+				      chunk);
+		  else
+		    nc_put_band_lines(netcdf, kk, ii-row, row+1, sample_count,
+				      chunk);
 		}
 	      }
               else
@@ -2652,19 +2650,8 @@ export_band_image (const char *metadata_file_name,
           finalize_ppm_file(opgm);
         else if (format == POLSARPRO_HDR)
           FCLOSE(ofp);
-	else if (format == HDF) {
-	  asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
-	  char dataset[50];
-	  sprintf(dataset, "/data/%s_AMPLITUDE_IMAGE", band_name[kk]);
-	  hid_t h5_data = H5Dopen(h5->file, dataset, H5P_DEFAULT);
-	  H5Dwrite(h5_data, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, 
-		   H5P_DEFAULT, hdf);
-	  H5Dclose(h5_data);
-	}
-	else if (format == NC) {
-	  asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
-	  nc_put_var_float(netcdf->ncid, netcdf->var_id[kk], &nc[0]);
-	}
+	else if (format == HDF)
+	  H5Dclose(h5_band);
 
         FCLOSE(fp);
       }
@@ -26,9 +26,6 @@
 #include <typlim.h>
 #include <hdf5.h>
 
-#define RES 16
-#define MAX_PTS 256
-
 void h5_att_double(hid_t data, hid_t space, char *name, double value)
 {
   hid_t attr = H5Acreate(data, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, 
@@ -175,7 +172,7 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   int samples = mg->sample_count;
   int lines = mg->line_count;
   hsize_t dims[2] = { lines, samples };
-  hsize_t cdims[2] = { 100, samples };
+  hsize_t cdims[2] = { export_chunk_lines(md), samples };
   hsize_t rdims[2] = { 1, 2 };
   h5_array = H5Screate_simple(2, dims, NULL);
   h5->space = h5_array;
@@ -496,54 +493,29 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   h5_att_str(h5_time, h5_string, "long_name", "serial date");
   H5Dclose(h5_time);
   
-  // Extra bands - Longitude
+  // Extra bands - Longitude and latitude, generated a chunk at a time
   int nl = mg->line_count;
   int ns = mg->sample_count;
-  long pixel_count = mg->line_count * mg->sample_count;
-  double *value = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *l = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *s = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double line, sample, lat, lon, first_value;
-  float *lons = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'longitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  if (lon < 0.0)
-    first_value = lon + 360.0;
-  else
-    first_value = lon;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      if (lon < 0.0)
-	value[ii*RES+kk] = lon + 360.0;
-      else
-	value[ii*RES+kk] = lon;
-    }
-    asfLineMeter(ii, nl);
-  }
-  quadratic_2d q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      lons[ii*ns+kk] = (float)
-	(q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	 q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	 q.K*kk*kk*kk) - 360.0;
-      if (lons[ii*ns+kk] < -180.0)
-	lons[ii*ns+kk] += 360.0;
-    }
-    asfLineMeter(ii, nl);
-  }
-  asfPrintStatus("Storing band 'longitude' ...\n");
+  int chunk_lines = cdims[0];
+  latlon_fit_t fit;
+  latlon_fit_init(&fit, md);
+  float *lons = (float *) MALLOC(sizeof(float)*chunk_lines*ns);
+  float *lats = (float *) MALLOC(sizeof(float)*chunk_lines*ns);
   sprintf(dataset, "/data/longitude");
   h5_lon = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 		     H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-  H5Dwrite(h5_lon, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, lons);
+  sprintf(dataset, "/data/latitude");
+  h5_lat = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
+		     H5P_DEFAULT, h5_plist, H5P_DEFAULT);
+  asfPrintStatus("Storing bands 'longitude' and 'latitude' ...\n");
+  for (ii=0; ii<nl; ii+=chunk_lines) {
+    int n_lines = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+    asfPercentMeter((double)ii/(double)nl);
+    latlon_fit_lines(&fit, ii, n_lines, ns, lats, lons);
+    h5_put_band_lines(h5_lon, ii, n_lines, ns, lons);
+    h5_put_band_lines(h5_lat, ii, n_lines, ns, lats);
+  }
+  asfPercentMeter(1.0);
   h5_att_str(h5_lon, h5_string, "units", "degrees_east");
   h5_att_str(h5_lon, h5_string, "long_name", "longitude");
   h5_att_str(h5_lon, h5_string, "standard_name", "longitude");
@@ -551,47 +523,6 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   h5_att_float2(h5_lon, h5_range, "valid_range", valid_range);
   h5_att_float(h5_lon, h5_string, "_FillValue", -999);
   H5Dclose(h5_lon);
-  FREE(lons);
-
-  // Extra bands - Latitude
-  float *lats = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'latitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  first_value = lat + 180.0;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      value[ii*RES+kk] = lat + 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
-  q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      if (mg->orbit_direction == 'A')
-	lats[(nl-ii-1)*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-      else
-	lats[ii*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
-  asfPrintStatus("Storing band 'latitude' ...\n");
-  sprintf(dataset, "/data/latitude");
-  h5_lat = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
-		     H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-  H5Dwrite(h5_lat, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, lats);
   h5_att_str(h5_lat, h5_string, "units", "degrees_north");
   h5_att_str(h5_lat, h5_string, "long_name", "latitude");
   h5_att_str(h5_lat, h5_string, "standard_name", "latitude");
@@ -600,21 +531,26 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   h5_att_float2(h5_lat, h5_range, "valid_range", valid_range);
   h5_att_float(h5_lat, h5_string, "_FillValue", -999);
   H5Dclose(h5_lat);
-  FREE(lats);
 
   if (projected) {
-    // Extra bands - ygrid
-    float *ygrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++)
-	ygrids[ii*ns+kk] = mp->startY + kk*mp->perY;
-      asfLineMeter(ii, nl);
-    }
-    asfPrintStatus("Storing band 'ygrid' ...\n");
+    // Extra bands - ygrid and xgrid, reusing the chunk buffers
+    float *ygrids = lats, *xgrids = lons;
+    for (kk=0; kk<chunk_lines*ns; kk++)
+      xgrids[kk] = mp->startX + (kk%ns)*mp->perX;
     sprintf(dataset, "/data/ygrid");
     h5_ygrid = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 			 H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-    H5Dwrite(h5_ygrid, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, ygrids);
+    sprintf(dataset, "/data/xgrid");
+    h5_xgrid = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
+			 H5P_DEFAULT, h5_plist, H5P_DEFAULT);
+    asfPrintStatus("Storing bands 'ygrid' and 'xgrid' ...\n");
+    for (ii=0; ii<nl; ii+=chunk_lines) {
+      int n_lines = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+      for (kk=0; kk<n_lines*ns; kk++)
+	ygrids[kk] = mp->startY + (ii + kk/ns)*mp->perY;
+      h5_put_band_lines(h5_ygrid, ii, n_lines, ns, ygrids);
+      h5_put_band_lines(h5_xgrid, ii, n_lines, ns, xgrids);
+    }
     h5_att_str(h5_ygrid, h5_string, "units", "meters");
     h5_att_str(h5_ygrid, h5_string, "long_name", 
 	       "projection_grid_y_coordinates");
@@ -622,20 +558,6 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
 	       "projection_y_coordinates");
     h5_att_str(h5_ygrid, h5_string, "axis", "Y");
     H5Dclose(h5_ygrid);
-    FREE(ygrids);
-    
-    // Extra bands - xgrid
-    float *xgrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++) 
-	xgrids[ii*ns+kk] = mp->startX + kk*mp->perX;
-      asfLineMeter(ii, nl);
-    }
-    asfPrintStatus("Storing band 'xgrid' ...\n");
-    sprintf(dataset, "/data/xgrid");
-    h5_xgrid = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
-			 H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-    H5Dwrite(h5_xgrid, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, xgrids);
     h5_att_str(h5_xgrid, h5_string, "units", "meters");
     h5_att_str(h5_xgrid, h5_string, "long_name", 
 	       "projection_grid_x_coordinates");
@@ -643,8 +565,9 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
 	       "projection_x_coordinates");
     h5_att_str(h5_xgrid, h5_string, "axis", "X");
     H5Dclose(h5_xgrid);
-    FREE(xgrids);
   }
+  FREE(lons);
+  FREE(lats);
 
   H5Gclose(h5_datagroup);
 
@@ -874,6 +797,23 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   return h5;
 }
 
+// Writes lines first_line .. first_line+n_lines-1 of a (lines by
+// samples) data set.
+void h5_put_band_lines(hid_t data, int first_line, int n_lines,
+		       int sample_count, const float *buf)
+{
+  hsize_t start[2] = { first_line, 0 };
+  hsize_t count[2] = { n_lines, sample_count };
+  hid_t h5_file_space = H5Dget_space(data);
+  hid_t h5_mem_space = H5Screate_simple(2, count, NULL);
+  H5Sselect_hyperslab(h5_file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+  if (H5Dwrite(data, H5T_NATIVE_FLOAT, h5_mem_space, h5_file_space,
+	       H5P_DEFAULT, buf) < 0)
+    asfPrintError("Could not write to HDF5 file.\n");
+  H5Sclose(h5_mem_space);
+  H5Sclose(h5_file_space);
+}
+
 void finalize_h5_file(h5_t *hdf)
 {
   H5Fclose(hdf->file);
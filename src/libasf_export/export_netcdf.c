@@ -463,15 +463,19 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     dims_bands[2] = dim_xgrid_id;
   }
   else {
-    dims_bands[1] = dim_lon_id;
-    dims_bands[2] = dim_lat_id;
+    dims_bands[1] = dim_lat_id;
+    dims_bands[2] = dim_lon_id;
   }
+  size_t chunk_lines = export_chunk_lines(meta);
+  size_t chunks_bands[3] = { 1, chunk_lines, sample_count };
+  size_t chunks_latlon[2] = { chunk_lines, sample_count };
 
   for (ii=0; ii<band_count; ii++) {
     
     sprintf(str, "%s_AMPLITUDE_IMAGE", band_name[ii]);
     nc_def_var(ncid, str, datatype, 3, dims_bands, &var_id);
     netcdf->var_id[ii] = var_id;
+    nc_def_var_chunking(ncid, var_id, NC_CHUNKED, chunks_bands);
     nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
     lfValue = -999.0;
     nc_put_att_double(ncid, var_id, "FillValue", NC_DOUBLE, 1, &lfValue);
@@ -527,10 +531,11 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, "longitude", NC_FLOAT, 2, dims_lon, &var_id);
   }
   else {
-    int dims_lon[2] = { dim_lon_id, dim_lat_id };
+    int dims_lon[2] = { dim_lat_id, dim_lon_id };
     nc_def_var(ncid, "longitude", NC_FLOAT, 2, dims_lon, &var_id);
   }
   netcdf->var_id[ii] = var_id;
+  nc_def_var_chunking(ncid, var_id, NC_CHUNKED, chunks_latlon);
   nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
   strcpy(str, "longitude");
   nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
@@ -557,6 +562,7 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, "latitude", NC_FLOAT, 2, dims_lat, &var_id);
   }
   netcdf->var_id[ii] = var_id;
+  nc_def_var_chunking(ncid, var_id, NC_CHUNKED, chunks_latlon);
   nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
   strcpy(str, "latitude");
   nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
@@ -833,36 +839,34 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
   return netcdf;
 }
 
-void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md)
+// Number of lines per chunk of the netCDF and HDF5 image variables.
+// A chunk holds whole lines, so that row-wise readers only decompress
+// the chunks they read, and is kept to about EXPORT_CHUNK_BYTES, which
+// fits the default chunk caches.  The exporters write a chunk at a time.
+int export_chunk_lines(meta_parameters *md)
 {
-  int ncid = netcdf->ncid;
-  int n = md->general->band_count;
-  int nl = md->general->line_count;
-  int ns = md->general->sample_count;
-  long pixel_count = md->general->line_count * md->general->sample_count;
-  int projected = FALSE;
-  if (md->projection && md->projection->type != SCANSAR_PROJECTION)
-    projected = TRUE;
-
-  // Extra bands - Time
-  float time = (float) seconds_from_str(md->general->acquisition_date);
-  asfPrintStatus("Storing band 'time' ...\n");
-  nc_put_var_float(ncid, netcdf->var_id[n], &time);
+  int lines = EXPORT_CHUNK_BYTES / (sizeof(float)*md->general->sample_count);
+  if (lines > md->general->line_count)
+    lines = md->general->line_count;
+  if (lines < 1)
+    lines = 1;
+  return lines;
+}
 
-  // Extra bands - longitude
-  n++;
+// Fits the latitude and longitude over the image, for generating the
+// latitude and longitude bands of the netCDF and HDF5 exports a chunk at
+// a time with latlon_fit_lines().
+void latlon_fit_init(latlon_fit_t *fit, meta_parameters *md)
+{
   int ii, kk;
-  double *value = (double *) MALLOC(sizeof(double)*MAX_PTS);
+  int nl = md->general->line_count;
+  int ns = md->general->sample_count;
+  double *lat_value = (double *) MALLOC(sizeof(double)*MAX_PTS);
+  double *lon_value = (double *) MALLOC(sizeof(double)*MAX_PTS);
   double *l = (double *) MALLOC(sizeof(double)*MAX_PTS);
   double *s = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double line, sample, lat, lon, first_value;
-  float *lons = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'longitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  if (lon < 0.0)
-    first_value = lon + 360.0;
-  else
-    first_value = lon;
+  double line, sample, lat, lon;
+
   asfPrintStatus("Calculating grid for quadratic fit ...\n");
   for (ii=0; ii<RES; ii++) {
     for (kk=0; kk<RES; kk++) {
@@ -871,92 +875,133 @@ void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md)
       meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
       l[ii*RES+kk] = line;
       s[ii*RES+kk] = sample;
+      lat_value[ii*RES+kk] = lat + 180.0;
       if (lon < 0.0)
-	value[ii*RES+kk] = lon + 360.0;
+	lon_value[ii*RES+kk] = lon + 360.0;
       else
-	value[ii*RES+kk] = lon;
-    }
-    asfLineMeter(ii, nl);
-  }
-  quadratic_2d q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      lons[ii*ns+kk] = (float)
-	(q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	 q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	 q.K*kk*kk*kk) - 360.0;
-      if (lons[ii*ns+kk] < -180.0)
-	lons[ii*ns+kk] += 360.0;
+	lon_value[ii*RES+kk] = lon;
     }
-    asfLineMeter(ii, nl);
   }
-  asfPrintStatus("Storing band 'longitude' ...\n");
-  nc_put_var_float(ncid, netcdf->var_id[n], &lons[0]);
-  FREE(lons);
+  fit->lat = find_quadratic(lat_value, l, s, MAX_PTS);
+  fit->lon = find_quadratic(lon_value, l, s, MAX_PTS);
 
-  // Extra bands - Latitude
-  n++;
-  float *lats = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'latitude' ...\n");
+  // Anchor the fits at the first pixel
   meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  first_value = lat + 180.0;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      value[ii*RES+kk] = lat + 180.0;
+  fit->lat.A = lat + 180.0;
+  fit->lon.A = lon < 0.0 ? lon + 360.0 : lon;
+  fit->line_count = nl;
+  fit->ascending = md->general->orbit_direction == 'A';
+
+  FREE(lat_value);
+  FREE(lon_value);
+  FREE(l);
+  FREE(s);
+}
+
+static double eval_fit(const quadratic_2d *q, int ii, int kk)
+{
+  return q->A + q->B*ii + q->C*kk + q->D*ii*ii + q->E*ii*kk + q->F*kk*kk +
+    q->G*ii*ii*kk + q->H*ii*kk*kk + q->I*ii*ii*kk*kk + q->J*ii*ii*ii +
+    q->K*kk*kk*kk;
+}
+
+// Latitudes and longitudes of lines first_line .. first_line+n_lines-1,
+// either of which may be NULL.  For ascending passes the latitude band
+// is stored upside down.
+void latlon_fit_lines(const latlon_fit_t *fit, int first_line, int n_lines,
+		      int sample_count, float *lats, float *lons)
+{
+  int ii, kk;
+
+  for (ii=first_line; ii<first_line+n_lines; ii++) {
+    float *lat_line = lats ? &lats[(ii-first_line)*sample_count] : NULL;
+    float *lon_line = lons ? &lons[(ii-first_line)*sample_count] : NULL;
+    int lat_ii = fit->ascending ? fit->line_count - ii - 1 : ii;
+    for (kk=0; kk<sample_count; kk++) {
+      if (lat_line)
+	lat_line[kk] = (float) eval_fit(&fit->lat, lat_ii, kk) - 180.0;
+      if (lon_line) {
+	lon_line[kk] = (float) eval_fit(&fit->lon, ii, kk) - 360.0;
+	if (lon_line[kk] < -180.0)
+	  lon_line[kk] += 360.0;
+      }
     }
-    asfLineMeter(ii, nl);
   }
-  q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      if (md->general->orbit_direction == 'A')
-	lats[(nl-ii-1)*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-      else
-	lats[ii*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-    }
-    asfLineMeter(ii, nl);
+}
+
+// Writes lines first_line .. first_line+n_lines-1 of a two dimensional
+// (lines by samples) or band (time by lines by samples) variable.
+static void nc_put_lines(netcdf_t *netcdf, int var, int ndims, int first_line,
+			 int n_lines, int sample_count, const float *buf)
+{
+  size_t start[3] = { 0, 0, 0 };
+  size_t count[3] = { 1, 1, 1 };
+  start[ndims-2] = first_line;
+  count[ndims-2] = n_lines;
+  count[ndims-1] = sample_count;
+  int status = nc_put_vara_float(netcdf->ncid, netcdf->var_id[var], start,
+				 count, buf);
+  if (status != NC_NOERR)
+    asfPrintError("Could not write to netCDF file (%s).\n", 
+		  nc_strerror(status));
+}
+
+// Writes a chunk of lines of image band 'band'.
+void nc_put_band_lines(netcdf_t *netcdf, int band, int first_line,
+		       int n_lines, int sample_count, const float *buf)
+{
+  nc_put_lines(netcdf, band, 3, first_line, n_lines, sample_count, buf);
+}
+
+void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md)
+{
+  int ncid = netcdf->ncid;
+  int n = md->general->band_count;
+  int nl = md->general->line_count;
+  int ns = md->general->sample_count;
+  int ii, chunk_lines = export_chunk_lines(md);
+  int projected = FALSE;
+  if (md->projection && md->projection->type != SCANSAR_PROJECTION)
+    projected = TRUE;
+
+  // Extra bands - Time
+  float time = (float) seconds_from_str(md->general->acquisition_date);
+  asfPrintStatus("Storing band 'time' ...\n");
+  nc_put_var_float(ncid, netcdf->var_id[n], &time);
+
+  // Extra bands - longitude and latitude, generated a chunk at a time
+  latlon_fit_t fit;
+  latlon_fit_init(&fit, md);
+  float *lons = (float *) MALLOC(sizeof(float)*chunk_lines*ns);
+  float *lats = (float *) MALLOC(sizeof(float)*chunk_lines*ns);
+  asfPrintStatus("Storing bands 'longitude' and 'latitude' ...\n");
+  for (ii=0; ii<nl; ii+=chunk_lines) {
+    int lines = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+    asfPercentMeter((double)ii/(double)nl);
+    latlon_fit_lines(&fit, ii, lines, ns, lats, lons);
+    nc_put_lines(netcdf, n+1, 2, ii, lines, ns, lons);
+    nc_put_lines(netcdf, n+2, 2, ii, lines, ns, lats);
   }
-  asfPrintStatus("Storing band 'latitude' ...\n");
-  nc_put_var_float(ncid, netcdf->var_id[n], &lats[0]);
+  asfPercentMeter(1.0);
+  FREE(lons);
   FREE(lats);
+  n += 2;
 
   if (projected) {
     // Extra bands - ygrid
     n++;
-    float *ygrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++)
-	ygrids[ii*ns+kk] = 
-	  md->projection->startY + kk*md->projection->perY;
-      asfLineMeter(ii, nl);
-    }
+    float *ygrids = (float *) MALLOC(sizeof(float)*nl);
+    for (ii=0; ii<nl; ii++)
+      ygrids[ii] = md->projection->startY + ii*md->projection->perY;
     asfPrintStatus("Storing band 'ygrid' ...\n");
     nc_put_var_float(ncid, netcdf->var_id[n], &ygrids[0]);
     FREE(ygrids);
     
     // Extra bands - xgrid
     n++;
-    float *xgrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++) 
-	xgrids[ii*ns+kk] = 
-	  md->projection->startX + kk*md->projection->perX;
-      asfLineMeter(ii, nl);
-    }
+    float *xgrids = (float *) MALLOC(sizeof(float)*ns);
+    for (ii=0; ii<ns; ii++)
+      xgrids[ii] = md->projection->startX + ii*md->projection->perX;
     asfPrintStatus("Storing band 'xgrid' ...\n");
     nc_put_var_float(ncid, netcdf->var_id[n], &xgrids[0]);
     FREE(xgrids);
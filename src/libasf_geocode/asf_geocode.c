@@ -28,6 +28,14 @@
 
 const float_image_byte_order_t fibo_be = FLOAT_IMAGE_BYTE_ORDER_BIG_ENDIAN;
 
+// Error bound, in input pixels, for the sampled geolocation grids used in
+// place of meta_get_lineSamp/meta_get_latLon on unprojected input
+#define GEO_GRID_MAX_ERROR 0.05
+
+// Below this many edge pixels, it's cheaper to look them up directly than
+// to build a geolocation grid for the image
+#define GEO_GRID_MIN_EDGE_POINTS 8192
+
 typedef int project_t(project_parameters_t *pps, double lat, double lon,
       double height, double *x, double *y, double *z, datum_type_t dtm);
 typedef int project_arr_t(project_parameters_t *pps, double *lat, double *lon,
@@ -831,6 +839,22 @@ int asf_geocode_ext(project_parameters_t *pp, projection_type_t projection_type,
 		      overlap, save_line_sample_mapping);
 }
 
+// meta_get_latLon, through the geolocation grid if there is one (lat/lon
+// in radians)
+static int edge_latLon(meta_parameters *imd, meta_geo_grid *geo_grid,
+                       double line, double samp, double average_height,
+                       double *lat, double *lon)
+{
+  int ret = 1;
+  if (geo_grid)
+    ret = meta_geo_grid_latLon(geo_grid, line, samp, lat, lon);
+  if (ret != 0)
+    ret = meta_get_latLon(imd, line, samp, average_height, lat, lon);
+  *lat *= D2R;
+  *lon *= D2R;
+  return ret;
+}
+
 static int symmetry_test(meta_parameters *imd, double stpx, double stpy,
                          double average_height)
 {
@@ -1186,6 +1210,10 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
         double *lats = g_new (double, edge_point_count);
         double *lons = g_new (double, edge_point_count);
         size_t current_edge_point = 0;
+        meta_geo_grid *geo_grid = NULL;
+        if (!input_projected && edge_point_count >= GEO_GRID_MIN_EDGE_POINTS)
+            geo_grid = meta_geo_grid_new (imd, average_height,
+                                          GEO_GRID_MAX_ERROR);
         size_t ii = 0, jj = 0;
         for ( ; ii < ii_size_x - 1 ; ii++ ) {
             if ( input_projected ) {
@@ -1198,14 +1226,12 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                 g_assert (ret);
             }
             else {
-                ret = meta_get_latLon (imd, (double)jj, (double)ii, average_height,
-                    &(lats[current_edge_point]),
+                ret = edge_latLon (imd, geo_grid, (double)jj, (double)ii,
+                    average_height, &(lats[current_edge_point]),
                     &(lons[current_edge_point]));
                 //g_assert (ret == 0);
                 asfRequire(ret == 0, "Unable to determine latitude and longitude "
                     "from current edge point\n");
-                lats[current_edge_point] *= D2R;
-                lons[current_edge_point] *= D2R;
             }
             current_edge_point++;
 
@@ -1222,12 +1248,10 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                 g_assert (ret);
             }
             else {
-                ret = meta_get_latLon (imd, (double)jj, (double)ii, average_height,
-                    &(lats[current_edge_point]),
+                ret = edge_latLon (imd, geo_grid, (double)jj, (double)ii,
+                    average_height, &(lats[current_edge_point]),
                     &(lons[current_edge_point]));
                 g_assert (ret == 0);
-                lats[current_edge_point] *= D2R;
-                lons[current_edge_point] *= D2R;
             }
             current_edge_point++;
 
@@ -1244,12 +1268,10 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                 g_assert (ret);
             }
             else {
-                ret = meta_get_latLon (imd, (double)jj, (double)ii, average_height,
-                    &(lats[current_edge_point]),
+                ret = edge_latLon (imd, geo_grid, (double)jj, (double)ii,
+                    average_height, &(lats[current_edge_point]),
                     &(lons[current_edge_point]));
                 g_assert (ret == 0);
-                lats[current_edge_point] *= D2R;
-                lons[current_edge_point] *= D2R;
             }
             current_edge_point++;
 
@@ -1266,18 +1288,17 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
                 g_assert (ret);
             }
             else {
-                ret = meta_get_latLon (imd, (double)jj, (double)ii, average_height,
-                    &(lats[current_edge_point]),
+                ret = edge_latLon (imd, geo_grid, (double)jj, (double)ii,
+                    average_height, &(lats[current_edge_point]),
                     &(lons[current_edge_point]));
                 g_assert (ret == 0);
-                lats[current_edge_point] *= D2R;
-                lons[current_edge_point] *= D2R;
             }
             current_edge_point++;
 
             asfPercentMeter((float)current_edge_point / (float)edge_point_count);
         }
         g_assert (current_edge_point == edge_point_count);
+        meta_geo_grid_free (geo_grid);
 	
 	if (!input_projected && projection_type != LAT_LONG_PSEUDO_PROJECTION) {
 	  // Pointers to arrays of projected coordinates to be filled in.
@@ -1697,6 +1718,9 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 
   // When mosaicing -- use banded_float_image to store the output, write
   //                   it out after processing all inputs
+  //                   (combine_ext() is the tiled, bounded-memory
+  //                   compositor, but only for inputs already geocoded
+  //                   to the same grid; this path does not use it yet)
   // When geocoding -- use float arrays to store the output, and write it
   //                   out line-by-line
 
@@ -2029,6 +2053,11 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
       size_t current_mapping = 0;
       size_t current_sparse_mapping = 0;
       size_t ii;
+
+      // Projection coordinates of the grid points, and the corresponding
+      // latitude and longitude (degrees) and input pixel indicies.
+      double *grid_lat = g_new (double, mapping_count);
+      double *grid_lon = g_new (double, mapping_count);
       
       for ( ii = 0 ; ii < grid_size ; ii++ ) {
         size_t jj;
@@ -2056,8 +2085,12 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	    if (lon_0 > 0 && lon < 0) lon += 360;
 	  }
 	  
-	  // Corresponding pixel indicies in input image.
-	  double x_pix, y_pix;
+	  g_assert(current_mapping < mapping_count);
+	  dtf.x_proj[current_mapping] = cxproj;
+	  dtf.y_proj[current_mapping] = cyproj;
+	  grid_lat[current_mapping] = lat;
+	  grid_lon[current_mapping] = lon;
+
 	  if ( input_projected ) {
 	    // Input projection coordinates of the current pixel.
 	    double ipcx, ipcy, ipcz;
@@ -2069,40 +2102,60 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	    g_assert (ret);
 	    // Find the input image pixel indicies corresponding to input
 	    // projection coordinates.
-	    x_pix = (ipcx - ipb->startX) / ipb->perX;
-	    y_pix = (ipcy - ipb->startY) / ipb->perY;
-	  }
-	  else {
-	    ret = meta_get_lineSamp (imd, lat, lon, average_height,
-				     &y_pix, &x_pix);
-	    //g_assert (ret == 0);
-	    if (ret != 0) {
-	      asfPrintError("Failed to determine line and sample from "
-			    "latitude and longitude\n"
-			    "Lat: %f, Lon: %f\n", lat, lon);
-	    }
-	  }
-	  
-	  g_assert(current_mapping < mapping_count);
-	  dtf.x_proj[current_mapping] = cxproj;
-	  dtf.y_proj[current_mapping] = cyproj;
-	  dtf.x_pix[current_mapping] = x_pix;
-	  dtf.y_pix[current_mapping] = y_pix;
-	  
-	  if ( ii % sparse_grid_sample_stride == 0 &&
-	       jj % sparse_grid_sample_stride == 0 ) {
-	    g_assert(current_sparse_mapping < sparse_mapping_count);
-	    dtf.sparse_x_proj[current_sparse_mapping] = cxproj;
-	    dtf.sparse_y_proj[current_sparse_mapping] = cyproj;
-	    dtf.sparse_x_pix[current_sparse_mapping] = x_pix;
-	    dtf.sparse_y_pix[current_sparse_mapping] = y_pix;
-	    current_sparse_mapping++;
+	    dtf.x_pix[current_mapping] = (ipcx - ipb->startX) / ipb->perX;
+	    dtf.y_pix[current_mapping] = (ipcy - ipb->startY) / ipb->perY;
 	  }
 	  current_mapping++;
 	  
 	  asfPercentMeter((float)current_mapping / (float)(grid_size*grid_size));
         }
       }
+      g_assert(current_mapping == mapping_count);
+
+      // Unprojected input: look all of the grid points up at once through
+      // a sampled geolocation grid, rather than searching with
+      // meta_get_lineSamp for every one of them.  Points it can't handle
+      // still go through meta_get_lineSamp.
+      if ( !input_projected ) {
+	int n_bad = 0;
+	meta_geo_grid *geo_grid = meta_geo_grid_new (imd, average_height,
+						     GEO_GRID_MAX_ERROR);
+	if ( geo_grid ) {
+	  n_bad = meta_geo_grid_lineSamp_batch (geo_grid, mapping_count,
+						grid_lat, grid_lon,
+						dtf.y_pix, dtf.x_pix);
+	  meta_geo_grid_free (geo_grid);
+	}
+	else {
+	  for ( ii = 0 ; ii < mapping_count ; ii++ )
+	    if ( meta_get_lineSamp (imd, grid_lat[ii], grid_lon[ii],
+				    average_height, &dtf.y_pix[ii],
+				    &dtf.x_pix[ii]) != 0 )
+	      n_bad++;
+	}
+	if (n_bad > 0) {
+	  asfPrintError("Failed to determine line and sample from "
+			"latitude and longitude\n"
+			"for %d of the %d grid points.\n", n_bad,
+			(int)mapping_count);
+	}
+      }
+      g_free (grid_lat);
+      g_free (grid_lon);
+
+      // Every other grid point in each direction makes up the sparse grid
+      for ( ii = 0 ; ii < grid_size ; ii += sparse_grid_sample_stride ) {
+        size_t jj;
+        for ( jj = 0 ; jj < grid_size ; jj += sparse_grid_sample_stride ) {
+	  size_t k = ii*grid_size + jj;
+	  g_assert(current_sparse_mapping < sparse_mapping_count);
+	  dtf.sparse_x_proj[current_sparse_mapping] = dtf.x_proj[k];
+	  dtf.sparse_y_proj[current_sparse_mapping] = dtf.y_proj[k];
+	  dtf.sparse_x_pix[current_sparse_mapping] = dtf.x_pix[k];
+	  dtf.sparse_y_pix[current_sparse_mapping] = dtf.y_pix[k];
+	  current_sparse_mapping++;
+	}
+      }
       
       // Here are some convenience macros for the spline model.
 #define X_PIXEL(x, y) reverse_map_x (&dtf, x, y)
@@ -2636,19 +2689,27 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	      // the outer if guards against the case where no valid pixels
 	      // were on this line (i.e., both are -1)
 	      if (oix_first_valid > 0 && oix_last_valid > 0) {
+		int n = oix_last_valid - oix_first_valid + 1;
+		float *geoid = MALLOC(sizeof(float)*n);
+		for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
+		  lat[oix] *= R2D;
+		  lon[oix] *= R2D;
+		}
+		get_geoid_heights(n, &lat[oix_first_valid], &lon[oix_first_valid],
+				  GEOID_BILINEAR, geoid);
 		if (output_by_line) {
 		  for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
-		    output_line[oix] +=
-		      get_geoid_height(lat[oix]*R2D, lon[oix]*R2D);
+		    output_line[oix] += geoid[oix - oix_first_valid];
 		  }
 		}
 		else {
 		  for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
 		    float value = banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
 		    banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
-						 value + get_geoid_height(lat[oix]*R2D, lon[oix]*R2D));
+						 value + geoid[oix - oix_first_valid]);
 		  }
 		}
+		FREE(geoid);
 	      }
 	      
 	      free(lat);
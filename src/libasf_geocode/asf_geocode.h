@@ -142,11 +142,21 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	       char *overlap, int save_line_sample_mapping);
 void sigsegv_handler (int signal_number);
 
-// Prototype from combine.c
+// Prototypes from combine.c
 int combine(char **infiles, int n_inputs, char *outfile);
+int combine_ext(char **infiles, int n_inputs, char *outfile,
+                overlap_method_t overlap, double background_val);
 
 // Prototypes from geoid.c
+typedef enum {
+    GEOID_NEAREST,
+    GEOID_BILINEAR,
+    GEOID_BICUBIC
+} geoid_interp_t;
 float get_geoid_height(double lat, double lon);
+float get_geoid_height_ext(double lat, double lon, geoid_interp_t interp);
+void get_geoid_heights(int n, const double *lat, const double *lon,
+                       geoid_interp_t interp, float *heights);
 
 // Prototypes from clip.c
 int clip(char *inFile, char *maskFile, char *outFile);
@@ -1,21 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
+#ifndef win32
+#include <sys/resource.h>
+#endif
 
 #include "asf.h"
 #include "asf_meta.h"
 #include "asf_raster.h"
-#include "float_image.h"
 #include "asf_geocode.h"
 
-#include "asf_contact.h"
-#include "asf_license.h"
-#include "asf_version.h"
+#include "asf_contact.h"
+#include "asf_license.h"
+#include "asf_version.h"
 
 #define ASF_NAME_STRING "mosaic"
 
-static const float_image_byte_order_t fibo_be =
-    FLOAT_IMAGE_BYTE_ORDER_BIG_ENDIAN;
-
 static void print_proj_info(meta_parameters *meta)
 {
     project_parameters_t pp = meta->projection->param;
@@ -173,7 +172,7 @@ static void update_corners(double px, double py,
 }
 
 static void determine_extents(char **infiles, int n_inputs,
-                              int *size_x, int *size_y,
+                              int *size_x, int *size_y, int *n_bands,
                               double *start_x, double *start_y,
                               double *per_x, double *per_y)
 {
@@ -203,6 +202,9 @@ static void determine_extents(char **infiles, int n_inputs,
 
     projection_type_t proj_type = meta0->projection->type;
 
+    int nBands;
+    nBands = *n_bands = meta0->general->band_count;
+
     int i, n_ok = 1, n_bad = 0;
     for (i=1; i<n_inputs; ++i) {
         char *file = infiles[i];
@@ -222,6 +224,8 @@ static void determine_extents(char **infiles, int n_inputs,
             why = "Image is in a different projection";
         else if (!proj_parms_match(meta0, meta))
             why = "Projection parameters differ";
+        else if (meta->general->band_count != nBands)
+            why = "Number of bands differ";
 
         if (strlen(why) > 0) {
             ++n_bad;
@@ -255,107 +259,323 @@ static void determine_extents(char **infiles, int n_inputs,
     meta_free(meta0);
 }
 
-static void add_pixels(FloatImage *out, char *file,
-                       double start_x, double start_y,
-                       double per_x, double per_y)
+// Tiled compositor: the combined image is built one strip of lines at a
+// time, and each strip is cut into tiles that are filled in parallel.
+// A tile only reads from the inputs whose footprint overlaps it, so
+// memory use is bounded by the size of a strip rather than the size of
+// the whole mosaic.
+
+#define COMBINE_TILE_SIZE 512
+#define COMBINE_MAX_STRIP_PIXELS (32*1024*1024)
+
+typedef struct {
+  char *file;
+  meta_parameters *meta;       // NULL if this input is skipped
+  int start_line, start_sample; // location in the combined image
+  int nl, ns;
+} combine_input_t;
+
+typedef struct {
+  combine_input_t *inputs;
+  int n_inputs;
+  int n_bands;
+  int size_x;                  // width of the combined image
+  int strip_line;              // first line of the current strip
+  int strip_lines;             // number of lines in the current strip
+  overlap_method_t overlap;
+  float background;
+  float *strip;                // n_bands x strip_lines x size_x
+  FILE **fps;                  // per-thread handles, [thread*n_inputs + i]
+  float **in_bufs;             // per-thread read buffers
+  int **n_valid;               // per-thread count of values per tile pixel
+} combine_params_t;
+
+static int input_overlaps_lines(combine_input_t *in, int line, int n_lines)
 {
-    meta_parameters *meta = meta_read(file);
-
-    if (!meta) {
-        asfPrintError("Couldn't read metadata for: %s!\n", file);
-    }
-
-    // figure out where in the giant image these pixels will go
-    int start_line, start_sample;
-
-    // this should work even if per_x / per_y are negative...
-    start_sample = (int) ((meta->projection->startX - start_x) / per_x + .5);
-    start_line = (int) ((meta->projection->startY - start_y) / per_y + .5);
-
-    int ns = meta->general->sample_count;
-    int nl = meta->general->line_count;
+  return in->meta &&
+    in->start_line < line + n_lines && in->start_line + in->nl > line;
+}
 
-    asfPrintStatus("  Location in combined is S:%d-%d, L:%d-%d\n",
-        start_sample, start_sample + ns,
-        start_line, start_line + nl);
+// Each thread keeps its own handle on every input in the current strip,
+// so the number of threads is limited by how many files we may have open
+// at once.  A few descriptors are left over for everything else.
+#define COMBINE_RESERVED_FDS 32
 
-    if (start_sample + ns > out->size_x || start_line + nl > out->size_y) {
-        asfPrintError("Image extents were not calculated correctly!\n");
-    }
+static int combine_max_threads(combine_input_t *inputs, int n_inputs,
+                               int size_y, int strip_lines)
+{
+  int ii, line, max_open = 0;
+  for (line=0; line<size_y; line+=strip_lines) {
+    int n_open = 0;
+    for (ii=0; ii<n_inputs; ++ii)
+      if (input_overlaps_lines(&inputs[ii], line, strip_lines))
+        ++n_open;
+    if (n_open > max_open)
+      max_open = n_open;
+  }
 
-    FILE *img = fopenImage(file, "rb");
-    if (!img) {
-        asfPrintError("Couldn't open image file: %s!\n", file);
+  int n_threads = asf_get_num_threads();
+#ifndef win32
+  struct rlimit rl;
+  if (max_open > 0 && getrlimit(RLIMIT_NOFILE, &rl) == 0 &&
+      rl.rlim_cur != RLIM_INFINITY)
+  {
+    long avail = (long)rl.rlim_cur - COMBINE_RESERVED_FDS;
+    int max_threads = avail > max_open ? (int)(avail / max_open) : 1;
+    if (n_threads > max_threads) {
+      asfPrintStatus("Using %d threads: up to %d inputs per strip are open "
+                     "in each thread, and the open file limit is %ld.\n",
+                     max_threads, max_open, (long)rl.rlim_cur);
+      n_threads = max_threads;
     }
+  }
+#endif
+  return n_threads;
+}
 
-    float *line = MALLOC(sizeof(float)*ns);
-
-    int y;
-    for (y=0; y<nl; ++y) {
-        get_float_line(img, meta, y, line);
-
-        int x;
-        for (x=0; x<ns; ++x) {
-            float v = line[x];
+// Merge one valid input value into an output pixel that has already
+// received n_valid values.  MIN and MAX follow asf_mosaic in treating an
+// output value of zero as "not set".
+static void merge_value(overlap_method_t overlap, float *out, int *n_valid,
+                        float value)
+{
+  if (*n_valid == 0) {
+    *out = value;
+  }
+  else switch (overlap) {
+    case MIN_OVERLAP:
+      if (!(*out != 0 && *out < value))
+        *out = value;
+      break;
+    case MAX_OVERLAP:
+      if (!(*out != 0 && *out > value))
+        *out = value;
+      break;
+    case AVG_OVERLAP:
+      *out += value;
+      break;
+    default:
+      *out = value;
+      break;
+  }
+  ++(*n_valid);
+}
 
-            // don't write out "no data" values
-            if (v != meta->general->no_data)
-                float_image_set_pixel(out, x + start_sample, y + start_line, v);
+static void combine_tile(int tile, int thread, void *vp)
+{
+  combine_params_t *p = (combine_params_t *)vp;
+
+  int size_x = p->size_x;
+  int x0 = tile*COMBINE_TILE_SIZE;
+  int tw = size_x - x0 < COMBINE_TILE_SIZE ? size_x - x0 : COMBINE_TILE_SIZE;
+  int y0 = p->strip_line;
+  int th = p->strip_lines;
+  int *n_valid = p->n_valid[thread];
+  float *buf = p->in_bufs[thread];
+  int ii, b, x, y;
+
+  for (b=0; b<p->n_bands; ++b)
+    for (y=0; y<th; ++y) {
+      float *out = p->strip + ((size_t)b*th + y)*size_x + x0;
+      for (x=0; x<tw; ++x)
+        out[x] = p->background;
+    }
+  memset(n_valid, 0, sizeof(int)*p->n_bands*th*tw);
+
+  // Paste the inputs last to first, so that the files listed first have
+  // the final say where the inputs overlap
+  for (ii=p->n_inputs-1; ii>=0; --ii) {
+    combine_input_t *in = &p->inputs[ii];
+    if (!in->meta)
+      continue;
+
+    int ix0 = in->start_sample > x0 ? in->start_sample : x0;
+    int ix1 = in->start_sample + in->ns < x0 + tw ?
+      in->start_sample + in->ns : x0 + tw;
+    int iy0 = in->start_line > y0 ? in->start_line : y0;
+    int iy1 = in->start_line + in->nl < y0 + th ?
+      in->start_line + in->nl : y0 + th;
+    if (ix0 >= ix1 || iy0 >= iy1)
+      continue;
+
+    FILE *fp = p->fps[thread*p->n_inputs + ii];
+    float no_data = in->meta->general->no_data;
+    int nx = ix1 - ix0;
+    int ny = iy1 - iy0;
+
+    for (b=0; b<p->n_bands; ++b) {
+      get_partial_float_lines(fp, in->meta,
+                              b*in->nl + iy0 - in->start_line, ny,
+                              ix0 - in->start_sample, nx, buf);
+      for (y=0; y<ny; ++y) {
+        float *line = buf + (size_t)y*nx;
+        float *out = p->strip + ((size_t)b*th + iy0 - y0 + y)*size_x + ix0;
+        int *n = n_valid + ((size_t)b*th + iy0 - y0 + y)*tw + ix0 - x0;
+        for (x=0; x<nx; ++x) {
+          // don't write out "no data" values
+          if (line[x] != no_data)
+            merge_value(p->overlap, &out[x], &n[x], line[x]);
         }
-
-        asfLineMeter(y, nl);
+      }
     }
+  }
 
-    fclose(img);
-    free(line);
-    meta_free(meta);
+  if (p->overlap == AVG_OVERLAP) {
+    for (b=0; b<p->n_bands; ++b)
+      for (y=0; y<th; ++y) {
+        float *out = p->strip + ((size_t)b*th + y)*size_x + x0;
+        int *n = n_valid + ((size_t)b*th + y)*tw;
+        for (x=0; x<tw; ++x)
+          if (n[x] > 1)
+            out[x] /= n[x];
+      }
+  }
 }
 
-int combine(char **infiles, int n_inputs, char *outfile)
+int combine_ext(char **infiles, int n_inputs, char *outfile,
+                overlap_method_t overlap, double background_val)
 {
-  int ret, ii, size_x, size_y;
+  int ii, kk, size_x, size_y, n_bands;
   double start_x, start_y;
   double per_x, per_y;
 
+  if (overlap == NEAR_RANGE_OVERLAP)
+    asfPrintError("Overlap method 'NEAR RANGE' not yet supported...\n");
+
   // Determine image parameters
-  determine_extents(infiles, n_inputs, &size_x, &size_y, &start_x, &start_y,
-		    &per_x, &per_y);
-  
+  determine_extents(infiles, n_inputs, &size_x, &size_y, &n_bands,
+                    &start_x, &start_y, &per_x, &per_y);
+
   asfPrintStatus("\nCombined image size: %dx%d LxS\n", size_y, size_x);
   asfPrintStatus("  Start X,Y: %f,%f\n", start_x, start_y);
   asfPrintStatus("    Per X,Y: %lg,%lg\n", per_x, per_y);
-  
-  // float_image will handle cacheing of the large output image
-  FloatImage *out = float_image_new(size_x, size_y);
-  
-  // loop over the input images, last to first, so that the files listed
-  // first have their pixels overwrite files listed later on the command line
-  for (ii=n_inputs-1; ii>=0; ii--) {
-    asfPrintStatus("\nProcessing %s... \n", infiles[ii]);
-      
-    // Add this image's pixels
-    add_pixels(out, infiles[ii], start_x, start_y, per_x, per_y);
+
+  // Figure out where in the combined image each input goes
+  combine_input_t *inputs = MALLOC(sizeof(combine_input_t)*n_inputs);
+  for (ii=0; ii<n_inputs; ++ii) {
+    combine_input_t *in = &inputs[ii];
+    in->file = infiles[ii];
+    in->meta = infiles[ii] ? meta_read(infiles[ii]) : NULL;
+    if (!in->meta)
+      continue;
+
+    // this should work even if per_x / per_y are negative...
+    in->start_sample =
+      (int) ((in->meta->projection->startX - start_x) / per_x + .5);
+    in->start_line =
+      (int) ((in->meta->projection->startY - start_y) / per_y + .5);
+    in->ns = in->meta->general->sample_count;
+    in->nl = in->meta->general->line_count;
+
+    asfPrintStatus("%s\n  Location in combined is S:%d-%d, L:%d-%d\n",
+                   in->file, in->start_sample, in->start_sample + in->ns,
+                   in->start_line, in->start_line + in->nl);
+
+    if (in->start_sample < 0 || in->start_line < 0 ||
+        in->start_sample + in->ns > size_x ||
+        in->start_line + in->nl > size_y)
+      asfPrintError("Image extents were not calculated correctly!\n");
   }
-  
+
   asfPrintStatus("Writing metadata.\n");
-  
+
   meta_parameters *meta_out = meta_read(infiles[0]);
-  
   meta_out->projection->startX = start_x;
   meta_out->projection->startY = start_y;
   meta_out->general->line_count = size_y;
   meta_out->general->sample_count = size_x;
-  
+  meta_out->general->band_count = n_bands;
+  meta_out->general->data_type = REAL32;
   meta_write(meta_out, outfile);
-  meta_free(meta_out);
+
+  // Strips are as tall as a tile, unless the image is very wide
+  int strip_lines = COMBINE_MAX_STRIP_PIXELS / ((size_t)size_x*n_bands);
+  if (strip_lines > COMBINE_TILE_SIZE)
+    strip_lines = COMBINE_TILE_SIZE;
+  if (strip_lines < 1)
+    strip_lines = 1;
+  int n_tiles = (size_x + COMBINE_TILE_SIZE - 1) / COMBINE_TILE_SIZE;
+  int n_threads = combine_max_threads(inputs, n_inputs, size_y, strip_lines);
+
+  combine_params_t params;
+  params.inputs = inputs;
+  params.n_inputs = n_inputs;
+  params.n_bands = n_bands;
+  params.size_x = size_x;
+  params.overlap = overlap;
+  params.background = (float)background_val;
+  params.strip = MALLOC(sizeof(float)*n_bands*strip_lines*size_x);
+  params.fps = CALLOC(n_threads*n_inputs, sizeof(FILE *));
+  params.in_bufs = MALLOC(sizeof(float *)*n_threads);
+  params.n_valid = MALLOC(sizeof(int *)*n_threads);
+  for (kk=0; kk<n_threads; ++kk) {
+    params.in_bufs[kk] = MALLOC(sizeof(float)*strip_lines*COMBINE_TILE_SIZE);
+    params.n_valid[kk] =
+      MALLOC(sizeof(int)*n_bands*strip_lines*COMBINE_TILE_SIZE);
+  }
 
   char *outfile_full = appendExt(outfile, ".img");
   asfPrintStatus("Saving image (%s).\n", outfile_full);
-  ret = float_image_store(out, outfile_full, fibo_be);
-  if (ret!=0) 
-    asfPrintError("Error storing output image!\n");
-  float_image_free(out);
-  free(outfile_full);
-  
-  return ret;
+  FILE *fpOut = FOPEN(outfile_full, "wb");
+
+  int line;
+  for (line=0; line<size_y; line+=strip_lines) {
+    int n_lines = size_y - line < strip_lines ? size_y - line : strip_lines;
+    params.strip_line = line;
+    params.strip_lines = n_lines;
+
+    // Each thread gets its own handle on the inputs in this strip, and
+    // handles on inputs that are already behind us are closed.
+    for (ii=0; ii<n_inputs; ++ii) {
+      int needed = input_overlaps_lines(&inputs[ii], line, n_lines);
+      for (kk=0; kk<n_threads; ++kk) {
+        FILE **fp = &params.fps[kk*n_inputs + ii];
+        if (needed && !*fp) {
+          *fp = fopenImage(inputs[ii].file, "rb");
+          if (!*fp)
+            asfPrintError("Couldn't open image file: %s!\n",
+                          inputs[ii].file);
+        }
+        else if (!needed && *fp) {
+          FCLOSE(*fp);
+          *fp = NULL;
+        }
+      }
+    }
+
+    asf_parallel_for_n(n_tiles, n_threads, combine_tile, &params);
+
+    for (kk=0; kk<n_bands; ++kk)
+      put_band_float_lines(fpOut, meta_out, kk, line, n_lines,
+                           params.strip + (size_t)kk*n_lines*size_x);
+
+    asfLineMeter(line + n_lines - 1, size_y);
+  }
+
+  FCLOSE(fpOut);
+
+  for (ii=0; ii<n_threads*n_inputs; ++ii)
+    if (params.fps[ii])
+      FCLOSE(params.fps[ii]);
+  for (kk=0; kk<n_threads; ++kk) {
+    FREE(params.in_bufs[kk]);
+    FREE(params.n_valid[kk]);
+  }
+  FREE(params.fps);
+  FREE(params.in_bufs);
+  FREE(params.n_valid);
+  FREE(params.strip);
+  for (ii=0; ii<n_inputs; ++ii)
+    if (inputs[ii].meta)
+      meta_free(inputs[ii].meta);
+  FREE(inputs);
+  meta_free(meta_out);
+  FREE(outfile_full);
+
+  return 0;
+}
+
+int combine(char **infiles, int n_inputs, char *outfile)
+{
+  return combine_ext(infiles, n_inputs, outfile, OVERLAY_OVERLAP, 0.0);
 }
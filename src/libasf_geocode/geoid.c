@@ -1,37 +1,217 @@
+/*******************************************************************************
+NAME: geoid
+
+PURPOSE:
+  Geoid heights (EGM96, relative to the WGS84 ellipsoid) from the
+  15-minute WW15MGH grid.
+
+ALGORITHM DESCRIPTION:
+  The grid is shipped as WW15MGH.DAC: 721 rows of 1440 big-endian 16-bit
+  heights in centimeters, from 90 degrees North down to 90 South, and
+  from 0 to 359.75 degrees East, every 0.25 degrees.
+
+  The first time a height is requested, the grid is converted to floats
+  in the native byte order and saved next to the .DAC file as
+  WW15MGH.grd.  Later runs map that file into memory instead of decoding
+  the .DAC again.  If the share directory is not writable, the converted
+  grid is just kept in memory.  The loading is done exactly once, even
+  if several threads ask for heights at the same time; after that, the
+  grid is read-only and any number of threads may query it.
+
+  Heights are interpolated between the grid posts, bilinearly by default,
+  or with a bicubic (Catmull-Rom) kernel.  Longitudes wrap around, and
+  latitudes are clamped at the poles.  get_geoid_heights() handles a
+  whole row of points in one call.
+*******************************************************************************/
 #include "asf_geocode.h"
 #include "asf.h"
 
 #include <stdio.h>
+#include <math.h>
+
+#ifndef win32
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define GEOID_WIDTH 1440
+#define GEOID_HEIGHT 721
+#define GEOID_POSTS_PER_DEGREE 4
+#define GEOID_DAC_FILE "WW15MGH.DAC"
+#define GEOID_GRID_FILE "WW15MGH.grd"
+#define GEOID_MAGIC "ASFGEOID"
+
+// Header of the converted grid, followed by the heights as
+// float[GEOID_HEIGHT][GEOID_WIDTH] in the byte order of the machine
+// that wrote it ("one" tells whether that is ours).
+typedef struct {
+    char magic[8];
+    int width;
+    int height;
+    float one;
+    int pad[3];
+} geoid_header_t;
+
+static const float *geoid_heights = NULL;
 
-#define geoid_height_at(x,y) *(geoid_heights + y*w + x)
+#define geoid_height_at(x,y) geoid_heights[(y)*GEOID_WIDTH + (x)]
 
-static int read_geoid(float *geoid_heights, int w, int h)
+static char *share_file_name(const char *filename)
 {
-    int x,y;
-    FILE *f=fopen_share_file("WW15MGH.DAC","rb");
-    for (y=0;y<h;y++)
-	for (x=0;x<w;x++) {
-            signed char hi=fgetc(f);
-            unsigned char lo=fgetc(f);
-            float height=((hi<<8)+lo)*(1.0/100);
-            geoid_height_at(x,y) = height;
-	}
-    fclose(f);
-    return 0;
+    const char *share_dir = get_asf_share_dir();
+    char *full_name = (char *) MALLOC(sizeof(char) *
+                           (strlen(filename) + strlen(share_dir) + 10));
+    sprintf(full_name, "%s%c%s", share_dir, DIR_SEPARATOR, filename);
+    return full_name;
 }
 
-float get_geoid_height(double lat, double lon)
+static int header_ok(const geoid_header_t *hdr)
+{
+    return strncmp(hdr->magic, GEOID_MAGIC, 8) == 0 &&
+        hdr->width == GEOID_WIDTH && hdr->height == GEOID_HEIGHT &&
+        hdr->one == 1.0;
+}
+
+// Maps the converted grid, if there is a usable one.
+static const float *map_grid(void)
 {
-    const int w=1440;
-    const int h=721;
+#ifndef win32
+    char *grid_file = share_file_name(GEOID_GRID_FILE);
+    size_t size = sizeof(geoid_header_t) +
+        sizeof(float)*GEOID_WIDTH*GEOID_HEIGHT;
+    const float *ret = NULL;
+    struct stat st;
 
-    static float *geoid_heights = NULL;
+    int fd = open(grid_file, O_RDONLY);
+    FREE(grid_file);
+    if (fd < 0)
+        return NULL;
 
-    if (!geoid_heights) {
-        geoid_heights = MALLOC(sizeof(float)*w*h);
-        read_geoid(geoid_heights, w, h);
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+        void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            if (header_ok((const geoid_header_t *) p))
+                ret = (const float *)((const char *)p + sizeof(geoid_header_t));
+            else
+                munmap(p, size);
+        }
     }
+    close(fd);
+
+    return ret;
+#else
+    return NULL;
+#endif
+}
 
+// Saves the converted grid for the next run.  This is only a cache, so
+// failures are ignored.  The grid is written under a temporary name and
+// then renamed, so that a concurrent run never maps a partial file.
+static void save_grid(const float *heights)
+{
+#ifndef win32
+    geoid_header_t hdr;
+    char *grid_file = share_file_name(GEOID_GRID_FILE);
+    char *tmp_file = MALLOC(sizeof(char)*(strlen(grid_file) + 32));
+    sprintf(tmp_file, "%s.%d", grid_file, (int)getpid());
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, GEOID_MAGIC, 8);
+    hdr.width = GEOID_WIDTH;
+    hdr.height = GEOID_HEIGHT;
+    hdr.one = 1.0;
+
+    FILE *f = fopen(tmp_file, "wb");
+    if (f) {
+        size_t n = GEOID_WIDTH*GEOID_HEIGHT;
+        int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+            fwrite(heights, sizeof(float), n, f) == n;
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp_file, grid_file) != 0)
+            unlink(tmp_file);
+    }
+
+    FREE(tmp_file);
+    FREE(grid_file);
+#endif
+}
+
+// Decodes WW15MGH.DAC into a newly allocated grid.
+static float *read_dac(void)
+{
+    size_t n = GEOID_WIDTH*GEOID_HEIGHT;
+    unsigned char *raw = MALLOC(2*n);
+    float *heights = MALLOC(sizeof(float)*n);
+    size_t ii;
+
+    FILE *f = fopen_share_file(GEOID_DAC_FILE, "rb");
+    if (!f || fread(raw, 2, n, f) != n)
+        asfPrintError("Could not read the geoid height grid (%s)\n",
+                      GEOID_DAC_FILE);
+    fclose(f);
+
+    for (ii=0; ii<n; ii++) {
+        signed char hi = (signed char) raw[2*ii];
+        unsigned char lo = raw[2*ii+1];
+        heights[ii] = ((hi<<8)+lo)*(1.0/100);
+    }
+
+    FREE(raw);
+    return heights;
+}
+
+static void load_geoid(void)
+{
+    const float *heights = map_grid();
+    if (!heights) {
+        float *converted = read_dac();
+        save_grid(converted);
+        heights = converted;
+    }
+    geoid_heights = heights;
+}
+
+#ifndef win32
+static pthread_once_t geoid_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void init_geoid(void)
+{
+#ifndef win32
+    pthread_once(&geoid_once, load_geoid);
+#else
+    // everything runs in one thread on Windows
+    if (!geoid_heights)
+        load_geoid();
+#endif
+}
+
+// Catmull-Rom weights for a point at fraction t between posts 1 and 2.
+static void cubic_weights(double t, double w[4])
+{
+    double t2 = t*t, t3 = t2*t;
+    w[0] = 0.5*(-t3 + 2*t2 - t);
+    w[1] = 0.5*(3*t3 - 5*t2 + 2);
+    w[2] = 0.5*(-3*t3 + 4*t2 + t);
+    w[3] = 0.5*(t3 - t2);
+}
+
+static int clamp_row(int y)
+{
+    return y < 0 ? 0 : (y > GEOID_HEIGHT-1 ? GEOID_HEIGHT-1 : y);
+}
+
+static int wrap_column(int x)
+{
+    x %= GEOID_WIDTH;
+    return x < 0 ? x + GEOID_WIDTH : x;
+}
+
+static float geoid_lookup(double lat, double lon, geoid_interp_t interp)
+{
     if (lon < 0) lon += 360;
 
     if (lat > 90 || lat < -90 || lon < 0 || lon >= 360) {
@@ -39,16 +219,71 @@ float get_geoid_height(double lat, double lon)
         return 0;
     }
 
-    // Y: 721 records = 180*4+1, 
+    // Y: 721 records = 180*4+1,
     //    from 90 degrees North down to 90 degrees South every 0.25 degrees.
+    double fy = (90-lat)*GEOID_POSTS_PER_DEGREE;
 
-    int y = (int)(90-lat)*4;
-
-    // X: 1440 elements = 360*4, 
+    // X: 1440 elements = 360*4,
     //    from 0 degrees East to 359.75 degrees East every 0.25 degrees.
+    double fx = lon*GEOID_POSTS_PER_DEGREE;
+
+    int x = (int)floor(fx);
+    int y = (int)floor(fy);
+    double tx = fx - x;
+    double ty = fy - y;
 
-    int x = (int)lon*4;
+    switch (interp) {
+      case GEOID_NEAREST:
+        return geoid_height_at(wrap_column(x + (tx >= 0.5)),
+                               clamp_row(y + (ty >= 0.5)));
 
-    return geoid_height_at(x,y);
+      case GEOID_BICUBIC:
+      {
+        double wx[4], wy[4], sum = 0;
+        int ii, jj;
+        cubic_weights(tx, wx);
+        cubic_weights(ty, wy);
+        for (ii=0; ii<4; ii++) {
+          int row = clamp_row(y+ii-1);
+          double r = 0;
+          for (jj=0; jj<4; jj++)
+            r += wx[jj]*geoid_height_at(wrap_column(x+jj-1), row);
+          sum += wy[ii]*r;
+        }
+        return (float) sum;
+      }
+
+      case GEOID_BILINEAR:
+      default:
+      {
+        int x1 = wrap_column(x+1);
+        int y1 = clamp_row(y+1);
+        double top = (1-tx)*geoid_height_at(x,y) + tx*geoid_height_at(x1,y);
+        double bot = (1-tx)*geoid_height_at(x,y1) + tx*geoid_height_at(x1,y1);
+        return (float) ((1-ty)*top + ty*bot);
+      }
+    }
 }
 
+// Geoid height, in meters, at the given point (degrees).  Bilinearly
+// interpolated between the grid posts.
+float get_geoid_height(double lat, double lon)
+{
+    return get_geoid_height_ext(lat, lon, GEOID_BILINEAR);
+}
+
+float get_geoid_height_ext(double lat, double lon, geoid_interp_t interp)
+{
+    init_geoid();
+    return geoid_lookup(lat, lon, interp);
+}
+
+// Batched version: heights[i] is the geoid height at (lat[i], lon[i]).
+void get_geoid_heights(int n, const double *lat, const double *lon,
+                       geoid_interp_t interp, float *heights)
+{
+    int ii;
+    init_geoid();
+    for (ii=0; ii<n; ii++)
+        heights[ii] = geoid_lookup(lat[ii], lon[ii], interp);
+}
@@ -166,13 +166,17 @@ void JRS_PCM_sync(JRS_PCM *p)
 {
 /*Find the bit offset to the frame start (search over two frame's worth)*/
 	int bitOffset;
+	const unsigned int frameSync=0xFAF320;
+	const unsigned char *bits=p->pcmBits;
+	/*Slide a 24-bit window along the bits, instead of re-extracting
+	  three bytes at every offset*/
+	unsigned int window=(bits[0]<<16)|(bits[1]<<8)|(bits[2]);
 	for (bitOffset=0;bitOffset<8*256;bitOffset++)
 	{
-		static const unsigned char frameSync[3]={0xFA,0xF3,0x20};
-		unsigned char curSync[3];
-		extractBits(p->pcmBits,bitOffset,3,curSync);
-		if ((frameSync[0]==curSync[0])&&(frameSync[1]==curSync[1])&&(frameSync[2]==curSync[2]))
+		int next=bitOffset+24;
+		if ((window&0xFFFFFF)==frameSync)
 			break;/*Jump out of loop*/
+		window=(window<<1)|(1&(bits[next/8]>>(7-next%8)));
 	}
 	p->startBit=bitOffset;
 
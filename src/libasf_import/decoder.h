@@ -132,6 +132,7 @@ void extractBits(signalType *in,int bitStart,int nBytes,signalType *out);
 void RSAT_unpackCeosBytes(signalType *in,int nIn,iqType *out);
 iqType *RSAT_unpackBytes(signalType *in,int nIn,iqType *out);
 iqType *JERS_unpackBytes(signalType *in,int nIn,iqType *out);
+iqType *JERS_unpackBits(signalType *in,int bitStart,int nIn,iqType *out);
 iqType *ERS_unpackBytes(signalType *in,int nIn,iqType *out);
 
 
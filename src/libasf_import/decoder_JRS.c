@@ -22,15 +22,13 @@ This file ingests VEXCEL Level-0 products from the JERS satellite.
  * Extracts valid signal data from packed pulse structure, stripping headers.*/
 void decodePulse(signalType *pulse,iqType *iqBuf)
 {
-    signalType alignedBuf[2*1536/8];
     int i;
     iqType *iqCurr=iqBuf;
 
     for (i=0;i<12;i++)
     {/*We have to skip the sync, h/k data, frame count, and first PCM block.
       We then get 1536 bits from each channel, skip 3 bits, etc..*/
-        extractBits(pulse,2*(30+69+24+3+1539*i),2*1536/8,alignedBuf);
-        iqCurr=JERS_unpackBytes(alignedBuf,2*1536/8,iqCurr);
+        iqCurr=JERS_unpackBits(pulse,2*(30+69+24+3+1539*i),2*1536/8,iqCurr);
     }
 }
 
@@ -14,6 +14,11 @@ void check_sync(const unsigned char *sync,int nBytes,const unsigned char *trueVa
 {
   static int totalErrors=0,totalChecked=0;
   int i;
+  /*Nearly every sync is good: only go byte by byte when it isn't*/
+  if (memcmp(sync,trueVal,nBytes)==0) {
+    totalChecked+=nBytes;
+    return;
+  }
   for (i=0;i<nBytes;i++) {
     if (sync[i]!=trueVal[i]) {
       totalErrors++;
@@ -90,17 +95,32 @@ void scaleSamples(bin_state *s,iqType *buf,int start,int num,float factor)
   }
 }
 
+/*Number of one bits in each possible byte*/
+static const unsigned char bitCount[256]={
+  0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+  1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
+  1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+  1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+  2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+  3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+  3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+  4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
+};
+
 /*Return the number of bit errors between
 the bytes A and B.
 */
 int num_bit_errors(unsigned char a,unsigned char b)
 {
-  int numErrs=0;
-  int bitNo;
-  int xor=a^b;/*Compute bitwise XOR, and count the one bits*/
-  for (bitNo=0;bitNo<8;bitNo++)
-    numErrs+=((xor>>bitNo)&1);
-  return numErrs;
+  return bitCount[a^b];/*Count the one bits of the bitwise XOR*/
 }
 
 /*Create a bit-error table, where table[(a<<8)+b]==num_bit_errors(a,b)
@@ -112,13 +132,11 @@ unsigned char *createBitErrorTable(void)
   int a,b;
   for (a=0;a<256;a++)
     for (b=0;b<256;b++)
-      table[(a<<8)+b]=num_bit_errors(
-        (unsigned char)a,(unsigned char)b);
+      table[(a<<8)+b]=bitCount[a^b];
   return table;
 }
 
 
-
 /***********************************
 extractBits:
   Pulls the specified number of
@@ -130,13 +148,13 @@ void extractBits(signalType *in,int bitStart,int nBytes,signalType *out)
 /*Advance as many bytes as we can.*/
   in+=bitStart/8;
   bitStart-=(bitStart/8)*8;
+/*Byte-aligned data is just a copy.*/
+  if (bitStart==0) {
+    memcpy(out,in,nBytes);
+    return;
+  }
 /*Loop over output bytes, reading appropriate location from input.*/
   for (i=0;i<nBytes;i++)
     out[i]=(in[i]<<bitStart) | (in[i+1]>>(8-bitStart));
 
 }
-
-
-
-
-
@@ -20,13 +20,49 @@ void import_ceos_raw(char *inDataName, char *inMetaName, char *outDataName,
          char *outMetaName, char *bandExt, int band, int nBands,
          radiometry_t radiometry, int line, int sample, int width, int height,
          int import_single_band);
-void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
-              char *outMetaName, char *bandExt, int band, int nBands,
-              int nBandsOut, radiometry_t radiometry,
+
+// Number of CEOS records read from a band file at a time
+#define CEOS_LINE_BATCH 64
+
+// A CEOS band being imported.  The metadata for the bands of a product is
+// set up one band after another, the image data of all the bands is then
+// converted concurrently, each band with its own file handles.
+typedef struct {
+  meta_parameters *meta;
+  FILE *fpIn, *fpOut;
+  char bandExt[10];
+  data_type_t data_type;
+  radiometry_t radiometry;
+  int band, import_single_band, amp0_flag, complex_flag, multilook_flag;
+  int apply_ers2_gain_fix_flag, db_flag, projected, flip;
+  float gain_adj;
+  int nl, ns, nLooks, leftFill, reclen;
+  long long headerBytes;
+  char *lutName;
+  double *incid_table, *scale_table;
+  int min, max;
+  float *incid;
+  int meter;              // show a line meter (set when running alone)
+} ceos_band_t;
+
+// Reads a band file a batch of records at a time
+typedef struct {
+  FILE *fp;
+  long long headerBytes;
+  int reclen, lineBytes, nl;
+  int first, count;       // lines currently held in buf
+  unsigned char *buf;
+} ceos_line_reader_t;
+
+static ceos_band_t *import_ceos_data_init(char *inDataName,
+                      char *inMetaName, char *outDataName,
+                      char *outMetaName, char *bandExt, int band, int nBands,
+                      int nBandsOut, radiometry_t radiometry,
                       int line, int sample, int width, int height,
                       int import_single_band, int complex_flag,
                       int multilook_flag, char *lutName, int amp0_flag,
                       int apply_ers2_gain_fix_flag);
+static void import_ceos_bands(ceos_band_t **bands, int *nBands);
 
 void import_ceos_int_slant_range_amp(char *inDataName, char *inMetaName,
        char *outDataName, char *outMetaName, meta_parameters *meta, int band,
@@ -251,6 +287,10 @@ void import_ceos(char *inBaseName, char *outBaseName,
     nBandsOut = 1;
   }
 
+  // Bands that go through import_ceos_data_init() are converted together
+  ceos_band_t **jobs = (ceos_band_t **) MALLOC(sizeof(ceos_band_t *)*nBandsOut);
+  int nJobs = 0;
+
   for (ii=0; ii<nBandsOut; ii++) {
 
     if (do_resample) {
@@ -376,6 +416,8 @@ void import_ceos(char *inBaseName, char *outBaseName,
 
     // This is the little extra exit for importing only amplitude images
     if (band_id && strcmp_case(band_id, "NONE") == 0 && ii>0) {
+      import_ceos_bands(jobs, &nJobs);
+      FREE(jobs);
       if (do_resample) {
         if (range_scale < 0) {
           range_scale = DEFAULT_RANGE_SCALE;
@@ -435,7 +477,8 @@ void import_ceos(char *inBaseName, char *outBaseName,
         }
         else if (ceos->product == SSG || ceos->product == GEC ||
          ceos->product == SCN) {
-          import_ceos_data(inBandName[index], inMetaName[0], outDataName,
+          jobs[nJobs++] =
+            import_ceos_data_init(inBandName[index], inMetaName[0], outDataName,
                            outMetaName, bandExt, band, nBands, nBandsOut, rad,
                            line, sample, width, height,
                            import_single_band, complex_flag, multilook_flag,
@@ -448,7 +491,8 @@ void import_ceos(char *inBaseName, char *outBaseName,
         }
       }
       else {
-        import_ceos_data(inBandName[index], inMetaName[0], outDataName,
+        jobs[nJobs++] =
+          import_ceos_data_init(inBandName[index], inMetaName[0], outDataName,
                          outMetaName, bandExt, band, nBands, nBandsOut, rad,
                          line, sample, width, height,
                          import_single_band, complex_flag, multilook_flag,
@@ -459,6 +503,8 @@ void import_ceos(char *inBaseName, char *outBaseName,
       meta_free(meta);
     }
   }
+  import_ceos_bands(jobs, &nJobs);
+  FREE(jobs);
 
   // Resample, if necessary
   if (do_resample) {
@@ -1236,7 +1282,8 @@ static float apply_ers2_gain_fix(radiometry_t radiometry, float correction,
 }
 
 // Import all flavors of detected data
-void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
+static ceos_band_t *import_ceos_data_init(char *inDataName,
+                      char *inMetaName, char *outDataName,
                       char *outMetaName, char *bandExt, int band, int nBands,
                       int nBandsOut, radiometry_t radiometry,
                       int line, int sample, int width, int height,
@@ -1244,51 +1291,15 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                       int multilook_flag, char *lutName, int amp0_flag,
                       int apply_ers2_gain_fix_flag)
 {
-  FILE *fpIn=NULL;
-  int nl, ns, lc, nLooks, flip=FALSE, leftFill, rightFill, headerBytes;
-  int out = 0;
-  int min, max;
+  ceos_band_t *b = (ceos_band_t *) CALLOC(1, sizeof(ceos_band_t));
+  int nl, ns, nLooks, rightFill;
+  int min = 0, max = 0;
   int projected = 0; // Set to true if data is geocoded
-  long long ii, kk, ll, mm, offset;
-  float fValue;
-  double *incid_table, *scale_table;
+  double *incid_table=NULL, *scale_table=NULL;
   struct IOF_VFDR image_fdr;
   meta_parameters *meta;
   data_type_t data_type;
 
-  // input buffers
-  unsigned char *byte_buf=NULL, *cpx_byte_buf=NULL, *tmp_byte_buf=NULL;
-  unsigned short *short_buf=NULL, *tmp_short_buf=NULL;
-  short *cpx_short_buf=NULL, *tmp_cpx_short_buf=NULL;
-  int *int_buf=NULL, *cpx_int_buf=NULL, *tmp_int_buf=NULL;
-  float *float_buf=NULL, *cpx_float_buf=NULL, *tmp_float_buf=NULL;
-  double *double_buf=NULL, *cpx_double_buf=NULL, *tmp_double_buf=NULL;
-
-  // output buffers
-  unsigned char *amp_byte_buf=NULL;
-  float *amp_float_buf=NULL;
-  float *phase_float_buf=NULL;
-  float *incid=NULL;
-  complexFloat cpx, *cpxFloat_buf=NULL, *cpx_float_ml_buf=NULL;
-
-  // Output file will stay open through multiple calls to this function.
-  // We open it on first call, try to close it on the last call.
-  // Attempt to detect if we are called again after file was closed
-  // using the "output_file_closed" flag -- die if set.
-  // To handle batch mode, we reset the "output_file_closed" flag if we
-  // are going to open the file.
-  static FILE *fpOut = NULL;
-  static int output_file_closed = FALSE;
-  if (band == 1 || import_single_band) {
-      if (fpOut) {
-          asfPrintError("Impossible: Output file should not be opened!\n");
-      }
-      output_file_closed = FALSE;
-  }
-  if (output_file_closed) {
-    asfPrintError("Impossible: Output file has already been closed!\n");
-  }
-
   // Create metadata
   meta = meta_create(inMetaName);
   strcpy(meta->general->basename, inDataName);
@@ -1361,10 +1372,10 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   nl = meta->general->line_count;
   ns = meta->general->sample_count;
   if (meta->sar) {
-    lc = nLooks = meta->sar->look_count;
+    nLooks = meta->sar->look_count;
   }
   else {
-    lc = nLooks = 1;
+    nLooks = 1;
   }
 
   // PP Earth Radius Kludge
@@ -1456,62 +1467,228 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   else {
     strcat(outDataName, TOOLS_IMAGE_EXT);
   }
-  fpIn  = fopenImage(inDataName, "rb");
-  if (!fpOut) {
-    fpOut = fopenImage(outDataName, "wb");
+  // Each band gets its own handle on the output file, the first band
+  // creates (or truncates) it.  Bands never overlap in the file, so they
+  // can be written independently.
+  if (band == 1 || import_single_band) {
+    FILE *fp = fopenImage(outDataName, "wb");
+    FCLOSE(fp);
   }
+  b->fpIn = fopenImage(inDataName, "rb");
+  b->fpOut = fopenImage(outDataName, "r+b");
+
+  char *data_type_str = data_type2str(data_type);
+  asfPrintStatus("   Data type: %s\n", data_type_str);
+  FREE(data_type_str);
+
+  // Figure out left fill and right fill
+  if ((strcmp(meta->general->sensor, "ALOS") == 0 && meta->optical) ||
+      strncmp_case(meta->general->processor, "CSTARS", 6) == 0) {
+    get_ALOS_optical_ifiledr(inMetaName,&image_fdr);
+    b->leftFill = image_fdr.predata + image_fdr.lbrdrpxl;
+    rightFill = image_fdr.sufdata + image_fdr.rbrdrpxl;
+  }
+  else {
+    get_ifiledr(inMetaName,&image_fdr);
+    b->leftFill = image_fdr.lbrdrpxl;
+    rightFill = image_fdr.rbrdrpxl;
+  }
+  b->headerBytes = firstRecordLen(inDataName) +
+                (image_fdr.reclen - (ns + b->leftFill + rightFill) * image_fdr.bytgroup);
+  meta->general->sample_count -= b->leftFill;
+
+  // Set metadata for multilooking
+  if (meta->sar) {
+      if (data_type >= COMPLEX_BYTE) {
+          meta->sar->multilook = 0;
+      }
+      else {
+          meta->sar->multilook = 1;
+      }
+
+      // If multilook flag is true but data is already multilooked, turn off flag
+      if (multilook_flag && meta->sar && meta->sar->multilook) {
+          multilook_flag = FALSE;
+      }
+
+      if (multilook_flag) {
+          meta->general->line_count = (int)((float)nl / (float)nLooks + 0.99);
+          meta->general->y_pixel_size *= nLooks;
+          meta->sar->azimuth_time_per_pixel *= nLooks;
+          meta->sar->multilook = 1;
+      }
+  }
+
+  // Populate incidence angle array for calibration
+  //
+  // 1. If the image is not geocoded, then this array will be sample_count long
+  //    and will contain one incidence angle for each pixel.
+  // 2. If the image IS geocoded however, this array will contain 11 coefficients
+  //    for a 2D quadratic fit
+  if (meta->sar) {
+    b->incid = incid_init(meta);
+  }
+
+  // Check whether image needs to be flipped
+  if (meta->general->orbit_direction == 'D' &&
+      (!meta->projection || meta->projection->type != SCANSAR_PROJECTION) &&
+      (strncmp_case(meta->general->processor, "CDPF", 4) == 0 ||
+       strncmp_case(meta->general->processor, "RSI", 3) == 0 ||
+       strncmp_case(meta->general->processor, "KACST", 5) == 0))
+  {
+    b->flip = TRUE;
+  }
+
+  b->meta = meta;
+  strcpy(b->bandExt, bandExt);
+  b->data_type = data_type;
+  b->radiometry = radiometry;
+  b->band = band;
+  b->import_single_band = import_single_band;
+  b->amp0_flag = amp0_flag;
+  b->complex_flag = complex_flag;
+  b->multilook_flag = multilook_flag;
+  b->apply_ers2_gain_fix_flag = apply_ers2_gain_fix_flag;
+  b->gain_adj = apply_ers2_gain_fix_flag ?
+    get_ers2_gain_adj(meta, radiometry) : 0.0;
+  b->db_flag = db_flag;
+  b->projected = projected;
+  b->reclen = image_fdr.reclen;
+  b->nl = nl;
+  b->ns = ns;
+  b->nLooks = nLooks;
+  b->lutName = lutName;
+  b->incid_table = incid_table;
+  b->scale_table = scale_table;
+  b->min = min;
+  b->max = max;
+
+  // The metadata is complete at this point.  Write it out now, since the
+  // next band builds its band list on top of it.
+  int band_count = meta->general->band_count;
+
+  // Set radiometry
+  meta->general->radiometry = radiometry;
+
+  // Ensure that the band count always matches the number of bands in
+  // the bands string -- to do that, we just count the commas
+  meta->general->band_count = 1 + count_char(meta->general->bands, ',');
+
+  // Save the metadata
+  meta_write(meta, outMetaName);
+
+  // ... but keep writing the image data the same way as before
+  meta->general->band_count = band_count;
+
+  return b;
+}
+
+// Returns line "line" of the band's image data.  Lines are read from the
+// file CEOS_LINE_BATCH records at a time.
+static unsigned char *ceos_read_line(ceos_line_reader_t *r, int line)
+{
+  if (line < r->first || line >= r->first + r->count) {
+    int n = CEOS_LINE_BATCH;
+    if (line + n > r->nl)
+      n = r->nl - line;
+    FSEEK64(r->fp, r->headerBytes + (long long)line*r->reclen, SEEK_SET);
+    FREAD(r->buf, 1, (size_t)(n-1)*r->reclen + r->lineBytes, r->fp);
+    r->first = line;
+    r->count = n;
+  }
+  return r->buf + (size_t)(line - r->first)*r->reclen;
+}
+
+// Converts the image data of one band -- the asf_parallel_fn that
+// import_ceos_bands() runs over all the bands of a product.
+static void import_ceos_data_run(int i, int thread, void *params)
+{
+  ceos_band_t *b = ((ceos_band_t **) params)[i];
+  meta_parameters *meta = b->meta;
+  FILE *fpOut = b->fpOut;
+  char *bandExt = b->bandExt;
+  data_type_t data_type = b->data_type;
+  radiometry_t radiometry = b->radiometry;
+  int nl = b->nl, ns = b->ns, nLooks = b->nLooks, lc = b->nLooks;
+  int flip = b->flip, leftFill = b->leftFill;
+  int band = b->band, import_single_band = b->import_single_band;
+  int amp0_flag = b->amp0_flag;
+  int complex_flag = b->complex_flag, multilook_flag = b->multilook_flag;
+  int apply_ers2_gain_fix_flag = b->apply_ers2_gain_fix_flag;
+  int db_flag = b->db_flag, projected = b->projected;
+  char *lutName = b->lutName;
+  double *incid_table = b->incid_table, *scale_table = b->scale_table;
+  int min = b->min, max = b->max;
+  float *incid = b->incid;
+  int out = 0;
+  long long ii, kk, ll, mm;
+  float fValue;
+  unsigned char *rec;
+  ceos_line_reader_t reader;
+
+  // input buffers
+  unsigned char *byte_buf=NULL, *cpx_byte_buf=NULL, *tmp_byte_buf=NULL;
+  unsigned short *short_buf=NULL, *tmp_short_buf=NULL;
+  short *cpx_short_buf=NULL, *tmp_cpx_short_buf=NULL;
+  int *int_buf=NULL, *cpx_int_buf=NULL, *tmp_int_buf=NULL;
+  float *float_buf=NULL, *cpx_float_buf=NULL, *tmp_float_buf=NULL;
+  double *double_buf=NULL, *cpx_double_buf=NULL, *tmp_double_buf=NULL;
+
+  // output buffers
+  float *amp_float_buf=NULL;
+  float *phase_float_buf=NULL;
+  complexFloat cpx, *cpxFloat_buf=NULL, *cpx_float_ml_buf=NULL;
+
+  reader.fp = b->fpIn;
+  reader.headerBytes = b->headerBytes;
+  reader.reclen = b->reclen;
+  reader.lineBytes = ns*data_type2sample_size(data_type);
+  reader.nl = nl;
+  reader.first = reader.count = 0;
+  reader.buf = (unsigned char *)
+    MALLOC((size_t)(CEOS_LINE_BATCH-1)*b->reclen + reader.lineBytes);
 
   // Allocate memory for input buffers
   switch (data_type) {
     case BYTE:
       byte_buf = (unsigned char *) CALLOC(ns, sizeof(unsigned char));
       tmp_byte_buf = (unsigned char *) CALLOC(ns, sizeof(unsigned char));
-      asfPrintStatus("   Data type: BYTE\n");
       break;
     case INTEGER16:
       short_buf = (unsigned short *) CALLOC(ns, sizeof(unsigned short));
       tmp_short_buf = (unsigned short *) CALLOC(ns, sizeof(unsigned short));
-      asfPrintStatus("   Data type: INTEGER16\n");
       break;
     case INTEGER32:
       int_buf = (int *) CALLOC(ns, sizeof(int));
       tmp_int_buf = (int *) CALLOC(ns, sizeof(int));
-      asfPrintStatus("   Data type: INTEGER32\n");
       break;
     case REAL32:
       float_buf = (float *) CALLOC(ns, sizeof(float));
       tmp_float_buf = (float *) CALLOC(ns, sizeof(float));
-      asfPrintStatus("   Data type: REAL32\n");
       break;
     case REAL64:
       double_buf = (double *) CALLOC(ns, sizeof(double));
       tmp_double_buf = (double *) CALLOC(ns, sizeof(double));
-      asfPrintStatus("   Data type: REAL64\n");
       break;
     case COMPLEX_BYTE:
       cpx_byte_buf = (unsigned char *) CALLOC(2*ns*lc, sizeof(unsigned char));
       tmp_byte_buf =  (unsigned char *) CALLOC(2*ns*lc, sizeof(unsigned char));
-      asfPrintStatus("   Data type: COMPLEX_BYTE\n");
       break;
     case COMPLEX_INTEGER16:
       cpx_short_buf = (short *) CALLOC(2*ns*lc, sizeof(short));
       tmp_cpx_short_buf = (short *) CALLOC(2*ns*lc, sizeof(short));
-      asfPrintStatus("   Data type: COMPLEX_INTEGER16\n");
       break;
     case COMPLEX_INTEGER32:
       cpx_int_buf = (int *) CALLOC(2*ns*lc, sizeof(int));
       tmp_int_buf = (int *) CALLOC(2*ns*lc, sizeof(int));
-      asfPrintStatus("   Data type: COMPLEX_INTEGER32\n");
       break;
     case COMPLEX_REAL32:
       cpx_float_buf = (float *) CALLOC(2*ns*lc, sizeof(float));
       tmp_float_buf = (float *) CALLOC(2*ns*lc, sizeof(float));
-      asfPrintStatus("   Data type: COMPLEX_REAL32\n");
       break;
     case COMPLEX_REAL64:
-      cpx_double_buf = (double *) CALLOC(2*ns*lc, sizeof(float));
-      tmp_double_buf = (double *) CALLOC(2*ns*lc, sizeof(float));
-      asfPrintStatus("   Data type: COMPLEX_REAL64\n");
+      cpx_double_buf = (double *) CALLOC(2*ns*lc, sizeof(double));
+      tmp_double_buf = (double *) CALLOC(2*ns*lc, sizeof(double));
       break;
   }
 
@@ -1543,68 +1720,8 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
         break;
   }
 
-  // Figure out left fill and right fill
-  if ((strcmp(meta->general->sensor, "ALOS") == 0 && meta->optical) ||
-      strncmp_case(meta->general->processor, "CSTARS", 6) == 0) {
-    get_ALOS_optical_ifiledr(inMetaName,&image_fdr);
-    leftFill = image_fdr.predata + image_fdr.lbrdrpxl;
-    rightFill = image_fdr.sufdata + image_fdr.rbrdrpxl;
-  }
-  else {
-    get_ifiledr(inMetaName,&image_fdr);
-    leftFill = image_fdr.lbrdrpxl;
-    rightFill = image_fdr.rbrdrpxl;
-  }
-  headerBytes = firstRecordLen(inDataName) +
-                (image_fdr.reclen - (ns + leftFill + rightFill) * image_fdr.bytgroup);
-  meta->general->sample_count -= leftFill;
-
-  // Set metadata for multilooking
-  if (meta->sar) {
-      if (data_type >= COMPLEX_BYTE) {
-          meta->sar->multilook = 0;
-      }
-      else {
-          meta->sar->multilook = 1;
-      }
-
-      // If multilook flag is true but data is already multilooked, turn off flag
-      if (multilook_flag && meta->sar && meta->sar->multilook) {
-          multilook_flag = FALSE;
-      }
-
-      if (multilook_flag) {
-          meta->general->line_count = (int)((float)nl / (float)nLooks + 0.99);
-          meta->general->y_pixel_size *= nLooks;
-          meta->sar->azimuth_time_per_pixel *= nLooks;
-          meta->sar->multilook = 1;
-      }
-  }
-
-  // Populate incidence angle array for calibration
-  //
-  // 1. If the image is not geocoded, then this array will be sample_count long
-  //    and will contain one incidence angle for each pixel.
-  // 2. If the image IS geocoded however, this array will contain 11 coefficients
-  //    for a 2D quadratic fit
-  if (meta->sar) {
-    incid = incid_init(meta);
-  }
-
-  // Check whether image needs to be flipped
-  if (meta->general->orbit_direction == 'D' &&
-      (!meta->projection || meta->projection->type != SCANSAR_PROJECTION) &&
-      (strncmp_case(meta->general->processor, "CDPF", 4) == 0 ||
-       strncmp_case(meta->general->processor, "RSI", 3) == 0 ||
-       strncmp_case(meta->general->processor, "KACST", 5) == 0))
-  {
-    flip = TRUE;
-  }
-
   if (data_type >= COMPLEX_BYTE) {
-    float gain_adj = 0.0;
-    if (apply_ers2_gain_fix_flag)
-        gain_adj = get_ers2_gain_adj(meta,radiometry);
+    float gain_adj = b->gain_adj;
 
     // Go through complex imagery in chunks
     for (ii = 0; ii < nl; ii += nLooks) {
@@ -1615,26 +1732,26 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
 
       for (ll = 0; ll < lc; ll++) {
         int line = ii+ll;
-        asfLineMeter(line, nl);
-        offset = (long long)headerBytes+ (ii+ll)*(long long)image_fdr.reclen;
-        FSEEK64(fpIn, offset, SEEK_SET);
+        if (b->meter)
+          asfLineMeter(line, nl);
+        rec = ceos_read_line(&reader, line);
 
         // Read the data according to their data type
         switch (data_type) {
           case COMPLEX_BYTE:
-            FREAD(cpx_byte_buf+2*ll*ns, sizeof(unsigned char), 2*ns, fpIn);
+            memcpy(cpx_byte_buf+2*ll*ns, rec, 2*ns*sizeof(unsigned char));
             break;
           case COMPLEX_INTEGER16:
-            FREAD(cpx_short_buf+2*ll*ns, sizeof(short), 2*ns, fpIn);
+            memcpy(cpx_short_buf+2*ll*ns, rec, 2*ns*sizeof(short));
             break;
           case COMPLEX_INTEGER32:
-            FREAD(cpx_int_buf+2*ll*ns, sizeof(int), 2*ns, fpIn);
+            memcpy(cpx_int_buf+2*ll*ns, rec, 2*ns*sizeof(int));
             break;
           case COMPLEX_REAL64:
-            FREAD(cpx_double_buf+2*ll*ns, sizeof(double), 2*ns, fpIn);
+            memcpy(cpx_double_buf+2*ll*ns, rec, 2*ns*sizeof(double));
             break;
           case COMPLEX_REAL32:
-            FREAD(cpx_float_buf+2*ll*ns, sizeof(float), 2*ns, fpIn);
+            memcpy(cpx_float_buf+2*ll*ns, rec, 2*ns*sizeof(float));
             break;
           case BYTE:
           case INTEGER16:
@@ -1849,6 +1966,9 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
         --out_band;
       }
 
+      // complex output keeps one (complex) band per input band
+      int cpx_band = import_single_band ? 0 : band - 1;
+
       if (apply_ers2_gain_fix_flag && strcmp(meta->general->sensor,"ERS2") == 0)
       {
         if (radiometry != r_AMP) {
@@ -1883,7 +2003,9 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
       else {
         for (mm=0; mm<lc; mm++) {
           if (complex_flag) {
-            put_complexFloat_line(fpOut, meta, ii+mm, cpxFloat_buf+mm*ns);
+            put_complexFloat_line(fpOut, meta,
+                                  cpx_band*meta->general->line_count + ii+mm,
+                                  cpxFloat_buf+mm*ns);
           }
           else {
             put_band_float_line(fpOut, meta, out_band+0, ii+mm,
@@ -1899,35 +2021,32 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   }
   else {
     // Go through detected imagery line by line
-    float gain_adj = 0.0;
-    if (apply_ers2_gain_fix_flag)
-        gain_adj = get_ers2_gain_adj(meta,radiometry);
+    float gain_adj = b->gain_adj;
 
     for (ii=0; ii<nl; ii++) {
-      asfLineMeter(ii, nl);
-
-      offset = (long long)headerBytes+ ii*(long long)image_fdr.reclen;
-      FSEEK64(fpIn, offset, SEEK_SET);
+      if (b->meter)
+        asfLineMeter(ii, nl);
+      rec = ceos_read_line(&reader, ii);
 
       // Read the data according to their data type
       switch (data_type) {
         case REAL32:
-            FREAD(float_buf, sizeof(float), ns, fpIn);
+            memcpy(float_buf, rec, ns*sizeof(float));
             break;
         case BYTE:
-            FREAD(byte_buf, sizeof(unsigned char), ns, fpIn);
+            memcpy(byte_buf, rec, ns*sizeof(unsigned char));
             break;
         case INTEGER16:
-            FREAD(short_buf, sizeof(short), ns, fpIn);
+            memcpy(short_buf, rec, ns*sizeof(short));
             break;
         case INTEGER32:
-            FREAD(int_buf, sizeof(int), ns, fpIn);
+            memcpy(int_buf, rec, ns*sizeof(int));
             break;
         case REAL64:
-            FREAD(double_buf, sizeof(double), ns, fpIn);
+            memcpy(double_buf, rec, ns*sizeof(double));
             break;
         case COMPLEX_BYTE:
-            FREAD(cpx_byte_buf, sizeof(unsigned char), 2*ns, fpIn);
+            memcpy(cpx_byte_buf, rec, 2*ns*sizeof(unsigned char));
             break;
         case COMPLEX_INTEGER16:
         case COMPLEX_INTEGER32:
@@ -2089,10 +2208,10 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
 				     (float)int_buf[kk], bandExt, db_flag);
                     }
                     else if (radiometry == r_POWER) {
-                        amp_float_buf[ns+kk] = (float) int_buf[kk]*int_buf[kk];
+                        amp_float_buf[kk] = (float) int_buf[kk]*int_buf[kk];
                     }
                     else {
-                        amp_float_buf[ns+kk] = (float) int_buf[kk];
+                        amp_float_buf[kk] = (float) int_buf[kk];
                     }
                     break;
                 case REAL32:
@@ -2164,34 +2283,7 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     }
   }
 
-  if (import_single_band || band == nBandsOut) {
-    FCLOSE(fpOut);
-    fpOut = NULL;
-    output_file_closed = TRUE;
-  }
-
-  // Set radiometry
-  meta->general->radiometry = radiometry;
-
-  // Ensure that the band count always matches the number of bands in
-  // the bands string -- to do that, we just count the commas
-  meta->general->band_count = 1 + count_char(meta->general->bands, ',');
-
-  // Save the metadata
-  meta_write(meta, outMetaName);
-
-  /* for debugging
-     if (isPP(meta))
-     {
-     asfPrintStatus("PP Earth Radius: %.3lf\n", meta->sar->earth_radius_pp);
-     asfPrintStatus("  (for comparison) Scene Center Earth Radius: %.3lf\n",
-     meta->sar->earth_radius);
-     }
-  */
-
-  // Clean up
-  if (incid)
-    FREE(incid);
+  FREE(reader.buf);
   if (byte_buf) {
     FREE(byte_buf);
     FREE(tmp_byte_buf);
@@ -2232,9 +2324,6 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     FREE(cpx_double_buf);
     FREE(tmp_double_buf);
   }
-  if (amp_byte_buf) {
-    FREE(amp_byte_buf);
-  }
   if (cpxFloat_buf) {
     FREE(cpxFloat_buf);
   }
@@ -2248,9 +2337,34 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     FREE(cpx_float_ml_buf);
   }
 
-  meta_free(meta);
+}
 
-  FCLOSE(fpIn);
+static void import_ceos_data_free(ceos_band_t *b)
+{
+  FCLOSE(b->fpIn);
+  FCLOSE(b->fpOut);
+  if (b->incid)
+    FREE(b->incid);
+  meta_free(b->meta);
+  FREE(b);
+}
+
+// Converts the image data for the bands set up so far, all at once, and
+// releases them.
+static void import_ceos_bands(ceos_band_t **bands, int *nBands)
+{
+  int ii, n = *nBands;
+
+  if (n > 1)
+    asfPrintStatus("\n   Converting %d bands ...\n", n);
+  for (ii=0; ii<n; ii++)
+    bands[ii]->meter = n == 1;
+
+  asf_parallel_for(n, import_ceos_data_run, bands);
+
+  for (ii=0; ii<n; ii++)
+    import_ceos_data_free(bands[ii]);
+  *nBands = 0;
 }
 
 double quadratic_2_incidence_angle(long long x, long long y, float *q)
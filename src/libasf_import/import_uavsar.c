@@ -960,6 +960,228 @@ char *check_data_type(const char *inFileName)
   return type;
 }
 
+// Conversion of UAVSAR data to ASF internal format.
+//
+// The UAVSAR files are little endian; the ASF internal bands are big
+// endian.  uavsar_convert() reads a large block of lines at a time,
+// converts the lines of the block in parallel and then writes the
+// output bands of the block, each band through its own file handle so
+// that they are written concurrently.  The per line loops are kept
+// free of branches and library calls so that the compiler can
+// vectorize them.
+
+#define UAVSAR_BLOCK_BYTES (32*1024*1024)
+#define UAVSAR_MAX_OUT 9
+
+typedef enum {
+  UAVSAR_REAL,          // float -> value
+  UAVSAR_REAL_SQRT,     // float -> value, square root of value
+  UAVSAR_COMPLEX,       // complex float -> real part, imaginary part
+  UAVSAR_AMP_PHASE,     // complex float -> amplitude, phase
+  UAVSAR_STOKES         // compressed Stokes matrix -> power,
+                        //   amplitude and phase of HH, HV, VH and VV
+} uavsar_conversion_t;
+
+typedef struct {
+  uavsar_conversion_t conv;
+  radiometry_t radiometry;
+  int ns;                       // samples per line
+  int in_bytes;                 // bytes per input pixel
+  int out_count;                // number of output bands
+  unsigned char *raw;           // block of input lines
+  float *out[UAVSAR_MAX_OUT];   // block of lines of each output band
+  FILE *fp[UAVSAR_MAX_OUT];     // output file handle of each band
+  long long offset[UAVSAR_MAX_OUT]; // file offset of the block, per band
+  int lines;                    // lines in the current block
+} uavsar_block_t;
+
+static void swap32_buf(void *buf, long n)
+{
+  unsigned char *p = (unsigned char *) buf;
+  unsigned int x;
+  long ii;
+
+  for (ii=0; ii<n; ii++) {
+    memcpy(&x, p + 4*ii, 4);
+    x = (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+    memcpy(p + 4*ii, &x, 4);
+  }
+}
+
+// UAVSAR floats are little endian
+static void uavsar_to_host(float *buf, long n)
+{
+#if defined(big_ieee)
+  swap32_buf(buf, n);
+#endif
+}
+
+// ASF internal floats are big endian
+static void host_to_asf(float *buf, long n)
+{
+#if defined(lil_ieee)
+  swap32_buf(buf, n);
+#endif
+}
+
+// Same as atan2_check(), without branches or library calls.  The ratio
+// of the smaller to the larger component is brought to below tan(pi/8),
+// where ten terms of the arctangent series are good to better than
+// 1e-9 radians.
+static double uavsar_atan2(double y, double x)
+{
+  double ax = fabs(x), ay = fabs(y);
+  double mx = ax > ay ? ax : ay;
+  double mn = ax > ay ? ay : ax;
+  double t = mx > 0.0 ? mn/mx : 0.0;
+  int big = t > 0.41421356237309503;
+  double u = big ? (t - 1.0)/(t + 1.0) : t;
+  double u2 = u*u;
+  double r = u*(1.0 - u2*(1.0/3 - u2*(1.0/5 - u2*(1.0/7 - u2*(1.0/9 -
+             u2*(1.0/11 - u2*(1.0/13 - u2*(1.0/15 - u2*(1.0/17 -
+             u2*(1.0/19))))))))));
+  r = big ? r + M_PI/4 : r;
+  r = ay > ax ? M_PI/2 - r : r;
+  r = x < 0.0 ? M_PI - r : r;
+  r = signbit(y) ? -r : r;
+  return mx > 0.0 ? r : 0.0;
+}
+
+static void convert_stokes_line(const signed char *raw, int ns,
+                                radiometry_t radiometry, float **o)
+{
+  int kk, pp;
+
+  for (kk=0; kk<ns; kk++) {
+    const signed char *b = raw + 10*kk;
+    // Scale is always 1.0 according to Bruce Chapman
+    float total_power = ((float)b[1]/254.0 + 1.5) * ldexp(1.0, b[0]);
+    float ysca = 2.0 * sqrt(total_power);
+    o[0][kk] = sqrt(total_power);
+    // HH, HV, VH, VV
+    for (pp=0; pp<4; pp++) {
+      float re = (float)b[2*pp+2] * ysca / 127.0;
+      float im = (float)b[2*pp+3] * ysca / 127.0;
+      float amp = sqrt(re*re + im*im);
+      o[2*pp+1][kk] = radiometry == r_SIGMA ? amp*amp : amp;
+      o[2*pp+2][kk] = uavsar_atan2(im, re);
+    }
+  }
+}
+
+static void convert_line(int ii, int thread, void *params)
+{
+  uavsar_block_t *b = (uavsar_block_t *) params;
+  int ns = b->ns;
+  float *in = (float *) (b->raw + (long)ii*ns*b->in_bytes);
+  float *o[UAVSAR_MAX_OUT];
+  int kk, jj;
+
+  for (jj=0; jj<b->out_count; jj++)
+    o[jj] = b->out[jj] + (long)ii*ns;
+
+  if (b->conv != UAVSAR_STOKES)
+    uavsar_to_host(in, (long)ns*b->in_bytes/sizeof(float));
+
+  switch (b->conv) {
+    case UAVSAR_REAL:
+      // converted in place: out[0] is the input block
+      break;
+    case UAVSAR_REAL_SQRT:
+      for (kk=0; kk<ns; kk++)
+        o[1][kk] = sqrt(in[kk]);
+      break;
+    case UAVSAR_COMPLEX:
+      for (kk=0; kk<ns; kk++) {
+        o[0][kk] = in[2*kk];
+        o[1][kk] = in[2*kk+1];
+      }
+      break;
+    case UAVSAR_AMP_PHASE:
+      for (kk=0; kk<ns; kk++) {
+        double re = in[2*kk], im = in[2*kk+1];
+        o[0][kk] = sqrt(re*re + im*im);
+        o[1][kk] = uavsar_atan2(im, re);
+      }
+      break;
+    case UAVSAR_STOKES:
+      convert_stokes_line((signed char *) in, ns, b->radiometry, o);
+      break;
+  }
+
+  for (jj=0; jj<b->out_count; jj++)
+    host_to_asf(o[jj], ns);
+}
+
+static void write_band_block(int jj, int thread, void *params)
+{
+  uavsar_block_t *b = (uavsar_block_t *) params;
+  FSEEK64(b->fp[jj], b->offset[jj], SEEK_SET);
+  FWRITE(b->out[jj], sizeof(float), (size_t)b->lines*b->ns, b->fp[jj]);
+}
+
+// Converts the UAVSAR data file inName (nl lines of ns pixels) and
+// writes the results to bands band, band+1, ... of the ASF internal
+// image outName, which must already exist.  For UAVSAR_REAL_SQRT, the
+// value goes to band and its square root to sqrt_band.
+static void uavsar_convert(const char *inName, const char *outName,
+                           int nl, int ns, uavsar_conversion_t conv,
+                           radiometry_t radiometry, int band, int sqrt_band)
+{
+  uavsar_block_t b;
+  FILE *fpIn;
+  int ii, jj, block_lines, out_band[UAVSAR_MAX_OUT];
+
+  b.conv = conv;
+  b.radiometry = radiometry;
+  b.ns = ns;
+  switch (conv) {
+    case UAVSAR_REAL:      b.in_bytes = 4;  b.out_count = 1; break;
+    case UAVSAR_REAL_SQRT: b.in_bytes = 4;  b.out_count = 2; break;
+    case UAVSAR_COMPLEX:
+    case UAVSAR_AMP_PHASE: b.in_bytes = 8;  b.out_count = 2; break;
+    case UAVSAR_STOKES:    b.in_bytes = 10; b.out_count = 9; break;
+  }
+
+  block_lines = UAVSAR_BLOCK_BYTES / ((long)ns*b.in_bytes);
+  if (block_lines > nl)
+    block_lines = nl;
+  if (block_lines < 1)
+    block_lines = 1;
+
+  b.raw = (unsigned char *) MALLOC((size_t)block_lines*ns*b.in_bytes);
+  for (jj=0; jj<b.out_count; jj++) {
+    if (conv == UAVSAR_REAL || (conv == UAVSAR_REAL_SQRT && jj == 0))
+      b.out[jj] = (float *) b.raw;
+    else
+      b.out[jj] = (float *) MALLOC(sizeof(float)*block_lines*ns);
+    b.fp[jj] = FOPEN(outName, "r+b");
+    out_band[jj] = band + jj;
+  }
+  if (conv == UAVSAR_REAL_SQRT)
+    out_band[1] = sqrt_band;
+
+  fpIn = FOPEN(inName, "rb");
+  for (ii=0; ii<nl; ii+=block_lines) {
+    asfPercentMeter((double)ii/(double)nl);
+    b.lines = nl - ii < block_lines ? nl - ii : block_lines;
+    FREAD(b.raw, b.in_bytes, (size_t)b.lines*ns, fpIn);
+    asf_parallel_for(b.lines, convert_line, &b);
+    for (jj=0; jj<b.out_count; jj++)
+      b.offset[jj] = ((long long)out_band[jj]*nl + ii)*ns*sizeof(float);
+    asf_parallel_for(b.out_count, write_band_block, &b);
+  }
+  asfPercentMeter(1.0);
+  FCLOSE(fpIn);
+
+  for (jj=0; jj<b.out_count; jj++) {
+    FCLOSE(b.fp[jj]);
+    if (b.out[jj] != (float *) b.raw)
+      FREE(b.out[jj]);
+  }
+  FREE(b.raw);
+}
+
 void import_uavsar(const char *inFileName, int line, int sample, int width,
 		   int height, radiometry_t radiometry,
 		   const char *data_type, const char *outBaseName) {
@@ -995,12 +1217,9 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
   // amp_grd - Ground range amplitudes
   // hgt_grd - Digital elevation model in ground projection
 
-  FILE *fpIn, *fpOut;
-  int ii, kk, ll, nn, pp, nBands, ns, *dataType, product_count;
+  FILE *fpOut;
+  int ll, nn, pp, nBands, ns, *dataType, product_count;
   int multi = FALSE;
-  float *floatAmp, *floatPhase, *floatAmpBuf, *amp, re, im;
-  float *floatComplexReal, *floatComplexImag;
-  float *floatComplexBuf;
   char **dataName, **element, **product, tmp[50];
   char *type;
   char *outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
@@ -1033,9 +1252,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaIn->general->sample_count;
       nn = 0;
-      floatAmp = (float *) CALLOC(ns, sizeof(float));
-      floatPhase = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       metaOut->general->band_count = 2;
       if (multi)
@@ -1044,32 +1260,14 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nGround range interferogram:\n");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       sprintf(metaOut->general->bands, "INTERFEROGRAM_AMP,INTERFEROGRAM_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	metaIn->general->sample_count = 2*ns;
-	get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	for (kk=0; kk<ns; kk++) {
-	  re = floatComplexBuf[kk*2];
-	  im = floatComplexBuf[kk*2+1];
-	  ieee_big32(re);
-	  ieee_big32(im);
-	  floatAmp[kk] = hypot(re,im);
-	  floatPhase[kk] = atan2_check(im,re);
-	}
-	put_band_float_line(fpOut, metaOut, 0, ii, floatAmp);
-	put_band_float_line(fpOut, metaOut, 1, ii, floatPhase);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
-      FCLOSE(fpOut);
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_AMP_PHASE, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmp);
-      FREE(floatPhase);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1092,7 +1290,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_unw_grd.img");
@@ -1102,20 +1299,12 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
-      strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-      asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
+      strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_REAL, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1138,7 +1327,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       if (multi)
 	outName = appendToBasename(outBaseName, "_cor_grd.img");
       else
@@ -1147,20 +1335,12 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
-      strcpy(metaOut->general->bands, "COHERENCE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
+      strcpy(metaOut->general->bands, "COHERENCE");
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_REAL, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1184,32 +1364,23 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut->general->band_count = 2;
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_amp_grd.img");
       else
 	outName = appendExt(outBaseName, ".img");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       strcpy(metaOut->general->bands, "AMP1,AMP2");
       asfPrintStatus("\nGround range amplitude images:\n");
       for (nn=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		       UAVSAR_REAL, radiometry, nn, 0);
       }
-      FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1232,32 +1403,23 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_hgt_grd.img");
       else
 	outName = appendExt(outBaseName, ".img");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       strcpy(metaOut->general->bands, "HEIGHT");
       asfPrintStatus("\nGround range digital elevation model:\n");
       for (nn=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		       UAVSAR_REAL, radiometry, nn, 0);
       }
-      FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1280,9 +1442,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaIn->general->sample_count;
       nn = 0;
-      floatAmp = (float *) CALLOC(ns, sizeof(float));
-      floatPhase = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_int.img");
@@ -1295,32 +1454,14 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nSlant range interferogram:\n");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       sprintf(metaOut->general->bands, "INTERFEROGRAM_AMP,INTERFEROGRAM_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	metaIn->general->sample_count = 2*ns;
-	get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	for (kk=0; kk<ns; kk++) {
-	  re = floatComplexBuf[kk*2];
-	  im = floatComplexBuf[kk*2+1];
-	  ieee_big32(re);
-	  ieee_big32(im);
-	  floatAmp[kk] = hypot(re,im);
-	  floatPhase[kk] = atan2_check(im,re);
-	}
-	put_band_float_line(fpOut, metaOut, 0, ii, floatAmp);
-	put_band_float_line(fpOut, metaOut, 1, ii, floatPhase);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
-      FCLOSE(fpOut);
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_AMP_PHASE, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmp);
-      FREE(floatPhase);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1343,7 +1484,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_unw.img");
@@ -1353,20 +1493,12 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
-      strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
+      strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_REAL, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1389,7 +1521,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut = uavsar_insar2meta(insar_params);
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_cor.img");
@@ -1399,20 +1530,12 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
-      strcpy(metaOut->general->bands, "COHERENCE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
+      strcpy(metaOut->general->bands, "COHERENCE");
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_REAL, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1436,32 +1559,23 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaOut->general->band_count = 2;
       ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_amp.img");
       else
 	outName = appendExt(outBaseName, ".img");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       strcpy(metaOut->general->bands, "AMP1,AMP2");
       asfPrintStatus("\nSlant range amplitude images:\n");
       for (nn=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		       UAVSAR_REAL, radiometry, nn, 0);
       }
-      FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1508,12 +1622,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaIn = uavsar_polsar2meta(polsar_params);
       metaOut = uavsar_polsar2meta(polsar_params);
       ns = metaIn->general->sample_count;
-      amp = (float *) MALLOC(sizeof(float)*ns);
-      floatAmp = (float *) MALLOC(sizeof(float)*ns);
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexReal = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexImag = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexBuf = (float *) MALLOC(sizeof(float)*2*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       metaOut->general->band_count = ll = 1;
       if (multi)
@@ -1522,6 +1630,7 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nMultilooked data:\n");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       for (nn=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
@@ -1530,7 +1639,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	  metaOut->general->band_count += 1;
 	else
 	  metaOut->general->band_count += 2;
-	fpIn = FOPEN(dataName[nn], "rb");
 	if (nn == 0)
 	  sprintf(metaOut->general->bands, "AMP,%s", element[0]);
 	else {
@@ -1540,50 +1648,22 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	    sprintf(tmp, ",%s", element[nn]);
 	  strcat(metaOut->general->bands, tmp);
 	}
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  if (dataType[nn]) {
-	    metaIn->general->sample_count = 2*ns;
-	    get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	    for (kk=0; kk<ns; kk++) {
-	      floatComplexReal[kk] = floatComplexBuf[kk*2];
-	      floatComplexImag[kk] = floatComplexBuf[kk*2+1];
-	      ieee_big32(floatComplexReal[kk]);
-	      ieee_big32(floatComplexImag[kk]);
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatComplexReal);
-	    put_band_float_line(fpOut, metaOut, ll+1, ii, floatComplexImag);
-	  }
-	  else {
-	    metaIn->general->sample_count = ns;
-	    get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	    if (nn == 0) {
-	      for (kk=0; kk<ns; kk++) {
-		ieee_big32(floatAmpBuf[kk]);
-		floatAmp[kk] = sqrt(floatAmpBuf[kk]);
-	      }
-	    }
-	    else {
-	      for (kk=0; kk<ns; kk++) 
-		ieee_big32(floatAmpBuf[kk]);
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatAmpBuf);
-	  }
-	  asfLineMeter(ii, metaIn->general->line_count);      
-	}
+	// The first element also gives the amplitude band
+	if (dataType[nn])
+	  uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+			 UAVSAR_COMPLEX, radiometry, ll, 0);
+	else if (nn == 0)
+	  uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+			 UAVSAR_REAL_SQRT, radiometry, ll, 0);
+	else
+	  uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+			 UAVSAR_REAL, radiometry, ll, 0);
 	if (dataType[nn])
 	  ll += 2;
 	else
 	  ll++;
-	FCLOSE(fpIn);
       }
-      FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(amp);
-      FREE(floatAmp);
-      FREE(floatAmpBuf);
-      FREE(floatComplexReal);
-      FREE(floatComplexImag);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1627,127 +1707,11 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	       "AMP,SIGMA_DB-AMP-HH,SIGMA_DB-PHASE-HH,SIGMA_DB-AMP-HV,"	\
 	       "SIGMA_DB-PHASE-HV,SIGMA_DB-AMP-VH,SIGMA_DB-PHASE-VH,"	\
 	       "SIGMA_DB-AMP-VV,SIGMA_DB-PHASE-VV");
-      int ns = metaOut->general->sample_count;
-      float total_power, ysca, amp, phase;
-      complexFloat cpx;
-      float *power = (float *) MALLOC(sizeof(float)*ns);
-      float *shh_amp = (float *) MALLOC(sizeof(float)*ns);
-      float *shh_phase = (float *) MALLOC(sizeof(float)*ns);
-      float *shv_amp = (float *) MALLOC(sizeof(float)*ns);
-      float *shv_phase = (float *) MALLOC(sizeof(float)*ns);
-      float *svh_amp = (float *) MALLOC(sizeof(float)*ns);
-      float *svh_phase = (float *) MALLOC(sizeof(float)*ns);
-      float *svv_amp = (float *) MALLOC(sizeof(float)*ns);
-      float *svv_phase = (float *) MALLOC(sizeof(float)*ns);
-      char *byteBuf = (char *) MALLOC(sizeof(char)*10);
-      fpIn = FOPEN(dataName[0], "rb");
+      ns = metaOut->general->sample_count;
       fpOut = FOPEN(outName, "wb");
-      for (ii=0; ii<metaOut->general->line_count; ii++) {
-	for (kk=0; kk<metaOut->general->sample_count; kk++) {
-	  FREAD(byteBuf, sizeof(char), 10, fpIn);
-          //float m11, m12, m13, m14, m22, m23, m24, m33, m34, m44;
-	  // Scale is always 1.0 according to Bruce Chapman
-	  //m11 = ((float)byteBuf[1]/254.0 + 1.5) * pow(2, byteBuf[0]);
-	  //m12 = (float)byteBuf[2] * m11 / 127.0;
-	  //m13 = sign(byteBuf[3]) * SQR((float)byteBuf[3] / 127.0) * m11;
-	  //m14 = sign(byteBuf[4]) * SQR((float)byteBuf[4] / 127.0) * m11;
-	  //m23 = sign(byteBuf[5]) * SQR((float)byteBuf[5] / 127.0) * m11;
-	  //m24 = sign(byteBuf[6]) * SQR((float)byteBuf[6] / 127.0) * m11;
-	  //m33 = (float)byteBuf[7] * m11 / 127.0;
-	  //m34 = (float)byteBuf[8] * m11 / 127.0;
-	  //m44 = (float)byteBuf[9] * m11 / 127.0;
-	  //m22 = 1 - m33 -m44;
-	  total_power =
-	    ((float)byteBuf[1]/254.0 + 1.5) * pow(2, byteBuf[0]);
-	  ysca = 2.0 * sqrt(total_power);
-	  power[kk] = sqrt(total_power);
-	  cpx.real = (float)byteBuf[2] * ysca / 127.0;
-	  cpx.imag = (float)byteBuf[3] * ysca / 127.0;
-	  amp = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-	  phase = atan2(cpx.imag, cpx.real);
-	  if (radiometry == r_AMP) {
-	    shh_amp[kk] = amp;
-	    shh_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA) {
-	    shh_amp[kk] = amp*amp;
-	    shh_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA_DB) {
-	    shh_amp[kk] = amp;
-	    shh_phase[kk] = phase;
-	  }
-	  cpx.real = (float)byteBuf[4] * ysca / 127.0;
-	  cpx.imag = (float)byteBuf[5] * ysca / 127.0;
-	  amp = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-	  phase = atan2(cpx.imag, cpx.real);
-	  if (radiometry == r_AMP) {
-	    shv_amp[kk] = amp;
-	    shv_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA) {
-	    shv_amp[kk] = amp*amp;
-	    shv_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA_DB) {
-	    shv_amp[kk] = amp;
-	    shv_phase[kk] = phase;
-	  }
-	  cpx.real = (float)byteBuf[6] * ysca / 127.0;
-	  cpx.imag = (float)byteBuf[7] * ysca / 127.0;
-	  amp = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-	  phase = atan2(cpx.imag, cpx.real);
-	  if (radiometry == r_AMP) {
-	    svh_amp[kk] = amp;
-	    svh_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA) {
-	    svh_amp[kk] = amp*amp;
-	    svh_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA_DB) {
-	    svh_amp[kk] = amp;
-	    svh_phase[kk] = phase;
-	  }
-	  cpx.real = (float)byteBuf[8] * ysca / 127.0;
-	  cpx.imag = (float)byteBuf[9] * ysca / 127.0;
-	  amp = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-	  phase = atan2(cpx.imag, cpx.real);
-	  if (radiometry == r_AMP) {
-	    svv_amp[kk] = amp;
-	    svv_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA) {
-	    svv_amp[kk] = amp*amp;
-	    svv_phase[kk] = phase;
-	  }
-	  else if (radiometry == r_SIGMA_DB) {
-	    svv_amp[kk] = amp;
-	    svv_phase[kk] = phase;
-	  }
-	}
-	put_band_float_line(fpOut, metaOut, 0, ii, power);
-	put_band_float_line(fpOut, metaOut, 1, ii, shh_amp);
-	put_band_float_line(fpOut, metaOut, 2, ii, shh_phase);
-	put_band_float_line(fpOut, metaOut, 3, ii, shv_amp);
-	put_band_float_line(fpOut, metaOut, 4, ii, shv_phase);
-	put_band_float_line(fpOut, metaOut, 5, ii, svh_amp);
-	put_band_float_line(fpOut, metaOut, 6, ii, svh_phase);
-	put_band_float_line(fpOut, metaOut, 7, ii, svv_amp);
-	put_band_float_line(fpOut, metaOut, 8, ii, svv_phase);
-	asfLineMeter(ii, metaOut->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
-      FREE(power);
-      FREE(shh_amp);
-      FREE(shh_phase);
-      FREE(shv_amp);
-      FREE(shv_phase);
-      FREE(svh_amp);
-      FREE(svh_phase);
-      FREE(svv_amp);
-      FREE(svv_phase);
+      uavsar_convert(dataName[0], outName, metaOut->general->line_count, ns,
+		     UAVSAR_STOKES, radiometry, 0, 0);
       meta_write(metaOut, outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1770,10 +1734,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaIn = uavsar_polsar2meta(polsar_params);
       metaOut = uavsar_polsar2meta(polsar_params);
       ns = metaIn->general->sample_count;
-      floatAmpBuf = (float *) CALLOC(ns, sizeof(float));
-      floatComplexReal = (float *) CALLOC(ns, sizeof(float));
-      floatComplexImag = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       metaOut->general->band_count = ll = 0;
       if (multi)
@@ -1782,6 +1742,7 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nGround range projected data:\n");
       fpOut = FOPEN(outName, "wb");
+      FCLOSE(fpOut);
       for (nn=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
@@ -1790,7 +1751,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	  metaOut->general->band_count += 2;
 	else
 	  metaOut->general->band_count += 1;
-	fpIn = FOPEN(dataName[nn], "rb");
 	if (nn == 0)
 	  sprintf(metaOut->general->bands, "%s", element[0]);
 	else {
@@ -1800,43 +1760,18 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
 	    sprintf(tmp, ",%s", element[nn]);
 	  strcat(metaOut->general->bands, tmp);
 	}
-	if (dataType[nn]) {
-	  for (ii=0; ii<metaIn->general->line_count; ii++) {
-	    metaIn->general->sample_count = 2*ns;
-	    get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	    for (kk=0; kk<ns; kk++) {
-	      floatComplexReal[kk] = floatComplexBuf[kk*2];
-	      floatComplexImag[kk] = floatComplexBuf[kk*2+1];
-	      ieee_big32(floatComplexReal[kk]);
-	      ieee_big32(floatComplexImag[kk]);
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatComplexReal);
-	    put_band_float_line(fpOut, metaOut, ll+1, ii, floatComplexImag);
-	    asfLineMeter(ii, metaIn->general->line_count);
-	  }
-	}
-	else {
-	  for (ii=0; ii<metaIn->general->line_count; ii++) {
-	    metaIn->general->sample_count = ns;
-	    get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	    for (kk=0; kk<ns; kk++)
-	      ieee_big32(floatAmpBuf[kk]);
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatAmpBuf);
-	    asfLineMeter(ii, metaIn->general->line_count);      
-	  }
-	}
-	FCLOSE(fpIn);
+	if (dataType[nn])
+	  uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+			 UAVSAR_COMPLEX, radiometry, ll, 0);
+	else
+	  uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+			 UAVSAR_REAL, radiometry, ll, 0);
 	if (dataType[nn])
 	  ll += 2;
 	else
 	  ll++;
       }
-      FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
-      FREE(floatComplexReal);
-      FREE(floatComplexImag);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1858,7 +1793,6 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       metaIn = uavsar_polsar2meta(polsar_params);
       metaOut = uavsar_polsar2meta(polsar_params);
       ns = metaOut->general->sample_count;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_hgt.img");
@@ -1869,20 +1803,12 @@ void import_uavsar(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
-      strcpy(metaOut->general->bands, "HEIGHT");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
       FCLOSE(fpOut);
+      strcpy(metaOut->general->bands, "HEIGHT");
+      uavsar_convert(dataName[nn], outName, metaIn->general->line_count, ns,
+		     UAVSAR_REAL, radiometry, 0, 0);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
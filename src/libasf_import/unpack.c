@@ -22,15 +22,18 @@ Called only by ERS_unpackBytes.
 */
 void ERS_convertSignalBytes(signalType *in,iqType *out)
 {
-	long b=(in[0]<<24)|(in[1]<<16)|(in[2]<<8)|(in[3]);
-	out[0]=0x001f&(b >> 27);
-	out[1]=0x001f&(b >> 22);
-	out[2]=0x001f&(b >> 17);
-	out[3]=0x001f&(b >> 12);
-	out[4]=0x001f&(b >> 7);
-	out[5]=0x001f&(b >> 2);
-	out[6]=0x001f&((b<<3)+(in[4]>>5));
-	out[7]=0x001f&(in[4]);
+	/*All 40 bits of the group in one word; the samples are then
+	  consecutive 5-bit fields, most significant first.*/
+	unsigned long long b=((unsigned long long)in[0]<<32)|
+		((unsigned long long)in[1]<<24)|(in[2]<<16)|(in[3]<<8)|(in[4]);
+	out[0]=0x001f&(b >> 35);
+	out[1]=0x001f&(b >> 30);
+	out[2]=0x001f&(b >> 25);
+	out[3]=0x001f&(b >> 20);
+	out[4]=0x001f&(b >> 15);
+	out[5]=0x001f&(b >> 10);
+	out[6]=0x001f&(b >> 5);
+	out[7]=0x001f&(b);
 }
 
 /*Unpack nIn input bytes to nIn/nSig*nIQ*2 of output bytes.
@@ -60,30 +63,35 @@ JERS_convertSignalBytes:
 Trade JnSig signal bytes for JnIQ iq pairs (2*JnIQ bytes).
 Called only by JERS_unpackBytes.
 */
-void JERS_convertSignalBytes(signalType *in,iqType *out)
+/*I and Q values (offset by 125) for each 6-bit, bit-interleaved
+sample pair: the I bits are the odd bits, the Q bits the even ones.*/
+static const iqType JERS_iq[64][2]={
+	{125,125},{125,126},{126,125},{126,126},{125,127},{125,128},{126,127},{126,128},
+	{127,125},{127,126},{128,125},{128,126},{127,127},{127,128},{128,127},{128,128},
+	{125,129},{125,130},{126,129},{126,130},{125,131},{125,132},{126,131},{126,132},
+	{127,129},{127,130},{128,129},{128,130},{127,131},{127,132},{128,131},{128,132},
+	{129,125},{129,126},{130,125},{130,126},{129,127},{129,128},{130,127},{130,128},
+	{131,125},{131,126},{132,125},{132,126},{131,127},{131,128},{132,127},{132,128},
+	{129,129},{129,130},{130,129},{130,130},{129,131},{129,132},{130,131},{130,132},
+	{131,129},{131,130},{132,129},{132,130},{131,131},{131,132},{132,131},{132,132}
+};
+
+static void JERS_convertBits(int b,iqType *out)
 {
-/*Extract I or Q channel, de-interleaving bits.*/
-#define ext_i(s) ((0x4&(s>>3))|(0x2&(s>>2))|(0x1&(s>>1)))
-#define ext_q(s) ((0x4&(s>>2))|(0x2&(s>>1))|(0x1&(s>>0)))
-
-	int b=(in[0]<<16)|(in[1]<<8)|(in[2]);/*3 bytes as an int.*/
-	int s;/*6 bits, forming one sample.*/
-
-	s=0x03F&(b >> 18);/*1st sample pair*/
-	out[0]=125+ext_i(s);
-	out[1]=125+ext_q(s);
-
-	s=0x03F&(b >> 12);/*2nd sample pair*/
-	out[2]=125+ext_i(s);
-	out[3]=125+ext_q(s);
-
-	s=0x03F&(b >> 6);/*3rd sample pair*/
-	out[4]=125+ext_i(s);
-	out[5]=125+ext_q(s);
+	const iqType *iq;
+	iq=JERS_iq[0x03F&(b >> 18)];/*1st sample pair*/
+	out[0]=iq[0];out[1]=iq[1];
+	iq=JERS_iq[0x03F&(b >> 12)];/*2nd sample pair*/
+	out[2]=iq[0];out[3]=iq[1];
+	iq=JERS_iq[0x03F&(b >> 6)];/*3rd sample pair*/
+	out[4]=iq[0];out[5]=iq[1];
+	iq=JERS_iq[0x03F&(b)];/*4th sample pair*/
+	out[6]=iq[0];out[7]=iq[1];
+}
 
-	s=0x03F&(b);/*4th sample pair*/
-	out[6]=125+ext_i(s);
-	out[7]=125+ext_q(s);
+void JERS_convertSignalBytes(signalType *in,iqType *out)
+{
+	JERS_convertBits((in[0]<<16)|(in[1]<<8)|(in[2]),out);
 }
 
 /*Unpack nIn input bytes to nIn/nSig*nIQ*2 of output bytes.
@@ -99,6 +107,30 @@ iqType *JERS_unpackBytes(signalType *in,int nIn,iqType *out)
 	return &out[len*JnIQ*2];
 }
 
+/*Same as extractBits followed by JERS_unpackBytes, without the
+intermediate copy: unpack the nIn bytes' worth of signal data that
+start bitStart bits into in.  Like extractBits, this reads one byte
+past the end of the data when it isn't byte-aligned.*/
+iqType *JERS_unpackBits(signalType *in,int bitStart,int nIn,iqType *out)
+{
+	int i,len=nIn/JnSig;
+	int shift;
+	if (len*JnSig!=nIn)
+		asfPrintError("Asked to convert %d bytes, which is not divisble by %d!\n",
+		              nIn,JnSig);
+	in+=bitStart/8;
+	shift=bitStart%8;
+	if (shift==0)
+		return JERS_unpackBytes(in,nIn,out);
+	for (i=0;i<len;i++,in+=JnSig,out+=JnIQ*2)
+	{
+		/*The 24 bits we want, out of the 32 that hold them*/
+		unsigned int w=((unsigned int)in[0]<<24)|(in[1]<<16)|(in[2]<<8)|(in[3]);
+		JERS_convertBits(0xFFFFFF&(w>>(8-shift)),out);
+	}
+	return out;
+}
+
 
 /**************************************
 Bit fiddling:
@@ -112,9 +144,46 @@ convertSignalBytes:
 Trade RnSig signal bytes for RnIQ iq pairs (2*nIQ bytes).
 Called only by RSAT_unpackBytes.
 */
-static int  RSAT_cvrt[16]={ 8, 9,10,11,12,13,14,15,
+static const int RSAT_cvrt[16]={ 8, 9,10,11,12,13,14,15,
 			    0, 1, 2, 3, 4, 5, 6, 7};
 
+/*Both samples of every possible signal byte: RSAT_cvrt of the high,
+then of the low nibble.*/
+static const iqType RSAT_pairs[256][2]={
+	{8,8},{8,9},{8,10},{8,11},{8,12},{8,13},{8,14},{8,15},
+	{8,0},{8,1},{8,2},{8,3},{8,4},{8,5},{8,6},{8,7},
+	{9,8},{9,9},{9,10},{9,11},{9,12},{9,13},{9,14},{9,15},
+	{9,0},{9,1},{9,2},{9,3},{9,4},{9,5},{9,6},{9,7},
+	{10,8},{10,9},{10,10},{10,11},{10,12},{10,13},{10,14},{10,15},
+	{10,0},{10,1},{10,2},{10,3},{10,4},{10,5},{10,6},{10,7},
+	{11,8},{11,9},{11,10},{11,11},{11,12},{11,13},{11,14},{11,15},
+	{11,0},{11,1},{11,2},{11,3},{11,4},{11,5},{11,6},{11,7},
+	{12,8},{12,9},{12,10},{12,11},{12,12},{12,13},{12,14},{12,15},
+	{12,0},{12,1},{12,2},{12,3},{12,4},{12,5},{12,6},{12,7},
+	{13,8},{13,9},{13,10},{13,11},{13,12},{13,13},{13,14},{13,15},
+	{13,0},{13,1},{13,2},{13,3},{13,4},{13,5},{13,6},{13,7},
+	{14,8},{14,9},{14,10},{14,11},{14,12},{14,13},{14,14},{14,15},
+	{14,0},{14,1},{14,2},{14,3},{14,4},{14,5},{14,6},{14,7},
+	{15,8},{15,9},{15,10},{15,11},{15,12},{15,13},{15,14},{15,15},
+	{15,0},{15,1},{15,2},{15,3},{15,4},{15,5},{15,6},{15,7},
+	{0,8},{0,9},{0,10},{0,11},{0,12},{0,13},{0,14},{0,15},
+	{0,0},{0,1},{0,2},{0,3},{0,4},{0,5},{0,6},{0,7},
+	{1,8},{1,9},{1,10},{1,11},{1,12},{1,13},{1,14},{1,15},
+	{1,0},{1,1},{1,2},{1,3},{1,4},{1,5},{1,6},{1,7},
+	{2,8},{2,9},{2,10},{2,11},{2,12},{2,13},{2,14},{2,15},
+	{2,0},{2,1},{2,2},{2,3},{2,4},{2,5},{2,6},{2,7},
+	{3,8},{3,9},{3,10},{3,11},{3,12},{3,13},{3,14},{3,15},
+	{3,0},{3,1},{3,2},{3,3},{3,4},{3,5},{3,6},{3,7},
+	{4,8},{4,9},{4,10},{4,11},{4,12},{4,13},{4,14},{4,15},
+	{4,0},{4,1},{4,2},{4,3},{4,4},{4,5},{4,6},{4,7},
+	{5,8},{5,9},{5,10},{5,11},{5,12},{5,13},{5,14},{5,15},
+	{5,0},{5,1},{5,2},{5,3},{5,4},{5,5},{5,6},{5,7},
+	{6,8},{6,9},{6,10},{6,11},{6,12},{6,13},{6,14},{6,15},
+	{6,0},{6,1},{6,2},{6,3},{6,4},{6,5},{6,6},{6,7},
+	{7,8},{7,9},{7,10},{7,11},{7,12},{7,13},{7,14},{7,15},
+	{7,0},{7,1},{7,2},{7,3},{7,4},{7,5},{7,6},{7,7}
+};
+
 void RSAT_convertSignalBytes(signalType in,iqType *out)
 {
 	out[0]=RSAT_cvrt[ 0x00f&(in >> 4) ];
@@ -123,12 +192,15 @@ void RSAT_convertSignalBytes(signalType in,iqType *out)
 
 /*Unpack nIn input bytes to nIn output bytes.
 For CEOS frames, these have been expanded to bytes,
-but still use the RSAT (base-2 signed!) convention.*/
+but still use the RSAT (base-2 signed!) convention.
+Each byte holds one 4-bit sample in its low nibble, so valid data
+never has the high nibble set; the mask only keeps a corrupt byte
+from indexing past the end of the 16-entry RSAT_cvrt.*/
 void RSAT_unpackCeosBytes(signalType *in,int nIn,iqType *out)
 {
 	int i;
 	for (i=0;i<nIn;i++)
-		out[i]=RSAT_cvrt[in[i]];
+		out[i]=RSAT_cvrt[0x00f&in[i]];
 }
 
 /*Unpack nIn input bytes to nIn/RnSig*nIQ*2 of output bytes.
@@ -139,11 +211,9 @@ iqType *RSAT_unpackBytes(signalType *in,int nIn,iqType *out)
 	if (len*RnSig!=nIn)
 		asfPrintError("Asked to convert %d bytes, which is not divisble by %d!\n",
 		              nIn,RnSig);
-	for (i=0;i<len;i++)
-		RSAT_convertSignalBytes(in[i*RnSig],&out[i*RnIQ*2]);
+	for (i=0;i<len;i++) {
+		out[2*i]=RSAT_pairs[in[i]][0];
+		out[2*i+1]=RSAT_pairs[in[i]][1];
+	}
 	return &out[len*RnIQ*2];
 }
-
-
-
-
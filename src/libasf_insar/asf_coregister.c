@@ -41,21 +41,49 @@ int coregister_coarse(char *masterFile, char *slaveFile,
 
 // Fine coregistration
 
-float getFFTCorrelation(complexFloat *igram, int sizeX, int sizeY)
+// Scratch space for correlating one pair of chips.  coregister_fine keeps
+// one of these per thread.
+typedef struct {
+  complexFloat *s;        // [srcSize x srcSize] source chip
+  complexFloat *t;        // [trgSize x trgSize] target chip
+  complexFloat *product;  // [srcSize x srcSize] interferogram
+  complexFloat *fft;      // [srcSize x srcSize] 2D FFT of the product
+  complexFloat *fftTemp;  // [srcSize x srcSize] row FFTs of the product
+  float *peaks;           // [trgSize x trgSize] correlation at each offset
+} corr_work_t;
+
+static void corr_work_init(corr_work_t *w, int srcSize, int trgSize)
+{
+  w->s = (complexFloat *) MALLOC(sizeof(complexFloat)*srcSize*srcSize);
+  w->t = (complexFloat *) MALLOC(sizeof(complexFloat)*trgSize*trgSize);
+  w->product = (complexFloat *) MALLOC(sizeof(complexFloat)*srcSize*srcSize);
+  w->fft = (complexFloat *) MALLOC(sizeof(complexFloat)*srcSize*srcSize);
+  w->fftTemp = (complexFloat *) MALLOC(sizeof(complexFloat)*srcSize*srcSize);
+  w->peaks = (float *) MALLOC(sizeof(float)*trgSize*trgSize);
+}
+
+static void corr_work_free(corr_work_t *w)
+{
+  FREE(w->s);
+  FREE(w->t);
+  FREE(w->product);
+  FREE(w->fft);
+  FREE(w->fftTemp);
+  FREE(w->peaks);
+}
+
+// Maximum amplitude of the 2D FFT of the given interferogram (which gets
+// overwritten).  Uses the caller's buffers, and the FFT tables set up by
+// fftInit(log2(sizeX)), so several threads can run this at once.
+static float fft_correlation(complexFloat *igram, int sizeX,
+                             complexFloat *fftTemp, complexFloat *fft)
 {
   int line, samp;
-  int fftpowr;
+  int fftpowr = (log(sizeX)/log(2));
   float ampTmp=0;
   float maxAmp=0;
-  complexFloat *fftBuf;
-  complexFloat *fftTemp;
-  complexFloat *fft;
-  
-  fft = (complexFloat *)MALLOC(sizeof(complexFloat)*sizeX*sizeX);
-  fftTemp = (complexFloat *)MALLOC(sizeof(complexFloat)*sizeX*sizeX);
-  fftpowr = (log(sizeX)/log(2));
-  fftInit(fftpowr);
-  
+  complexFloat *fftBuf = NULL;
+
   // First do the FFT of each line
   for(line=0; line<sizeX; line++) {
     fftBuf = &igram[line*sizeX];
@@ -82,8 +110,6 @@ float getFFTCorrelation(complexFloat *igram, int sizeX, int sizeY)
       fft[line*sizeX+samp].imag = fftBuf[line].imag;
     }
   }
-  free(fftTemp);
-  fftFree();
   
   // Now we have a two dimension FFT that we can search to find the max value
   for(line=0; line<sizeX; line++) {
@@ -94,7 +120,22 @@ float getFFTCorrelation(complexFloat *igram, int sizeX, int sizeY)
 	maxAmp=ampTmp;
     }
   }
-  free(fft);
+  return maxAmp;
+}
+
+float getFFTCorrelation(complexFloat *igram, int sizeX, int sizeY)
+{
+  float maxAmp;
+  complexFloat *fft, *fftTemp;
+
+  fft = (complexFloat *)MALLOC(sizeof(complexFloat)*sizeX*sizeX);
+  fftTemp = (complexFloat *)MALLOC(sizeof(complexFloat)*sizeX*sizeX);
+  fftInit((int)(log(sizeX)/log(2)));
+  maxAmp = fft_correlation(igram, sizeX, fftTemp, fft);
+  fftFree();
+  FREE(fftTemp);
+  FREE(fft);
+
   return maxAmp;
 }
 
@@ -124,19 +165,26 @@ void topOffPeak(float *peaks,int i, int j, int maxI, int maxJ,
   else *dy=0;
 }
 
-// getPeak:
-// This function computes a correlation peak, with SNR, between
-// the two given images at the given points.
-void getPeak(int x1,int y1,char *szImg1,int x2,int y2,char *szImg2,
-	     int srcSize, int trgSize,
-             float *peakX,float *peakY, float *snr)
+// Copies the size x size chip centered on (x,y) out of a band of
+// full-width lines that starts at line band_start.
+static void copy_chip(const complexFloat *band, int band_start, int ns,
+                      int x, int y, int size, complexFloat *chip)
 {
-  FILE *fpSource, *fpTarget;
-  meta_parameters *metaSource, *metaTarget;
-  static float *peaks;
-  static complexFloat *bufSource, *bufTarget;
-  static complexFloat *s=NULL, *t, *product; // Keep working arrays around
-  int srcSamples, trgSamples;
+  int ii;
+  const complexFloat *src =
+    &band[(y-size/2+1-band_start)*ns + x-size/2+1];
+  for (ii=0; ii<size; ii++)
+    memcpy(&chip[ii*size], &src[ii*ns], sizeof(complexFloat)*size);
+}
+
+// correlateChips:
+// Computes the correlation peak, with SNR, between the source chip w->s
+// and the target chip w->t.  This is the core of getPeak.
+static void correlateChips(corr_work_t *w, int srcSize, int trgSize,
+                           float *peakX, float *peakY, float *snr)
+{
+  complexFloat *s = w->s, *t = w->t, *product = w->product;
+  float *peaks = w->peaks;
   int peakMaxX, peakMaxY, x,y,xOffset,yOffset,count;
   int xOffsetStart, yOffsetStart, xOffsetEnd, yOffsetEnd;
   float dx,dy,accel1 = (float)(trgSize/2 - srcSize/2);
@@ -155,45 +203,6 @@ void getPeak(int x1,int y1,char *szImg1,int x2,int y2,char *szImg2,
   yOffsetStart = (trgSize/2 - srcSize/2) - (int)(ymep);
   yOffsetEnd = (trgSize/2 - srcSize/2) + (int)(ymep);
 
-  // Read metadata
-  metaSource = meta_read(szImg1);
-  metaTarget = meta_read(szImg2);
-  srcSamples = metaSource->general->sample_count;
-  trgSamples = metaTarget->general->sample_count;
-
-  // Allocate working arrays if we haven't already done so
-  if (s==NULL)
-    {
-      bufSource = (complexFloat *) 
-	MALLOC(sizeof(complexFloat)*srcSize*srcSamples);
-      bufTarget = (complexFloat *) 
-	MALLOC(sizeof(complexFloat)*trgSize*trgSamples);
-      s = (complexFloat *)(MALLOC(srcSize*srcSize*sizeof(complexFloat)));
-      t = (complexFloat *)(MALLOC(trgSize*trgSize*sizeof(complexFloat)));
-      product = (complexFloat *)(MALLOC(srcSize*srcSize*sizeof(complexFloat)));
-      peaks=(float *)MALLOC(sizeof(float)*trgSize*trgSize);
-    }
-
-  // Open files, read lines and create subset
-  fpSource = FOPEN(szImg1, "rb");
-  fpTarget = FOPEN(szImg2, "rb");
-  get_complexFloat_lines(fpSource, metaSource, y1-srcSize/2+1, srcSize, 
-			 bufSource);
-  get_complexFloat_lines(fpTarget, metaTarget, y2-trgSize/2+1, trgSize, 
-			 bufTarget);
-  FCLOSE(fpSource);
-  FCLOSE(fpTarget);
-  for (y=0; y<srcSize; y++) {
-    int srcIndex = y*srcSize;
-    for (x=0; x<srcSize; x++)
-      s[srcIndex++] = bufSource[x1-srcSize/2+1+x+y*srcSamples];
-  }
-  for (y=0; y<trgSize; y++) {
-    int trgIndex = y*trgSize;
-    for (x=0; x<trgSize; x++)
-      t[trgIndex++] = bufTarget[x2-trgSize/2+1+x+y*trgSamples];
-  }
-
   // Take the complex conjugate of the source chunk (so we only have to do 
   // so once)
   for(y=0;y<srcSize;y++) {
@@ -219,7 +228,7 @@ void getPeak(int x1,int y1,char *szImg1,int x2,int y2,char *szImg2,
         }
       }
 
-      thisMax = getFFTCorrelation(product, srcSize, srcSize);
+      thisMax = fft_correlation(product, srcSize, w->fftTemp, w->fft);
 
       // Possibly save this coherence value
       if (thisMax > peakMax) {
@@ -247,6 +256,54 @@ void getPeak(int x1,int y1,char *szImg1,int x2,int y2,char *szImg2,
   *peakY=((float)(peakMaxY) + dy - accel1 );
 }
 
+// getPeak:
+// This function computes a correlation peak, with SNR, between
+// the two given images at the given points.  It reads the chips from
+// disk on every call; coregister_fine reads whole grid rows at once
+// instead.
+void getPeak(int x1,int y1,char *szImg1,int x2,int y2,char *szImg2,
+	     int srcSize, int trgSize,
+             float *peakX,float *peakY, float *snr)
+{
+  FILE *fpSource, *fpTarget;
+  meta_parameters *metaSource, *metaTarget;
+  complexFloat *bufSource, *bufTarget;
+  corr_work_t w;
+  int srcSamples, trgSamples;
+
+  // Read metadata
+  metaSource = meta_read(szImg1);
+  metaTarget = meta_read(szImg2);
+  srcSamples = metaSource->general->sample_count;
+  trgSamples = metaTarget->general->sample_count;
+
+  bufSource = (complexFloat *) MALLOC(sizeof(complexFloat)*srcSize*srcSamples);
+  bufTarget = (complexFloat *) MALLOC(sizeof(complexFloat)*trgSize*trgSamples);
+  corr_work_init(&w, srcSize, trgSize);
+
+  // Open files, read lines and create subset
+  fpSource = fopenImage(szImg1, "rb");
+  fpTarget = fopenImage(szImg2, "rb");
+  get_complexFloat_lines(fpSource, metaSource, y1-srcSize/2+1, srcSize, 
+			 bufSource);
+  get_complexFloat_lines(fpTarget, metaTarget, y2-trgSize/2+1, trgSize, 
+			 bufTarget);
+  FCLOSE(fpSource);
+  FCLOSE(fpTarget);
+  copy_chip(bufSource, y1-srcSize/2+1, srcSamples, x1, y1, srcSize, w.s);
+  copy_chip(bufTarget, y2-trgSize/2+1, trgSamples, x2, y2, trgSize, w.t);
+
+  fftInit((int)(log(srcSize)/log(2)));
+  correlateChips(&w, srcSize, trgSize, peakX, peakY, snr);
+  fftFree();
+
+  corr_work_free(&w);
+  FREE(bufSource);
+  FREE(bufTarget);
+  meta_free(metaSource);
+  meta_free(metaTarget);
+}
+
 bool outOfBoundary(int x1, int y1, int x2, int y2, int srcSize, int trgSize,
 		   int nl, int ns)
 {
@@ -261,80 +318,188 @@ bool outOfBoundary(int x1, int y1, int x2, int y2, int srcSize, int trgSize,
   return FALSE;
 }
 
+// One grid point of coregister_fine
+typedef struct {
+  int x1, x2;                    // sample in the master and in the slave
+  float dxFW, dyFW, snrFW;       // forward (master to slave) correlation
+  float dxBW, dyBW, snrBW;       // backward (slave to master) correlation
+} fine_point_t;
+
+// Everything the correlation threads need for one grid row
+typedef struct {
+  int srcSize, trgSize;
+  int y1, y2;                    // line of the grid row in master/slave
+  complexFloat *bandMaster;      // trgSize lines around y1
+  complexFloat *bandSlave;       // trgSize lines around y2
+  int nsMaster, nsSlave;
+  fine_point_t *points;
+  int *todo;                     // indices of the points to correlate
+  int backward;                  // 0 -> forward, 1 -> backward
+  corr_work_t *work;             // one per thread
+} fine_params_t;
+
+static void correlate_point(int i, int thread, void *params)
+{
+  fine_params_t *p = (fine_params_t *)params;
+  fine_point_t *pt = &p->points[p->todo[i]];
+  corr_work_t *w = &p->work[thread];
+  int startMaster = p->y1 - p->trgSize/2 + 1;
+  int startSlave = p->y2 - p->trgSize/2 + 1;
+
+  if (!p->backward) {
+    copy_chip(p->bandMaster, startMaster, p->nsMaster, pt->x1, p->y1,
+              p->srcSize, w->s);
+    copy_chip(p->bandSlave, startSlave, p->nsSlave, pt->x2, p->y2,
+              p->trgSize, w->t);
+    correlateChips(w, p->srcSize, p->trgSize,
+                   &pt->dxFW, &pt->dyFW, &pt->snrFW);
+  }
+  else {
+    copy_chip(p->bandSlave, startSlave, p->nsSlave, pt->x2, p->y2,
+              p->srcSize, w->s);
+    copy_chip(p->bandMaster, startMaster, p->nsMaster, pt->x1, p->y1,
+              p->trgSize, w->t);
+    correlateChips(w, p->srcSize, p->trgSize,
+                   &pt->dxBW, &pt->dyBW, &pt->snrBW);
+  }
+}
+
 int coregister_fine(char *masterFile, char *slaveFile, int nOffX, int nOffY,
                     char *ficoFile, char *maskFile, int gridSize)
 {
   int x1, x2, y1, y2, srcSize=32, trgSize, borderX=80, borderY=80;
-  int gridResolution=20, pointNo, goodPoints, attemptedPoints;
-  char gridRes[256];
+  int gridResolution=20, goodPoints, attemptedPoints;
+  int ii, kk, unscaledX, unscaledY, nPoints, nTodo;
   float minSNR = 0.3;  // Threshold for deleting points
   float maxDisp = 1.8; // Forward and reverse correlations which differ by more
                        // than this will be deleted
+  fine_params_t params;
 
   // calculate parameters
   trgSize = 2*srcSize;
 
   // determine size of input files
-  meta_parameters *meta = meta_read(masterFile);
-  int ns = meta->general->sample_count;
-  int nl = meta->general->line_count;
-  meta_free(meta);
+  meta_parameters *metaMaster = meta_read(masterFile);
+  meta_parameters *metaSlave = meta_read(slaveFile);
+  int ns = metaMaster->general->sample_count;
+  int nl = metaMaster->general->line_count;
 
   // create output file
   FILE *fp = FOPEN(ficoFile, "w");
 
-  // Check to see if the last parameter contains a number, the grid resolution
-  if (gridRes)
-    gridResolution=atoi(gridRes);
+  // Use the requested grid resolution, if there is a sensible one
+  gridResolution = gridSize;
   if (gridResolution<2)
     gridResolution=20;
   if (!quietflag)
     printf("   Sampling rectangular grid, %ix%i resolution.\n",
            gridResolution,gridResolution);
 
+  // Both images are opened once, and every grid row is read as a band of
+  // trgSize full-width lines from each, which holds all the chips of the
+  // row.  The correlations of a row run in parallel: first all of the
+  // forward ones, then the backward ones for the points that passed.
+  FILE *fpMaster = fopenImage(masterFile, "rb");
+  FILE *fpSlave = fopenImage(slaveFile, "rb");
+  int n_threads = asf_get_num_threads();
+  params.srcSize = srcSize;
+  params.trgSize = trgSize;
+  params.nsMaster = ns;
+  params.nsSlave = metaSlave->general->sample_count;
+  params.bandMaster = (complexFloat *)
+    MALLOC(sizeof(complexFloat)*trgSize*params.nsMaster);
+  params.bandSlave = (complexFloat *)
+    MALLOC(sizeof(complexFloat)*trgSize*params.nsSlave);
+  params.points = (fine_point_t *) MALLOC(sizeof(fine_point_t)*gridResolution);
+  params.todo = (int *) MALLOC(sizeof(int)*gridResolution);
+  params.work = (corr_work_t *) MALLOC(sizeof(corr_work_t)*n_threads);
+  for (ii=0; ii<n_threads; ii++)
+    corr_work_init(&params.work[ii], srcSize, trgSize);
+
+  // The FFT tables are shared by the threads, so set them up first
+  fftInit((int)(log(srcSize)/log(2)));
+
   // Loop over grid, performing forward and backward correlations
-  pointNo = goodPoints = attemptedPoints = 0;
-  while (pointNo < (gridResolution*gridResolution)) {
-    float dx, dy, snr, dxFW, dyFW, snrFW, dxBW, dyBW, snrBW;
-    int unscaledX = pointNo % gridResolution;
-    int unscaledY = pointNo / gridResolution;
-    x1 = unscaledX*(ns-2*borderX)/(gridResolution-1) + borderX;
+  goodPoints = attemptedPoints = 0;
+  for (unscaledY=0; unscaledY<gridResolution; unscaledY++) {
     y1 = unscaledY*(nl-2*borderY)/(gridResolution-1) + borderY;
-    x2 = x1 - nOffX;
     y2 = y1 - nOffY;
-    pointNo++;
-    attemptedPoints++;
+    attemptedPoints += gridResolution;
 
     // Check bounds...
-    if (!(outOfBoundary(x1, y1, x2, y2, srcSize, trgSize, nl, ns) ||
-          outOfBoundary(x2, y2, x1, y1, srcSize, trgSize, nl, ns))) {
-      // ...check forward correlation...
-      getPeak(x1, y1, masterFile, x2, y2, slaveFile, srcSize, trgSize,
-	      &dxFW, &dyFW, &snrFW);
-      if (snrFW > minSNR) {
-        // ...check backward correlation...
-        getPeak(x2, y2, slaveFile, x1, y1, masterFile, srcSize, trgSize,
-		&dxBW, &dyBW, &snrBW);
-        dxBW *= -1.0;
-        dyBW *= -1.0;
-        if ((snrBW > minSNR) &&
-            (fabs(dxFW-dxBW) < maxDisp) &&
-            (fabs(dyFW-dyBW) < maxDisp)) {
-          goodPoints++;
-          dx = (dxFW+dxBW)/2;
-          dy = (dyFW+dyBW)/2;
-          snr = snrFW*snrBW;
-          fprintf(fp,"%6d %6d %8.5f %8.5f %4.2f\n",
-                  x1, y1, x2+dx, y2+dy, snr);
-          fflush(fp);
-          if (!quietflag && (goodPoints <= 10 || !(goodPoints%100)))
-            printf("\t%6d %6d %8.5f %8.5f %4.2f/%4.2f\n",
-                   x1, y1, dx, dy, snrFW, snrBW);
-        }
+    nPoints = 0;
+    for (unscaledX=0; unscaledX<gridResolution; unscaledX++) {
+      x1 = unscaledX*(ns-2*borderX)/(gridResolution-1) + borderX;
+      x2 = x1 - nOffX;
+      if (!(outOfBoundary(x1, y1, x2, y2, srcSize, trgSize, nl, ns) ||
+            outOfBoundary(x2, y2, x1, y1, srcSize, trgSize, nl, ns))) {
+        params.points[nPoints].x1 = x1;
+        params.points[nPoints].x2 = x2;
+        nPoints++;
+      }
+    }
+    if (nPoints == 0)
+      continue;
+
+    params.y1 = y1;
+    params.y2 = y2;
+    get_complexFloat_lines(fpMaster, metaMaster, y1-trgSize/2+1, trgSize,
+                           params.bandMaster);
+    get_complexFloat_lines(fpSlave, metaSlave, y2-trgSize/2+1, trgSize,
+                           params.bandSlave);
+
+    // ...check forward correlation...
+    for (ii=0; ii<nPoints; ii++)
+      params.todo[ii] = ii;
+    params.backward = 0;
+    asf_parallel_for(nPoints, correlate_point, &params);
+
+    // ...check backward correlation...
+    nTodo = 0;
+    for (ii=0; ii<nPoints; ii++)
+      if (params.points[ii].snrFW > minSNR)
+        params.todo[nTodo++] = ii;
+    params.backward = 1;
+    asf_parallel_for(nTodo, correlate_point, &params);
+
+    for (kk=0; kk<nTodo; kk++) {
+      fine_point_t *pt = &params.points[params.todo[kk]];
+      float dx, dy, snr;
+      float dxBW = -1.0 * pt->dxBW;
+      float dyBW = -1.0 * pt->dyBW;
+      x1 = pt->x1;
+      x2 = pt->x2;
+      if ((pt->snrBW > minSNR) &&
+          (fabs(pt->dxFW-dxBW) < maxDisp) &&
+          (fabs(pt->dyFW-dyBW) < maxDisp)) {
+        goodPoints++;
+        dx = (pt->dxFW+dxBW)/2;
+        dy = (pt->dyFW+dyBW)/2;
+        snr = pt->snrFW*pt->snrBW;
+        fprintf(fp,"%6d %6d %8.5f %8.5f %4.2f\n",
+                x1, y1, x2+dx, y2+dy, snr);
+        fflush(fp);
+        if (!quietflag && (goodPoints <= 10 || !(goodPoints%100)))
+          printf("\t%6d %6d %8.5f %8.5f %4.2f/%4.2f\n",
+                 x1, y1, dx, dy, pt->snrFW, pt->snrBW);
       }
     }
   }
 
+  fftFree();
+  for (ii=0; ii<n_threads; ii++)
+    corr_work_free(&params.work[ii]);
+  FREE(params.work);
+  FREE(params.todo);
+  FREE(params.points);
+  FREE(params.bandMaster);
+  FREE(params.bandSlave);
+  FCLOSE(fpMaster);
+  FCLOSE(fpSlave);
+  FCLOSE(fp);
+  meta_free(metaMaster);
+  meta_free(metaSlave);
+
   if (goodPoints<20)
     asfPrintError("   coregister_fine was only able to find %i points which\n"
                   "   correlated the same backwards and forwards. This\n"
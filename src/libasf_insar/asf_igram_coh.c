@@ -3,24 +3,211 @@
 #include "asf_insar.h"
 #include "asf_raster.h"
 
-#define AMP(cpx) sqrt((cpx).real*(cpx).real + (cpx).imag*(cpx).imag)
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 
+// Number of output (multilooked) lines handed to a worker at a time
+#define ROWS_PER_BLOCK 32
+
+// The interferogram, the multilooked interferogram and the coherence are
+// all computed from the same conjugate product m*conj(s), so we form it
+// (and the two powers) once per input pixel, and get the box sums from
+// running column sums.  Along a column the look window slides down by
+// stepLine lines per output row, so the column sums are updated by adding
+// the lines entering the window and subtracting the ones leaving it.
+// Across the columns, prefix sums of the column sums give each look
+// window in constant time.  All sums are kept in double precision, so the
+// running updates don't drift.
+//
+// Each block of ROWS_PER_BLOCK output rows only depends on its own input
+// lines, so a batch of blocks is computed in parallel, and the results are
+// then written (and added into the histogram) in order.
+
+typedef struct {
+  int out_start;        // first multilooked line in this block
+  int out_count;        // number of multilooked lines
+  int in_start;         // first input line needed
+  int in_count;         // number of input lines needed
+  int sl_start;         // first single-look line written by this block
+  int sl_count;         // number of single-look lines written
+  float *amp, *phase;           // single-look output, sl_count lines
+  float *ml_amp, *ml_phase;     // multilooked output, out_count lines
+  float *coh;                   // coherence output, out_count lines
+} igram_block_t;
+
+typedef struct {
+  int lookLine, lookSample, stepLine, stepSample;
+  int line_count, sample_count, ml_sample_count;
+  int single_look;
+  float ampScale;
+  int batch_start;              // first input line held in master/slave
+  complexFloat *master, *slave;
+  igram_block_t *blocks;        // blocks in the current batch
+  // per-thread scratch
+  complexFloat **igram;
+  float **pow_a, **pow_b;
+  double **col, **prefix;
+} igram_params_t;
+
+static void igram_block(int i, int thread, void *params)
+{
+  igram_params_t *p = (igram_params_t*)params;
+  igram_block_t *b = &p->blocks[i];
+  int ns = p->sample_count;
+  int row, line, column, k;
+
+  complexFloat *igram = p->igram[thread];
+  float *pow_a = p->pow_a[thread];
+  float *pow_b = p->pow_b[thread];
+
+  // Column sums of the look window: real, imag, |m|^2, |s|^2, and their
+  // prefix sums across the columns
+  double *cr = p->col[thread];
+  double *ci = cr + ns;
+  double *ca = ci + ns;
+  double *cb = ca + ns;
+  double *pr = p->prefix[thread];
+  double *pi = pr + ns + 1;
+  double *pa = pi + ns + 1;
+  double *pb = pa + ns + 1;
+
+  // Conjugate product and powers, once for every input line in the block
+  for (line=0; line<b->in_count; ++line) {
+    int off = (b->in_start - p->batch_start + line)*ns;
+    complexFloat *m = p->master + off;
+    complexFloat *s = p->slave + off;
+    complexFloat *ig = igram + line*ns;
+    float *a = pow_a + line*ns;
+    float *bb = pow_b + line*ns;
+    for (column=0; column<ns; ++column) {
+      ig[column].real = m[column].real*s[column].real +
+        m[column].imag*s[column].imag;
+      ig[column].imag = m[column].imag*s[column].real -
+        m[column].real*s[column].imag;
+      a[column] = m[column].real*m[column].real + m[column].imag*m[column].imag;
+      bb[column] = s[column].real*s[column].real + s[column].imag*s[column].imag;
+    }
+  }
+
+  // Single-look amplitude and phase
+  if (p->single_look) {
+    for (line=0; line<b->sl_count; ++line) {
+      complexFloat *ig = igram + (b->sl_start - b->in_start + line)*ns;
+      float *amp = b->amp + line*ns;
+      float *phase = b->phase + line*ns;
+      for (column=0; column<ns; ++column) {
+        double re = ig[column].real, im = ig[column].imag;
+        amp[column] = sqrt(re*re + im*im);
+        if (FLOAT_EQUIVALENT(re, 0.0) || FLOAT_EQUIVALENT(im, 0.0))
+          phase[column] = 0.0;
+        else
+          phase[column] = atan2(im, re);
+      }
+    }
+  }
+
+  int win_start = 0, win_end = 0; // current look window, input lines
+  for (column=0; column<ns; ++column)
+    cr[column] = ci[column] = ca[column] = cb[column] = 0.0;
+
+  for (row=0; row<b->out_count; ++row) {
+    int out_line = b->out_start + row;
+    int start = out_line*p->stepLine;
+    int end = MIN(start + p->lookLine, p->line_count);
+
+    // Slide the look window down to [start, end)
+    for (line=win_start; line<start && line<win_end; ++line) {
+      int off = (line - b->in_start)*ns;
+      for (column=0; column<ns; ++column) {
+        cr[column] -= igram[off+column].real;
+        ci[column] -= igram[off+column].imag;
+        ca[column] -= pow_a[off+column];
+        cb[column] -= pow_b[off+column];
+      }
+    }
+    for (line=(win_end > start ? win_end : start); line<end; ++line) {
+      int off = (line - b->in_start)*ns;
+      for (column=0; column<ns; ++column) {
+        cr[column] += igram[off+column].real;
+        ci[column] += igram[off+column].imag;
+        ca[column] += pow_a[off+column];
+        cb[column] += pow_b[off+column];
+      }
+    }
+    win_start = start;
+    win_end = end;
+
+    pr[0] = pi[0] = pa[0] = pb[0] = 0.0;
+    for (column=0; column<ns; ++column) {
+      pr[column+1] = pr[column] + cr[column];
+      pi[column+1] = pi[column] + ci[column];
+      pa[column+1] = pa[column] + ca[column];
+      pb[column+1] = pb[column] + cb[column];
+    }
+
+    // Coherence over lookLine x lookSample windows
+    float *coh = b->coh + row*p->ml_sample_count;
+    for (k=0; k<p->ml_sample_count; ++k) {
+      int c0 = k*p->stepSample;
+      int c1 = MIN(c0 + p->lookSample, ns);
+      double re = pr[c1] - pr[c0];
+      double im = pi[c1] - pi[c0];
+      double sum_a = pa[c1] - pa[c0];
+      double sum_b = pb[c1] - pb[c0];
+
+      if (FLOAT_EQUIVALENT((sum_a*sum_b), 0.0))
+        coh[k] = 0.0;
+      else {
+        coh[k] = (float) (sqrt(re*re + im*im) / sqrt(sum_a*sum_b));
+        // Can only go over 1 through round-off
+        if (coh[k] > 1.0)
+          coh[k] = 1.0;
+      }
+    }
+
+    // Multilooked interferogram over stepLine x stepSample boxes
+    int ml_end = MIN(start + p->stepLine, p->line_count);
+    float *ml_amp = b->ml_amp + row*p->ml_sample_count;
+    float *ml_phase = b->ml_phase + row*p->ml_sample_count;
+    for (k=0; k<p->ml_sample_count; ++k) {
+      int c0 = k*p->stepSample;
+      double re = 0.0, im = 0.0;
+      for (line=start; line<ml_end; ++line) {
+        complexFloat *ig = igram + (line - b->in_start)*ns;
+        for (column=c0; column<c0+p->stepSample; ++column) {
+          re += ig[column].real;
+          im += ig[column].imag;
+        }
+      }
+      ml_amp[k] = sqrt(re*re + im*im)*p->ampScale;
+      if (FLOAT_EQUIVALENT(re, 0.0) || FLOAT_EQUIVALENT(im, 0.0))
+        ml_phase[k] = 0.0;
+      else
+        ml_phase[k] = atan2(im, re);
+    }
+  }
+}
+
 int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
 		  char *masterFile, char *slaveFile, char *outBase,
 		  float *average)
 {
-  char ampFile[255], phaseFile[255], igramFile[512];
-  char cohFile[512], ml_ampFile[255], ml_phaseFile[255], ml_igramFile[512];
-  FILE *fpMaster, *fpSlave, *fpAmp, *fpPhase, *fpCoh, *fpAmp_ml, *fpPhase_ml;
-  int line, sample_count, line_count, count;
-  float	bin_high, bin_low, max=0.0, sum_a, sum_b, ampScale;
+  return asf_igram_coh_ext(lookLine, lookSample, stepLine, stepSample,
+                           masterFile, slaveFile, outBase, average, TRUE);
+}
+
+int asf_igram_coh_ext(int lookLine, int lookSample, int stepLine,
+                      int stepSample, char *masterFile, char *slaveFile,
+                      char *outBase, float *average, int single_look)
+{
+  char ampFile[255], phaseFile[255];
+  char cohFile[512], ml_ampFile[255], ml_phaseFile[255];
+  FILE *fpMaster, *fpSlave, *fpAmp=NULL, *fpPhase=NULL, *fpCoh;
+  FILE *fpAmp_ml, *fpPhase_ml;
+  int ii, kk, sample_count, line_count, ml_line_count, ml_sample_count, count;
+  float	bin_high, bin_low, max=0.0;
   double hist_sum=0.0, percent, percent_sum;
   long long hist_val[HIST_SIZE], hist_cnt=0;
   meta_parameters *inMeta,*outMeta, *ml_outMeta;
-  complexFloat *master, *slave, *sum_igram, *sum_ml_igram;
-  float *amp, *phase, *sum_cpx_a, *sum_cpx_b, *coh, *pCoh;
-  float *ml_amp, *ml_phase;
 
   // FIXME: Processing flow with two-banded interferogram needed - backed out
   //        for now
@@ -28,42 +215,37 @@ int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
   create_name(phaseFile, outBase,"_igram_phase.img");
   create_name(ml_ampFile, outBase,"_igram_ml_amp.img");
   create_name(ml_phaseFile, outBase,"_igram_ml_phase.img");
-  //create_name(igramFile, outBase,"_igram.img");
-  //create_name(ml_igramFile, outBase, "_igram_ml.img");
-  //sprintf(cohFile, "coherence.img");
   create_name(cohFile, outBase, "_coh.img");
 
   // Read input meta file
   inMeta = meta_read(masterFile);
   line_count = inMeta->general->line_count; 
   sample_count = inMeta->general->sample_count;
-  ampScale = 1.0/(stepLine*stepSample);
+  ml_line_count = line_count/stepLine;
+  ml_sample_count = sample_count/stepSample;
+  if (ml_line_count < 1 || ml_sample_count < 1)
+    asfPrintError("Image (%dx%d) is smaller than one step (%dx%d).\n",
+                  line_count, sample_count, stepLine, stepSample);
 
   // Generate metadata for single-look images 
   outMeta = meta_read(masterFile);
   outMeta->general->data_type = REAL32;
 
-  // Write metadata for interferometric amplitude
-  outMeta->general->image_data_type = AMPLITUDE_IMAGE;
-  meta_write(outMeta, ampFile);
-
-  // Write metadata for interferometric phase
-  outMeta->general->image_data_type = PHASE_IMAGE;
-  meta_write(outMeta, phaseFile);
-
-  /*
-  // Write metadata for interferogram
-  outMeta->general->image_data_type = INTERFEROGRAM;
-  outMeta->general->band_count = 2;
-  strcpy(outMeta->general->bands, "IGRAM-AMP,IGRAM-PHASE");
-  meta_write(outMeta, igramFile);
-  */	
-     
+  if (single_look) {
+    // Write metadata for interferometric amplitude
+    outMeta->general->image_data_type = AMPLITUDE_IMAGE;
+    meta_write(outMeta, ampFile);
+
+    // Write metadata for interferometric phase
+    outMeta->general->image_data_type = PHASE_IMAGE;
+    meta_write(outMeta, phaseFile);
+  }
+
   // Generate metadata for multilooked images
   ml_outMeta = meta_read(masterFile);
   ml_outMeta->general->data_type = REAL32;
-  ml_outMeta->general->line_count = line_count/stepLine;
-  ml_outMeta->general->sample_count = sample_count/stepSample;
+  ml_outMeta->general->line_count = ml_line_count;
+  ml_outMeta->general->sample_count = ml_sample_count;
   ml_outMeta->general->x_pixel_size *= stepSample;
   ml_outMeta->general->y_pixel_size *= stepLine;
   ml_outMeta->sar->multilook = 1;
@@ -86,36 +268,75 @@ int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
   ml_outMeta->general->image_data_type = COHERENCE_IMAGE;
   meta_write(ml_outMeta, cohFile);
 
-  /*
-  // Write metadata for multilooked interferogram
-  ml_outMeta->general->image_data_type = INTERFEROGRAM;
-  strcpy(ml_outMeta->general->bands, "IGRAM-AMP,IGRAM-PHASE");
-  ml_outMeta->general->band_count = 2;
-  meta_write(ml_outMeta, ml_igramFile);
-  */
+  // Split the output into blocks of multilooked lines.  The last block
+  // also writes the single-look lines left over below the last full step.
+  int n_blocks = (ml_line_count + ROWS_PER_BLOCK - 1)/ROWS_PER_BLOCK;
+  igram_block_t *blocks = MALLOC(sizeof(igram_block_t)*n_blocks);
+  int max_in = 0, max_sl = 0;
+  for (ii=0; ii<n_blocks; ++ii) {
+    igram_block_t *b = &blocks[ii];
+    b->out_start = ii*ROWS_PER_BLOCK;
+    b->out_count = MIN(ROWS_PER_BLOCK, ml_line_count - b->out_start);
+    b->sl_start = b->out_start*stepLine;
+    b->sl_count = ii==n_blocks-1 ? line_count - b->sl_start :
+      b->out_count*stepLine;
+    b->in_start = b->sl_start;
+    b->in_count = MIN((b->out_start + b->out_count - 1)*stepLine + lookLine,
+                      line_count) - b->in_start;
+    if (b->in_count < b->sl_count)
+      b->in_count = b->sl_count;
+    if (b->in_count > max_in) max_in = b->in_count;
+    if (b->sl_count > max_sl) max_sl = b->sl_count;
+  }
+
+  int n_threads = asf_get_num_threads();
+  int batch_size = n_threads < n_blocks ? n_threads : n_blocks;
+  if (batch_size < 1) batch_size = 1;
+  int max_batch_lines =
+    (batch_size - 1)*ROWS_PER_BLOCK*stepLine + max_in;
+
+  igram_params_t params;
+  params.lookLine = lookLine;
+  params.lookSample = lookSample;
+  params.stepLine = stepLine;
+  params.stepSample = stepSample;
+  params.line_count = line_count;
+  params.sample_count = sample_count;
+  params.ml_sample_count = ml_sample_count;
+  params.single_look = single_look;
+  params.ampScale = 1.0/(stepLine*stepSample);
 
   // Allocate memory
-  master = (complexFloat *) MALLOC(sizeof(complexFloat)*sample_count*lookLine);
-  slave = (complexFloat *) MALLOC(sizeof(complexFloat)*sample_count*lookLine);
-  amp = (float *) MALLOC(sizeof(float)*sample_count*lookLine);
-  phase = (float *) MALLOC(sizeof(float)*sample_count*lookLine);
-  ml_amp = (float *) MALLOC(sizeof(float)*sample_count/stepSample);
-  ml_phase = (float *) MALLOC(sizeof(float)*sample_count/stepSample);
-  coh = (float *) MALLOC(sizeof(float)*sample_count/stepSample);
-  sum_cpx_a = (float *) MALLOC(sizeof(float)*sample_count);
-  sum_cpx_b = (float *) MALLOC(sizeof(float)*sample_count);
-  sum_igram = (complexFloat *) MALLOC(sizeof(complexFloat)*sample_count);
-  sum_ml_igram = (complexFloat *) MALLOC(sizeof(complexFloat)*sample_count);
+  params.master = MALLOC(sizeof(complexFloat)*sample_count*max_batch_lines);
+  params.slave = MALLOC(sizeof(complexFloat)*sample_count*max_batch_lines);
+  params.igram = MALLOC(sizeof(complexFloat*)*n_threads);
+  params.pow_a = MALLOC(sizeof(float*)*n_threads);
+  params.pow_b = MALLOC(sizeof(float*)*n_threads);
+  params.col = MALLOC(sizeof(double*)*n_threads);
+  params.prefix = MALLOC(sizeof(double*)*n_threads);
+  for (ii=0; ii<n_threads; ++ii) {
+    params.igram[ii] = MALLOC(sizeof(complexFloat)*sample_count*max_in);
+    params.pow_a[ii] = MALLOC(sizeof(float)*sample_count*max_in);
+    params.pow_b[ii] = MALLOC(sizeof(float)*sample_count*max_in);
+    params.col[ii] = MALLOC(sizeof(double)*sample_count*4);
+    params.prefix[ii] = MALLOC(sizeof(double)*(sample_count+1)*4);
+  }
+  // One set of output buffers for each block in a batch
+  float **slot = MALLOC(sizeof(float*)*batch_size);
+  int sl_size = single_look ? sample_count*max_sl : 0;
+  int ml_size = ml_sample_count*ROWS_PER_BLOCK;
+  for (ii=0; ii<batch_size; ++ii)
+    slot[ii] = MALLOC(sizeof(float)*(sl_size*2 + ml_size*3));
 
   // Open files
   fpMaster = FOPEN(masterFile,"rb");
   fpSlave = FOPEN(slaveFile,"rb");
-  fpAmp = FOPEN(ampFile,"wb");
-  fpPhase = FOPEN(phaseFile,"wb");
+  if (single_look) {
+    fpAmp = FOPEN(ampFile,"wb");
+    fpPhase = FOPEN(phaseFile,"wb");
+  }
   fpAmp_ml = FOPEN(ml_ampFile,"wb");
   fpPhase_ml = FOPEN(ml_phaseFile,"wb");
-  //FILE *fpIgram = FOPEN(igramFile, "wb");
-  //FILE *fpIgram_ml = FOPEN(ml_igramFile, "wb");
   fpCoh = FOPEN(cohFile,"wb");
 
   // Initialize histogram
@@ -123,141 +344,69 @@ int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
 
   asfPrintStatus("   Calculating interferogram and coherence ...\n\n");
 
-  for (line=0; line<line_count; line+=stepLine)
-  {
-    register int offset, row, column, limitLine;
-    double igram_real, igram_imag;
-    int inCol;
-    limitLine=MIN(lookLine, line_count-line);
-
-    printf("Percent completed %3.0f\r",(float)line/line_count*100.0);
-
-    pCoh = coh;
-
-    // Read in the next lines of data
-    get_complexFloat_lines(fpMaster, inMeta, line, limitLine, master);
-    get_complexFloat_lines(fpSlave, inMeta, line, limitLine, slave);
-
-    // Add the remaining rows into sum vectors
-    offset = sample_count;
-    for (column=0; column<sample_count; column++)
-    {
-      offset = column;
-      sum_cpx_a[column] = 0.0;
-      sum_cpx_b[column] = 0.0;
-      sum_igram[column].real = 0.0;
-      sum_igram[column].imag = 0.0;
-      sum_ml_igram[column].real = 0.0;
-      sum_ml_igram[column].imag = 0.0;
-      igram_real = 0.0;
-      igram_imag = 0.0;
-
-      for (row=0; row<limitLine; row++)
-      {
-	// Complex multiplication for interferogram generation
-	igram_real = master[offset].real*slave[offset].real + 
-	  master[offset].imag*slave[offset].imag;
-        igram_imag = master[offset].imag*slave[offset].real - 
-	  master[offset].real*slave[offset].imag;
-        amp[offset] = sqrt(igram_real*igram_real + igram_imag*igram_imag);
-        if (FLOAT_EQUIVALENT(igram_real, 0.0) || 
-	    FLOAT_EQUIVALENT(igram_imag, 0.0))
-	  phase[offset]=0.0;
-        else
-	  phase[offset] = atan2(igram_imag, igram_real);
-
-       	sum_cpx_a[column] += AMP(master[offset])*AMP(master[offset]);
-      	sum_cpx_b[column] += AMP(slave[offset])*AMP(slave[offset]);
-       	sum_igram[column].real += igram_real;
-	sum_igram[column].imag += igram_imag;
-	if (line % stepLine == 0 && row < stepLine) {
-	  sum_ml_igram[column].real += igram_real;
-	  sum_ml_igram[column].imag += igram_imag;
-	}
-
-	offset += sample_count;
-      }
+  for (ii=0; ii<n_blocks; ii+=batch_size) {
+    int n = MIN(batch_size, n_blocks - ii);
 
-      ml_amp[column] = 
-	sqrt(sum_ml_igram[column].real*sum_ml_igram[column].real + 
-	     sum_ml_igram[column].imag*sum_ml_igram[column].imag)*ampScale;
-      if (FLOAT_EQUIVALENT(sum_ml_igram[column].real, 0.0) || 
-	  FLOAT_EQUIVALENT(sum_ml_igram[column].imag, 0.0))
-	ml_phase[column] = 0.0;
-      else
-	ml_phase[column] = atan2(sum_ml_igram[column].imag, 
-				 sum_ml_igram[column].real);
+    for (kk=0; kk<n; ++kk) {
+      igram_block_t *b = &blocks[ii+kk];
+      b->amp = slot[kk];
+      b->phase = b->amp + sl_size;
+      b->ml_amp = b->phase + sl_size;
+      b->ml_phase = b->ml_amp + ml_size;
+      b->coh = b->ml_phase + ml_size;
     }
 
-    // Write single-look and multilooked amplitude and phase
-    put_float_lines(fpAmp, outMeta, line, stepLine, amp);
-    put_float_lines(fpPhase, outMeta, line, stepLine, phase);
-    put_float_line(fpAmp_ml, ml_outMeta, line/stepLine, ml_amp);
-    put_float_line(fpPhase_ml, ml_outMeta, line/stepLine, ml_phase);
-    //put_band_float_lines(fpIgram, outMeta, 0, line, stepLine, amp);
-    //put_band_float_lines(fpIgram, outMeta, 1, line, stepLine, phase);
-    //put_band_float_line(fpIgram_ml, ml_outMeta, 0, line/stepLine, ml_amp);
-    //put_band_float_line(fpIgram_ml, ml_outMeta, 1, line/stepLine, ml_phase);
-
-    // Calculate the coherence by adding from sum vectors
-    for (inCol=0; inCol<sample_count; inCol+=stepSample)
-    {
-      register int limitSample = MIN(lookSample,sample_count-inCol);
-      sum_a = 0.0;
-      sum_b = 0.0;
-      igram_real = 0.0;
-      igram_imag = 0.0;
-
-      // Step over multilook area and sum output columns
-      for (column=0; column<limitSample; column++)
-      {
-	igram_real += sum_igram[inCol+column].real;
-	igram_imag += sum_igram[inCol+column].imag;				
-	sum_a += sum_cpx_a[inCol+column];
-	sum_b += sum_cpx_b[inCol+column];
+    // Read in all of the lines needed by this batch
+    int first = blocks[ii].in_start;
+    int last = first;
+    for (kk=0; kk<n; ++kk) {
+      igram_block_t *b = &blocks[ii+kk];
+      if (b->in_start + b->in_count > last)
+        last = b->in_start + b->in_count;
+    }
+    get_complexFloat_lines(fpMaster, inMeta, first, last-first, params.master);
+    get_complexFloat_lines(fpSlave, inMeta, first, last-first, params.slave);
+    params.batch_start = first;
+    params.blocks = &blocks[ii];
+
+    asf_parallel_for(n, igram_block, &params);
+
+    // Write out the blocks in order, and keep filling the coherence
+    // histogram
+    for (kk=0; kk<n; ++kk) {
+      igram_block_t *b = &blocks[ii+kk];
+
+      if (single_look) {
+        put_float_lines(fpAmp, outMeta, b->sl_start, b->sl_count, b->amp);
+        put_float_lines(fpPhase, outMeta, b->sl_start, b->sl_count, b->phase);
       }
+      put_float_lines(fpAmp_ml, ml_outMeta, b->out_start, b->out_count,
+                      b->ml_amp);
+      put_float_lines(fpPhase_ml, ml_outMeta, b->out_start, b->out_count,
+                      b->ml_phase);
+      put_float_lines(fpCoh, ml_outMeta, b->out_start, b->out_count, b->coh);
 
-      if (FLOAT_EQUIVALENT((sum_a*sum_b), 0.0))
-	*pCoh = 0.0;
-      else 
+      for (count=0; count<b->out_count*ml_sample_count; count++)
       {
-	*pCoh = (float) sqrt(igram_real*igram_real + igram_imag*igram_imag) /
-	  sqrt(sum_a * sum_b);
-	if (*pCoh>1.0001)
-	{ 
-	  printf("   coh = %f -- setting to 1.0\n",*pCoh);
-	  printf("   You shouldn't have seen this!\n");
-	  printf("   Exiting.\n");
-          exit(EXIT_FAILURE);
-	  *pCoh=1.0;
-	}
+        register int tmp;
+        tmp = (int) (b->coh[count]*HIST_SIZE); /* Figure out which bin this value is in */
+        /* This shouldn't happen */
+        if(tmp >= HIST_SIZE)
+          tmp = HIST_SIZE-1;
+        if(tmp < 0)
+          tmp = 0;
+
+        hist_val[tmp]++;        // Increment that bin for the histogram
+        hist_sum += b->coh[count];   // Add up the values for the sum
+        hist_cnt++;             // Keep track of the total number of values
+        if (b->coh[count]>max)
+          max = b->coh[count];  // Calculate maximum coherence
       }
-     pCoh++;
-    } 
-
-    // Write out values for coherence
-    put_float_line(fpCoh, ml_outMeta, line/stepLine, coh);
-
-    // Keep filling coherence histogram
-    for (count=0; count<sample_count/stepSample; count++)
-    {
-      register int tmp;
-      tmp = (int) (coh[count]*HIST_SIZE); /* Figure out which bin this value is in */
-      /* This shouldn't happen */
-      if(tmp >= HIST_SIZE)
-	tmp = HIST_SIZE-1;
-      if(tmp < 0)
-	tmp = 0;
-      
-      hist_val[tmp]++;        // Increment that bin for the histogram
-      hist_sum += coh[count];   // Add up the values for the sum
-      hist_cnt++;             // Keep track of the total number of values
-      if (coh[count]>max) 
-	max = coh[count];  // Calculate maximum coherence
     }
-  } // End for line
 
-  printf("Percent completed %3.0f\n",(float)line/line_count*100.0);
+    asfLineMeter(blocks[ii+n-1].out_start + blocks[ii+n-1].out_count - 1,
+                 ml_line_count);
+  }
 
   // Sum and print the statistics
   percent_sum = 0.0;
@@ -278,25 +427,35 @@ int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
 		 *average,hist_sum, hist_cnt, percent_sum);
 
   // Free and exit
-  FREE(master); 
-  FREE(slave);
-  FREE(amp); 
-  FREE(phase);
-  FREE(ml_amp); 
-  FREE(ml_phase); 
-  FREE(coh); 
+  for (ii=0; ii<n_threads; ++ii) {
+    FREE(params.igram[ii]);
+    FREE(params.pow_a[ii]);
+    FREE(params.pow_b[ii]);
+    FREE(params.col[ii]);
+    FREE(params.prefix[ii]);
+  }
+  for (ii=0; ii<batch_size; ++ii)
+    FREE(slot[ii]);
+  FREE(slot);
+  FREE(params.igram);
+  FREE(params.pow_a);
+  FREE(params.pow_b);
+  FREE(params.col);
+  FREE(params.prefix);
+  FREE(params.master);
+  FREE(params.slave);
+  FREE(blocks);
   FCLOSE(fpMaster); 
   FCLOSE(fpSlave);
-  FCLOSE(fpAmp); 
-  FCLOSE(fpPhase);
+  if (single_look) {
+    FCLOSE(fpAmp); 
+    FCLOSE(fpPhase);
+  }
   FCLOSE(fpAmp_ml); 
   FCLOSE(fpPhase_ml);
-  //FCLOSE(fpIgram);
-  //FCLOSE(fpIgram_ml);
   FCLOSE(fpCoh); 
   meta_free(inMeta);
   meta_free(outMeta);
   meta_free(ml_outMeta);
   return(0);
 }
-
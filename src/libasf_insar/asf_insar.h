@@ -52,6 +52,9 @@ int asf_coregister(int datatype, char *coregType, char *baseName, int deskew,
 int asf_igram_coh(int lookLine, int lookSample, int stepLine, int stepSample,
 		  char *masterFile, char *slaveFile, char *outBase,
 		  float *average);
+int asf_igram_coh_ext(int lookLine, int lookSample, int stepLine,
+		      int stepSample, char *masterFile, char *slaveFile,
+		      char *outBase, float *average, int single_look);
 
 // Prototypes from asf_phase_unwrap.c
 int dem2phase(char *demFile, char *baseFile, char *phaseFile);
@@ -81,6 +84,7 @@ int zeroify(char *inFile, char *testFile, char *outFile);
 
 // Prototypes from escher.c
 int escher(char *inFile, char *outFile);
+int escher_tiled(char *inFile, char *outFile, int block_size);
 
 // Prototypes from refine_baseline.c
 int refine_baseline(char *phaseFile, char *seeds, char *oldBase, 
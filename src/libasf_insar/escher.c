@@ -1,5 +1,4 @@
 #include "asf.h"
-#include "ifm.h"
 #include "asf_meta.h"
 #include "asf_endian.h"
 #include "asf_insar.h"
@@ -7,6 +6,11 @@
 // General constants
 #define MAXNAME         256
 #define DO_DEBUG_CHECKS 0
+#define TWOPI           6.28318530718   // the value ifm.h uses
+
+#ifndef min
+#define min(x,y)        (((x) < (y)) ? (x) : (y))
+#endif
 
 /*
  * bits are number from 0 (lsb) to 7 (msb)
@@ -65,62 +69,118 @@
 #define SOURCE_X              (0xf0)        /* 1 1 1 1  0 0 0 0 */
 
 // New Data types
+#ifndef __Uchar_var
+#define __Uchar_var
+typedef unsigned char Uchar;
+#endif
+
 typedef struct _Point {
   int i;
   int j;
 } Point;
 
-#define MAX_PLIST 1048576
+// Branch cut bookkeeping: the points of the current tree, grows as needed
 typedef struct _PList {
   int n;
-  Point p[1048576];
-  int c[1048576];
+  int max;
+  Point *p;
+  int *c;
 } PList;
 
-// Globals
-PList list;
-Uchar *mask;     /* phase-state mask  */
-Uchar *im;       /* integration mask  */
-float *phase;   /* input phase       */
-float *coh;     /* coherence 'rho'   */
-int wid;
-int len;
-int size;
+// Everything needed to unwrap one image (or one block of an image, see
+// escher_tiled), so that several blocks can be unwrapped at once.
+typedef struct {
+  PList list;
+  Uchar *mask;     /* phase-state mask  */
+  Uchar *im;       /* integration mask  */
+  float *phase;    /* input phase       */
+  int wid;
+  int len;
+  int size;
+  int verbose;     /* print progress    */
+} escher_t;
+
+// Images with more pixels than this are unwrapped in blocks
+#define MAX_WHOLE_IMAGE_PIXELS (8192*8192)
+
+// Default block size, and overlap between blocks, for escher_tiled
+#define DEFAULT_BLOCK_SIZE 2048
+#define BLOCK_OVERLAP 128
 
 // Function declarations
-void loadWrappedPhase(char *phaseName);
-void groundBorder(void);
-void makeMask(void);
-void verifyCuts(void);
-Uchar chargeCalc(float ul, float ll, float lr, float ur);
-float phaseRemap(float in);
-void installCordon(char *cordonName);
-void cutMask(void);
-void generateCut(int x, int y);
-void makeBranchCut(int x1, int y1, int x2, int y2, Uchar orBy);
-void saveMask(Uchar *mask, char *maskName);
-void readMask(Uchar *mask, char *maskName);
-void finishUwp(void);
-void checkSeed(int *new_seedX, int *new_seedY);
-void integratePhase(int x, int y);
-void saveUwp(char *uwpName);
-void doStats();
-
-void loadWrappedPhase(char *f)
+static void groundBorder(escher_t *e);
+static void makeMask(escher_t *e);
+static Uchar chargeCalc(float ul, float ll, float lr, float ur);
+static float phaseRemap(float in);
+static void installCordon(escher_t *e, char *cordonName, int x0, int y0);
+static void cutMask(escher_t *e);
+static void generateCut(escher_t *e, int x, int y);
+static void makeBranchCut(escher_t *e, int x1, int y1, int x2, int y2,
+                          Uchar orBy);
+static void saveMask(escher_t *e, char *maskName);
+static void finishUwp(escher_t *e);
+static void checkSeed(escher_t *e, int *new_seedX, int *new_seedY);
+static void integratePhase(escher_t *e, int x, int y);
+static void doStats(escher_t *e);
+
+static void escher_init(escher_t *e, int wid, int len, int verbose)
+{
+  e->wid = wid;
+  e->len = len;
+  e->size = wid*len;
+  e->verbose = verbose;
+  e->mask = (Uchar *)CALLOC(e->size, sizeof(Uchar));
+  e->im = (Uchar *)CALLOC(e->size, sizeof(Uchar));
+  e->phase = (float *)MALLOC(sizeof(float)*e->size);
+  e->list.n = 0;
+  e->list.max = 0;
+  e->list.p = NULL;
+  e->list.c = NULL;
+}
+
+static void escher_free(escher_t *e)
+{
+  FREE(e->mask);
+  FREE(e->im);
+  FREE(e->phase);
+  if (e->list.p) FREE(e->list.p);
+  if (e->list.c) FREE(e->list.c);
+}
+
+/* add point (i, j), connected to point number 'c', to the list */
+static void listAdd(PList *list, int i, int j, int c)
+{
+  if (list->n == list->max) {
+    list->max = list->max ? 2*list->max : 4096;
+    list->p = (Point *)realloc(list->p, sizeof(Point)*list->max);
+    list->c = (int *)realloc(list->c, sizeof(int)*list->max);
+    if (!list->p || !list->c)
+      asfPrintError("Out of memory for branch cut (%d points)\n", list->max);
+  }
+  list->p[list->n].i = i;
+  list->p[list->n].j = j;
+  list->c[list->n] = c;
+  list->n++;
+}
+
+static void loadWrappedPhase(escher_t *e, char *f)
 {
   FILE * fd;
   meta_parameters *meta;
 
   fd = FOPEN(f, "rb");
   meta = meta_read(f);
-  get_float_lines(fd, meta, 0, len, phase);
+  get_float_lines(fd, meta, 0, e->len, e->phase);
   FCLOSE(fd);
+  meta_free(meta);
 
   return;
 }
 
-void groundBorder()
+static void groundBorder(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  int wid = e->wid, len = e->len;
   int i, j;
 
   /* ground the left edge once and ground the right edge twice */
@@ -141,7 +201,7 @@ void groundBorder()
 }
 
 
-float phaseRemap(float p)
+static float phaseRemap(float p)
 {
   p = (double)fmod((double)p,(double)TWOPI);
   if (p>PI) p-=TWOPI;
@@ -150,8 +210,10 @@ float phaseRemap(float p)
 }
 
 
-int isGoodSeed(int x,int y)
+static int isGoodSeed(escher_t *e, int x, int y)
 {
+  Uchar *mask = e->mask;
+  int wid = e->wid, len = e->len;
 #define check_span 10 /*Make sure no cuts occur within this many pixels of seed*/
   int dx,dy;
   if ((x<check_span)||(x>=wid-check_span)||
@@ -168,10 +230,12 @@ int isGoodSeed(int x,int y)
   return 1;/*If no cut is nearby, this is a good point*/
 }
 
-void checkSeed(int *x, int *y)
+static void checkSeed(escher_t *e, int *x, int *y)
 {
+  int wid = e->wid, len = e->len;
+
   /* adjust seed point to reside on a usable (mask == ZERO) pixel */
-  while (!isGoodSeed(*x,*y))
+  while (!isGoodSeed(e,*x,*y))
   {
     asfPrintStatus("\n   seed point (%d, %d) is not ZERO.\n", *x, *y);
     /*Pick a new, random seed point.*/
@@ -183,12 +247,42 @@ void checkSeed(int *x, int *y)
   return;
 }
 
+/* Like checkSeed, but without the random search (which might never end
+ * on a block with no usable pixels): looks for the usable pixel nearest
+ * the center of the image, on a coarse grid.  Returns FALSE if there
+ * isn't one. */
+static int findSeed(escher_t *e, int *x, int *y)
+{
+  const int step = 8;
+  int i, j, found = FALSE;
+  long best = 0;
+
+  for (j = check_span; j < e->len - check_span; j += step) {
+    for (i = check_span; i < e->wid - check_span; i += step) {
+      long d = (long)(i - e->wid/2)*(i - e->wid/2) +
+               (long)(j - e->len/2)*(j - e->len/2);
+      if ((!found || d < best) && isGoodSeed(e, i, j)) {
+        *x = i;
+        *y = j;
+        best = d;
+        found = TRUE;
+      }
+    }
+  }
+
+  return found;
+}
+
 /*
  * This function is a cursory test to check for 'residual' residues.
  *   If 'escher' is working properly it should give a null result.
  */
-void verifyCuts(void)
+#if DO_DEBUG_CHECKS
+static void verifyCuts(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  float *phase = e->phase;
+  int wid = e->wid, len = e->len;
   int i, j, nSites = 0, nResidues = 0;
   float p0, p1, p2, p3;
 
@@ -219,9 +313,13 @@ void verifyCuts(void)
     nResidues, nSites, 100.0*(float)(nResidues)/(float)(nSites));
   return;
 }
+#endif
 
-void makeMask()
+static void makeMask(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  float *phase = e->phase;
+  int wid = e->wid, len = e->len;
   int i, j;
   float p0, p1, p2, p3;
 
@@ -240,7 +338,7 @@ void makeMask()
   return;
 }
 
-Uchar chargeCalc(float p0, float p1, float p2, float p3)
+static Uchar chargeCalc(float p0, float p1, float p2, float p3)
 {
   register float d0, d1, d2, d3, od0, od1, od2, od3, sum;
 
@@ -292,23 +390,25 @@ Uchar chargeCalc(float p0, float p1, float p2, float p3)
 #endif
 }
 
-void installCordon(char *cordonFnm)
+/* (x0, y0) is the location of this block in the image */
+static void installCordon(escher_t *e, char *cordonFnm, int x0, int y0)
 {
-  int i, n, x, y;
+  int x, y;
   FILE *fp;
 
-  if (fileExist(cordonFnm)) {
-    n = fileNumLines(cordonFnm);
+  if (fileExists(cordonFnm)) {
     fp = FOPEN(cordonFnm,"r");
-    for (i = 0; i < n; i++) {
-      fscanf(fp,"%d", &x);
-      fscanf(fp,"%d", &y);
-      mask[ y*wid + x] |= GROUNDED;
+    while (fscanf(fp,"%d %d", &x, &y) == 2) {
+      x -= x0;
+      y -= y0;
+      if (x >= 0 && x < e->wid && y >= 0 && y < e->len)
+        e->mask[ y*e->wid + x] |= GROUNDED;
     }
-    fclose(fp);
+    FCLOSE(fp);
     //printf("\ngrounded out %d points from cordon file '%s'\n\n",
     //  n, cordonFnm);
-    doStats();
+    if (e->verbose)
+      doStats(e);
   }
   else {
     /*The "cordon" file almost never exists; so this shouldn't be an error!
@@ -320,25 +420,29 @@ void installCordon(char *cordonFnm)
   return;
 }
 
-void saveMask(unsigned char *m, char *f)
+static void maskName(char *fnm, char *f)
 {
-  char fnm[256];
-
-  create_name(fnm,f,"_mask.img");
-  writeVector(m, fnm, CHAR, size);
-  return;
+  char *base = stripExt(f);
+  sprintf(fnm, "%s_mask.img", base);
+  FREE(base);
 }
 
-void readMask(unsigned char *m, char *fnm)
+static void saveMask(escher_t *e, char *f)
 {
-  if (!size)
-    Exit("   escher:  readMask():  zero mask size");
-  readVector(m, fnm, CHAR, size);
+  char fnm[1024];
+  FILE *fp;
+
+  maskName(fnm, f);
+  fp = FOPEN(fnm, "wb");
+  FWRITE(e->mask, sizeof(Uchar), e->size, fp);
+  FCLOSE(fp);
   return;
 }
 
-void cutMask(void)
+static void cutMask(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  int wid = e->wid, len = e->len;
   int i, j;
 
   /*
@@ -415,12 +519,12 @@ void cutMask(void)
 #endif
 
   /* initialize the number of points in 'list' to zero */
-  list.n = 0;
+  e->list.n = 0;
 
   /* loop over (wid-3)x(len-3) residue sites */
   for (j = 1; j < len-2; j++) {
     register Uchar *maskLineStart=mask+wid*j;
-    if (!(j%(len/8)))  
+    if (e->verbose && len >= 8 && !(j%(len/8)))
       asfPrintStatus("     ...at %d of %d\n", j, len);
     for (i = 1; i < wid-2; i++) {
       /*
@@ -428,7 +532,7 @@ void cutMask(void)
        * and is not already in a cut
        */
       if (*(maskLineStart+i) & SOME_CHARGE && !(*(maskLineStart+i) & IN_CUT)) {
-        generateCut(i, j);
+        generateCut(e, i, j);
       }
     }
   }
@@ -443,8 +547,11 @@ void cutMask(void)
  * and which has a total charge of zero. Furthermore, we want the
  * number of points involved in the branch cut to be minimized.
  */
-void generateCut(int i, int j)
+static void generateCut(escher_t *e, int i, int j)
 {
+  Uchar *mask = e->mask;
+  PList *list = &e->list;
+  int wid = e->wid, len = e->len;
   Uchar tV;                        /* test value */
   int point, point_i, point_j;
   int subR, subRmo;
@@ -453,7 +560,9 @@ void generateCut(int i, int j)
   int rmo;                       /* r minus one */
   int maxR;
   int tC=0;                        /* total charge */
-  /*int count;*/                     /* debug test */
+#if DO_DEBUG_CHECKS
+  int count;                       /* debug test */
+#endif
   int scram;
 
   /* calculate the total charge of the tree */
@@ -462,7 +571,7 @@ void generateCut(int i, int j)
   else if (mask[ j*wid + i] & NEGATIVE_CHARGE)
     tC = -1;
   else
-    Exit("   generateCut() called with no charge at (%d,%d)",i,j);
+    asfPrintError("   generateCut() called with no charge at (%d,%d)\n",i,j);
 
   /* calculate the maximum possible radius box around this point */
   maxR = min(i + 1, j + 1);
@@ -470,10 +579,8 @@ void generateCut(int i, int j)
   maxR = min(maxR, len - j);
 
   /* set the number of points in the list to 1, and point 0 to (i, j) */
-  list.n      = 1;
-  list.p[0].i = i;
-  list.p[0].j = j;
-  list.c[0]   = 0;   /* point 0 connects to itself */
+  list->n = 0;
+  listAdd(list, i, j, 0);   /* point 0 connects to itself */
 
   /* set this point in the mask to IN_TREE */
   mask[ j*wid + i] |= IN_TREE;
@@ -490,10 +597,10 @@ void generateCut(int i, int j)
 
     /* loop over the charge points in the current tree      */
     /*   (These may include cut charges from earlier trees) */
-    for (point = 0; point < list.n; point++) {
+    for (point = 0; point < list->n; point++) {
 
-      point_i = list.p[point].i;
-      point_j = list.p[point].j;
+      point_i = list->p[point].i;
+      point_j = list->p[point].j;
 
       /* loop over ALL the pixels in the box of radius r around this point */
       /* do this by starting with a box of radius 2 and working out */
@@ -534,7 +641,8 @@ void generateCut(int i, int j)
             /* test to see if the test value is grounded */
             if (tV & GROUNDED) {
               /* logical error check */
-              if (tV & IN_TREE) Exit("tV is both GROUNDED && IN_TREE");
+              if (tV & IN_TREE)
+                asfPrintError("tV is both GROUNDED && IN_TREE\n");
               /* new total charge is zero automatically */
               tC    =    0;
               /*
@@ -543,14 +651,8 @@ void generateCut(int i, int j)
                */
               scram = TRUE;
 
-              /* increment number of points in the list, set last location */
-              list.n++;
-              if (list.n > 1000000)
-                 Exit("list exceeded 1 million points");
-              list.p[(list.n)-1].i = k;
-              list.p[(list.n)-1].j = l;
-              /* connect this guy to point number 'point' */
-              list.c[(list.n)-1]   = point;
+              /* add (k, l) to the list, connected to point number 'point' */
+              listAdd(list, k, l, point);
 
               /*
                * connect all points with GROUNDED lines
@@ -558,15 +660,15 @@ void generateCut(int i, int j)
                */
               /* start at the second point on the list */
               /* loop to the last point on the list    */
-              for (p = 1; p <= (list.n)-1; p++) {
+              for (p = 1; p <= (list->n)-1; p++) {
                 /* set (p_i, p_j) to 'p-th' point in the list */
-                p_i  = list.p[p].i;
-                p_j  = list.p[p].j;
+                p_i  = list->p[p].i;
+                p_j  = list->p[p].j;
                 /* connection index is carried in c[] array   */
-                cIdx = list.c[p];
-                p_ii = list.p[cIdx].i;
-                p_jj = list.p[cIdx].j;
-                makeBranchCut(p_i, p_j, p_ii, p_jj, (IN_CUT | GROUNDED));
+                cIdx = list->c[p];
+                p_ii = list->p[cIdx].i;
+                p_jj = list->p[cIdx].j;
+                makeBranchCut(e, p_i, p_j, p_ii, p_jj, (IN_CUT | GROUNDED));
               }
 
             }  /* end if test value tV is GROUNDED */
@@ -582,14 +684,9 @@ void generateCut(int i, int j)
                * is not already part of a cut */
               if (!(tV & IN_CUT)) { tC += 3 - 2*((int)(tV & SOME_CHARGE)); }
               /* label all points from (point_i, _j) to (k, l) as IN_CUT */
-              makeBranchCut(point_i, point_j, k, l, IN_CUT);
-              /* increment number of points in the list, set last location */
-              list.n++;
-              if (list.n > 1000000) Exit("list exceeded 1 million points");
-              list.p[(list.n)-1].i = k;
-              list.p[(list.n)-1].j = l;
-              /* connect this guy to point number 'point' */
-              list.c[(list.n)-1]   = point;
+              makeBranchCut(e, point_i, point_j, k, l, IN_CUT);
+              /* add (k, l) to the list, connected to point number 'point' */
+              listAdd(list, k, l, point);
 
               /* mark this point as being on the current tree */
               mask[ l*wid + k] |= IN_TREE;
@@ -636,7 +733,7 @@ void generateCut(int i, int j)
   /* I think we can just about take this out pretty soon */
   if (!scram) {
     asfPrintStatus("(%d, %d), maxR = %d, r = %d, rmo = %d, list.n = %d\n",
-      i, j, maxR, r, rmo, list.n);
+      i, j, maxR, r, rmo, list->n);
     asfPrintError("Error in generateCut()");
   }
 #endif
@@ -647,42 +744,41 @@ void generateCut(int i, int j)
    * there is a list of points on the current
    * tree which should be marked 'NOT_IN_TREE'.
    */
-  for (point = 0; point < list.n; point++) {
-    point_i = list.p[point].i;
-    point_j = list.p[point].j;
+  for (point = 0; point < list->n; point++) {
+    point_i = list->p[point].i;
+    point_j = list->p[point].j;
     mask[ point_j*wid + point_i] &= NOT_IN_TREE;
   }
 
-#if DEBUG_TEST
+#if DO_DEBUG_CHECKS
   /* debug test... */
   /* I think we can just about take this out pretty soon */
   count = 0;
-  for (point = 0; point < list.n; point++) {
-    point_i = list.p[point].i;
-    point_j = list.p[point].j;
+  for (point = 0; point < list->n; point++) {
+    point_i = list->p[point].i;
+    point_j = list->p[point].j;
     if (!(mask[ point_j*wid + point_i] & IN_CUT)) { count++; }
   }
   if (count) {
     asfPrintStatus("   at point (%d, %d), the debug test for IN_CUT returned:"
 		   "\n",i,j);
-    asfPrintStatus("   \t%d bad of %d in the list\n", count, list.n);
-    for (point = 0; point < list.n; point++) {
-      point_i = list.p[point].i;
-      point_j = list.p[point].j;
-      if (!(mask[ point_j*wid + point_i] & IN_CUT)) { count++; }
+    asfPrintStatus("   \t%d bad of %d in the list\n", count, list->n);
+    for (point = 0; point < list->n; point++) {
+      point_i = list->p[point].i;
+      point_j = list->p[point].j;
       asfPrintStatus("   %d: (%d, %d)\n\tmask %d\n\tmask & IN_CUT %d\n",
-        point, point_i, point_j, (int)(mask[point_j*wid+point_i)),
+        point, point_i, point_j, (int)(mask[point_j*wid+point_i]),
         (int)(mask[point_j*wid+point_i] & IN_CUT));
       asfPrintStatus("   \tmask & GROUNDED %d\n\tmask & SOME_CHARGE %d\n",
         (int)(mask[point_j*wid+point_i] & GROUNDED),
         (int)(mask[point_j*wid+point_i] & SOME_CHARGE));
     }
-    Exit("   generateCut() failed logical test");
+    asfPrintError("generateCut() failed logical test\n");
   }
 #endif
 
   /* reset number of points on list to zero */
-  list.n = 0;
+  list->n = 0;
 
   return;
 }
@@ -692,8 +788,11 @@ void generateCut(int i, int j)
  * The purpose of this function is to do a logical or of 'orVal' with every
  *   pixel in the mask array from (i, j) to (ii, jj) inclusive.
  */
-void makeBranchCut(int i, int j, int ii, int jj, Uchar orVal)
+static void makeBranchCut(escher_t *e, int i, int j, int ii, int jj,
+                          Uchar orVal)
 {
+  Uchar *mask = e->mask;
+  int   wid = e->wid;
   int   dx, dy;        /* differences in coord values               */
   int   adx, ady;      /* absolute values of diffs                  */
   int   lc, sc;        /* int and short coords                     */
@@ -718,7 +817,7 @@ void makeBranchCut(int i, int j, int ii, int jj, Uchar orVal)
     lcd   = dx;
     if      (dx < 0) dc1 =  1;
     else if (dx > 0) dc1 = -1;
-    else             Exit("makeBranchCut():  logic error 1");
+    else             asfPrintError("makeBranchCut():  logic error 1\n");
     slope = (float)(dy)/(float)(dx);
   }
   else           {
@@ -728,7 +827,7 @@ void makeBranchCut(int i, int j, int ii, int jj, Uchar orVal)
     lcd   = dy;
     if      (dy < 0) dc1 =  1;
     else if (dy > 0) dc1 = -1;
-    else             Exit("makeBranchCut():  logic error 2");
+    else             asfPrintError("makeBranchCut():  logic error 2\n");
     slope = (float)(dx)/(float)(dy);
   }
 
@@ -752,8 +851,11 @@ void makeBranchCut(int i, int j, int ii, int jj, Uchar orVal)
   return;
 }
 
-void finishUwp(void)
+static void finishUwp(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  float *phase = e->phase;
+  int wid = e->wid, len = e->len;
   int i, j;
 
   for (j = 0; j < len; j++) {
@@ -766,21 +868,26 @@ void finishUwp(void)
   return;
 }
 
-void saveUwp(char *f)
+static void saveUwp(escher_t *e, char *f)
 {
   meta_parameters *meta;
 
   FILE *fd = FOPEN(f, "wb");
   meta = meta_read(f);
-  put_float_lines(fd, meta, 0, len, phase);
+  put_float_lines(fd, meta, 0, e->len, e->phase);
   FCLOSE(fd);
+  meta_free(meta);
 
   return;
 }
 
 
-void integratePhase(int i, int j)
+static void integratePhase(escher_t *e, int i, int j)
 {
+  Uchar *mask = e->mask;
+  Uchar *im = e->im;
+  float *phase = e->phase;
+  int    wid = e->wid;
   int    u, v;      /* starting point coordinates                         */
   Uchar  s;         /* temp status value                                  */
   int    t = 0;     /* total number of pixels integrated for this region  */
@@ -815,7 +922,8 @@ void integratePhase(int i, int j)
     phase[v*wid + u]  = phase[j*wid+i] +
                            phaseRemap((phase[v*wid+u]) -
                            (phase[j*wid+i]));
-    asfPrintStatus("   from seed point, started out by going up...");
+    if (e->verbose)
+      asfPrintStatus("   from seed point, started out by going up...");
   }
 
   /* try 2:  go right one pixel to (i + 1, j) */
@@ -827,7 +935,8 @@ void integratePhase(int i, int j)
     phase[ v*wid + u]  = phase[j*wid+i] +
                            phaseRemap((phase[v*wid+u]) -
                            (phase[j*wid+i]));
-    asfPrintStatus("   from seed point, started out by going right...\n");
+    if (e->verbose)
+      asfPrintStatus("   from seed point, started out by going right...\n");
   }
 
   /* try 3:  go down one pixel to (i, j + 1) */
@@ -839,7 +948,8 @@ void integratePhase(int i, int j)
     phase[ v*wid + u]  = phase[j*wid+i] +
                            phaseRemap((phase[v*wid+u]) -
                            (phase[j*wid+i]));
-    asfPrintStatus("   from seed point, started out by going down...\n");
+    if (e->verbose)
+      asfPrintStatus("   from seed point, started out by going down...\n");
   }
 
   /* try 4:  go left one pixel to (i - 1, j) */
@@ -851,7 +961,8 @@ void integratePhase(int i, int j)
     phase[ v*wid + u]  = phase[j*wid+i] +
                            phaseRemap((phase[v*wid+u]) -
                            (phase[j*wid+i]));
-    asfPrintStatus("\n   from seed point, started out by going left...\n");
+    if (e->verbose)
+      asfPrintStatus("\n   from seed point, started out by going left...\n");
   }
 
   /* fall through:  No good 4-nbrs found */
@@ -870,7 +981,8 @@ void integratePhase(int i, int j)
    */
   while (u != i || v != j || !(im[j*wid+i] & TRIED_L)){
 
-    if (!(t%100000)) asfPrintStatus ("\r   total integrated = %d", t);
+    if (e->verbose && !(t%100000))
+      asfPrintStatus ("\r   total integrated = %d", t);
 
     /* s = temp value of 'im' at pixel (u, v) */
     s        = im[v*wid + u];
@@ -984,13 +1096,15 @@ void integratePhase(int i, int j)
 
   }  /* end of the big 'while-not-done' loop */
 
-  asfPrintStatus("\nUnwrapped %d pixels...\n", t);
+  if (e->verbose) asfPrintStatus("\nUnwrapped %d pixels...\n", t);
   return;
 }
 
 
-void doStats()
+static void doStats(escher_t *e)
 {
+  Uchar *mask = e->mask;
+  int    wid = e->wid, len = e->len;
   int    i, j, k;
   int    nZero     = 0;
   int    nPlus     = 0;
@@ -1044,11 +1158,366 @@ void doStats()
   return;
 }
 
+/* One block of the image, for escher_tiled.  The block covers a "core"
+ * region of the image, plus BLOCK_OVERLAP pixels on each side (where
+ * there is image). */
+typedef struct {
+  int x0, y0, wid, len;   /* location and size, with overlap     */
+  int cx0, cy0, cx1, cy1; /* core region, in image coordinates    */
+  float *phase;           /* unwrapped phase (0 if not integrated) */
+  Uchar *mask;            /* phase-state mask                     */
+  int n_integrated;
+} escher_block_t;
+
+/* Link between two neighboring blocks: block b's phases need
+ * 2*PI*k added to match block a's. */
+typedef struct {
+  int a, b, k, weight;
+} escher_link_t;
+
+typedef struct {
+  char *inFile;
+  meta_parameters *meta;
+  escher_block_t *blocks;  /* the current row of blocks */
+} escher_row_params_t;
+
+/* runs in a worker thread -- unwraps one block */
+static void unwrap_block(int n, int thread, void *p)
+{
+  escher_row_params_t *params = (escher_row_params_t *)p;
+  escher_block_t *b = &params->blocks[n];
+  escher_t e;
+  int i, j, seedX, seedY;
+
+  escher_init(&e, b->wid, b->len, FALSE);
+
+  FILE *fp = FOPEN(params->inFile, "rb");
+  get_partial_float_lines(fp, params->meta, b->y0, b->len, b->x0, b->wid,
+                          e.phase);
+  FCLOSE(fp);
+
+  groundBorder(&e);
+  makeMask(&e);
+  installCordon(&e, "cordon", b->x0, b->y0);
+  cutMask(&e);
+
+  if (findSeed(&e, &seedX, &seedY))
+    integratePhase(&e, seedX, seedY);
+  finishUwp(&e);
+
+  /* count the integrated pixels in the core */
+  b->n_integrated = 0;
+  for (j = b->cy0 - b->y0; j < b->cy1 - b->y0; j++)
+    for (i = b->cx0 - b->x0; i < b->cx1 - b->x0; i++)
+      if (e.mask[j*e.wid + i] & INTEGRATED)
+        b->n_integrated++;
+
+  /* keep the phase & mask, the rest isn't needed any more */
+  b->phase = e.phase;
+  b->mask = e.mask;
+  e.phase = NULL;
+  e.mask = NULL;
+  FREE(e.im);
+  e.im = NULL;
+  if (e.list.p) FREE(e.list.p);
+  if (e.list.c) FREE(e.list.c);
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/* Finds the number of 2*PI cycles to add to block b to match block a,
+ * by voting over the pixels (in image coordinates [x0,x1) x [y0,y1))
+ * integrated in both blocks.  Block a's phase and mask are given as a
+ * separate array, as we only keep the bottom strip of the previous row
+ * of blocks.  Returns the number of votes for the winner (0 if the
+ * blocks don't share any integrated pixels). */
+static int link_blocks(float *aPhase, Uchar *aMask, int ax0, int ay0,
+                       int aWid, escher_block_t *b,
+                       int x0, int y0, int x1, int y1, int *k)
+{
+  int i, j, n = 0, best = 0, run;
+  int *votes;
+
+  if (x1 <= x0 || y1 <= y0)
+    return 0;
+  votes = (int *)MALLOC(sizeof(int)*(x1-x0)*(y1-y0));
+
+  for (j = y0; j < y1; j++) {
+    for (i = x0; i < x1; i++) {
+      int ia = (j - ay0)*aWid + (i - ax0);
+      int ib = (j - b->y0)*b->wid + (i - b->x0);
+      if ((aMask[ia] & INTEGRATED) && (b->mask[ib] & INTEGRATED))
+        votes[n++] = (int)floor((aPhase[ia] - b->phase[ib])/TWOPI + 0.5);
+    }
+  }
+
+  /* the most common value wins */
+  qsort(votes, n, sizeof(int), compare_ints);
+  for (i = 0; i < n; i += run) {
+    for (run = 1; i + run < n && votes[i+run] == votes[i]; run++)
+      ;
+    if (run > best) {
+      best = run;
+      *k = votes[i];
+    }
+  }
+
+  FREE(votes);
+  return best;
+}
+
+static void add_link(escher_link_t **links, int *n_links, int *max_links,
+                     int a, int b, int k, int weight)
+{
+  if (weight <= 0)
+    return;
+  if (*n_links == *max_links) {
+    *max_links = *max_links ? 2*(*max_links) : 64;
+    *links = (escher_link_t *)realloc(*links,
+                                      sizeof(escher_link_t)*(*max_links));
+    if (!*links)
+      asfPrintError("Out of memory for block links\n");
+  }
+  (*links)[*n_links].a = a;
+  (*links)[*n_links].b = b;
+  (*links)[*n_links].k = k;
+  (*links)[*n_links].weight = weight;
+  (*n_links)++;
+}
+
+/* Chooses the 2*PI cycles to add to each block: grows a maximum spanning
+ * tree over the links (the strongest agreement between overlaps wins),
+ * starting from the block with the most integrated pixels.  Blocks that
+ * can't be reached from there start trees of their own. */
+static void solve_block_offsets(int n_blocks, int *n_integrated,
+                                escher_link_t *links, int n_links, int *k)
+{
+  int *done = (int *)CALLOC(n_blocks, sizeof(int));
+  int i, n_done = 0;
+
+  while (n_done < n_blocks) {
+    int root = -1;
+    for (i = 0; i < n_blocks; i++)
+      if (!done[i] && (root < 0 || n_integrated[i] > n_integrated[root]))
+        root = i;
+    done[root] = TRUE;
+    k[root] = 0;
+    n_done++;
+
+    while (1) {
+      int best = -1, from = 0, to = 0, dk = 0;
+      for (i = 0; i < n_links; i++) {
+        escher_link_t *l = &links[i];
+        if (done[l->a] == done[l->b])
+          continue;
+        if (best < 0 || l->weight > links[best].weight) {
+          best = i;
+          if (done[l->a]) { from = l->a; to = l->b; dk =  l->k; }
+          else            { from = l->b; to = l->a; dk = -l->k; }
+        }
+      }
+      if (best < 0)
+        break;
+      k[to] = k[from] + dk;
+      done[to] = TRUE;
+      n_done++;
+    }
+  }
+
+  FREE(done);
+}
+
+/* Unwraps the phase in overlapping blocks of (about) block_size pixels,
+ * so that only one row of blocks needs to be in memory.  The blocks of a
+ * row are unwrapped in parallel, each from its own seed point, then the
+ * 2*PI offsets between blocks are worked out from their overlaps and
+ * applied at the end.  block_size <= 0 means use the default. */
+int escher_tiled(char *inFile, char *outFile, int block_size)
+{
+  char szWrap[MAXNAME], szUnwrap[MAXNAME], szMask[1024];
+  meta_parameters *meta;
+  int wid, len, nbx, nby, r, c, i, j;
+  const int o = BLOCK_OVERLAP;
+
+  create_name(szWrap, inFile, ".img");
+  create_name(szUnwrap, outFile, ".img");
+  maskName(szMask, szUnwrap);
+
+  if (block_size <= 0)
+    block_size = DEFAULT_BLOCK_SIZE;
+  if (block_size < 4*o)
+    block_size = 4*o;
+
+  meta = meta_read(szWrap);
+  wid = meta->general->sample_count;
+  len = meta->general->line_count;
+  meta_write(meta, szUnwrap);
+
+  nbx = (wid + block_size/2)/block_size;
+  nby = (len + block_size/2)/block_size;
+  if (nbx < 1) nbx = 1;
+  if (nby < 1) nby = 1;
+
+  asfPrintStatus("\nUnwrapping the phase in %dx%d blocks of about %dx%d "
+                 "pixels,\nusing %d thread%s ...\n\n", nbx, nby,
+                 len/nby, wid/nbx, asf_get_num_threads(),
+                 asf_get_num_threads()==1 ? "" : "s");
+
+  escher_block_t *row = (escher_block_t *)MALLOC(sizeof(escher_block_t)*nbx);
+  int *n_integrated = (int *)MALLOC(sizeof(int)*nbx*nby);
+  escher_link_t *links = NULL;
+  int n_links = 0, max_links = 0;
+
+  /* bottom strip (2*o lines) of the previous row of blocks */
+  int sy0 = 0, sLen = 0;
+  float *sPhase = (float *)MALLOC(sizeof(float)*2*o*wid);
+  Uchar *sMask = (Uchar *)MALLOC(sizeof(Uchar)*2*o*wid);
+
+  float *outBuf = (float *)MALLOC(sizeof(float)*wid);
+  Uchar *maskBuf = (Uchar *)MALLOC(sizeof(Uchar)*wid);
+
+  FILE *fpOut = FOPEN(szUnwrap, "wb");
+  FILE *fpMask = FOPEN(szMask, "wb");
+
+  for (r = 0; r < nby; r++) {
+    int cy0 = r*len/nby, cy1 = (r+1)*len/nby;
+
+    for (c = 0; c < nbx; c++) {
+      escher_block_t *b = &row[c];
+      b->cx0 = c*wid/nbx;
+      b->cx1 = (c+1)*wid/nbx;
+      b->cy0 = cy0;
+      b->cy1 = cy1;
+      b->x0 = b->cx0 - o < 0 ? 0 : b->cx0 - o;
+      b->y0 = cy0 - o < 0 ? 0 : cy0 - o;
+      b->wid = (b->cx1 + o > wid ? wid : b->cx1 + o) - b->x0;
+      b->len = (cy1 + o > len ? len : cy1 + o) - b->y0;
+    }
+
+    escher_row_params_t params;
+    params.inFile = szWrap;
+    params.meta = meta;
+    params.blocks = row;
+    asf_parallel_for(nbx, unwrap_block, &params);
+
+    for (c = 0; c < nbx; c++) {
+      escher_block_t *b = &row[c];
+      int n = r*nbx + c, k = 0, w;
+      n_integrated[n] = row[c].n_integrated;
+
+      /* link to the block to the left ... */
+      if (c > 0) {
+        escher_block_t *a = &row[c-1];
+        w = link_blocks(a->phase, a->mask, a->x0, a->y0, a->wid, b,
+                        b->x0, b->y0, a->x0 + a->wid, b->y0 + b->len, &k);
+        add_link(&links, &n_links, &max_links, n-1, n, k, w);
+      }
+
+      /* ... and to the one above (only its core columns are kept) */
+      if (r > 0) {
+        w = link_blocks(sPhase, sMask, 0, sy0, wid, b,
+                        b->cx0, b->y0 > sy0 ? b->y0 : sy0,
+                        b->cx1, sy0 + sLen, &k);
+        add_link(&links, &n_links, &max_links, n-nbx, n, k, w);
+      }
+    }
+
+    /* write out the core lines of this row of blocks (the offsets get
+     * applied later) */
+    for (j = cy0; j < cy1; j++) {
+      for (c = 0; c < nbx; c++) {
+        escher_block_t *b = &row[c];
+        for (i = b->cx0; i < b->cx1; i++) {
+          int ib = (j - b->y0)*b->wid + (i - b->x0);
+          outBuf[i] = b->phase[ib];
+          maskBuf[i] = b->mask[ib];
+        }
+      }
+      put_float_line(fpOut, meta, j, outBuf);
+      FWRITE(maskBuf, sizeof(Uchar), wid, fpMask);
+    }
+
+    /* keep the bottom of this row (the core columns of each block), for
+     * linking to the next one */
+    sy0 = cy1 - o < 0 ? 0 : cy1 - o;
+    sLen = (cy1 + o > len ? len : cy1 + o) - sy0;
+    for (j = sy0; j < sy0 + sLen; j++) {
+      for (c = 0; c < nbx; c++) {
+        escher_block_t *b = &row[c];
+        for (i = b->cx0; i < b->cx1; i++) {
+          int ib = (j - b->y0)*b->wid + (i - b->x0);
+          sPhase[(j - sy0)*wid + i] = b->phase[ib];
+          sMask[(j - sy0)*wid + i] = b->mask[ib];
+        }
+      }
+    }
+
+    for (c = 0; c < nbx; c++) {
+      FREE(row[c].phase);
+      FREE(row[c].mask);
+    }
+
+    asfPrintStatus("   unwrapped block row %d of %d\n", r+1, nby);
+  }
+
+  FCLOSE(fpOut);
+  FCLOSE(fpMask);
+
+  /* reconcile the blocks */
+  int *k = (int *)MALLOC(sizeof(int)*nbx*nby);
+  solve_block_offsets(nbx*nby, n_integrated, links, n_links, k);
+
+  long total = 0;
+  for (i = 0; i < nbx*nby; i++)
+    total += n_integrated[i];
+  asfPrintStatus("\nReconciled %d blocks using %d overlaps.\n",
+                 nbx*nby, n_links);
+
+  fpOut = FOPEN(szUnwrap, "r+b");
+  fpMask = FOPEN(szMask, "rb");
+  for (r = 0; r < nby; r++) {
+    int cy0 = r*len/nby, cy1 = (r+1)*len/nby;
+    for (j = cy0; j < cy1; j++) {
+      get_float_line(fpOut, meta, j, outBuf);
+      FREAD(maskBuf, sizeof(Uchar), wid, fpMask);
+      for (c = 0; c < nbx; c++) {
+        float add = TWOPI*k[r*nbx + c];
+        for (i = c*wid/nbx; i < (c+1)*wid/nbx; i++)
+          if (maskBuf[i] & INTEGRATED)
+            outBuf[i] += add;
+      }
+      put_float_line(fpOut, meta, j, outBuf);
+    }
+  }
+  FCLOSE(fpOut);
+  FCLOSE(fpMask);
+
+  asfPrintStatus("Unwrapped %ld of %ld pixels (%.3f %%)\n", total,
+                 (long)wid*len, 100.0*(double)total/((double)wid*len));
+
+  FREE(row);
+  FREE(n_integrated);
+  FREE(k);
+  if (links) free(links);
+  FREE(sPhase);
+  FREE(sMask);
+  FREE(outBuf);
+  FREE(maskBuf);
+  meta_free(meta);
+
+  return(0);
+}
+
 int escher(char *inFile, char *outFile)
 {
   int seedX=-1,seedY=-1; 
   char szWrap[MAXNAME], szUnwrap[MAXNAME];
   meta_parameters *meta;
+  escher_t e;
+  int wid, len;
 
   create_name(szWrap, inFile, ".img");
   create_name(szUnwrap, outFile, ".img");
@@ -1056,6 +1525,13 @@ int escher(char *inFile, char *outFile)
   meta = meta_read(szWrap);
   wid = meta->general->sample_count;
   len = meta->general->line_count;
+
+  // Too big to do all at once
+  if ((double)wid*len > MAX_WHOLE_IMAGE_PIXELS) {
+    meta_free(meta);
+    return escher_tiled(inFile, outFile, DEFAULT_BLOCK_SIZE);
+  }
+
   if ((seedX == -1)&&(seedY == -1))
   {
     seedX = wid/2;
@@ -1063,42 +1539,38 @@ int escher(char *inFile, char *outFile)
   }
   
   meta_write(meta, szUnwrap);
+  meta_free(meta);
 
-  size = wid*len;
-  mask = (Uchar *)calloc(size, sizeof(Uchar));
-  im = (Uchar *)calloc(size, sizeof(Uchar));
-  phase = (float *)MALLOC(sizeof(float)*size);
+  escher_init(&e, wid, len, TRUE);
 
   /* perform steps*/
   asfPrintStatus("\nGenerating phase unwrapping mask ...\n\n");
-  loadWrappedPhase(szWrap);
-  groundBorder();
-  makeMask();
-  doStats();
+  loadWrappedPhase(&e, szWrap);
+  groundBorder(&e);
+  makeMask(&e);
+  doStats(&e);
   asfPrintStatus("\n\nGrounding remaining residues ...\n\n");
-  installCordon("cordon");
+  installCordon(&e, "cordon", 0, 0);
   asfPrintStatus("\n\nDefining branch cuts ...\n\n");
-  cutMask();
-  doStats();
+  cutMask(&e);
+  doStats(&e);
 
 #if DO_DEBUG_CHECKS
-  saveMask((char *)mask, "test");
+  saveMask(&e, "test");
 
-  verifyCuts();                                           
+  verifyCuts(&e);
 #endif
 
   asfPrintStatus("\n\nIntegrating the phase ...\n\n");
-  checkSeed(&seedX, &seedY);
-  integratePhase(seedX, seedY);
-  doStats();
-  finishUwp();
-  saveMask(mask, szUnwrap);
-  saveUwp(szUnwrap);
+  checkSeed(&e, &seedX, &seedY);
+  integratePhase(&e, seedX, seedY);
+  doStats(&e);
+  finishUwp(&e);
+  saveMask(&e, szUnwrap);
+  saveUwp(&e, szUnwrap);
   
   // Clean up
-  FREE(mask);
-  FREE(im);
-  FREE(phase);
+  escher_free(&e);
 
   return(0);
 }
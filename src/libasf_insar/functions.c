@@ -183,23 +183,4 @@ int zeroify(char *phaseFile1, char *phaseFile2, char *outFile)
   return ret;
 }
 
-int escher(char *inFile, char *outFile)
-{       
-  char options[255]="", command[255];
-  int ret;
-  
-  sprintf(options, "-log %s", logFile);
-  sprintf(command, "escher %s %s %s", options, inFile, outFile);
-  
-  printf("\nCommand line: %s\n", command);
-  //fLog = FOPEN(logFile, "a");
-  sprintf(logbuf,"\nCommand line: %s\n", command);
-  printLog(logbuf);
-  FCLOSE(fLog);
-  ret = system(command);
-  fLog = FOPEN(logFile, "a");
-  
-  return ret;
-}
-
 #endif
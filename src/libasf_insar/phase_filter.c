@@ -264,7 +264,7 @@ Huge scalings, like 2.0 or 3.0, result in very geometric-
 looking phase.
 */
 
-void phase_filter_func(complex *buf,float strength)
+void phase_filter_func(complex *buf,float strength,float *work)
 {
   register int x,y;
   
@@ -278,8 +278,8 @@ void phase_filter_func(complex *buf,float strength)
   */
   float adjStrength=(strength-1)/2;
   
-  /*fft buf*/
-  fft2d((float *)buf,dMy,dMx);	
+  /*fft buf (work is this thread's fft2dWorkSize(dMy) column buffer)*/
+  fft2d_r((float *)buf,dMy,dMx,work);
   
   /*Manipulate power spectrum.*/
   for (y=0; y<dy; y++) {
@@ -293,7 +293,61 @@ void phase_filter_func(complex *buf,float strength)
   }
 	
   /*ifft buf*/
-  ifft2d((float *)buf, dMy, dMx);
+  ifft2d_r((float *)buf, dMy, dMx, work);
+}
+
+
+/* Number of rows of chunks handed to the threads at once */
+#define ROWS_PER_THREAD 4
+
+/*Polar to complex conversion table*/
+#define NUM_PHASE 512
+#define phase2cpx(ph) p2c[(int)((ph)*polarCvrt)&(NUM_PHASE-1)]
+
+typedef struct {
+  int nChunkX;
+  float strength;
+  float *inBuf;        /* [ns, rows*oy+oy] input phase of this batch */
+  complex ***rows;     /* [rows+1][nChunkX] chunks; row 0 is the last
+                          row of the previous batch */
+  int first;           /* 1 if there is no previous row */
+  complex *p2c;
+  float polarCvrt;
+  float *weight;
+  float **work;        /* per-thread FFT column buffers */
+  float *outBuf;       /* [rows][ns, oy] output phase */
+} filter_params_t;
+
+/* Converts and filters one chunk of the batch */
+static void filter_chunk(int i, int thread, void *params)
+{
+  filter_params_t *p = (filter_params_t *)params;
+  int row = i / p->nChunkX;
+  int chunkX = i % p->nChunkX;
+  complex *p2c = p->p2c;
+  float polarCvrt = p->polarCvrt;
+  register float *in;
+  register complex *out;
+  int x,y;
+
+  /*Convert polar image to complex chunk.*/
+  for (y=0; y<dy; y++) {
+    in = &p->inBuf[(row*oy+y)*ns+chunkX*ox];
+    out = &p->rows[row+1][chunkX][y*dx];
+    for (x=0;x<dx;x++)
+      *out++=phase2cpx(*in++);
+  }
+
+  phase_filter_func(p->rows[row+1][chunkX], p->strength, p->work[thread]);
+}
+
+/* Blends one row of filtered chunks with the row above it */
+static void blend_row(int row, int thread, void *params)
+{
+  filter_params_t *p = (filter_params_t *)params;
+  complex **last_chunks = (row == 0 && p->first) ? NULL : p->rows[row];
+
+  blendData(p->rows[row+1], last_chunks, p->weight, &p->outBuf[row*oy*ns]);
 }
 
 /************************************************************
@@ -312,13 +366,11 @@ void image_filter(FILE *in, meta_parameters *meta,
 		  FILE *out, double strength)
 {
   int chunkX,chunkY,nChunkX,nChunkY;
-  int i,x,y;
-  float *inBuf, *outBuf, *weight;
-  complex **chunks, **last_chunks=NULL;
-  
+  int i,x,y,row;
+  float *weight;
+  filter_params_t params;
+
   /*Allocate polar to complex conversion array*/
-#define NUM_PHASE 512
-#define phase2cpx(ph) p2c[(int)((ph)*polarCvrt)&(NUM_PHASE-1)]
   complex *p2c;
   float polarCvrt = NUM_PHASE/(2*PI);
   p2c = (complex *) MALLOC(sizeof(complex)*NUM_PHASE);
@@ -334,59 +386,84 @@ void image_filter(FILE *in, meta_parameters *meta,
     for (x=0;x<ox;x++)
       weight[y*ox+x] = (float)x/(ox-1)*(float)y/(oy-1);
   
+  /*The FFT tables are shared by all threads, so set them up first.*/
+  fft2dInit(dMy, dMx);
+  int n_threads = asf_get_num_threads();
+  int batch_rows = n_threads*ROWS_PER_THREAD;
+
   /*Allocate storage arrays.*/
   nChunkX = ns/ox-1;
   nChunkY = nl/oy-1;
-  outBuf = inBuf = (float *)MALLOC(sizeof(float)*ns*dy);
-#define newChunkArray(name) name=(complex **)MALLOC(sizeof(complex **)*nChunkX); \
-			for (chunkX=0;chunkX<nChunkX;chunkX++) \
-				name[chunkX]=(complex *)MALLOC(sizeof(complex)*dx*dy);
-  newChunkArray(chunks);
+  params.nChunkX = nChunkX;
+  params.strength = strength;
+  params.p2c = p2c;
+  params.polarCvrt = polarCvrt;
+  params.weight = weight;
+  params.inBuf = (float *)MALLOC(sizeof(float)*ns*(batch_rows*oy+oy));
+  params.outBuf = (float *)MALLOC(sizeof(float)*ns*oy*batch_rows);
+  params.work = (float **)MALLOC(sizeof(float *)*n_threads);
+  for (i=0; i<n_threads; i++)
+    params.work[i] = (float *)MALLOC(sizeof(float)*fft2dWorkSize(dMy));
+  params.rows = (complex ***)MALLOC(sizeof(complex **)*(batch_rows+1));
+  for (row=0; row<=batch_rows; row++) {
+    params.rows[row] = (complex **)MALLOC(sizeof(complex *)*nChunkX);
+    for (chunkX=0; chunkX<nChunkX; chunkX++)
+      params.rows[row][chunkX] = (complex *)MALLOC(sizeof(complex)*dx*dy);
+  }
+  params.first = 1;
   
-  /*Loop across each chunk in file.
+  /*Loop across the chunk rows in batches.  Each batch is read in one
+    go, all of its chunks are filtered in parallel, and then each row
+    is blended with the row above it (in parallel again, since every
+    row writes its own output lines).  The arithmetic for every chunk
+    is the same as when running serially, so the output is too.
     printf("Filtering phase in %d x %d blocks...\n",dx,dy);
     printf("Output phase in %d x %d blocks...\n",ox,oy);*/
-  for (chunkY=0; chunkY<nChunkY; chunkY++) {
+  for (chunkY=0; chunkY<nChunkY; chunkY+=batch_rows) {
+    int n = nChunkY - chunkY < batch_rows ? nChunkY - chunkY : batch_rows;
 
-    asfLineMeter(chunkY, nChunkY);
-    
-    /*Read next chunk of input.*/
-    read_image(in, meta, inBuf, 0, chunkY*ox, ns, dy);
-    
-    /*Convert polar image to complex chunk.*/
-    for (chunkX=0; chunkX<nChunkX; chunkX++) {
-	register float *in;
-	register complex *out;
-	for (y=0; y<dy; y++) {
-	  in = &inBuf[y*ns+chunkX*ox];
-	  out = &chunks[chunkX][y*dx];
-	  for (x=0;x<dx;x++)
-	    *out++=phase2cpx(*in++);
-	}
-    }
+    /*Read the input lines of the whole batch: chunk row r needs
+      lines (chunkY+r)*oy ... (chunkY+r)*oy+dy-1.*/
+    read_image(in, meta, params.inBuf, 0, chunkY*oy, ns, n*oy+oy);
     
     /*Filter each newly-read chunk.*/
-    for (chunkX=0; chunkX<nChunkX; chunkX++)
-      phase_filter_func(chunks[chunkX], strength);
+    asf_parallel_for(n*nChunkX, filter_chunk, &params);
 	
     /*Blend and write out filtered data.*/
-    blendData(chunks, last_chunks, weight, outBuf);
-    for (y=0; y<oy; y++) {
-      if (chunkY*oy+y < meta->general->line_count)
-	put_float_line(out, meta, chunkY*oy+y, &outBuf[y*ns]);
+    asf_parallel_for(n, blend_row, &params);
+    for (row=0; row<n; row++) {
+      asfLineMeter(chunkY+row, nChunkY);
+      for (y=0; y<oy; y++) {
+        int line = (chunkY+row)*oy+y;
+        if (line < meta->general->line_count)
+          put_float_line(out, meta, line, &params.outBuf[(row*oy+y)*ns]);
+      }
     }
 		
-    /*Swap chunks and last_chunks.*/
-    {complex **tmp=last_chunks;last_chunks=chunks;chunks=tmp;}
-    if (chunks == NULL) { newChunkArray(chunks); }
+    /*The last row of this batch is the previous row of the next one.*/
+    {complex **tmp=params.rows[0];params.rows[0]=params.rows[n];params.rows[n]=tmp;}
+    params.first = 0;
   }
   
   /*Write very last line of phase.*/
-  blendData(NULL, last_chunks, weight, outBuf);
+  blendData(NULL, nChunkY > 0 ? params.rows[0] : NULL, weight, params.outBuf);
   for (y=0; y<oy; y++)
-    if (chunkY*oy+y < meta->general->line_count)
-      put_float_line(out, meta, chunkY*oy+y, &outBuf[y*ns]);
-  
+    if (nChunkY*oy+y < meta->general->line_count)
+      put_float_line(out, meta, nChunkY*oy+y, &params.outBuf[y*ns]);
+
+  for (row=0; row<=batch_rows; row++) {
+    for (chunkX=0; chunkX<nChunkX; chunkX++)
+      FREE(params.rows[row][chunkX]);
+    FREE(params.rows[row]);
+  }
+  FREE(params.rows);
+  for (i=0; i<n_threads; i++)
+    FREE(params.work[i]);
+  FREE(params.work);
+  FREE(params.inBuf);
+  FREE(params.outBuf);
+  FREE(weight);
+  FREE(p2c);
 }
 
 /* FIXME: does not perform properly - call command line and clean up after
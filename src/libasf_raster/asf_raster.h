@@ -123,8 +123,19 @@ void kernel_filter(char *inFile, char *outFile, filter_type_t filter,
 		   int kernel_size, float damping, int nLooks);
 
 /* Prototypes from interpolate.c *********************************************/
+typedef struct sinc_kernel_t sinc_kernel_t;
+/* SPLINES works on B-spline coefficients, not samples: run
+   samples2coefficients(inbuf, 'x') and samples2coefficients(inbuf, 'y')
+   over the image before calling interpolate() or interpolate_line(),
+   otherwise the result is smoothed like BICUBIC. */
 float interpolate(interpolate_type_t interpolation, FloatImage *inbuf, float yLine,
 		  float xSample, weighting_type_t weighting, int sinc_points);
+void interpolate_line(interpolate_type_t interpolation, FloatImage *inbuf,
+		      int n, const float *yLine, const float *xSample,
+		      weighting_type_t weighting, int sinc_points, float *out);
+void samples2coefficients(FloatImage *inbuf, char dimension);
+sinc_kernel_t *sinc_kernel_get(weighting_type_t weighting, int sinc_points);
+const float *sinc_kernel_weights(const sinc_kernel_t *kernel, float frac);
 
 /* Prototypes from trim.c ****************************************************/
 int trim(char *infile, char *outfile, long long startX, long long startY,
@@ -142,6 +153,10 @@ int fftMatch(char *inFile1, char *inFile2, char *corrFile,
 	     float *dx, float *dy, float *certainty);
 void fftMatch_withOffsetFile(char *inFile1, char *inFile2, char *corrFile,
 			     char *offsetFileName);
+void fftMatch_buffers_init(int nl, int ns);
+void fftMatch_buffers(const float *img1, int nl1, int ns1,
+		      const float *img2, int nl2, int ns2,
+		      float *dx, float *dy, float *certainty);
 
 /* Prototypes from shaded_relief.c *******************************************/
 void shaded_relief(char *inFile, char *outFile, int addSpeckle, int water);
@@ -235,4 +250,37 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
 	      psnr_t **psnrs, complex_psnr_t **complex_psnr,
 	      shift_data_t **data_shift);
 
+// Prototypes from diff_stats.c
+// A format independent source of image rows for diff_image_stats().
+// get_rows() fills buf with rows first_row .. first_row+n_rows-1 of the
+// given band, as floats.
+typedef void diff_get_rows_fn(void *source, int band, int first_row,
+                              int n_rows, float *buf);
+
+typedef struct {
+  diff_get_rows_fn *get_rows;
+  void *source;
+  int lines;
+  int samples;
+  int band_count;
+  double mask;    // No-data value, left out of the statistics (or NAN)
+} diff_stream_t;
+
+// Histogram of the absolute pixel differences: bin 0 counts identical
+// pixels, bin 1 differences below 1e-7, and each further bin one decade
+// (the last one is open ended).
+#define DIFF_HIST_BINS 17
+typedef struct {
+  long long count;      // Pixels compared
+  long long differ;     // Pixels that are not identical
+  double max_abs_diff;
+  long long hist[DIFF_HIST_BINS];
+} diff_hist_t;
+
+void diff_image_stats(diff_stream_t *s1, diff_stream_t *s2,
+                      int first_band, int band_count, float max_val,
+                      stats_t *stats1, stats_t *stats2, psnr_t *psnr,
+                      diff_hist_t *diff_hist);
+double diff_hist_bin_start(int bin);
+
 #endif
@@ -0,0 +1,224 @@
+/*******************************************************************************
+NAME: diff_stats
+
+PURPOSE:
+  Single pass comparison statistics for diffimage.
+
+ALGORITHM DESCRIPTION:
+  The two images are read together, a block of rows at a time, through
+  diff_stream_t sources that hide the file format.  Every block is read
+  once (serially, as the readers are not thread safe) and then handed to
+  one worker per band, which updates that band's running statistics:
+
+    - minimum, maximum, mean and standard deviation of each image
+      (Welford's method, leaving out the no-data value),
+    - the sum of squared differences for the PSNR,
+    - a histogram of the absolute differences, by decade.
+
+  The statistics of both images, the PSNR and the difference histogram
+  thus come out of one read of each file instead of a read per quantity.
+*******************************************************************************/
+#include "asf.h"
+#include "asf_nan.h"
+#include "asf_meta.h"
+#include "asf_raster.h"
+#include <float.h>
+
+#define DIFF_BLOCK_ROWS 64
+#define DIFF_HIST_MIN_EXP -7    // bin 2 starts at 1e-7
+
+typedef struct {
+  long long count;
+  double min, max, mean, m2;
+} band_accum_t;
+
+typedef struct {
+  band_accum_t a1, a2;
+  double sse;
+  long long pixel_count;
+  diff_hist_t hist;
+} band_stats_t;
+
+typedef struct {
+  diff_stream_t *s1, *s2;
+  int first_band;
+  int rows1, rows2, rows_cmp;   // rows of the block in file 1, 2, both
+  int samples_cmp;              // samples compared per row
+  float **buf1, **buf2;         // [band] block of rows
+  band_stats_t *bs;             // [band]
+} stats_params_t;
+
+static void accum_init(band_accum_t *a)
+{
+  a->count = 0;
+  a->min = FLT_MAX;
+  a->max = -FLT_MAX;
+  a->mean = a->m2 = 0.0;
+}
+
+static void accum_rows(band_accum_t *a, const float *data, int n,
+                       double mask)
+{
+  int ii;
+  for (ii=0; ii<n; ii++) {
+    double cs = data[ii];
+    if (ISNAN(mask) || !FLOAT_EQUIVALENT(cs, mask)) {
+      double old_mean = a->mean;
+      if (cs < a->min) a->min = cs;
+      if (cs > a->max) a->max = cs;
+      a->mean += (cs - a->mean) / (a->count + 1);
+      a->m2 += (cs - old_mean) * (cs - a->mean);
+      a->count++;
+    }
+  }
+}
+
+static int diff_hist_bin(double abs_diff)
+{
+  int bin;
+  if (abs_diff == 0.0)
+    return 0;
+  bin = (int) floor(log10(abs_diff)) - DIFF_HIST_MIN_EXP + 2;
+  if (bin < 1) bin = 1;
+  if (bin > DIFF_HIST_BINS - 1) bin = DIFF_HIST_BINS - 1;
+  return bin;
+}
+
+static void stats_band(int k, int thread, void *params)
+{
+  stats_params_t *p = (stats_params_t *) params;
+  band_stats_t *bs = &p->bs[k];
+  int band = p->first_band + k;
+  int ii, jj;
+
+  if (band < p->s1->band_count)
+    accum_rows(&bs->a1, p->buf1[k], p->rows1*p->s1->samples, p->s1->mask);
+  if (band < p->s2->band_count)
+    accum_rows(&bs->a2, p->buf2[k], p->rows2*p->s2->samples, p->s2->mask);
+  if (band >= p->s1->band_count || band >= p->s2->band_count)
+    return;
+
+  for (ii=0; ii<p->rows_cmp; ii++) {
+    const float *line1 = p->buf1[k] + (long)ii*p->s1->samples;
+    const float *line2 = p->buf2[k] + (long)ii*p->s2->samples;
+    for (jj=0; jj<p->samples_cmp; jj++) {
+      double d = (double)line1[jj] - (double)line2[jj];
+      double ad = fabs(d);
+      bs->sse += d*d;
+      if (ad != 0.0) {
+        bs->hist.differ++;
+        if (ad > bs->hist.max_abs_diff) bs->hist.max_abs_diff = ad;
+      }
+      bs->hist.hist[diff_hist_bin(ad)]++;
+    }
+    bs->pixel_count += p->samples_cmp;
+  }
+  bs->hist.count = bs->pixel_count;
+}
+
+static void accum_to_stats(const band_accum_t *a, stats_t *s)
+{
+  s->hist = NULL;
+  s->hist_pdf = NULL;
+  s->stats_good = a->count > 0;
+  s->min = a->count > 0 ? a->min : 0.0;
+  s->max = a->count > 0 ? a->max : 0.0;
+  s->mean = a->mean;
+  s->sdev = a->count > 1 ? sqrt(a->m2/(a->count - 1)) : 0.0;
+  // This assumes the sample count is large enough to ensure that the
+  // sample standard deviation is very very similar to the population
+  // standard deviation.
+  s->rmse = s->sdev;
+  if (fabs(s->mean) > FLT_MAX || fabs(s->sdev) > FLT_MAX)
+    s->stats_good = 0;
+}
+
+static int min_int(int a, int b) { return a < b ? a : b; }
+
+// Computes the statistics of bands first_band .. first_band+band_count-1
+// of both images, the PSNR between them (if max_val > 0, i.e. the data
+// types match) and, if diff_hist is not NULL, the difference histograms.
+// The results for band b go to stats1[b], stats2[b], psnr[b] and
+// diff_hist[b].  Only the overlapping part of the images is compared.
+void diff_image_stats(diff_stream_t *s1, diff_stream_t *s2,
+                      int first_band, int band_count, float max_val,
+                      stats_t *stats1, stats_t *stats2, psnr_t *psnr,
+                      diff_hist_t *diff_hist)
+{
+  stats_params_t params;
+  int k, row;
+  int lines = s1->lines > s2->lines ? s1->lines : s2->lines;
+
+  if (s1->lines != s2->lines)
+    asfPrintWarning("The images have a different number of lines (%d v. %d)."
+                    "\nOnly the first %d lines will be compared.\n",
+                    s1->lines, s2->lines, min_int(s1->lines, s2->lines));
+  if (s1->samples != s2->samples)
+    asfPrintWarning("The images have a different number of samples per line "
+                    "(%d v. %d).\nOnly the first %d samples of each line will "
+                    "be compared.\n", s1->samples, s2->samples,
+                    min_int(s1->samples, s2->samples));
+
+  params.s1 = s1;
+  params.s2 = s2;
+  params.first_band = first_band;
+  params.samples_cmp = min_int(s1->samples, s2->samples);
+  params.buf1 = (float **) MALLOC(sizeof(float *)*band_count);
+  params.buf2 = (float **) MALLOC(sizeof(float *)*band_count);
+  params.bs = (band_stats_t *) CALLOC(band_count, sizeof(band_stats_t));
+  for (k=0; k<band_count; k++) {
+    params.buf1[k] = (float *)
+      MALLOC(sizeof(float)*DIFF_BLOCK_ROWS*s1->samples);
+    params.buf2[k] = (float *)
+      MALLOC(sizeof(float)*DIFF_BLOCK_ROWS*s2->samples);
+    accum_init(&params.bs[k].a1);
+    accum_init(&params.bs[k].a2);
+  }
+
+  for (row=0; row<lines; row+=DIFF_BLOCK_ROWS) {
+    asfPercentMeter((double)row/(double)lines);
+    params.rows1 = s1->lines > row ?
+      min_int(DIFF_BLOCK_ROWS, s1->lines - row) : 0;
+    params.rows2 = s2->lines > row ?
+      min_int(DIFF_BLOCK_ROWS, s2->lines - row) : 0;
+    params.rows_cmp = min_int(params.rows1, params.rows2);
+    for (k=0; k<band_count; k++) {
+      int band = first_band + k;
+      if (params.rows1 > 0 && band < s1->band_count)
+        s1->get_rows(s1->source, band, row, params.rows1, params.buf1[k]);
+      if (params.rows2 > 0 && band < s2->band_count)
+        s2->get_rows(s2->source, band, row, params.rows2, params.buf2[k]);
+    }
+    asf_parallel_for(band_count, stats_band, &params);
+  }
+  asfPercentMeter(1.0);
+
+  for (k=0; k<band_count; k++) {
+    band_stats_t *bs = &params.bs[k];
+    int band = first_band + k;
+    accum_to_stats(&bs->a1, &stats1[band]);
+    accum_to_stats(&bs->a2, &stats2[band]);
+    if (bs->pixel_count > 0 && max_val > 0) {
+      double rmse = sqrt(bs->sse/bs->pixel_count);
+      psnr[band].psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
+      psnr[band].psnr_good = 1;
+    }
+    else {
+      psnr[band].psnr_good = 0;
+    }
+    if (diff_hist)
+      diff_hist[band] = bs->hist;
+    FREE(params.buf1[k]);
+    FREE(params.buf2[k]);
+  }
+  FREE(params.buf1);
+  FREE(params.buf2);
+  FREE(params.bs);
+}
+
+// Lower edge of the given difference histogram bin (bins 0 and 1 hold
+// the identical pixels and those closer than 1e-7, respectively).
+double diff_hist_bin_start(int bin)
+{
+  return bin < 2 ? 0.0 : pow(10.0, bin - 2 + DIFF_HIST_MIN_EXP);
+}
@@ -146,19 +146,25 @@ void fftDiff(char *inFile1, char *inFile2, float *bestLocX, float *bestLocY,
 float get_maxval(data_type_t data_type);
 void calc_asf_img_stats_2files(char *inFile1, char *inFile2,
                                stats_t *inFile1_stats, stats_t *inFile2_stats,
-                               psnr_t *psnr, int band);
-void calc_ppm_pgm_stats_2files(char *inFile1, char *inFile2, char *outfile,
-                               stats_t *inFile1_stats, stats_t *inFile2_stats,
-                               psnr_t *psnr, int band);
-void calc_jpeg_stats_2files(char *inFile1, char *inFile2, char *outfile,
-                            stats_t *inFile1_stats, stats_t *inFile2_stats,
-                            psnr_t *psnr, int band);
+                               psnr_t *psnr, diff_hist_t *diff_hist,
+                               int first_band, int band_count);
 void calc_tiff_stats_2files(char *inFile1, char *inFile2,
                             stats_t *inFile1_stats, stats_t *inFile2_stats,
-                            psnr_t *psnr, int band);
-void calc_png_stats_2files(char *inFile1, char *inFile2, char *outfile,
+                            psnr_t *psnr, diff_hist_t *diff_hist,
+                            int first_band, int band_count);
+void calc_png_stats_2files(char *inFile1, char *inFile2,
                            stats_t *inFile1_stats, stats_t *inFile2_stats,
-                           psnr_t *psnr, int band);
+                           psnr_t *psnr, diff_hist_t *diff_hist,
+                           int first_band, int band_count);
+void calc_jpeg_stats_2files(char *inFile1, char *inFile2,
+                            stats_t *inFile1_stats, stats_t *inFile2_stats,
+                            psnr_t *psnr, diff_hist_t *diff_hist,
+                            int first_band, int band_count);
+void calc_ppm_pgm_stats_2files(char *inFile1, char *inFile2,
+                               stats_t *inFile1_stats, stats_t *inFile2_stats,
+                               psnr_t *psnr, diff_hist_t *diff_hist,
+                               int first_band, int band_count);
+void print_diff_hist(char *band_name, diff_hist_t *h);
 void print_stats_results(char *filename1, char *filename2,
                          char *band_str1, char *band_str2,
                          stats_t *s1, stats_t *s2,
@@ -175,58 +181,23 @@ void get_tiff_info_from_file(char *file, tiff_data_t *t);
 void get_tiff_info(TIFF *tif, tiff_data_t *t);
 void get_geotiff_keys(char *file, geotiff_data_t *g);
 void projection_type_2_str(projection_type_t proj, char *proj_str);
-int  tiff_image_band_statistics_from_file(char *inFile, int band_no, 
-					  int *stats_exist,
-                                          double *min, double *max,
-                                          double *mean, double *sdev, 
-					  double *rmse,
-                                          int use_mask_value, float mask_value);
-void tiff_image_band_psnr_from_files(char *inFile1, char *inFile2,
-                                     int band1, int band2, psnr_t *psnr);
 float tiff_image_get_float_pixel(TIFF *tif, int row, int col, int band_no);
 void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no);
+static void tiff_scanline_to_float(tdata_t tif_buf, tiff_data_t *t,
+                                   float *buf, int band_no);
 void get_png_info_hdr_from_file(char *inFile, png_info_t *ihdr1, char *outfile);
-int png_image_band_statistics_from_file(char *inFile, char *outfile,
-                                        int band_no, int *stats_exist,
-                                        double *min, double *max,
-                                        double *mean, double *sdev, 
-					double *rmse,
-                                        int use_mask_value, float mask_value);
-void png_image_band_psnr_from_files(char *inFile1, char *inFile2, char *outfile,
-                                    int band1, int band2, psnr_t *psnr);
 void png_sequential_get_float_line(png_structp png_ptr, png_infop info_ptr, 
 				   float *buf, int band);
 void get_ppm_pgm_info_hdr_from_file(char *inFile, ppm_pgm_info_t *pgm, 
 				    char *outfile);
 void ppm_pgm_get_float_line(FILE *fp, float *buf, int row, ppm_pgm_info_t *pgm,
 			    int band_no);
-int ppm_pgm_image_band_statistics_from_file(char *inFile, char *outfile,
-					    int band_no, int *stats_exist,
-					    double *min, double *max,
-					    double *mean, double *sdev, 
-					    double *rmse,
-					    int use_mask_value, 
-					    float mask_value);
-void ppm_pgm_image_band_psnr_from_files(char *inFile1, char *inFile2, 
-					char *outfile,
-                                        int band1, int band2, psnr_t *psnr);
 void get_band_names(char *inFile, FILE *outputFP,
                     char ***band_names, int *num_extracted_bands);
 void free_band_names(char ***band_names, int num_extracted_bands);
 METHODDEF(void) jpeg_err_exit(j_common_ptr cinfo);
 GLOBAL(void) get_jpeg_info_hdr_from_file(char *inFile, jpeg_info_t *jpg, 
 					 char *outputFile);
-GLOBAL(void) jpeg_image_band_statistics_from_file(char *inFile, char *outfile,
-                                                  int band_no, int *stats_exist,
-                                                  double *min, double *max,
-                                                  double *mean, double *sdev, 
-						  double *rmse,
-                                                  int use_mask_value, 
-						  float mask_value);
-GLOBAL(void) jpeg_image_band_psnr_from_files(char *inFile1, char *inFile2, 
-					     char *outfile,
-                                             int band1, int band2, 
-					     psnr_t *psnr);
 void make_generic_meta(char *file, uint32 height, uint32 width, 
 		       data_type_t data_type);
 void fftShiftCheck(char *file1, char *file2, char *corr_file,
@@ -285,6 +256,7 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
   complex_stats_t inFile1_complex_stats[MAX_BANDS];
   complex_stats_t inFile2_complex_stats[MAX_BANDS];
   psnr_t psnr[MAX_BANDS]; // peak signal to noise ratio
+  diff_hist_t diff_hist[MAX_BANDS];
   complex_psnr_t cpsnr[MAX_BANDS];
   shift_data_t shifts[MAX_BANDS];
 
@@ -557,6 +529,14 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
           // Process every available band
           int band_no;
           int empty_band1, empty_band2;
+          if (!is_complex) {
+            // All bands are done together, reading each file only once
+            asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
+                           inFile1, inFile2);
+            calc_asf_img_stats_2files(inFile1, inFile2,
+                                      inFile1_stats, inFile2_stats,
+                                      psnr, diff_hist, 0, band_count1);
+          }
           for (band_no=0; band_no < band_count1; band_no++) {
             strcpy(band_str1, "");
             strcpy(band_str2, "");
@@ -564,9 +544,9 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
               sprintf(band_str1, "Band %s in ", band_names1[band_no]);
               sprintf(band_str2, "Band %s in ", band_names2[band_no]);
             }
-            asfPrintStatus("\nCalculating statistics for\n  %s%s and\n  %s%s\n",
-                           band_str1, inFile1, band_str2, inFile2);
             if (is_complex) {
+              asfPrintStatus("\nCalculating statistics for\n  %s%s and\n"
+                             "  %s%s\n", band_str1, inFile1, band_str2, inFile2);
 	      // For complex data, only check stats and psnr ...and don't check
 	      // for shifts in geolocation (doesn't make sense)
 	      calc_asf_complex_image_stats_2files(inFile1, inFile2,
@@ -578,10 +558,7 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
 	      (*complex_psnr)[band_no] = cpsnr[band_no];
             }
             else {
-	      calc_asf_img_stats_2files(inFile1, inFile2,
-                                        &inFile1_stats[band_no], 
-					&inFile2_stats[band_no],
-                                        &psnr[band_no], band_no);
+              print_diff_hist(band_names1[band_no], &diff_hist[band_no]);
 	      (*stats1)[band_no] = inFile1_stats[band_no];
 	      (*stats2)[band_no] = inFile2_stats[band_no];
 	      (*psnrs)[band_no] = psnr[band_no];
@@ -641,7 +618,8 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
 			 inFile1, inFile2);
           calc_asf_img_stats_2files(inFile1, inFile2,
                                     inFile1_stats, inFile2_stats,
-                                    psnr, band);
+                                    psnr, diff_hist, band, 1);
+          print_diff_hist("", &diff_hist[band]);
           empty_band1 = 
 	    (FLOAT_EQUIVALENT2(inFile1_stats[band].mean, 0.0) &&
 	     FLOAT_EQUIVALENT2(inFile1_stats[band].sdev, 0.0)) ? 1 : 0;
@@ -762,19 +740,21 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
         if (!bandflag) {
           // Process every available band
           int band_no;
+          // All bands are done together, reading each file only once
+          asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
+                         inFile1, inFile2);
+          calc_jpeg_stats_2files(inFile1, inFile2,
+                                 inFile1_stats, inFile2_stats,
+                                 psnr, diff_hist, 0, jpg1.num_bands);
           for (band_no=0; band_no < jpg1.num_bands; band_no++) {
+            print_diff_hist(jpg1.num_bands > 1 ? band_names1[band_no] : "",
+                            &diff_hist[band_no]);
             strcpy(band_str1, "");
             strcpy(band_str2, "");
             if (jpg1.num_bands > 1) {
               sprintf(band_str1, "Band %s in ", band_names1[band_no]);
               sprintf(band_str2, "Band %s in ", band_names2[band_no]);
             }
-            asfPrintStatus("\nCalculating statistics for\n  %s%s and\n  %s%s\n",
-                           band_str1, inFile1, band_str2, inFile2);
-            calc_jpeg_stats_2files(inFile1, inFile2, outputFile,
-                                   &inFile1_stats[band_no], 
-				   &inFile2_stats[band_no],
-                                   &psnr[band_no], band_no);
 	    (*stats1)[band_no] = inFile1_stats[band_no];
 	    (*stats2)[band_no] = inFile2_stats[band_no];
 	    (*psnrs)[band_no] = psnr[band_no];
@@ -830,9 +810,10 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
           // Process selected band
           asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
                          inFile1, inFile2);
-          calc_jpeg_stats_2files(inFile1, inFile2, outputFile,
+          calc_jpeg_stats_2files(inFile1, inFile2,
                                  inFile1_stats, inFile2_stats,
-                                 psnr, band);
+                                 psnr, diff_hist, band, 1);
+          print_diff_hist("", &diff_hist[band]);
 	  (*stats1)[band] = inFile1_stats[band];
 	  (*stats2)[band] = inFile2_stats[band];
 	  (*psnrs)[band] = psnr[band];
@@ -942,19 +923,15 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
         if (!bandflag) {
           // Process every available band
           int band_no;
+          // All bands are done together, reading each file only once
+          asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
+                         inFile1, inFile2);
+          calc_png_stats_2files(inFile1, inFile2,
+                                inFile1_stats, inFile2_stats,
+                                psnr, diff_hist, 0, ihdr1.num_bands);
           for (band_no=0; band_no < ihdr1.num_bands; band_no++) {
-            strcpy(band_str1, "");
-            strcpy(band_str2, "");
-            if (ihdr1.num_bands > 1) {
-              sprintf(band_str1, "Band %s in ", band_names1[band_no]);
-              sprintf(band_str2, "Band %s in ", band_names2[band_no]);
-            }
-            asfPrintStatus("\nCalculating statistics for\n  %s%s and\n  %s%s\n",
-                          band_str1, inFile1, band_str2, inFile2);
-            calc_png_stats_2files(inFile1, inFile2, outputFile,
-                                  &inFile1_stats[band_no], 
-				  &inFile2_stats[band_no],
-                                  &psnr[band_no], band_no);
+            print_diff_hist(ihdr1.num_bands > 1 ? band_names1[band_no] : "",
+                            &diff_hist[band_no]);
             int empty_band1, empty_band2;
             empty_band1 = 
 	      (FLOAT_EQUIVALENT2(inFile1_stats[band_no].mean, 0.0) &&
@@ -1001,9 +978,10 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
           // Process selected band
           asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
                         inFile1, inFile2);
-          calc_png_stats_2files(inFile1, inFile2, outputFile,
+          calc_png_stats_2files(inFile1, inFile2,
                                 inFile1_stats, inFile2_stats,
-                                psnr, band);
+                                psnr, diff_hist, band, 1);
+          print_diff_hist("", &diff_hist[band]);
           int empty_band1, empty_band2;
           empty_band1 = 
 	    (FLOAT_EQUIVALENT2(inFile1_stats[band].mean, 0.0) &&
@@ -1109,19 +1087,15 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
         if (!bandflag) {
           // Process every available band
           int band_no;
+          // All bands are done together, reading each file only once
+          asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
+                         inFile1, inFile2);
+          calc_ppm_pgm_stats_2files(inFile1, inFile2,
+                                    inFile1_stats, inFile2_stats,
+                                    psnr, diff_hist, 0, pgm1.num_bands);
           for (band_no=0; band_no < pgm1.num_bands; band_no++) {
-            strcpy(band_str1, "");
-            strcpy(band_str2, "");
-            if (pgm1.num_bands > 1) {
-              sprintf(band_str1, "Band %s in ", band_names1[band_no]);
-              sprintf(band_str2, "Band %s in ", band_names2[band_no]);
-            }
-            asfPrintStatus("\nCalculating statistics for\n  %s%s and\n  %s%s\n",
-                          band_str1, inFile1, band_str2, inFile2);
-            calc_ppm_pgm_stats_2files(inFile1, inFile2, outputFile,
-                                      &inFile1_stats[band_no], 
-				      &inFile2_stats[band_no],
-                                      &psnr[band_no], band_no);
+            print_diff_hist(pgm1.num_bands > 1 ? band_names1[band_no] : "",
+                            &diff_hist[band_no]);
             int empty_band1, empty_band2;
             empty_band1 = 
 	      (FLOAT_EQUIVALENT2(inFile1_stats[band_no].mean, 0.0) &&
@@ -1170,9 +1144,10 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
           // Process selected band
           asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
 			 inFile1, inFile2);
-          calc_ppm_pgm_stats_2files(inFile1, inFile2, outputFile,
+          calc_ppm_pgm_stats_2files(inFile1, inFile2,
                                     inFile1_stats, inFile2_stats,
-                                    psnr, band);
+                                    psnr, diff_hist, band, 1);
+          print_diff_hist("", &diff_hist[band]);
           int empty_band1, empty_band2;
           empty_band1 = 
 	    (FLOAT_EQUIVALENT2(inFile1_stats[band].mean, 0.0) &&
@@ -1300,19 +1275,15 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
         if (!bandflag) {
           // Process every available band
           int band_no;
+          // All bands are done together, reading each file only once
+          asfPrintStatus("\nCalculating statistics for\n  %s and\n  %s\n",
+                         inFile1, inFile2);
+          calc_tiff_stats_2files(inFile1, inFile2,
+                                 inFile1_stats, inFile2_stats,
+                                 psnr, diff_hist, 0, t1.num_bands);
           for (band_no=0; band_no < t1.num_bands; band_no++) {
-            strcpy(band_str1, "");
-            strcpy(band_str2, "");
-            if (t1.num_bands > 1) {
-              sprintf(band_str1, "Band %s in ", band_names1[band_no]);
-              sprintf(band_str2, "Band %s in ", band_names2[band_no]);
-            }
-            asfPrintStatus("\nCalculating statistics for\n  %s%s and\n  %s%s\n",
-                          band_str1, inFile1, band_str2, inFile2);
-            calc_tiff_stats_2files(inFile1, inFile2,
-				   &inFile1_stats[band_no], 
-				   &inFile2_stats[band_no],
-				   &psnr[band_no], band_no);
+            print_diff_hist(t1.num_bands > 1 ? band_names1[band_no] : "",
+                            &diff_hist[band_no]);
 	    (*stats1)[band_no] = inFile1_stats[band_no];
 	    (*stats2)[band_no] = inFile2_stats[band_no];
 	    (*psnrs)[band_no] = psnr[band_no];
@@ -1327,19 +1298,19 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
             if (!empty_band1 && !empty_band2 &&
                 inFile1_stats[band_no].stats_good && 
 		inFile2_stats[band_no].stats_good) {
-              // Find shift in geolocation (if it exists)
-              // (Export to an ASF internal format file for fftMatch() 
-	      // compatibility)
-              export_tiff_to_asf_img(inFile1, outputFile,
-                                     file1_fftFile, file1_fftMetaFile,
-                                     t1.height, t1.width, REAL32, band_no);
-              export_tiff_to_asf_img(inFile2, outputFile,
-                                     file2_fftFile, file2_fftMetaFile,
-                                     t2.height, t2.width, REAL32, band_no);
               // FIXME: Consider shift checking each band ...
 	      // shouldn't be necessary tho', so we
               // only check the first band for now.
               if (band_no == 0) {
+                // Find shift in geolocation (if it exists)
+                // (Export to an ASF internal format file for fftMatch() 
+                // compatibility)
+                export_tiff_to_asf_img(inFile1, outputFile,
+                                       file1_fftFile, file1_fftMetaFile,
+                                       t1.height, t1.width, REAL32, band_no);
+                export_tiff_to_asf_img(inFile2, outputFile,
+                                       file2_fftFile, file2_fftMetaFile,
+                                       t2.height, t2.width, REAL32, band_no);
                 fftShiftCheck(file1_fftFile, file2_fftFile,
                               CORR_FILE, &shifts[band_no]);
 		(*data_shift)[band_no] = shifts[band_no];
@@ -1373,7 +1344,8 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
                         inFile1, inFile2);
           calc_tiff_stats_2files(inFile1, inFile2,
                                 inFile1_stats, inFile2_stats,
-                                psnr, band);
+                                psnr, diff_hist, band, 1);
+          print_diff_hist("", &diff_hist[band]);
 	  (*stats1)[band] = inFile1_stats[band];
 	  (*stats2)[band] = inFile2_stats[band];
 	  (*psnrs)[band] = psnr[band];
@@ -1387,16 +1359,16 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
           if (!empty_band1 && !empty_band2 &&
 	      inFile1_stats[band].stats_good && 
 	      inFile2_stats[band].stats_good) {
-            // Find shift in geolocation (if it exists)
-            // (Export to an ASF internal format file for fftMatch() 
-	    // compatibility)
-            export_tiff_to_asf_img(inFile1, outputFile,
-                                   file1_fftFile, file1_fftMetaFile,
-                                   t1.height, t1.width, REAL32, band);
-            export_tiff_to_asf_img(inFile2, outputFile,
-                                   file2_fftFile, file2_fftMetaFile,
-                                   t2.height, t2.width, REAL32, band);
             if (band == 0) {
+              // Find shift in geolocation (if it exists)
+              // (Export to an ASF internal format file for fftMatch() 
+              // compatibility)
+              export_tiff_to_asf_img(inFile1, outputFile,
+                                     file1_fftFile, file1_fftMetaFile,
+                                     t1.height, t1.width, REAL32, band);
+              export_tiff_to_asf_img(inFile2, outputFile,
+                                     file2_fftFile, file2_fftMetaFile,
+                                     t2.height, t2.width, REAL32, band);
               fftShiftCheck(file1_fftFile, file2_fftFile,
                             CORR_FILE, &shifts[band]);
 	      (*data_shift)[band] = shifts[band];
@@ -1443,6 +1415,38 @@ int diffimage(char *inFile1, char *inFile2, char *outputFile, char *logFile,
   return (0);
 }
 
+// Summarizes a difference histogram from diff_image_stats()
+void print_diff_hist(char *band_name, diff_hist_t *h)
+{
+  int bin;
+
+  if (h->count == 0)
+    return;
+  if (band_name && strlen(band_name) > 0)
+    asfPrintStatus("\nBand %s: ", band_name);
+  else
+    asfPrintStatus("\n");
+  asfPrintStatus("%lld of %lld compared pixels differ", h->differ, h->count);
+  if (h->differ == 0) {
+    asfPrintStatus("\n");
+    return;
+  }
+  asfPrintStatus(" (largest difference %g):\n", h->max_abs_diff);
+  for (bin=1; bin<DIFF_HIST_BINS; bin++) {
+    if (h->hist[bin] == 0)
+      continue;
+    if (bin == 1)
+      asfPrintStatus("  %12lld below %g\n", h->hist[bin],
+                     diff_hist_bin_start(2));
+    else if (bin == DIFF_HIST_BINS - 1)
+      asfPrintStatus("  %12lld at or above %g\n", h->hist[bin],
+                     diff_hist_bin_start(bin));
+    else
+      asfPrintStatus("  %12lld from %g to %g\n", h->hist[bin],
+                     diff_hist_bin_start(bin), diff_hist_bin_start(bin+1));
+  }
+}
+
 graphics_file_t getGraphicsFileType (char *file)
 {
   FILE *fp = (FILE *)FOPEN(file, "rb");
@@ -1833,354 +1837,581 @@ void calc_asf_complex_image_stats_2files(char *inFile1, char *inFile2,
   if (md2 != NULL) meta_free(md2);
 }
 
+// Row source for diff_image_stats() reading an ASF internal format file
+typedef struct {
+  FILE *fp;
+  meta_parameters *meta;
+} asf_img_source_t;
+
+static void asf_img_get_rows(void *source, int band, int first_row,
+                             int n_rows, float *buf)
+{
+  asf_img_source_t *src = (asf_img_source_t *) source;
+  get_float_lines(src->fp, src->meta,
+                  band*src->meta->general->line_count + first_row,
+                  n_rows, buf);
+}
+
+static void init_stats_2files(stats_t *s1, stats_t *s2, psnr_t *psnr,
+                              diff_hist_t *diff_hist,
+                              int first_band, int band_count)
+{
+  int band;
+  for (band=first_band; band<first_band+band_count; band++) {
+    s1[band].stats_good = s2[band].stats_good = 0;
+    s1[band].min = s2[band].min = 0.0;
+    s1[band].max = s2[band].max = 0.0;
+    s1[band].mean = s2[band].mean = 0.0;
+    s1[band].sdev = s2[band].sdev = 0.0;
+    s1[band].rmse = s2[band].rmse = 0.0;
+    s1[band].hist = s2[band].hist = NULL;
+    s1[band].hist_pdf = s2[band].hist_pdf = NULL;
+    psnr[band].psnr = MISSING_PSNR;
+    psnr[band].psnr_good = 0;
+    memset(&diff_hist[band], 0, sizeof(diff_hist_t));
+  }
+}
+
+static void missing_psnr_2files(psnr_t *psnr, int first_band, int band_count)
+{
+  int band;
+  for (band=first_band; band<first_band+band_count; band++)
+    if (!psnr[band].psnr_good)
+      psnr[band].psnr = MISSING_PSNR;
+}
+
+// Calculates the statistics of bands first_band .. first_band+band_count-1
+// of both files, and the PSNR and difference histogram between them, in
+// a single read of each file.  Results for band b go to element b of the
+// output arrays.
 void calc_asf_img_stats_2files(char *inFile1, char *inFile2,
                                stats_t *inFile1_stats, stats_t *inFile2_stats,
-                               psnr_t *psnr, int band)
+                               psnr_t *psnr, diff_hist_t *diff_hist,
+                               int first_band, int band_count)
 {
-  char *f1;
-  char *f2;
+  char *f1, *f2, *c;
   char inFile1_meta[255], inFile2_meta[255];
-  char **band_names1 = NULL;
-  char **band_names2 = NULL;
-  char *c;
-  int band_count1, band_count2;
-  stats_t *s1 = inFile1_stats;
-  stats_t *s2 = inFile2_stats;
   meta_parameters *md1 = NULL;
   meta_parameters *md2 = NULL;
+  asf_img_source_t src1, src2;
+  diff_stream_t s1, s2;
+
+  init_stats_2files(inFile1_stats, inFile2_stats, psnr, diff_hist,
+                    first_band, band_count);
+
+  // Read metadata
+  f1 = STRDUP(inFile1);
+  c = findExt(f1);
+  if (c) *c = '\0';
+  sprintf(inFile1_meta, "%s.meta", f1);
+  if (fileExists(inFile1_meta))
+    md1 = meta_read(inFile1_meta);
+  f2 = STRDUP(inFile2);
+  c = findExt(f2);
+  if (c) *c = '\0';
+  sprintf(inFile2_meta, "%s.meta", f2);
+  if (fileExists(inFile2_meta))
+    md2 = meta_read(inFile2_meta);
+  FREE(f1);
+  FREE(f2);
 
-  // Init stats
-  s1->stats_good = s2->stats_good = 1; // Presumed innocent until proven guilty
-  s1->min = s2->min = 0.0;
-  s1->max = s2->max = 0.0;
-  s1->mean = s2->mean = 0.0;
-  s1->sdev = s2->sdev = 0.0;
-  s1->rmse = s2->rmse = 0.0;
-  psnr->psnr = 0.0;
-
-  // Read metadata and check for multi-bandedness
-  if (inFile1 != NULL && strlen(inFile1) > 0) {
-    f1 = STRDUP(inFile1);
-    c = findExt(f1);
-    *c = '\0';
-    sprintf(inFile1_meta, "%s.meta", f1);
-    if (fileExists(inFile1_meta)) {
-      md1 = meta_read(inFile1_meta);
-      s1->stats_good = (md1 != NULL) ? s1->stats_good : 0;
-    }
-  }
-  else {
-    s1->stats_good = 0;
+  src1.fp = md1 ? fopen(inFile1, "rb") : NULL;
+  src2.fp = md2 ? fopen(inFile2, "rb") : NULL;
+  if (src1.fp != NULL && src2.fp != NULL) {
+    src1.meta = md1;
+    src2.meta = md2;
+    s1.get_rows = s2.get_rows = asf_img_get_rows;
+    s1.source = &src1;
+    s1.lines = md1->general->line_count;
+    s1.samples = md1->general->sample_count;
+    s1.band_count = md1->general->band_count;
+    s1.mask = md1->general->no_data;
+    s2.source = &src2;
+    s2.lines = md2->general->line_count;
+    s2.samples = md2->general->sample_count;
+    s2.band_count = md2->general->band_count;
+    s2.mask = md2->general->no_data;
+
+    // The PSNR peak value is only meaningful if the data types match
+    float max_val = md1->general->data_type == md2->general->data_type ?
+      get_maxval(md1->general->data_type) : 0.0;
+    diff_image_stats(&s1, &s2, first_band, band_count, max_val,
+                     inFile1_stats, inFile2_stats, psnr, diff_hist);
+    missing_psnr_2files(psnr, first_band, band_count);
   }
-  if (inFile2 != NULL && strlen(inFile2) > 0) {
-    f2 = STRDUP(inFile2);
-    c = findExt(f2);
-    *c = '\0';
-    sprintf(inFile2_meta, "%s.meta", f2);
-    if (fileExists(inFile2_meta)) {
-      md2 = meta_read(inFile2_meta);
-      s2->stats_good = (md2 != NULL) ? s2->stats_good : 0;
-    }
-  }
-  else {
-    s2->stats_good = 0;
-  }
-  band_count1 = (md1 != NULL) ? md1->general->band_count : 0;
-  band_count2 = (md2 != NULL) ? md2->general->band_count : 0;
 
-  // Calculate the stats from the data.
-  s1->hist = NULL;
-  s1->hist_pdf = NULL;
-  s2->hist = NULL;
-  s2->hist_pdf = NULL;
-  if (band_count1 > 0 && md1 != NULL) {
-    band_names1 = 
-      extract_band_names(md1->general->bands, md1->general->band_count);
-    if (band_names1 != NULL) {
-      asfPrintStatus("\nCalculating statistics for %s band in %s", 
-		     band_names1[band], inFile1);
-      calc_stats_rmse_from_file(inFile1, band_names1[band],
-                                md1->general->no_data,
-                                &s1->min, &s1->max, &s1->mean,
-                                &s1->sdev, &s1->rmse, &s1->hist);
-    }
-  }
-  if (band_count2 > 0 && md2 != NULL) {
-    band_names2 = 
-      extract_band_names(md2->general->bands, md2->general->band_count);
-    if (band_names2 != NULL) {
-      asfPrintStatus("\nCalculating statistics for %s band in %s", 
-		     band_names2[band], inFile2);
-      calc_stats_rmse_from_file(inFile2, band_names2[band],
-                                md2->general->no_data,
-                                &s2->min, &s2->max, &s2->mean,
-                                &s2->sdev, &s2->rmse, &s2->hist);
-    }
-  }
+  // Cleanup and begone
+  if (src1.fp) FCLOSE(src1.fp);
+  if (src2.fp) FCLOSE(src2.fp);
+  if (md1 != NULL) meta_free(md1);
+  if (md2 != NULL) meta_free(md2);
+}
 
-  // Calculate the peak signal to noise ratio (PSNR) between the two images
-  double sse;
-  double rmse;
-  int ii, jj;
-  int band1 = band;
-  int band2 = band;
-  long pixel_count = 0;
-  long lines, samples;
-  long offset1 = md1->general->line_count * band1;
-  long offset2 = md2->general->line_count * band2;
-  float max_val;
-  float *data1;
-  float *data2;
-  if (md1 != NULL && md2 != NULL) {
-    data1 = (float*)MALLOC(sizeof(float) * md1->general->sample_count);
-    data2 = (float*)MALLOC(sizeof(float) * md2->general->sample_count);
-    if (data1 == NULL || data2 == NULL ||
-        (md1->general->data_type != md2->general->data_type)) {
-      psnr->psnr = MISSING_PSNR;
-      psnr->psnr_good = 0;
-    }
-    else {
-      asfPrintStatus("\nCalculating PSNR between\n  Band %s in %s and\n  "\
-		     "Band %s in %s\n",
-		     band_names1[band1], inFile1, band_names2[band2], inFile2);
-      FILE *fp1 = fopen(inFile1, "rb");
-      FILE *fp2 = fopen(inFile2, "rb");
-      if (fp1 != NULL && fp2 != NULL) {
-        sse = 0.0;
-	// Since both file's data types are the same, this is OK
-        max_val = get_maxval(md1->general->data_type);
-        lines = MIN(md1->general->line_count, md2->general->line_count);
-        if (lines < md1->general->line_count) {
-          asfPrintWarning("File2 has fewer lines than File1 (%d v. %d).\n"
-              "Only the first %d lines will be utilized for PSNR calculation\n",
-              md2->general->line_count, md1->general->line_count, lines);
-        }
-        if (lines < md2->general->line_count) {
-          asfPrintWarning("File1 has fewer lines than File2 (%d v. %d).\n"
-              "Only the first %d lines will be utilized for PSNR calculation\n",
-          md1->general->line_count, md2->general->line_count, lines);
-        }
-        samples = MIN(md1->general->sample_count, md2->general->sample_count);
-        if (samples < md1->general->sample_count) {
-          asfPrintWarning("File2 has fewer samples per line than File1 (%d v. "
-			  "%d).\nOnly the first %d samples within each line of "
-			  "data will be utilized for PSNR calculation\n",
-			  md2->general->sample_count, 
-			  md1->general->sample_count, samples);
-        }
-        if (samples < md2->general->sample_count) {
-          asfPrintWarning("File1 has fewer samples per line than File2 (%d v. "
-			  "%d).\nOnly the first %d samples within each line of "
-			  "data will be utilized for PSNR calculation\n",
-			  md1->general->sample_count, 
-			  md2->general->sample_count, samples);
-        }
-        for (ii=0; ii<lines; ++ii) {
-          asfPercentMeter((double)ii/(double)lines);
-          get_float_line(fp1, md1, ii + offset1, data1);
-          get_float_line(fp2, md2, ii + offset2, data2);
-          for (jj=0; jj<samples; ++jj) {
-            sse += (data1[jj] - data2[jj]) * (data1[jj] - data2[jj]);
-            pixel_count++;
-          }
-        }
-        asfPercentMeter(1.0);
-        if (fp1) FCLOSE(fp1);
-        if (fp2) FCLOSE(fp2);
-        if (pixel_count > 0 && max_val > 0) {
-          rmse = sqrt(sse/pixel_count);
-          psnr->psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
-          psnr->psnr_good = 1;
-        }
-        else {
-          psnr->psnr = MISSING_PSNR;
-          psnr->psnr_good = 0;
-        }
-      }
-      else {
-        psnr->psnr = MISSING_PSNR;
-        psnr->psnr_good = 0;
-      }
-    }
-  }
-  else {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-  }
+// Row source for diff_image_stats() reading a TIFF file.  For pixel
+// interleaved files, the scanlines of the last block of rows are kept so
+// that every band after the first one is converted from memory.
+typedef struct {
+  TIFF *tif;
+  tiff_data_t t;
+  tsize_t scanline_size;
+  tdata_t rows;             // raw scanlines of the cached block
+  int first_row, n_rows;    // the cached block
+} tiff_source_t;
 
-  // Cleanup and begone
-  if (f1 != NULL) FREE(f1);
-  if (f2 != NULL) FREE(f2);
-  if (band_names1 != NULL && md1 != NULL) {
-    for (ii=0; ii<md1->general->band_count; ii++) {
-      if (band_names1[ii] != NULL) FREE(band_names1[ii]);
+static void tiff_get_rows(void *source, int band, int first_row,
+                          int n_rows, float *buf)
+{
+  tiff_source_t *src = (tiff_source_t *) source;
+  int ii;
+
+  if (src->t.planar_config == PLANARCONFIG_CONTIG || src->t.num_bands == 1) {
+    if (src->rows == NULL || first_row != src->first_row ||
+        n_rows > src->n_rows) {
+      if (src->rows) _TIFFfree(src->rows);
+      src->rows = _TIFFmalloc(src->scanline_size*n_rows);
+      for (ii=0; ii<n_rows; ii++)
+        TIFFReadScanline(src->tif,
+                         (char *)src->rows + ii*src->scanline_size,
+                         first_row + ii, 0);
+      src->first_row = first_row;
+      src->n_rows = n_rows;
     }
-    FREE(band_names1);
+    for (ii=0; ii<n_rows; ii++)
+      tiff_scanline_to_float((char *)src->rows + ii*src->scanline_size,
+                             &src->t, buf + ii*src->t.width, band);
   }
-  if (band_names2 != NULL && md2 != NULL) {
-    for (ii=0; ii<md2->general->band_count; ii++) {
-      if (band_names2[ii] != NULL) FREE(band_names2[ii]);
+  else {
+    // Planar configuration is band-sequential
+    tdata_t scanline = _TIFFmalloc(src->scanline_size);
+    for (ii=0; ii<n_rows; ii++) {
+      TIFFReadScanline(src->tif, scanline, first_row + ii, band);
+      tiff_scanline_to_float(scanline, &src->t, buf + ii*src->t.width, band);
     }
-    FREE(band_names2);
+    _TIFFfree(scanline);
   }
-  if (data1 != NULL) FREE(data1);
-  if (data2 != NULL) FREE(data2);
-  if (md1 != NULL) meta_free(md1);
-  if (md2 != NULL) meta_free(md2);
 }
 
-void calc_jpeg_stats_2files(char *inFile1, char *inFile2, char *outfile,
-                            stats_t *inFile1_stats, stats_t *inFile2_stats,
-                            psnr_t *psnr, int band)
+// Opens a TIFF row source, returns 0 if the file cannot be compared
+static int tiff_source_open(char *inFile, tiff_source_t *src,
+                            diff_stream_t *s)
 {
-  stats_t *s1 = inFile1_stats;
-  stats_t *s2 = inFile2_stats;
+  tiff_data_t *t = &src->t;
 
-  // Init stats
-  s1->stats_good = s2->stats_good = 0;
-  s1->min = s2->min = 0.0;
-  s1->max = s2->max = 0.0;
-  s1->mean = s2->mean = 0.0;
-  s1->sdev = s2->sdev = 0.0;
-  s1->rmse = s2->rmse = 0.0;
-  s1->hist = s2->hist = NULL;
-  s1->hist_pdf = s2->hist_pdf = NULL;
-  psnr->psnr = MISSING_PSNR;
-  psnr->psnr_good = 0;
-
-  jpeg_image_band_statistics_from_file(inFile1, outfile, band, &s1->stats_good,
-                                       &s1->min, &s1->max,
-                                       &s1->mean, &s1->sdev, &s1->rmse,
-                                       0, UINT8_IMAGE_DEFAULT_MASK);
-  jpeg_image_band_statistics_from_file(inFile2, outfile, band, &s2->stats_good,
-                                       &s2->min, &s2->max,
-                                       &s2->mean, &s2->sdev, &s2->rmse,
-                                       0, UINT8_IMAGE_DEFAULT_MASK);
-  jpeg_image_band_psnr_from_files(inFile1, inFile2, outfile, band, band, psnr);
+  get_tiff_info_from_file(inFile, t);
+  // Note: For single-plane (greyscale) images, planar_config will remain 
+  // unset so we can't use it as a guide for checking TIFF validity...
+  if (t->sample_format == MISSING_TIFF_DATA ||
+      t->bits_per_sample == MISSING_TIFF_DATA ||
+      t->data_type == 0 ||
+      t->num_bands == MISSING_TIFF_DATA ||
+      t->is_scanline_format == MISSING_TIFF_DATA ||
+      t->height == 0 ||
+      t->width == 0) {
+    asfPrintWarning("Missing TIFF header values in %s\n", inFile);
+    return 0;
+  }
+  if (t->num_bands > 1 &&
+      t->planar_config != PLANARCONFIG_CONTIG &&
+      t->planar_config != PLANARCONFIG_SEPARATE) {
+    asfPrintWarning("Invalid planar configuration in %s\n", inFile);
+    return 0;
+  }
+  src->tif = XTIFFOpen(inFile, "rb");
+  if (src->tif == NULL) {
+    asfPrintWarning("Cannot open %s\n", inFile);
+    return 0;
+  }
+  src->scanline_size = TIFFScanlineSize(src->tif);
+  if (src->scanline_size <= 0) {
+    asfPrintWarning("Invalid scanline size (%d)\n", src->scanline_size);
+    return 0;
+  }
+
+  s->get_rows = tiff_get_rows;
+  s->source = src;
+  s->lines = t->height;
+  s->samples = t->width;
+  s->band_count = t->num_bands;
+  s->mask = NAN;
+  return 1;
 }
 
-void calc_ppm_pgm_stats_2files(char *inFile1, char *inFile2, char *outfile,
-                               stats_t *inFile1_stats, stats_t *inFile2_stats,
-                               psnr_t *psnr, int band)
+static void tiff_source_close(tiff_source_t *src)
 {
-  stats_t *s1 = inFile1_stats;
-  stats_t *s2 = inFile2_stats;
-
-  // Init stats
-  s1->stats_good = s2->stats_good = 0;
-  s1->min = s2->min = 0.0;
-  s1->max = s2->max = 0.0;
-  s1->mean = s2->mean = 0.0;
-  s1->sdev = s2->sdev = 0.0;
-  s1->rmse = s2->rmse = 0.0;
-  s1->hist = s2->hist = NULL;
-  s1->hist_pdf = s2->hist_pdf = NULL;
-  psnr->psnr = MISSING_PSNR;
-  psnr->psnr_good = 0;
-
-  ppm_pgm_image_band_statistics_from_file(inFile1, outfile, band, 
-					  &s1->stats_good,
-                                          &s1->min, &s1->max,
-                                          &s1->mean, &s1->sdev, &s1->rmse,
-                                          0, UINT8_IMAGE_DEFAULT_MASK);
-  ppm_pgm_image_band_statistics_from_file(inFile2, outfile, band, 
-					  &s2->stats_good,
-                                          &s2->min, &s2->max,
-                                          &s2->mean, &s2->sdev, &s2->rmse,
-                                          0, UINT8_IMAGE_DEFAULT_MASK);
-  ppm_pgm_image_band_psnr_from_files(inFile1, inFile2, outfile, band, band, 
-				     psnr);
+  if (src->rows) _TIFFfree(src->rows);
+  if (src->tif) XTIFFClose(src->tif);
 }
 
 void calc_tiff_stats_2files(char *inFile1, char *inFile2,
                             stats_t *inFile1_stats, stats_t *inFile2_stats,
-                            psnr_t *psnr, int band)
+                            psnr_t *psnr, diff_hist_t *diff_hist,
+                            int first_band, int band_count)
 {
-  stats_t *s1 = inFile1_stats;
-  stats_t *s2 = inFile2_stats;
-
-  // Init stats
-  s1->stats_good = s2->stats_good = 0;
-  s1->min = s2->min = 0.0;
-  s1->max = s2->max = 0.0;
-  s1->mean = s2->mean = 0.0;
-  s1->sdev = s2->sdev = 0.0;
-  s1->rmse = s2->rmse = 0.0;
-  s1->hist = s2->hist = NULL;
-  s1->hist_pdf = s2->hist_pdf = NULL;
-  psnr->psnr = MISSING_PSNR;
-  psnr->psnr_good = 0;
-
-  tiff_image_band_statistics_from_file(inFile1, band, &s1->stats_good,
-                                       &s1->min, &s1->max,
-                                       &s1->mean, &s1->sdev, &s1->rmse,
-                                       0, FLOAT_IMAGE_DEFAULT_MASK);
-  tiff_image_band_statistics_from_file(inFile2, band, &s2->stats_good,
-                                       &s2->min, &s2->max,
-                                       &s2->mean, &s2->sdev, &s2->rmse,
-                                       0, FLOAT_IMAGE_DEFAULT_MASK);
-  tiff_image_band_psnr_from_files(inFile1, inFile2, band, band, psnr);
+  tiff_source_t src1, src2;
+  diff_stream_t s1, s2;
+
+  src1.tif = src2.tif = NULL;
+  src1.rows = src2.rows = NULL;
+  init_stats_2files(inFile1_stats, inFile2_stats, psnr, diff_hist,
+                    first_band, band_count);
+
+  if (tiff_source_open(inFile1, &src1, &s1) &&
+      tiff_source_open(inFile2, &src2, &s2)) {
+    float max_val = 0.0;
+    if (src1.t.data_type != src2.t.data_type)
+      asfPrintWarning("TIFF files have different data types.\n");
+    else
+      max_val = get_maxval(src1.t.data_type);
+    diff_image_stats(&s1, &s2, first_band, band_count, max_val,
+                     inFile1_stats, inFile2_stats, psnr, diff_hist);
+    missing_psnr_2files(psnr, first_band, band_count);
+  }
+  tiff_source_close(&src1);
+  tiff_source_close(&src2);
 }
 
-float get_maxval(data_type_t data_type)
-{
-  float ret;
+// Row source for diff_image_stats() reading an 8-bit, pixel interleaved
+// PNG, JPEG or PPM/PGM file.  These can only be read front to back, which
+// is how diff_image_stats() asks for the rows, so every block of rows is
+// read once and the bands are converted from memory.
+typedef enum {
+  BYTE_SOURCE_PNG,
+  BYTE_SOURCE_JPEG,
+  BYTE_SOURCE_PPM_PGM
+} byte_source_type_t;
 
-  // Only non-complex types with 32 bits or less are supported
-  switch (data_type) {
-  case BYTE:
-    ret = pow(2, sizeof(unsigned char) * 8.0) - 1;
-    break;
-  case COMPLEX_BYTE:
-    // HACK ALERT!  This assumes that COMPLEX_BYTE is
-    // from raw data off a satellite and has only 5-bit
-    // resolution... Probably a safe assumption for diffimage
-    ret = pow(2, 5) - 1;
-    break;
-  case INTEGER16:
-  case COMPLEX_INTEGER16:
-    ret = pow(2, sizeof(short int) * 8.0) - 1;
-    break;
-  case INTEGER32:
-  case COMPLEX_INTEGER32:
-    ret = pow(2, sizeof(int) * 8.0) - 1;
+typedef struct {
+  byte_source_type_t type;
+  char *file;
+  FILE *fp;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  struct jpeg_decompress_struct cinfo;
+  jpeg_error_hdlr_t jerr;
+  int width, num_bands;
+  unsigned char *rows;      // raw rows of the cached block
+  int first_row, n_rows;    // the cached block
+} byte_source_t;
+
+static void byte_source_read(byte_source_t *src, int n_rows)
+{
+  int row_size = src->width*src->num_bands;
+  JSAMPROW row;
+  int ii;
+
+  switch (src->type) {
+  case BYTE_SOURCE_PNG:
+    if (setjmp(png_jmpbuf(src->png_ptr)))
+      asfPrintError("PNG library error occurred reading %s\n", src->file);
+    for (ii=0; ii<n_rows; ii++)
+      png_read_row(src->png_ptr, src->rows + ii*row_size, NULL);
     break;
-  case REAL32:
-  case COMPLEX_REAL32:
-    ret = MAXREAL;
+  case BYTE_SOURCE_JPEG:
+    if (setjmp(src->jerr.setjmp_buffer))
+      asfPrintError("JPEG library error occurred reading %s\n", src->file);
+    for (ii=0; ii<n_rows; ii++) {
+      row = src->rows + ii*row_size;
+      jpeg_read_scanlines(&src->cinfo, &row, 1);
+    }
     break;
-  default:
-    ret = 0.0;
+  case BYTE_SOURCE_PPM_PGM:
+    FREAD(src->rows, sizeof(unsigned char), n_rows*row_size, src->fp);
     break;
   }
-
-  return ret;
 }
 
-void print_stats_results(char *filename1, char *filename2,
-                         char *band_str1, char *band_str2,
-                         stats_t *s1, stats_t *s2,
-                         psnr_t psnr)
+static void byte_get_rows(void *source, int band, int first_row,
+                          int n_rows, float *buf)
 {
-  asfPrintStatus("\nStatistics for %s%s\n"
-		 "   min: %f\n"
-		 "   max: %f\n"
-		 "  mean: %f\n"
-		 "  sdev: %f\n"
-		 "  rmse: %f\n"
-		 "result: %s\n",
-		 band_str1, filename1, s1->min, s1->max, s1->mean, s1->sdev, 
-		 s1->rmse, s1->stats_good ? "GOOD STATS" : "UNRELIABLE STATS");
-  asfPrintStatus("\nStatistics for %s%s\n"
-		 "   min: %f\n"
-		 "   max: %f\n"
-		 "  mean: %f\n"
-		 "  sdev: %f\n"
-		 "  rmse: %f\n"
-		 "result: %s\n",
-		 band_str2, filename2, s2->min, s2->max, s2->mean, s2->sdev, 
-		 s2->rmse, s2->stats_good ? "GOOD STATS" : "UNRELIABLE STATS");
-  asfPrintStatus("\nPSNR between files: %f\n\n", psnr.psnr);
+  byte_source_t *src = (byte_source_t *) source;
+  int ii, n = n_rows*src->width;
+
+  if (first_row != src->first_row) {
+    if (n_rows > src->n_rows) {
+      if (src->rows) FREE(src->rows);
+      src->rows = (unsigned char *)
+        MALLOC(sizeof(unsigned char)*n_rows*src->width*src->num_bands);
+      src->n_rows = n_rows;
+    }
+    byte_source_read(src, n_rows);
+    src->first_row = first_row;
+  }
+  for (ii=0; ii<n; ii++)
+    buf[ii] = (float)src->rows[ii*src->num_bands + band];
+}
+
+static void byte_source_init(byte_source_t *src, byte_source_type_t type,
+                             char *inFile)
+{
+  src->type = type;
+  src->file = inFile;
+  src->fp = NULL;
+  src->png_ptr = NULL;
+  src->info_ptr = NULL;
+  src->rows = NULL;
+  src->first_row = -1;
+  src->n_rows = 0;
+}
+
+static void byte_source_stream(byte_source_t *src, int height,
+                               diff_stream_t *s)
+{
+  s->get_rows = byte_get_rows;
+  s->source = src;
+  s->lines = height;
+  s->samples = src->width;
+  s->band_count = src->num_bands;
+  s->mask = NAN;
+}
+
+// Opens a PNG row source, returns 0 if the file cannot be compared
+static int png_source_open(char *inFile, byte_source_t *src,
+                           diff_stream_t *s)
+{
+  png_info_t ihdr;
+  unsigned char sig[8];
+
+  byte_source_init(src, BYTE_SOURCE_PNG, inFile);
+  get_png_info_hdr_from_file(inFile, &ihdr, NULL);
+  if (ihdr.bit_depth == MISSING_PNG_DATA ||
+      ihdr.color_type == MISSING_PNG_DATA ||
+      ihdr.interlace_type == MISSING_PNG_DATA ||
+      ihdr.compression_type == MISSING_PNG_DATA ||
+      ihdr.filter_type == MISSING_PNG_DATA ||
+      ihdr.data_type == 0 ||
+      ihdr.num_bands == MISSING_PNG_DATA ||
+      ihdr.height == 0 ||
+      ihdr.width == 0) {
+    asfPrintWarning("Missing PNG header values in %s\n", inFile);
+    return 0;
+  }
+  if (ihdr.bit_depth != 8 ||
+      (ihdr.color_type != PNG_COLOR_TYPE_GRAY &&
+       ihdr.color_type != PNG_COLOR_TYPE_RGB)) {
+    asfPrintWarning("Only 8-bit greyscale or RGB PNG files are supported "
+                    "(%s)\n", inFile);
+    return 0;
+  }
+
+  src->fp = (FILE*)FOPEN(inFile, "rb");
+  // Important: Leaves file pointer offset into file by 8 bytes for png lib
+  if (fread(sig, 1, 8, src->fp) != 8 || !png_check_sig(sig, 8)) {
+    asfPrintWarning("Invalid PNG file (%s)\n", inFile);
+    return 0;
+  }
+  src->png_ptr =
+    png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!src->png_ptr)
+    asfPrintError("Cannot allocate PNG read struct (out of memory?)\n");
+  src->info_ptr = png_create_info_struct(src->png_ptr);
+  if (!src->info_ptr)
+    asfPrintError("Cannot allocate PNG info struct (out of memory?)\n");
+  if (setjmp(png_jmpbuf(src->png_ptr)))
+    asfPrintError("PNG library error occurred (invalid PNG file?)\n");
+  png_init_io(src->png_ptr, src->fp);
+  // Because of the sig-reading offset ...must do this for PNG lib
+  png_set_sig_bytes(src->png_ptr, 8);
+  png_read_info(src->png_ptr, src->info_ptr);
+
+  src->width = ihdr.width;
+  src->num_bands = ihdr.num_bands;
+  byte_source_stream(src, ihdr.height, s);
+  return 1;
+}
+
+// Opens a JPEG row source, returns 0 if the file cannot be compared
+static int jpeg_source_open(char *inFile, byte_source_t *src,
+                            diff_stream_t *s)
+{
+  jpeg_info_t jpg;
+
+  byte_source_init(src, BYTE_SOURCE_JPEG, inFile);
+  get_jpeg_info_hdr_from_file(inFile, &jpg, NULL);
+  if (jpg.width <= 0 ||
+      jpg.height <= 0 ||
+      jpg.data_type != BYTE ||
+      jpg.num_bands <= 0) {
+    asfPrintWarning("Missing JPEG header values in %s\n", inFile);
+    return 0;
+  }
+
+  src->fp = (FILE*)FOPEN(inFile, "rb");
+  // Setup jpeg lib error handler
+  src->cinfo.err = jpeg_std_error(&src->jerr.pub);
+  src->jerr.pub.error_exit = jpeg_err_exit;
+  if (setjmp(src->jerr.setjmp_buffer))
+    asfPrintError("JPEG library critical error ...Aborting\n");
+  jpeg_create_decompress(&src->cinfo);
+  jpeg_stdio_src(&src->cinfo, src->fp);
+  jpeg_read_header(&src->cinfo, TRUE);
+  jpeg_start_decompress(&src->cinfo);
+
+  src->width = jpg.width;
+  src->num_bands = jpg.num_bands;
+  byte_source_stream(src, jpg.height, s);
+  return 1;
+}
+
+// Opens a PPM/PGM row source, returns 0 if the file cannot be compared
+static int ppm_pgm_source_open(char *inFile, byte_source_t *src,
+                               diff_stream_t *s)
+{
+  ppm_pgm_info_t pgm;
+
+  byte_source_init(src, BYTE_SOURCE_PPM_PGM, inFile);
+  get_ppm_pgm_info_hdr_from_file(inFile, &pgm, NULL);
+  if (pgm.width <= 0 ||
+      pgm.height <= 0 ||
+      pgm.max_val <= 0 ||
+      pgm.img_offset < 0 ||
+      pgm.bit_depth != 8 ||
+      pgm.data_type != BYTE ||
+      pgm.num_bands <= 0) {
+    asfPrintWarning("Missing or unsupported PPM/PGM header values in %s\n",
+                    inFile);
+    return 0;
+  }
+
+  src->fp = (FILE*)FOPEN(inFile, "rb");
+  FSEEK64(src->fp, (long long)pgm.img_offset, SEEK_SET);
+
+  src->width = pgm.width;
+  src->num_bands = pgm.num_bands;
+  byte_source_stream(src, pgm.height, s);
+  return 1;
+}
+
+static void byte_source_close(byte_source_t *src)
+{
+  if (src->type == BYTE_SOURCE_PNG && src->png_ptr)
+    png_destroy_read_struct(&src->png_ptr, &src->info_ptr, NULL);
+  if (src->type == BYTE_SOURCE_JPEG && src->fp) {
+    // Every scanline has been read, so the decompression can be finished
+    jpeg_finish_decompress(&src->cinfo);
+    jpeg_destroy_decompress(&src->cinfo);
+  }
+  if (src->rows) FREE(src->rows);
+  if (src->fp) FCLOSE(src->fp);
+}
+
+// Compares two 8-bit files through byte sources, the peak value of BYTE
+// data being the PSNR peak
+static void calc_byte_stats_2files(char *inFile1, char *inFile2,
+                                   int (*source_open)(char *,
+                                                      byte_source_t *,
+                                                      diff_stream_t *),
+                                   stats_t *inFile1_stats,
+                                   stats_t *inFile2_stats,
+                                   psnr_t *psnr, diff_hist_t *diff_hist,
+                                   int first_band, int band_count)
+{
+  byte_source_t src1, src2;
+  diff_stream_t s1, s2;
+  int ok1, ok2;
+
+  init_stats_2files(inFile1_stats, inFile2_stats, psnr, diff_hist,
+                    first_band, band_count);
+
+  ok1 = source_open(inFile1, &src1, &s1);
+  ok2 = ok1 && source_open(inFile2, &src2, &s2);
+  if (ok1 && ok2) {
+    diff_image_stats(&s1, &s2, first_band, band_count, get_maxval(BYTE),
+                     inFile1_stats, inFile2_stats, psnr, diff_hist);
+    missing_psnr_2files(psnr, first_band, band_count);
+  }
+  byte_source_close(&src1);
+  if (ok1) byte_source_close(&src2);
+}
+
+void calc_png_stats_2files(char *inFile1, char *inFile2,
+                           stats_t *inFile1_stats, stats_t *inFile2_stats,
+                           psnr_t *psnr, diff_hist_t *diff_hist,
+                           int first_band, int band_count)
+{
+  calc_byte_stats_2files(inFile1, inFile2, png_source_open,
+                         inFile1_stats, inFile2_stats, psnr, diff_hist,
+                         first_band, band_count);
+}
+
+void calc_jpeg_stats_2files(char *inFile1, char *inFile2,
+                            stats_t *inFile1_stats, stats_t *inFile2_stats,
+                            psnr_t *psnr, diff_hist_t *diff_hist,
+                            int first_band, int band_count)
+{
+  calc_byte_stats_2files(inFile1, inFile2, jpeg_source_open,
+                         inFile1_stats, inFile2_stats, psnr, diff_hist,
+                         first_band, band_count);
+}
+
+void calc_ppm_pgm_stats_2files(char *inFile1, char *inFile2,
+                               stats_t *inFile1_stats, stats_t *inFile2_stats,
+                               psnr_t *psnr, diff_hist_t *diff_hist,
+                               int first_band, int band_count)
+{
+  calc_byte_stats_2files(inFile1, inFile2, ppm_pgm_source_open,
+                         inFile1_stats, inFile2_stats, psnr, diff_hist,
+                         first_band, band_count);
+}
+
+float get_maxval(data_type_t data_type)
+{
+  float ret;
+
+  // Only non-complex types with 32 bits or less are supported
+  switch (data_type) {
+  case BYTE:
+    ret = pow(2, sizeof(unsigned char) * 8.0) - 1;
+    break;
+  case COMPLEX_BYTE:
+    // HACK ALERT!  This assumes that COMPLEX_BYTE is
+    // from raw data off a satellite and has only 5-bit
+    // resolution... Probably a safe assumption for diffimage
+    ret = pow(2, 5) - 1;
+    break;
+  case INTEGER16:
+  case COMPLEX_INTEGER16:
+    ret = pow(2, sizeof(short int) * 8.0) - 1;
+    break;
+  case INTEGER32:
+  case COMPLEX_INTEGER32:
+    ret = pow(2, sizeof(int) * 8.0) - 1;
+    break;
+  case REAL32:
+  case COMPLEX_REAL32:
+    ret = MAXREAL;
+    break;
+  default:
+    ret = 0.0;
+    break;
+  }
+
+  return ret;
+}
+
+void print_stats_results(char *filename1, char *filename2,
+                         char *band_str1, char *band_str2,
+                         stats_t *s1, stats_t *s2,
+                         psnr_t psnr)
+{
+  asfPrintStatus("\nStatistics for %s%s\n"
+		 "   min: %f\n"
+		 "   max: %f\n"
+		 "  mean: %f\n"
+		 "  sdev: %f\n"
+		 "  rmse: %f\n"
+		 "result: %s\n",
+		 band_str1, filename1, s1->min, s1->max, s1->mean, s1->sdev, 
+		 s1->rmse, s1->stats_good ? "GOOD STATS" : "UNRELIABLE STATS");
+  asfPrintStatus("\nStatistics for %s%s\n"
+		 "   min: %f\n"
+		 "   max: %f\n"
+		 "  mean: %f\n"
+		 "  sdev: %f\n"
+		 "  rmse: %f\n"
+		 "result: %s\n",
+		 band_str2, filename2, s2->min, s2->max, s2->mean, s2->sdev, 
+		 s2->rmse, s2->stats_good ? "GOOD STATS" : "UNRELIABLE STATS");
+  asfPrintStatus("\nPSNR between files: %f\n\n", psnr.psnr);
 }
 
 void diff_check_stats(char *outputFile, char *inFile1, char *inFile2,
@@ -3353,348 +3584,22 @@ void projection_type_2_str(projection_type_t proj, char *proj_str)
     }
 }
 
-int tiff_image_band_statistics_from_file(char *inFile, int band_no,
-                                         int *stats_exist,
-                                         double *min, double *max,
-                                         double *mean, double *sdev, 
-					 double *rmse,
-                                         int use_mask_value, float mask_value)
-{
-  tiff_data_t t;
-  tsize_t scanlineSize;
-  
-  *stats_exist = 1; // Innocent until presumed guilty...
-  get_tiff_info_from_file(inFile, &t);
-  // Note: For single-plane (greyscale) images, planar_config will remain 
-  // unset so we can't use it as a guide for checking TIFF validity...
-  if (t.sample_format == MISSING_TIFF_DATA ||
-      t.bits_per_sample == MISSING_TIFF_DATA ||
-      t.data_type == 0 ||
-      t.num_bands == MISSING_TIFF_DATA ||
-      t.is_scanline_format == MISSING_TIFF_DATA ||
-      t.height == 0 ||
-      t.width == 0) {
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  // Minimum and maximum sample values as integers.
-  double fmin = FLT_MAX;
-  double fmax = -FLT_MAX;
-  double cs; // Current sample value
-  
-  *mean = 0.0;
-  double s = 0.0;
-  
-  uint32 sample_count = 0;      // Samples considered so far.
-  uint32 ii, jj;
-  TIFF *tif = XTIFFOpen(inFile, "rb");
-  if (tif == NULL) {
-    *stats_exist = 0;
-    return 1;
-  }
-  scanlineSize = TIFFScanlineSize(tif);
-  if (scanlineSize <= 0) {
-    if (tif) XTIFFClose(tif);
-    *stats_exist = 0;
-    return 1;
-  }
-  if (t.num_bands > 1 &&
-      t.planar_config != PLANARCONFIG_CONTIG &&
-      t.planar_config != PLANARCONFIG_SEPARATE) {
-    if (tif) XTIFFClose(tif);
-    *stats_exist = 0;
-    return 1;
-  }
-  float *buf = (float*)MALLOC(t.width * sizeof(float));
-  
-  // If there is a mask value we are supposed to ignore,
-  if ( use_mask_value ) {
-    // iterate over all rows in the TIFF
-    for ( ii = 0; ii < t.height; ii++ ) {
-      // Planar configuration is chunky, e.g. interlaced pixels, rgb rgb etc.
-      asfPercentMeter((double)ii/(double)t.height);
-      tiff_get_float_line(tif, buf, ii, band_no);
-      for (jj = 0 ; jj < t.width; jj++ ) {
-	// iterate over each pixel sample in the scanline
-	cs = buf[jj];
-	if ( !isnan(mask_value) && 
-	     (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-	  continue;
-	}
-	if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-	if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-	double old_mean = *mean;
-	*mean += (cs - *mean) / (sample_count + 1);
-	s += (cs - old_mean) * (cs - *mean);
-	sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  else {
-    // There is no mask value to ignore, so we do the same as the
-    // above loop, but without the possible continue statement.
-    for ( ii = 0; ii < t.height; ii++ ) {
-      asfPercentMeter((double)ii/(double)t.height);
-      tiff_get_float_line(tif, buf, ii, band_no);
-      for (jj = 0 ; jj < t.width; jj++ ) {
-	// iterate over each pixel sample in the scanline
-	cs = buf[jj];
-	if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-	if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-	double old_mean = *mean;
-	*mean += (cs - *mean) / (sample_count + 1);
-	s += (cs - old_mean) * (cs - *mean);
-	sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  
-  // Verify the new extrema have been found.
-  //if (fmin == FLT_MAX || fmax == -FLT_MAX)
-  if (gsl_fcmp (fmin, FLT_MAX, 0.00000000001) == 0 ||
-      gsl_fcmp (fmax, -FLT_MAX, 0.00000000001) == 0) {
-    if (buf) free(buf);
-    if (tif) XTIFFClose(tif);
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  *min = fmin;
-  *max = fmax;
-  *sdev = sqrt (s / (sample_count - 1));
-  // This assumes the sample count is large enough to ensure that the sample 
-  // standard deviation is very very similar to the population standard 
-  // deviation.
-  *rmse = *sdev; 
-  
-  // The new extrema had better be in the range supported range
-  if (fabs(*mean) > FLT_MAX || fabs(*sdev) > FLT_MAX) {
-    if (buf) free(buf);
-    if (tif) XTIFFClose(tif);
-    *stats_exist = 0;
-    return 1;
-  }
-
-  if (buf) free(buf);
-  if (tif) XTIFFClose(tif);
-  return 0;
-}
-
-void tiff_image_band_psnr_from_files(char *inFile1, char *inFile2,
-                                     int band1, int band2,
-                                     psnr_t *psnr)
-{
-  double cs1, cs2;
-  tiff_data_t t1, t2;
-  tsize_t scanlineSize1, scanlineSize2;
-  
-  get_tiff_info_from_file(inFile1, &t1);
-  if (t1.sample_format == MISSING_TIFF_DATA ||
-      t1.bits_per_sample == MISSING_TIFF_DATA ||
-      t1.planar_config == MISSING_TIFF_DATA ||
-      t1.data_type == 0 ||
-      t1.num_bands == MISSING_TIFF_DATA ||
-      t1.is_scanline_format == MISSING_TIFF_DATA ||
-      t1.height == 0 ||
-      t1.width == 0) {
-    asfPrintWarning("Missing TIFF header values in %s\n", inFile1);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  get_tiff_info_from_file(inFile2, &t2);
-  if (t2.sample_format == MISSING_TIFF_DATA ||
-      t2.bits_per_sample == MISSING_TIFF_DATA ||
-      t2.planar_config == MISSING_TIFF_DATA ||
-      t2.data_type == 0 ||
-      t2.num_bands == MISSING_TIFF_DATA ||
-      t2.is_scanline_format == MISSING_TIFF_DATA ||
-      t2.height == 0 ||
-      t2.width == 0) {
-    asfPrintWarning("Missing TIFF header values in %s\n", inFile2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  
-  // Calculate the peak signal to noise ratio (PSNR) between the two images
-  double sse;
-  double rmse;
-  int ii, jj;
-  long height = MIN(t1.height, t2.height);
-  long width = MIN(t1.width, t2.width);
-  long pixel_count = 0;
-  float max_val;
-  char **band_names1, **band_names2;
-  int num_extracted_names1=0;
-  int num_extracted_names2=0;
-  
-  if (band1 < 0 || band1 > t1.num_bands - 1 ||
-      band2 < 0 || band2 > t2.num_bands - 1) {
-    asfPrintWarning("Invalid band number for file1 (%d v. %d) or file2 (%d v. "
-		    "%d)\n", band1, t1.num_bands, band2, t2.num_bands);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (t1.height != t2.height) {
-    asfPrintWarning("File1 and File2 have a differing numbers of rows (%d v. "
-		    "%d).\nPSNR calculation will only use the first %d rows "
-		    "from each file.\n", t1.height, t2.height, height);
-  }
-  if (t1.width != t2.width) {
-    asfPrintWarning("File1 and File2 have a different number of pixels per row "
-		    "(%d v. %d).\nPSNR calculation will only use the first %d "
-		    "pixels from each row of data.\n", 
-		    t1.width, t2.width, width);
-  }
-  
-  if (t1.data_type != t2.data_type) {
-    asfPrintWarning("TIFF files have different data types.\n");
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  
-  get_band_names(inFile1, NULL, &band_names1, &num_extracted_names1);
-  get_band_names(inFile2, NULL, &band_names2, &num_extracted_names2);
-  asfPrintStatus("\nCalculating PSNR between\n  Band %s in %s and\n  Band %s "
-		 "in %s\n",
-                 band_names1[band1], inFile1, band_names2[band2], inFile2);
-  
-  TIFF *tif1 = XTIFFOpen(inFile1, "rb");
-  if (tif1 == NULL) {
-    asfPrintWarning("Cannot open %s\n", inFile1);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  scanlineSize1 = TIFFScanlineSize(tif1);
-  if (scanlineSize1 <= 0) {
-    asfPrintWarning("Invalid scanline size (%d)\n", scanlineSize1);
-    if (tif1) XTIFFClose(tif1);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (t1.num_bands > 1 &&
-      t1.planar_config != PLANARCONFIG_CONTIG &&
-      t1.planar_config != PLANARCONFIG_SEPARATE) {
-    asfPrintWarning("Invalid planar configuration in %s\n", inFile1);
-    if (tif1) XTIFFClose(tif1);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  TIFF *tif2 = XTIFFOpen(inFile2, "rb");
-  if (tif2 == NULL) {
-    asfPrintWarning("Cannot open %s\n", inFile2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  scanlineSize2 = TIFFScanlineSize(tif2);
-  if (scanlineSize2 <= 0) {
-    asfPrintWarning("Invalid scanline size (%d)\n", scanlineSize2);
-    if (tif2) XTIFFClose(tif2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (t2.num_bands > 1 &&
-      t2.planar_config != PLANARCONFIG_CONTIG &&
-      t2.planar_config != PLANARCONFIG_SEPARATE) {
-    asfPrintWarning("Invalid planar configuration in %s\n", inFile2);
-    if (tif2) XTIFFClose(tif2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  float *buf1 = (float*)CALLOC(t1.width, sizeof(float));
-  float *buf2 = (float*)CALLOC(t2.width, sizeof(float));
-  if (buf1 == NULL || buf2 == NULL) {
-    asfPrintWarning("Cannot allocate memory for TIFF data buffers.\n");
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    if (buf1) FREE(buf1);
-    if (buf2) FREE(buf2);
-    return;
-  }
-  
-  sse = 0.0;
-  // Since both file's data types are the same, this is OK
-  max_val = get_maxval(t1.data_type); 
-  for (ii=0; ii<height; ++ii) {
-    asfPercentMeter((double)ii/(double)height);
-    tiff_get_float_line(tif1, buf1, ii, band1);
-    tiff_get_float_line(tif2, buf2, ii, band2);
-    for (jj=0; jj<width; ++jj) {
-      cs1 = buf1[jj];
-      cs2 = buf2[jj];
-      sse += (cs1 - cs2) * (cs1 - cs2);
-      pixel_count++;
-    }
-  }
-  asfPercentMeter(1.0);
-  if (pixel_count > 0 && max_val > 0) {
-    rmse = sqrt(sse/pixel_count);
-    psnr->psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
-    psnr->psnr_good = 1;
-  }
-  else {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-  }
-  
-  free_band_names(&band_names1, num_extracted_names1);
-  free_band_names(&band_names2, num_extracted_names2);
-  XTIFFClose(tif1);
-  XTIFFClose(tif2);
-  if (buf1) FREE(buf1);
-  if (buf2) FREE(buf2);
-}
-
-void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
+// Converts band band_no of a scanline read with TIFFReadScanline() (the
+// only band in it, unless the planar configuration is contiguous) to
+// floats.
+static void tiff_scanline_to_float(tdata_t tif_buf, tiff_data_t *t,
+                                   float *buf, int band_no)
 {
-  tiff_data_t t;
-  
-  get_tiff_info(tif, &t);
-  // Note: For single-plane (greyscale) images, planar_config may remain unset
-  // so we can't use it as a guide for checking TIFF validity...
-  if (t.sample_format == MISSING_TIFF_DATA ||
-      t.bits_per_sample == MISSING_TIFF_DATA ||
-      t.data_type == 0 ||
-      t.num_bands == MISSING_TIFF_DATA ||
-      t.is_scanline_format == MISSING_TIFF_DATA ||
-      t.height == 0 ||
-      t.width == 0) {
-    asfPrintError("Cannot read tif file\n");
-  }
-  
-  // Read a scanline
-  tsize_t scanlineSize = TIFFScanlineSize(tif);
-  tdata_t *tif_buf = _TIFFmalloc(scanlineSize);
-  if (t.planar_config == PLANARCONFIG_CONTIG || t.num_bands == 1) {
-    TIFFReadScanline(tif, tif_buf, row, 0);
-  }
-  else {
-    // Planar configuration is band-sequential
-    TIFFReadScanline(tif, tif_buf, row, band_no);
-  }
-  
   int col;
-  for (col=0; col<t.width; col++) {
-    switch(t.bits_per_sample) 
+  for (col=0; col<t->width; col++) {
+    switch(t->bits_per_sample) 
       {
       case 8:
-	switch(t.sample_format) {
+	switch(t->sample_format) {
 	case SAMPLEFORMAT_UINT:
-	  if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	  if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	    // Current sample.
-	    buf[col] = (float)(((uint8*)(tif_buf))[(col*t.num_bands)+band_no]);
+	    buf[col] = (float)(((uint8*)(tif_buf))[(col*t->num_bands)+band_no]);
 	  }
 	  else {
 	    // Planar configuration is band-sequential or single-banded
@@ -3702,9 +3607,9 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	  }
 	  break;
 	case SAMPLEFORMAT_INT:
-	  if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	  if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	    // Current sample.
-	    buf[col] = (float)(((int8*)(tif_buf))[(col*t.num_bands)+band_no]);
+	    buf[col] = (float)(((int8*)(tif_buf))[(col*t->num_bands)+band_no]);
 	  }
 	  else {
 	    // Planar configuration is band-sequential or single-banded
@@ -3713,21 +3618,19 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	  break;
 	default:
 	  // There is no such thing as an IEEE 8-bit floating point
-	  if (tif_buf) _TIFFfree(tif_buf);
-	  if (tif) XTIFFClose(tif);
-	  asfPrintError("tiff_get_float_line(): Unexpected data type in TIFF "
+	  asfPrintError("tiff_scanline_to_float(): Unexpected data type in TIFF "
 			"file.\n");
 	  break;
 	}
 	break;
       case 16:
-	switch(t.sample_format) 
+	switch(t->sample_format) 
 	  {
 	  case SAMPLEFORMAT_UINT:
-	    if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	    if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	      // Current sample.
 	      buf[col] = 
-		(float)(((uint16*)(tif_buf))[(col*t.num_bands)+band_no]);
+		(float)(((uint16*)(tif_buf))[(col*t->num_bands)+band_no]);
 	    }
 	    else {
 	      // Planar configuration is band-sequential or single-banded
@@ -3735,10 +3638,10 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	    }
 	    break;
 	  case SAMPLEFORMAT_INT:
-	    if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	    if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	      // Current sample.
 	      buf[col] = 
-		(float)(((int16*)(tif_buf))[(col*t.num_bands)+band_no]);
+		(float)(((int16*)(tif_buf))[(col*t->num_bands)+band_no]);
 	    }
 	    else {
 	      // Planar configuration is band-sequential or single-banded
@@ -3747,21 +3650,19 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	    break;
 	  default:
 	    // There is no such thing as an IEEE 16-bit floating point
-	    if (tif_buf) _TIFFfree(tif_buf);
-	    if (tif) XTIFFClose(tif);
-	    asfPrintError("tiff_get_float_line(): Unexpected data type in TIFF "
+	    asfPrintError("tiff_scanline_to_float(): Unexpected data type in TIFF "
 			  "file.\n");
 	    break;
 	  }
 	break;
       case 32:
-	switch(t.sample_format) 
+	switch(t->sample_format) 
 	  {
 	  case SAMPLEFORMAT_UINT:
-	    if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	    if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	      // Current sample.
 	      buf[col] = 
-		(float)(((uint32*)(tif_buf))[(col*t.num_bands)+band_no]);
+		(float)(((uint32*)(tif_buf))[(col*t->num_bands)+band_no]);
 	    }
 	    else {
 	      // Planar configuration is band-sequential or single-banded
@@ -3769,9 +3670,9 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	    }
 	    break;
 	  case SAMPLEFORMAT_INT:
-	    if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	    if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	      // Current sample.
-	      buf[col] = (float)(((long*)(tif_buf))[(col*t.num_bands)+band_no]);
+	      buf[col] = (float)(((long*)(tif_buf))[(col*t->num_bands)+band_no]);
 	    }
 	    else {
 	      // Planar configuration is band-sequential or single-banded
@@ -3779,10 +3680,10 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	    }
 	    break;
 	  case SAMPLEFORMAT_IEEEFP:
-	    if (t.planar_config == PLANARCONFIG_CONTIG && t.num_bands > 1) {
+	    if (t->planar_config == PLANARCONFIG_CONTIG && t->num_bands > 1) {
 	      // Current sample.
 	      buf[col] = 
-		(float)(((float*)(tif_buf))[(col*t.num_bands)+band_no]);
+		(float)(((float*)(tif_buf))[(col*t->num_bands)+band_no]);
 	    }
 	    else {
 	      // Planar configuration is band-sequential or single-banded
@@ -3790,21 +3691,48 @@ void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
 	    }
 	    break;
 	  default:
-	    if (tif_buf) _TIFFfree(tif_buf);
-	    if (tif) XTIFFClose(tif);
-	    asfPrintError("tiff_get_float_line(): Unexpected data type in TIFF "
+	    asfPrintError("tiff_scanline_to_float(): Unexpected data type in TIFF "
 			  "file.\n");
 	    break;
 	  }
 	break;
       default:
-	if (tif_buf) _TIFFfree(tif_buf);
-	if (tif) XTIFFClose(tif);
-	asfPrintError("tiff_get_float_line(): Unexpected data type in TIFF "
+	asfPrintError("tiff_scanline_to_float(): Unexpected data type in TIFF "
 		      "file.\n");
 	break;
       }
   }
+}
+
+void tiff_get_float_line(TIFF *tif, float *buf, int row, int band_no)
+{
+  tiff_data_t t;
+  
+  get_tiff_info(tif, &t);
+  // Note: For single-plane (greyscale) images, planar_config may remain unset
+  // so we can't use it as a guide for checking TIFF validity...
+  if (t.sample_format == MISSING_TIFF_DATA ||
+      t.bits_per_sample == MISSING_TIFF_DATA ||
+      t.data_type == 0 ||
+      t.num_bands == MISSING_TIFF_DATA ||
+      t.is_scanline_format == MISSING_TIFF_DATA ||
+      t.height == 0 ||
+      t.width == 0) {
+    asfPrintError("Cannot read tif file\n");
+  }
+  
+  // Read a scanline
+  tsize_t scanlineSize = TIFFScanlineSize(tif);
+  tdata_t *tif_buf = _TIFFmalloc(scanlineSize);
+  if (t.planar_config == PLANARCONFIG_CONTIG || t.num_bands == 1) {
+    TIFFReadScanline(tif, tif_buf, row, 0);
+  }
+  else {
+    // Planar configuration is band-sequential
+    TIFFReadScanline(tif, tif_buf, row, band_no);
+  }
+  
+  tiff_scanline_to_float(tif_buf, &t, buf, band_no);
   if (tif_buf) {
     _TIFFfree(tif_buf);
   }
@@ -4032,585 +3960,101 @@ void get_png_info_hdr_from_file(char *inFile, png_info_t *ihdr, char *outfile)
   if (output_file_exists && outputFP) FCLOSE(outputFP);
 }
 
-void calc_png_stats_2files(char *inFile1, char *inFile2, char *outfile,
-                           stats_t *inFile1_stats, stats_t *inFile2_stats,
-                           psnr_t *psnr, int band)
-{
-  stats_t *s1 = inFile1_stats;
-  stats_t *s2 = inFile2_stats;
-
-  // Init stats
-  s1->stats_good = s2->stats_good = 0;
-  s1->min = s2->min = 0.0;
-  s1->max = s2->max = 0.0;
-  s1->mean = s2->mean = 0.0;
-  s1->sdev = s2->sdev = 0.0;
-  s1->rmse = s2->rmse = 0.0;
-  s1->hist = s2->hist = NULL;
-  s1->hist_pdf = s2->hist_pdf = NULL;
-  psnr->psnr = MISSING_PSNR;
-  psnr->psnr_good = 0;
-  
-  png_image_band_statistics_from_file(inFile1, outfile, band, &s1->stats_good,
-                                      &s1->min, &s1->max,
-                                      &s1->mean, &s1->sdev, &s1->rmse,
-                                      0, UINT8_IMAGE_DEFAULT_MASK);
-  png_image_band_statistics_from_file(inFile2, outfile, band, &s2->stats_good,
-                                      &s2->min, &s2->max,
-                                      &s2->mean, &s2->sdev, &s2->rmse,
-                                      0, UINT8_IMAGE_DEFAULT_MASK);
-  png_image_band_psnr_from_files(inFile1, inFile2, outfile, band, band, psnr);
-}
-
-int png_image_band_statistics_from_file(char *inFile, char *outfile,
-                                        int band_no,
-                                        int *stats_exist,
-                                        double *min, double *max,
-                                        double *mean, double *sdev, 
-					double *rmse,
-                                        int use_mask_value, float mask_value)
+// NOTE: No row offset provided because png_ptr acts like a file pointer ...
+// just read all the rows in sequence.
+void png_sequential_get_float_line(png_structp png_ptr, png_infop info_ptr, 
+				   float *buf, int band)
 {
-  png_structp png_ptr;
-  png_infop info_ptr;
-  png_uint_32  width, height;
-  int bit_depth, color_type, interlace_type, compression_type, filter_type;
-  unsigned char sig[8];
-  char msg[1024];
-  FILE *pngFP, *outputFP;
-  png_info_t ihdr;
-  
-  *stats_exist = 1; // Innocent until presumed guilty...
-  get_png_info_hdr_from_file(inFile, &ihdr, outfile);
-  if (ihdr.bit_depth == MISSING_PNG_DATA ||
-      ihdr.color_type == MISSING_PNG_DATA ||
-      (ihdr.color_type_str == NULL || strlen(ihdr.color_type_str) <= 0) ||
-      ihdr.interlace_type == MISSING_PNG_DATA ||
-      ihdr.compression_type == MISSING_PNG_DATA ||
-      ihdr.filter_type == MISSING_PNG_DATA ||
-      ihdr.data_type == 0 ||
-      ihdr.num_bands == MISSING_PNG_DATA ||
-      ihdr.height == 0 ||
-      ihdr.width == 0) {
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  // Initialize PNG file for read
-  int output_file_exists = 0;
-  pngFP = (FILE*)FOPEN(inFile,"rb");
-  if (outfile && strlen(outfile) > 0) {
-    outputFP = (FILE*)FOPEN(outfile, "a");
-    if (outputFP) {
-      output_file_exists = 1;
-    }
-    else {
-      outputFP = stderr;
-      output_file_exists = 0;
-    }
-  }
-  else {
-    outputFP = stderr;
-    output_file_exists = 0;
-  }
-  // Important: Leaves file pointer offset into file by 8 bytes for png lib
-  fread(sig, 1, 8, pngFP); 
-  if (!png_check_sig(sig, 8)) {
-    // Bad PNG magic number (signature)
-    sprintf(msg, "Invalid PNG file (%s)\n", "file type header bytes invalid");
-    fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-  png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (!png_ptr) {
-    sprintf(msg, "Cannot allocate PNG read struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
+  int num_bands = (int)png_get_channels(png_ptr, info_ptr);
+  if (band < 0 || band > num_bands - 1) {
+    asfPrintError("png_get_float_line(): bad band number (band %d, bands %d "
+		  "through %d available)\n", band, 0, num_bands - 1);
   }
-  info_ptr = png_create_info_struct(png_ptr);
-  if (!info_ptr) {
-    png_destroy_read_struct(&png_ptr, NULL, NULL);
-    sprintf(msg, "Cannot allocate PNG info struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
+  png_uint_32 width, height;
+  int bit_depth, color_type;
+  png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, 
+	       NULL, NULL, NULL);
+  if (bit_depth != 8) {
+    asfPrintError("png_get_float_line(): PNG image has unsupported bit depth "
+		  "(%d).  Bit depth of 8-bits supported.\n", bit_depth);
   }
-  if (setjmp(png_jmpbuf(png_ptr))) {
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    sprintf(msg, "PNG library error occurred (invalid PNG file?)\n");
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
+  if (color_type != PNG_COLOR_TYPE_GRAY &&
+      color_type != PNG_COLOR_TYPE_RGB) {
+    asfPrintError("png_get_float_line(): PNG image must be RGB or greyscale. "
+		  "Alpha band, palette-color,\nand mask-type images not "
+		  "supported.\n");
   }
-  png_init_io(png_ptr, pngFP);
-  // Because of the sig-reading offset ...must do this for PNG lib
-  png_set_sig_bytes(png_ptr, 8); 
-  
-  // Read info and IHDR
-  png_read_info(png_ptr, info_ptr);
-  png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
-               &interlace_type, &compression_type, &filter_type);
-  
-  // Minimum and maximum sample values as integers.
-  double fmin = FLT_MAX;
-  double fmax = -FLT_MAX;
-  double cs; // Current sample value
 
-  *mean = 0.0;
-  double s = 0.0;
+  int rgb = color_type == PNG_COLOR_TYPE_RGB ? 1 : 0;
+  png_bytep png_buf = (png_bytep)MALLOC(width*sizeof(png_byte)*(rgb ? 3 : 1));
+  int col;
 
-  uint32 sample_count = 0;      // Samples considered so far.
-  uint32 ii, jj;
-  float *buf = (float*)MALLOC(ihdr.width * sizeof(float));
-  
-  // If there is a mask value we are supposed to ignore,
-  if ( use_mask_value ) {
-    // iterate over all rows in the TIFF
-    for ( ii = 0; ii < ihdr.height; ii++ ) {
-      // Planar configuration is chunky, e.g. interlaced pixels, rgb rgb etc.
-      asfPercentMeter((double)ii/(double)ihdr.height);
-      png_sequential_get_float_line(png_ptr, info_ptr, buf, band_no);
-      for (jj = 0 ; jj < ihdr.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        cs = buf[jj];
-        if (!isnan(mask_value) && 
-	    (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-          continue;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  else {
-    // There is no mask value to ignore, so we do the same as the
-    // above loop, but without the possible continue statement.
-    for ( ii = 0; ii < ihdr.height; ii++ ) {
-      asfPercentMeter((double)ii/(double)ihdr.height);
-      png_sequential_get_float_line(png_ptr, info_ptr, buf, band_no);
-      for (jj = 0 ; jj < ihdr.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        cs = buf[jj];
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  
-  // Verify the new extrema have been found.
-  //if (fmin == FLT_MAX || fmax == -FLT_MAX)
-  if (gsl_fcmp (fmin, FLT_MAX, 0.00000000001) == 0 ||
-      gsl_fcmp (fmax, -FLT_MAX, 0.00000000001) == 0) {
-    if (buf) free(buf);
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    sprintf(msg, "PNG library error occurred (invalid PNG file?)\n");
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  *min = fmin;
-  *max = fmax;
-  *sdev = sqrt (s / (sample_count - 1));
-  // This assumes the sample count is large enough to ensure that the sample 
-  // standard deviation is very very similar to the population standard 
-  // deviation.
-  *rmse = *sdev; 
-
-  // The new extrema had better be in the range supported range
-  if (fabs(*mean) > FLT_MAX || fabs(*sdev) > FLT_MAX) {
-    if (buf) free(buf);
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    sprintf(msg, "PNG library error occurred (invalid PNG file?)\n");
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP) FCLOSE(pngFP);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    *stats_exist = 0;
-    return 1;
+  // Read current row
+  png_read_row(png_ptr, png_buf, NULL);
+  for (col=0; col<width; col++) {
+    if (rgb)
+      buf[col] = (float)png_buf[col*3+band];
+    else
+      buf[col] = (float)png_buf[col];
   }
-  
-  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-  if (buf) free(buf);
-  if (output_file_exists && outputFP) FCLOSE(outputFP);
-  if (pngFP) FCLOSE(pngFP);
-  return 0;
 }
 
-void png_image_band_psnr_from_files(char *inFile1, char *inFile2, char *outfile,
-				    int band1, int band2, psnr_t *psnr)
+void get_ppm_pgm_info_hdr_from_file(char *inFile, ppm_pgm_info_t *pgm, 
+				    char *outfile)
 {
-  double cs1, cs2;
-  png_structp png_ptr1 = NULL, png_ptr2 = NULL;
-  png_infop info_ptr1 = NULL, info_ptr2 = NULL;
-  png_uint_32 png_width, png_height;
-  int bit_depth, color_type, interlace_type, compression_type, filter_type;
-  int num_names_extracted1=0, num_names_extracted2=0;
-  unsigned char sig[8];
-  char msg[1024];
-  FILE *pngFP1, *pngFP2, *outputFP;
-  png_info_t ihdr1, ihdr2;
+  int ch, i;
+  unsigned char tmp[1024]; // For reading width, height, max_val only
+  // Length of tmp for loop termination when reading sequential uchars
+  int max_chars   = 1024; 
+  FILE *fp = (FILE*)FOPEN(inFile, "rb");
 
-  int output_file_exists = 0;
-  if (outfile && strlen(outfile) > 0) {
-    outputFP = (FILE*)FOPEN(outfile, "a");
-    if (outputFP) {
-      output_file_exists = 1;
-    }
-    else {
-      outputFP = stderr;
-      output_file_exists = 0;
-    }
+  strcpy(pgm->magic,"");
+  pgm->width=MISSING_PPM_PGM_DATA;
+  pgm->height=MISSING_PPM_PGM_DATA;
+  pgm->max_val=MISSING_PPM_PGM_DATA;
+  // Default to unsupported type ...ASCII data separated by whitespace
+  pgm->ascii_data=1; 
+  pgm->img_offset = MISSING_PSNR; // Will result in a failed fseek()
+  pgm->bit_depth=0;
+  pgm->data_type=0;
+  pgm->num_bands=0;
+
+  //// Read magic number that identifies
+  FREAD(pgm->magic, sizeof(unsigned char), 2, fp);
+  if (pgm->magic[0] == 'P' && (pgm->magic[1] == '5' || pgm->magic[1] == '6')) {
+    pgm->ascii_data = 0;
+    pgm->img_offset = 2; // Just past magic number
   }
   else {
-    outputFP = stderr;
-    output_file_exists = 0;
+    // Shouldn't be possible to be here, but what the hey...
+    FILE *outFP=NULL;
+    if (outfile && strlen(outfile) > 0) outFP=(FILE*)FOPEN(outfile,"a");
+    char msg[1024];
+    sprintf(msg, "get_ppm_pgm_info_hdr_from_file(): Found invalid or "
+	    "unsupported (ASCII data?)\nPPM/PGM file header.\n");
+    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
+    if (outFP) FCLOSE(outFP);
+    if (fp) FCLOSE(fp);
+    asfPrintError(msg);
   }
 
-  get_png_info_hdr_from_file(inFile1, &ihdr1, outfile);
-  if (ihdr1.bit_depth == MISSING_PNG_DATA ||
-      ihdr1.color_type == MISSING_PNG_DATA ||
-      (ihdr1.color_type_str == NULL || strlen(ihdr1.color_type_str) <= 0) ||
-      ihdr1.interlace_type == MISSING_PNG_DATA ||
-      ihdr1.compression_type == MISSING_PNG_DATA ||
-      ihdr1.filter_type == MISSING_PNG_DATA ||
-      ihdr1.data_type == 0 ||
-      ihdr1.num_bands == MISSING_PNG_DATA ||
-      ihdr1.height == 0 ||
-      ihdr1.width == 0) {
-    sprintf(msg, "Cannot read PNG file header in file1\n  %s\n", inFile1);
-    if (outputFP) fprintf(outputFP, msg);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  get_png_info_hdr_from_file(inFile2, &ihdr2, outfile);
-  if (ihdr2.bit_depth == MISSING_PNG_DATA ||
-      ihdr2.color_type == MISSING_PNG_DATA ||
-      (ihdr2.color_type_str == NULL || strlen(ihdr2.color_type_str) <= 0) ||
-      ihdr2.interlace_type == MISSING_PNG_DATA ||
-      ihdr2.compression_type == MISSING_PNG_DATA ||
-      ihdr2.filter_type == MISSING_PNG_DATA ||
-      ihdr2.data_type == 0 ||
-      ihdr2.num_bands == MISSING_PNG_DATA ||
-      ihdr2.height == 0 ||
-      ihdr2.width == 0) {
-    sprintf(msg, "Cannot read PNG file header in file2\n  %s\n", inFile2);
-    if (outputFP) fprintf(outputFP, msg);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
+  // Determine number of channels (3 for rgb, 1 for gray)
+  if (pgm->magic[1] == '6') {
+    pgm->num_bands = 3; // RGB PPM file
   }
-
-  // Initialize PNG file for read
-  pngFP1 = (FILE*)FOPEN(inFile1,"rb");
-  // Important: Leaves file pointer offset into file by 8 bytes for png lib
-  fread(sig, 1, 8, pngFP1); 
-  if (!png_check_sig(sig, 8)) {
-    // Bad PNG magic number (signature)
-    sprintf(msg, "Invalid PNG file (%s)\n  %s\n", "file type header bytes "
-	    "invalid", inFile1);
-    fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
+  else if (pgm->magic[1] == '5') {
+    pgm->num_bands = 1; // Grayscale PGM file
   }
-  pngFP2 = (FILE*)FOPEN(inFile2,"rb");
-  // Important: Leaves file pointer offset into file by 8 bytes for png lib
-  fread(sig, 1, 8, pngFP2); 
-  if (!png_check_sig(sig, 8)) {
-    // Bad PNG magic number (signature)
-    sprintf(msg, "Invalid PNG file (%s)\n  %s\n", "file type header bytes "
-	    "invalid", inFile2);
-    fprintf(outputFP, msg);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-
-  png_ptr1 = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (!png_ptr1) {
-    sprintf(msg, "Cannot allocate PNG read struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-  info_ptr1 = png_create_info_struct(png_ptr1);
-  if (!info_ptr1) {
-    png_destroy_read_struct(&png_ptr1, NULL, NULL);
-    sprintf(msg, "Cannot allocate PNG info struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-  png_ptr2 = png_create_read_struct(
-      PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (!png_ptr2) {
-    sprintf(msg, "Cannot allocate PNG read struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-  info_ptr2 = png_create_info_struct(png_ptr2);
-  if (!info_ptr2) {
-    png_destroy_read_struct(&png_ptr2, NULL, NULL);
-    sprintf(msg, "Cannot allocate PNG info struct (out of memory?)\n");
-    fprintf(outputFP, msg);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-
-  if (setjmp(png_jmpbuf(png_ptr1))) {
-    if (png_ptr1) png_destroy_read_struct(&png_ptr1, &info_ptr1, NULL);
-    if (png_ptr2) png_destroy_read_struct(&png_ptr2, &info_ptr2, NULL);
-    sprintf(msg, "PNG library error occurred (invalid PNG file?)\n");
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    asfPrintError(msg);
-  }
-
-  png_init_io(png_ptr1, pngFP1);
-  // Because of the sig-reading offset ...must do this for PNG lib
-  png_set_sig_bytes(png_ptr1, 8); 
-  png_init_io(png_ptr2, pngFP2);
-  // Because of the sig-reading offset ...must do this for PNG lib
-  png_set_sig_bytes(png_ptr2, 8); 
-
-  // Read info and IHDR
-  png_read_info(png_ptr1, info_ptr1);
-  png_get_IHDR(png_ptr1, info_ptr1, &png_width, &png_height, &bit_depth, 
-	       &color_type, &interlace_type, &compression_type, &filter_type);
-  png_read_info(png_ptr2, info_ptr2);
-  png_get_IHDR(png_ptr2, info_ptr2, &png_width, &png_height, &bit_depth, 
-	       &color_type, &interlace_type, &compression_type, &filter_type);
-
-  // Calculate the peak signal to noise ratio (PSNR) between the two images
-  double sse;
-  double rmse;
-  int ii, jj;
-  long height = MIN(ihdr1.height, ihdr2.height);
-  long width = MIN(ihdr1.width, ihdr2.width);
-  long pixel_count = 0;
-  float max_val;
-  if (band1 < 0 || band1 > ihdr1.num_bands - 1 ||
-      band2 < 0 || band2 > ihdr2.num_bands - 1) {
-    sprintf(msg,"Invalid band number for file1 (%d v. %d) or file2 (%d v. %d)"
-	    "\n", band1, ihdr1.num_bands, band2, ihdr2.num_bands);
-    asfPrintWarning(msg);
-    if (png_ptr1) png_destroy_read_struct(&png_ptr1, &info_ptr1, NULL);
-    if (png_ptr2) png_destroy_read_struct(&png_ptr2, &info_ptr2, NULL);
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (ihdr1.height != ihdr2.height) {
-    asfPrintWarning("File1 and File2 have a differing numbers of rows (%d v. "
-		    "%d).\nPSNR calculation will only use the first %d rows "
-		    "from each file.\n", ihdr1.height, ihdr2.height, height);
-  }
-  if (ihdr1.width != ihdr2.width) {
-    asfPrintWarning("File1 and File2 have a different number of pixels per row "
-		    "(%d v. %d).\nPSNR calculation will only use the first %d "
-		    "pixels from each row of data.\n",
-		    ihdr1.width, ihdr2.width, width);
-  }
-
-  if (ihdr1.data_type != ihdr2.data_type) {
-    sprintf(msg,"PNG files have differing data types.\n");
-    asfPrintWarning(msg);
-    if (png_ptr1) png_destroy_read_struct(&png_ptr1, &info_ptr1, NULL);
-    if (png_ptr2) png_destroy_read_struct(&png_ptr2, &info_ptr2, NULL);
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  char **band_names1, **band_names2;
-  get_band_names(inFile1, NULL, &band_names1, &num_names_extracted1);
-  get_band_names(inFile2, NULL, &band_names2, &num_names_extracted2);
-  asfPrintStatus("\nCalculating PSNR between\n  Band %s in %s and\n  Band %s in"
-		 " %s\n",
-                 band_names1[band1], inFile1, band_names2[band2], inFile2);
-  float *buf1 = (float*)CALLOC(ihdr1.width, sizeof(float));
-  float *buf2 = (float*)CALLOC(ihdr2.width, sizeof(float));
-  if (buf1 == NULL || buf2 == NULL) {
-    asfPrintWarning("Cannot allocate memory for PNG data buffers.\n");
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    if (buf1) FREE(buf1);
-    if (buf2) FREE(buf2);
-    if (png_ptr1) png_destroy_read_struct(&png_ptr1, &info_ptr1, NULL);
-    if (png_ptr2) png_destroy_read_struct(&png_ptr2, &info_ptr2, NULL);
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (pngFP1) FCLOSE(pngFP1);
-    if (pngFP2) FCLOSE(pngFP2);
-    if (output_file_exists && outputFP) FCLOSE(outputFP);
-    return;
-  }
-
-  sse = 0.0;
-  // Since both file's data types are the same, this is OK
-  max_val = get_maxval(ihdr1.data_type); 
-  for (ii=0; ii<height; ++ii) {
-    asfPercentMeter((double)ii/(double)height);
-    png_sequential_get_float_line(png_ptr1, info_ptr1, buf1, band1);
-    png_sequential_get_float_line(png_ptr2, info_ptr2, buf2, band2);
-    for (jj=0; jj<width; ++jj) {
-      cs1 = buf1[jj];
-      cs2 = buf2[jj];
-      sse += (cs1 - cs2) * (cs1 - cs2);
-      pixel_count++;
-    }
-  }
-  asfPercentMeter(1.0);
-  if (pixel_count > 0 && max_val > 0) {
-    rmse = sqrt(sse/pixel_count);
-    psnr->psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
-    psnr->psnr_good = 1;
-  }
-  else {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-  }
-  
-  free_band_names(&band_names1, num_names_extracted1);
-  free_band_names(&band_names2, num_names_extracted2);
-  if (png_ptr1) png_destroy_read_struct(&png_ptr1, &info_ptr1, NULL);
-  if (png_ptr2) png_destroy_read_struct(&png_ptr2, &info_ptr2, NULL);
-  if (pngFP1) FCLOSE(pngFP1);
-  if (pngFP2) FCLOSE(pngFP2);
-  if (output_file_exists && outputFP) FCLOSE(outputFP);
-  if (buf1) FREE(buf1);
-  if (buf2) FREE(buf2);
-}
-
-// NOTE: No row offset provided because png_ptr acts like a file pointer ...
-// just read all the rows in sequence.
-void png_sequential_get_float_line(png_structp png_ptr, png_infop info_ptr, 
-				   float *buf, int band)
-{
-  int num_bands = (int)png_get_channels(png_ptr, info_ptr);
-  if (band < 0 || band > num_bands - 1) {
-    asfPrintError("png_get_float_line(): bad band number (band %d, bands %d "
-		  "through %d available)\n", band, 0, num_bands - 1);
-  }
-  png_uint_32 width, height;
-  int bit_depth, color_type;
-  png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, 
-	       NULL, NULL, NULL);
-  if (bit_depth != 8) {
-    asfPrintError("png_get_float_line(): PNG image has unsupported bit depth "
-		  "(%d).  Bit depth of 8-bits supported.\n", bit_depth);
-  }
-  if (color_type != PNG_COLOR_TYPE_GRAY &&
-      color_type != PNG_COLOR_TYPE_RGB) {
-    asfPrintError("png_get_float_line(): PNG image must be RGB or greyscale. "
-		  "Alpha band, palette-color,\nand mask-type images not "
-		  "supported.\n");
-  }
-
-  int rgb = color_type == PNG_COLOR_TYPE_RGB ? 1 : 0;
-  png_bytep png_buf = (png_bytep)MALLOC(width*sizeof(png_byte)*(rgb ? 3 : 1));
-  int col;
-
-  // Read current row
-  png_read_row(png_ptr, png_buf, NULL);
-  for (col=0; col<width; col++) {
-    if (rgb)
-      buf[col] = (float)png_buf[col*3+band];
-    else
-      buf[col] = (float)png_buf[col];
-  }
-}
-
-void get_ppm_pgm_info_hdr_from_file(char *inFile, ppm_pgm_info_t *pgm, 
-				    char *outfile)
-{
-  int ch, i;
-  unsigned char tmp[1024]; // For reading width, height, max_val only
-  // Length of tmp for loop termination when reading sequential uchars
-  int max_chars   = 1024; 
-  FILE *fp = (FILE*)FOPEN(inFile, "rb");
-
-  strcpy(pgm->magic,"");
-  pgm->width=MISSING_PPM_PGM_DATA;
-  pgm->height=MISSING_PPM_PGM_DATA;
-  pgm->max_val=MISSING_PPM_PGM_DATA;
-  // Default to unsupported type ...ASCII data separated by whitespace
-  pgm->ascii_data=1; 
-  pgm->img_offset = MISSING_PSNR; // Will result in a failed fseek()
-  pgm->bit_depth=0;
-  pgm->data_type=0;
-  pgm->num_bands=0;
-
-  //// Read magic number that identifies
-  FREAD(pgm->magic, sizeof(unsigned char), 2, fp);
-  if (pgm->magic[0] == 'P' && (pgm->magic[1] == '5' || pgm->magic[1] == '6')) {
-    pgm->ascii_data = 0;
-    pgm->img_offset = 2; // Just past magic number
-  }
-  else {
-    // Shouldn't be possible to be here, but what the hey...
-    FILE *outFP=NULL;
-    if (outfile && strlen(outfile) > 0) outFP=(FILE*)FOPEN(outfile,"a");
-    char msg[1024];
-    sprintf(msg, "get_ppm_pgm_info_hdr_from_file(): Found invalid or "
-	    "unsupported (ASCII data?)\nPPM/PGM file header.\n");
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    if (fp) FCLOSE(fp);
-    asfPrintError(msg);
-  }
-
-  // Determine number of channels (3 for rgb, 1 for gray)
-  if (pgm->magic[1] == '6') {
-    pgm->num_bands = 3; // RGB PPM file
-  }
-  else if (pgm->magic[1] == '5') {
-    pgm->num_bands = 1; // Grayscale PGM file
-  }
-  else {
-    // Shouldn't be able to reach this code
-    FILE *outFP=NULL;
-    if (outfile && strlen(outfile) > 0) outFP = (FILE*)FOPEN(outfile,"a");
-    char msg[1024];
-    sprintf(msg, "get_ppm_pgm_info_hdr_from_file(): Found invalid or "
-	    "unsupported\n(ASCII data?) PPM/PGM file header...\n");
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    if (fp) FCLOSE(fp);
+  else {
+    // Shouldn't be able to reach this code
+    FILE *outFP=NULL;
+    if (outfile && strlen(outfile) > 0) outFP = (FILE*)FOPEN(outfile,"a");
+    char msg[1024];
+    sprintf(msg, "get_ppm_pgm_info_hdr_from_file(): Found invalid or "
+	    "unsupported\n(ASCII data?) PPM/PGM file header...\n");
+    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
+    if (outFP) FCLOSE(outFP);
+    if (fp) FCLOSE(fp);
     asfPrintError(msg);
   }
 
@@ -4901,281 +4345,6 @@ void ppm_pgm_get_float_line(FILE *fp, float *buf, int row, ppm_pgm_info_t *pgm,
   if (pgm_buf)FREE(pgm_buf);
 }
 
-int ppm_pgm_image_band_statistics_from_file(char *inFile, char *outfile,
-					    int band_no, int *stats_exist,
-					    double *min, double *max,
-					    double *mean, double *sdev, 
-					    double *rmse, int use_mask_value, 
-					    float mask_value)
-{
-  ppm_pgm_info_t pgm;
-
-  *stats_exist = 1; // Innocent until presumed guilty...
-  get_ppm_pgm_info_hdr_from_file(inFile, &pgm, outfile);
-  if (pgm.magic == NULL || strlen(pgm.magic) == 0 ||
-      pgm.width <= 0 ||
-      pgm.height <= 0 ||
-      pgm.max_val <= 0 ||
-      pgm.img_offset < 0 ||
-      pgm.bit_depth != 8 ||
-      pgm.data_type != BYTE ||
-      pgm.num_bands <= 0) {
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  // Minimum and maximum sample values as integers.
-  double fmin = FLT_MAX;
-  double fmax = -FLT_MAX;
-  double cs; // Current sample value
-  
-  *mean = 0.0;
-  double s = 0.0;
-  
-  uint32 sample_count = 0;      // Samples considered so far.
-  uint32 ii, jj;
-  FILE *fp = FOPEN(inFile, "rb");
-  if (fp == NULL) {
-    *stats_exist = 0;
-    return 1;
-  }
-  float *buf = (float*)MALLOC(pgm.width * sizeof(float));
-  if (buf == NULL) {
-    *stats_exist = 0;
-    return 1;
-  }
-  
-  // If there is a mask value we are supposed to ignore,
-  FSEEK64(fp, (long long)pgm.img_offset, SEEK_SET);
-  if ( use_mask_value ) {
-    // iterate over all rows in the PPM or PGM file
-    for ( ii = 0; ii < pgm.height; ii++ ) {
-      asfPercentMeter((double)ii/(double)pgm.height);
-      ppm_pgm_get_float_line(fp, buf, ii, &pgm, band_no);
-      for (jj = 0 ; jj < pgm.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        cs = buf[jj];
-        if ( !isnan(mask_value) && 
-	     (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-          continue;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  else {
-    // There is no mask value to ignore, so we do the same as the
-    // above loop, but without the possible continue statement.
-    for ( ii = 0; ii < pgm.height; ii++ ) {
-      asfPercentMeter((double)ii/(double)pgm.height);
-      ppm_pgm_get_float_line(fp, buf, ii, &pgm, band_no);
-      for (jj = 0 ; jj < pgm.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        cs = buf[jj];
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  
-  // Verify the new extrema have been found.
-  //if (fmin == FLT_MAX || fmax == -FLT_MAX)
-  if (gsl_fcmp (fmin, FLT_MAX, 0.00000000001) == 0 ||
-      gsl_fcmp (fmax, -FLT_MAX, 0.00000000001) == 0) {
-    if (buf) free(buf);
-    if (fp) FCLOSE(fp);
-    *stats_exist = 0;
-    return 1;
-  }
-
-  *min = fmin;
-  *max = fmax;
-  *sdev = sqrt (s / (sample_count - 1));
-  // This assumes the sample count is large enough to ensure that the sample 
-  // standard deviation is very very similar to the population standard 
-  // deviation.
-  *rmse = *sdev; 
-
-  // The new extrema had better be in the range supported range
-  if (fabs(*mean) > FLT_MAX || fabs(*sdev) > FLT_MAX) {
-    if (buf) free(buf);
-    if (fp) FCLOSE(fp);
-    *stats_exist = 0;
-    return 1;
-  }
-
-  if (buf) free(buf);
-  if (fp) FCLOSE(fp);
-  return 0;
-}
-
-void ppm_pgm_image_band_psnr_from_files(char *inFile1, char *inFile2, 
-					char *outfile,
-                                        int band1, int band2, psnr_t *psnr)
-{
-  ppm_pgm_info_t pgm1, pgm2; // Header info
-  double cs1, cs2;
-  char msg[1024];
-  FILE *fp1, *fp2, *outputFP = NULL;
-
-  if (outfile && strlen(outfile) > 0) {
-      outputFP = (FILE*)FOPEN(outfile, "a");
-  }
-  else {
-      outputFP = NULL;
-  }
-
-  // Get header info and fseek() to beginning of image data
-  get_ppm_pgm_info_hdr_from_file(inFile1, &pgm1, outfile);
-  if (pgm1.magic == NULL || strlen(pgm1.magic) == 0 ||
-      pgm1.width <= 0 ||
-      pgm1.height <= 0 ||
-      pgm1.max_val <= 0 ||
-      pgm1.img_offset < 0 ||
-      pgm1.bit_depth != 8 ||
-      pgm1.data_type != BYTE ||
-      pgm1.num_bands <= 0) {
-    sprintf(msg, "Cannot read PPM/PNG file header in file1\n  %s\n", inFile1);
-    if (outputFP) fprintf(outputFP, msg); else fprintf(stderr, msg);
-    if (outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  get_ppm_pgm_info_hdr_from_file(inFile2, &pgm2, outfile);
-  if (pgm2.magic == NULL || strlen(pgm2.magic) == 0 ||
-      pgm2.width <= 0 ||
-      pgm2.height <= 0 ||
-      pgm2.max_val <= 0 ||
-      pgm2.img_offset < 0 ||
-      pgm2.bit_depth != 8 ||
-      pgm2.data_type != BYTE ||
-      pgm2.num_bands <= 0) {
-    sprintf(msg, "Cannot read PPM/PNG file header in file2\n  %s\n", inFile2);
-    if (outputFP) fprintf(outputFP, msg); else fprintf(stderr, msg);
-    if (outputFP) FCLOSE(outputFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  // Calculate the peak signal to noise ratio (PSNR) between the two images
-  double sse;
-  double rmse;
-  int ii, jj;
-  long height = MIN(pgm1.height, pgm2.height);
-  long width = MIN(pgm1.width, pgm2.width);
-  long pixel_count = 0;
-  float max_val;
-  if (band1 < 0 || band1 > pgm1.num_bands - 1 ||
-      band2 < 0 || band2 > pgm2.num_bands - 1) {
-    sprintf(msg,"Invalid band number for file1 (%d v. %d) or file2 (%d v. %d)"
-	    "\n", band1, pgm1.num_bands, band2, pgm2.num_bands);
-    asfPrintWarning(msg);
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    if (outputFP) FCLOSE(outputFP); else fprintf(stderr, msg);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (pgm1.height != pgm2.height) {
-    asfPrintWarning("File1 and File2 have a differing numbers of rows (%d v. "
-		    "%d).\nPSNR calculation will only use the first %d rows "
-		    "from each file.\n", pgm1.height, pgm2.height, height);
-  }
-  if (pgm1.width != pgm2.width) {
-    asfPrintWarning("File1 and File2 have a different number of pixels per row "
-		    "(%d v. %d).\nPSNR calculation will only use the first %d "
-		    "pixels from each row of data.\n",
-		    pgm1.width, pgm2.width, width);
-  }
-
-  if (pgm1.data_type != pgm2.data_type) {
-    sprintf(msg,"PPM/PGM files have differing data types.\n");
-    asfPrintWarning(msg);
-    if (outputFP != NULL) fprintf(outputFP, msg);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    if (outputFP) FCLOSE(outputFP); else fprintf(stderr, msg);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  char **band_names1, **band_names2;
-  int num_names_extracted1=0, num_names_extracted2=0;
-  get_band_names(inFile1, NULL, &band_names1, &num_names_extracted1);
-  get_band_names(inFile2, NULL, &band_names2, &num_names_extracted2);
-  asfPrintStatus("\nCalculating PSNR between\n  Band %s in %s and\n  Band %s "
-		 "in %s\n",
-                 band_names1[band1], inFile1, band_names2[band2], inFile2);
-  float *buf1 = (float*)CALLOC(pgm1.width, sizeof(float));
-  float *buf2 = (float*)CALLOC(pgm2.width, sizeof(float));
-  if (buf1 == NULL || buf2 == NULL) {
-    asfPrintWarning("Cannot allocate memory for PNG data buffers.\n");
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    if (buf1) FREE(buf1);
-    if (buf2) FREE(buf2);
-    if (outputFP) fprintf(outputFP, msg); else fprintf(stderr, msg);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    if (outputFP) FCLOSE(outputFP);
-    return;
-  }
-
-  sse = 0.0;
-  // Since both file's data types are the same, this is OK
-  max_val = get_maxval(pgm1.data_type); 
-  fp1 = (FILE*)FOPEN(inFile1, "rb");
-  fp2 = (FILE*)FOPEN(inFile2, "rb");
-  FSEEK64(fp1, (long long)pgm1.img_offset, SEEK_SET);
-  FSEEK64(fp2, (long long)pgm2.img_offset, SEEK_SET);
-  for (ii=0; ii<height; ++ii) {
-    asfPercentMeter((double)ii/(double)height);
-    // Get float lines
-    ppm_pgm_get_float_line(fp1, buf1, ii, &pgm1, band1);
-    ppm_pgm_get_float_line(fp2, buf2, ii, &pgm2, band2);
-    for (jj=0; jj<width; ++jj) {
-      cs1 = buf1[jj];
-      cs2 = buf2[jj];
-      sse += (cs1 - cs2) * (cs1 - cs2);
-      pixel_count++;
-    }
-  }
-  asfPercentMeter(1.0);
-  if (pixel_count > 0 && max_val > 0) {
-    rmse = sqrt(sse/pixel_count);
-    psnr->psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
-    psnr->psnr_good = 1;
-  }
-  else {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-  }
-
-  if (fp1) FCLOSE(fp1);
-  if (fp2) FCLOSE(fp2);
-  if (outputFP) FCLOSE(outputFP);
-  if (buf1) FREE(buf1);
-  if (buf2) FREE(buf2);
-  free_band_names(&band_names1, num_names_extracted1);
-  free_band_names(&band_names2, num_names_extracted2);
-}
-
 void free_band_names(char ***band_names, int num_extracted_bands)
 {
   if (*band_names != NULL) {
@@ -5266,408 +4435,6 @@ GLOBAL(void) get_jpeg_info_hdr_from_file(char *inFile, jpeg_info_t *jpg,
   if (fp) FCLOSE(fp);
 }
 
-GLOBAL(void) jpeg_image_band_statistics_from_file(char *inFile, char *outfile,
-						  int band_no, int *stats_exist,
-						  double *min, double *max,
-						  double *mean, double *sdev, 
-						  double *rmse,
-						  int use_mask_value, 
-						  float mask_value)
-{
-  jpeg_info_t jpg;
-  char msg[1024];
-  struct jpeg_decompress_struct cinfo;
-  FILE *outFP = NULL;
-  jpeg_error_hdlr_t jerr;
-  JSAMPARRAY jpg_buf;
-
-  *stats_exist = 1; // Innocent until presumed guilty...
-  get_jpeg_info_hdr_from_file(inFile, &jpg, outfile);
-  if (jpg.width <= 0 ||
-      jpg.height <= 0 ||
-      jpg.data_type != BYTE ||
-      jpg.num_bands <= 0) {
-    *stats_exist = 0;
-    return;
-  }
-
-  // Minimum and maximum sample values as integers.
-  double fmin = FLT_MAX;
-  double fmax = -FLT_MAX;
-  double cs; // Current sample value
-
-  *mean = 0.0;
-  double s = 0.0;
-
-  uint32 sample_count = 0;      // Samples considered so far.
-  uint32 jj;
-  FILE *fp = FOPEN(inFile, "rb");
-  if (fp == NULL) {
-    *stats_exist = 0;
-    return;
-  }
-
-  // Setup jpeg lib error handler
-  cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = jpeg_err_exit; // Error hook to catch jpeg lib errors
-  if (setjmp(jerr.setjmp_buffer)) {
-    // JPEG lib error occurred
-    jpeg_destroy_decompress (&cinfo);
-    if (fp) FCLOSE(fp);
-    sprintf(msg,"JPEG library critical error ...Aborting\n");
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    asfPrintError(msg);
-  }
-
-  // Init jpeg lib to read
-  jpeg_create_decompress(&cinfo); // Init decompression object
-  jpeg_stdio_src(&cinfo, fp); // Set input to open inFile
-
-  // Read jpeg file header
-  jpeg_read_header(&cinfo, TRUE);
-  jpeg_start_decompress(&cinfo);
-
-  // Allocate buffer for reading jpeg
-  jpg_buf = (*cinfo.mem->alloc_sarray) 
-    ((j_common_ptr)&cinfo, JPOOL_IMAGE, jpg.byte_width, 1);
-
-  // If there is a mask value we are supposed to ignore,
-  if ( use_mask_value ) {
-    // iterate over all rows in the PPM or PGM file
-    while (cinfo.output_scanline < cinfo.image_height) {
-      asfPercentMeter((double)cinfo.output_scanline/(double)jpg.height);
-      jpeg_read_scanlines(&cinfo, jpg_buf, 1); // Reads one scanline
-      for (jj = 0 ; jj < jpg.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        if (jpg.num_bands == 1) {
-          cs = (float)jpg_buf[0][jj];
-        }
-        else if (jpg.num_bands == 3) {
-          cs = (float)jpg_buf[0][jj*3+band_no];
-        }
-        else {
-          // Shouldn't get here...
-          *stats_exist = 0;
-          return;
-        }
-        if ( !isnan(mask_value) && 
-	     (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-          continue;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  else {
-    // There is no mask value to ignore, so we do the same as the
-    // above loop, but without the possible continue statement.
-    while (cinfo.output_scanline < cinfo.image_height) {
-      asfPercentMeter((double)cinfo.output_scanline/(double)jpg.height);
-      jpeg_read_scanlines(&cinfo, jpg_buf, 1); // Reads one scanline
-      for (jj = 0 ; jj < jpg.width; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        if (jpg.num_bands == 1) {
-          cs = (float)jpg_buf[0][jj];
-        }
-        else if (jpg.num_bands == 3) {
-          cs = (float)jpg_buf[0][jj*3+band_no];
-        }
-        else {
-          // Shouldn't get here...
-          *stats_exist = 0;
-          return;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = *mean;
-        *mean += (cs - *mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - *mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
-  }
-  
-  // Verify the new extrema have been found.
-  if (gsl_fcmp (fmin, FLT_MAX, 0.00000000001) == 0 ||
-      gsl_fcmp (fmax, -FLT_MAX, 0.00000000001) == 0) {
-    if (fp) FCLOSE(fp);
-    *stats_exist = 0;
-    return;
-  }
-  
-  *min = fmin;
-  *max = fmax;
-  *sdev = sqrt (s / (sample_count - 1));
-  *rmse = *sdev; 
-  // This assumes the sample count is large enough to ensure that the sample 
-  // standard deviation is very very similar to the population standard 
-  // deviation.
-
-  // The new extrema had better be in the range supported range
-  if (fabs(*mean) > FLT_MAX || fabs(*sdev) > FLT_MAX) {
-    if (fp) FCLOSE(fp);
-    *stats_exist = 0;
-    return;
-  }
-  
-  // Finish up
-  jpeg_finish_decompress(&cinfo);
-  jpeg_destroy_decompress(&cinfo);
-  if (fp) FCLOSE(fp);
-  if (outFP) FCLOSE(outFP);
-  return;
-}
-
-GLOBAL(void) jpeg_image_band_psnr_from_files(char *inFile1, char *inFile2, 
-					     char *outfile, int band1, 
-					     int band2, psnr_t *psnr)
-{
-  jpeg_info_t jpg1, jpg2;
-  char msg[1024];
-  struct jpeg_decompress_struct cinfo1, cinfo2;
-  FILE *outFP=NULL, *fp1=NULL, *fp2=NULL;
-  jpeg_error_hdlr_t jerr1, jerr2;
-  JSAMPARRAY jpg_buf1, jpg_buf2;
-  float cs1, cs2;
-
-  fp1 = (FILE*)FOPEN(inFile1, "rb");
-  fp2 = (FILE*)FOPEN(inFile2, "rb");
-  if (fp1 == NULL) {
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP)
-        fprintf(outFP, "Cannot open file: %s\n", inFile1);
-    else
-        fprintf(stderr, "Cannot open file: %s\n", inFile1);
-    if (outFP) FCLOSE(outFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (fp2 == NULL) {
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP)
-      fprintf(outFP, "Cannot open file: %s\n", inFile2);
-    else
-      fprintf(stderr, "Cannot open file: %s\n", inFile2);
-    if (outFP) FCLOSE(outFP);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  get_jpeg_info_hdr_from_file(inFile1, &jpg1, outfile);
-  if (jpg1.width <= 0 ||
-      jpg1.height <= 0 ||
-      jpg1.data_type != BYTE ||
-      jpg1.num_bands <= 0) {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  get_jpeg_info_hdr_from_file(inFile2, &jpg2, outfile);
-  if (jpg2.width <= 0 ||
-      jpg2.height <= 0 ||
-      jpg2.data_type != BYTE ||
-      jpg2.num_bands <= 0) {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  // Setup jpeg lib error handlers
-  cinfo1.err = jpeg_std_error(&jerr1.pub);
-  jerr1.pub.error_exit = jpeg_err_exit; // Error hook to catch jpeg lib errors
-  if (setjmp(jerr1.setjmp_buffer)) {
-    // JPEG lib error occurred
-    jpeg_destroy_decompress (&cinfo1);
-    jpeg_destroy_decompress (&cinfo2);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    sprintf(msg,"JPEG library critical error ...Aborting\n");
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    asfPrintError(msg);
-  }
-  cinfo2.err = jpeg_std_error(&jerr2.pub);
-  jerr2.pub.error_exit = jpeg_err_exit; // Error hook to catch jpeg lib errors
-  if (setjmp(jerr2.setjmp_buffer)) {
-    // JPEG lib error occurred
-    jpeg_destroy_decompress (&cinfo1);
-    jpeg_destroy_decompress (&cinfo2);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    sprintf(msg,"JPEG library critical error ...Aborting\n");
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    asfPrintError(msg);
-  }
-
-  // Init jpeg lib to read files
-  jpeg_create_decompress(&cinfo1); // Init decompression object
-  jpeg_stdio_src(&cinfo1, fp1); // Set input to open inFile
-  jpeg_create_decompress(&cinfo2); // Init decompression object
-  jpeg_stdio_src(&cinfo2, fp2); // Set input to open inFile
-
-  // Read jpeg file headers
-  jpeg_read_header(&cinfo1, TRUE);
-  jpeg_start_decompress(&cinfo1);
-  jpeg_read_header(&cinfo2, TRUE);
-  jpeg_start_decompress(&cinfo2);
-
-  // Allocate buffers for reading jpeg
-  jpg_buf1 = (*cinfo1.mem->alloc_sarray) 
-    ((j_common_ptr)&cinfo1, JPOOL_IMAGE, jpg1.byte_width, 1);
-  jpg_buf2 = (*cinfo2.mem->alloc_sarray) 
-    ((j_common_ptr)&cinfo2, JPOOL_IMAGE, jpg2.byte_width, 1);
-
-  // Calculate the peak signal to noise ratio (PSNR) between the two images
-  double sse;
-  double rmse;
-  int jj;
-  long height = MIN(jpg1.height, jpg2.height);
-  long width = MIN(jpg1.width, jpg2.width);
-  long pixel_count = 0;
-  float max_val;
-  if (band1 < 0 || band1 > jpg1.num_bands - 1 ||
-      band2 < 0 || band2 > jpg2.num_bands - 1) {
-    sprintf(msg,"Invalid band number for file1 (%d v. %d) or file2 (%d v. %d)"
-	    "\n", band1, jpg1.num_bands, band2, jpg2.num_bands);
-    asfPrintWarning(msg);
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (jpg1.height != jpg2.height) {
-    asfPrintWarning("File1 and File2 have a differing numbers of rows (%d v. "
-		    "%d).\nPSNR calculation will only use the first %d rows "
-		    "from each file.\n", jpg1.height, jpg2.height, height);
-  }
-  if (jpg1.width != jpg2.width) {
-    asfPrintWarning("File1 and File2 have a different number of pixels per row "
-		    "(%d v. %d).\nPSNR calculation will only use the first %d "
-		    "pixels from each row of data.\n",
-		    jpg1.width, jpg2.width, width);
-  }
-
-  if (jpg1.data_type != jpg2.data_type) {
-    sprintf(msg,"Input JPEG files have differing data types.\n");
-    asfPrintWarning(msg);
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-  if (jpg1.num_bands != jpg2.num_bands) {
-    sprintf(msg,"Input JPEG files have a different number of bands (%d v. %d)"
-	    "\n", jpg1.num_bands, jpg2.num_bands);
-    asfPrintWarning(msg);
-    if (outfile && strlen(outfile) > 0) 
-      outFP = (FILE*)FOPEN(outfile,"a"); 
-    else 
-      outFP = NULL;
-    if (outFP) fprintf(outFP, msg); else fprintf(stderr, msg);
-    if (outFP) FCLOSE(outFP);
-    if (fp1) FCLOSE(fp1);
-    if (fp2) FCLOSE(fp2);
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-    return;
-  }
-
-  char **band_names1, **band_names2;
-  int num_names_extracted1=0, num_names_extracted2=0;
-  get_band_names(inFile1, NULL, &band_names1, &num_names_extracted1);
-  get_band_names(inFile2, NULL, &band_names2, &num_names_extracted2);
-  asfPrintStatus("\nCalculating PSNR between\n  Band %s in %s and\n  Band %s "
-		 "in %s\n",
-                 band_names1[band1], inFile1, band_names2[band2], inFile2);
-
-  sse = 0.0;
-  // Since both file's data types are the same, this is OK
-  max_val = get_maxval(jpg1.data_type); 
-  while (cinfo1.output_scanline < height &&
-         cinfo2.output_scanline < height) {
-    asfPercentMeter((double)cinfo1.output_scanline/(double)jpg1.height);
-    jpeg_read_scanlines(&cinfo1, jpg_buf1, 1); // Reads one scanline
-    jpeg_read_scanlines(&cinfo2, jpg_buf2, 1); // Reads one scanline
-    for (jj=0; jj<width; ++jj) {
-      cs1 = (float)jpg_buf1[0][jj];
-      cs2 = (float)jpg_buf2[0][jj];
-      sse += (cs1 - cs2) * (cs1 - cs2);
-      pixel_count++;
-    }
-  }
-  asfPercentMeter(1.0);
-  // Read any unread lines so the jpeg library won't complain when 
-  // jpeg_finish_decompress() and jpeg_destroy_decompress() are called...
-  while (cinfo1.output_scanline < jpg1.height) {
-    jpeg_read_scanlines(&cinfo1, jpg_buf1, 1);
-  }
-  while (cinfo2.output_scanline < jpg2.height) {
-    jpeg_read_scanlines(&cinfo2, jpg_buf2, 1);
-  }
-  if (pixel_count > 0 && max_val > 0) {
-    rmse = sqrt(sse/pixel_count);
-    psnr->psnr = 10.0 * log10(max_val/(rmse+.00000000000001));
-    psnr->psnr_good = 1;
-  }
-  else {
-    psnr->psnr = MISSING_PSNR;
-    psnr->psnr_good = 0;
-  }
-
-  jpeg_finish_decompress(&cinfo1);
-  jpeg_destroy_decompress(&cinfo1);
-  jpeg_finish_decompress(&cinfo2);
-  jpeg_destroy_decompress(&cinfo2);
-  if (fp1) FCLOSE(fp1);
-  if (fp2) FCLOSE(fp2);
-  if (outFP) FCLOSE(outFP);
-  free_band_names(&band_names1, num_names_extracted1);
-  free_band_names(&band_names2, num_names_extracted2);
-}
-
 // Creates and writes VERY simple metadata file to coax the fftMatch() functions
 // to work.  The only requirements are that the number of lines and samples, and
 // data type, are required.  The rest of the metadata is ignored.
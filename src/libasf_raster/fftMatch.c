@@ -155,6 +155,37 @@ static void findPeak(float *corrImage,float *dx,float *dy,float *doubt,
 }
 
 
+/* spectProd: conjugates the spectrum in2, multiplies it by in1 and
+   zeroes out the low frequencies.  The product is left in in2.*/
+static void spectProd(float *in1,float *in2,int nl,int ns)
+{
+  register int x,y,l;
+
+  /*Conjugate in2.*/
+  //asfPrintStatus("Conjugate Image 2\n");
+  for (y=0;y<nl;y++) {
+    l=ns*y;
+    x = (y < 2) ? 1 : 0;
+    //if (y<2) x=1; else x=0;
+    for (;x<ns/2;x++) {
+      in2[l+2*x+1]*=-1.0;
+    }
+  }
+
+  /*Take complex product of in1 and in2 into in2.*/
+  //asfPrintStatus("Complex Product\n");
+  rspect2dprod(in1,in2,in2,nl,ns);
+
+  /*Zero out the low frequencies of the correlation image.*/
+  //asfPrintStatus("Zero low frequencies.\n");
+  for (y=0;y<4;y++) {
+    l=ns*y;
+    for (x=0;x<8;x++) in2[l+x]=0;
+    l=ns*(nl-1-y);
+    for (x=0;x<8;x++) in2[l+x]=0;
+  }
+}
+
 /* las_fftProd: reads both given files, and correlates them into the
 created outReal (nl x ns) float array.*/
 static void fftProd(FILE *in1F,meta_parameters *metaMaster,
@@ -205,29 +236,8 @@ static void fftProd(FILE *in1F,meta_parameters *metaMaster,
   //asfPrintStatus("FFT Image 1\n");
   rfft2d(in1,mY,mX);
 
-  /*Conjugate in2.*/
-  //asfPrintStatus("Conjugate Image 2\n");
-  for (y=0;y<nl;y++) {
-    l=ns*y;
-    x = (y < 2) ? 1 : 0;
-    //if (y<2) x=1; else x=0;
-    for (;x<ns/2;x++) {
-      in2[l+2*x+1]*=-1.0;
-    }
-  }
-
-  /*Take complex product of in1 and in2 into out.*/
-  //asfPrintStatus("Complex Product\n");
-  rspect2dprod(in1,in2,out,nl,ns);
-
-  /*Zero out the low frequencies of the correlation image.*/
-  //asfPrintStatus("Zero low frequencies.\n");
-  for (y=0;y<4;y++) {
-    l=ns*y;
-    for (x=0;x<8;x++) out[l+x]=0;
-    l=ns*(nl-1-y);
-    for (x=0;x<8;x++) out[l+x]=0;
-  }
+  /*Correlate the spectra into out (== in2)*/
+  spectProd(in1,in2,nl,ns);
 
   /*Inverse-fft the product*/
   //asfPrintStatus("I-FFT\n");
@@ -364,3 +374,109 @@ void fftMatch_withOffsetFile(char *inFile1, char *inFile2, char *corrFile,
     FCLOSE(descF);
   }
 }
+
+/* Same as readImage, but copies out of an in-memory (src_nl x src_ns)
+   image instead of reading from a file. */
+static void copyImage(const float *src,int src_nl,int src_ns,
+              int startX,int startY,int delX,int delY,
+              float add,float *sum, float *dest, int nl, int ns)
+{
+  register int x,y,l;
+  double tempSum=0;
+  const double maxval = ((double)MAXFLOAT) / ((double)ns*nl);
+
+  for (y=0;y<delY;y++) {
+      const float *inBuf=src+(long)src_ns*(startY+y);
+      l=ns*y;
+      for (x=0;x<delX;x++) {
+          if (fabs(inBuf[startX+x]) < maxval && meta_is_valid_double(inBuf[startX+x])) {
+              tempSum+=inBuf[startX+x];
+              dest[l+x]=inBuf[startX+x]+add;
+          }
+          else {
+              dest[l+x]=0.0;
+          }
+      }
+      for (x=delX;x<ns;x++) {
+          dest[l+x]=0.0;
+      }
+  }
+  for (y=delY;y<nl;y++) {
+      l=ns*y;
+      for (x=0;x<ns;x++) {
+          dest[l+x]=0.0;
+      }
+  }
+  if (sum!=NULL) {
+      *sum=(float)tempSum;
+  }
+}
+
+/* log2 of the FFT size fftMatch uses for an image dimension */
+static int fftSize(int n, int max_m)
+{
+  int m = (int)(log((float)n)/log(2.0)+0.5);
+  return m > max_m ? max_m : m;
+}
+
+/* Sets up the FFT tables for a later fftMatch_buffers() call on a master
+   image of (nl x ns) pixels.  This part isn't thread safe, so it must
+   be called (for every image size that will be used) before starting
+   any threads that call fftMatch_buffers(). */
+void fftMatch_buffers_init(int nl, int ns)
+{
+  fft2dInit(fftSize(nl,15), fftSize(ns,13));
+}
+
+/* In-memory version of fftMatch: finds the offset of img2 (the slave)
+   relative to img1 (the master), using the same chip size, search
+   distance and peak fitting that fftMatch uses on files.  Nothing is
+   printed, and all scratch space is private to the call, so several
+   threads can run fftMatch_buffers() at once (see fftMatch_buffers_init).
+   Invalid (NaN or crazy big) pixels are set to zero. */
+void fftMatch_buffers(const float *img1, int nl1, int ns1,
+                      const float *img2, int nl2, int ns2,
+                      float *bestLocX, float *bestLocY, float *certainty)
+{
+  int mX = fftSize(ns1,13), mY = fftSize(nl1,15);
+  int ns = 1<<mX, nl = 1<<mY;
+  int x,y,l;
+  float aveChip, doubt;
+
+  int chipDX=MINI(ns2,ns)*3/4;
+  int chipDY=MINI(nl2,nl)*3/4;
+  int chipX=MINI(ns2,ns)/8;
+  int chipY=MINI(nl2,nl)/8;
+  int searchX=MINI(ns2,ns)*3/8;
+  int searchY=MINI(nl2,nl)*3/8;
+  float scaleFact=1.0/(chipDX*chipDY);
+
+  float *in1=(float *)MALLOC(sizeof(float)*ns*nl);
+  float *in2=(float *)MALLOC(sizeof(float)*ns*nl);
+  float *work=(float *)MALLOC(sizeof(float)*fft2dWorkSize(mY));
+
+  /*Chip from image 2, with its average brightness removed*/
+  copyImage(img2,nl2,ns2,chipX,chipY,chipDX,chipDY,0.0,&aveChip,in2,nl,ns);
+  aveChip/=-(float)chipDY*chipDX;
+  for (y=0;y<chipDY;y++) {
+    l=ns*y;
+    for (x=0;x<chipDX;x++) {
+      in2[l+x]=(in2[l+x]+aveChip)*scaleFact;
+    }
+  }
+  rfft2d_r(in2,mY,mX,work);
+
+  copyImage(img1,nl1,ns1,0,0,MINI(ns1,ns),MINI(nl1,nl),aveChip,NULL,
+            in1,nl,ns);
+  rfft2d_r(in1,mY,mX,work);
+
+  spectProd(in1,in2,nl,ns);
+  rifft2d_r(in2,mY,mX,work);
+
+  findPeak(in2,bestLocX,bestLocY,&doubt,nl,ns,chipX,chipY,searchX,searchY);
+  *certainty = 1-doubt;
+
+  FREE(in1);
+  FREE(in2);
+  FREE(work);
+}
@@ -2,14 +2,15 @@
 FUNCTION NAME:   interpolate - performs the interpolation to calculate
                  the pixel value e.g. during resampling
 
-INPUT: interpolation  - interpolation method (nearest neighbor, bilinear, sinc)
+INPUT: interpolation  - interpolation method (nearest neighbor, bilinear,
+                        bicubic, B-splines, sinc)
        inbuf          - input image buffer
        nLines         - number of lines (image buffer)
        nSamples       - number of samples per line (image buffer)
        xLine          - line of interest
        xSample        - sample position within line
        weighting      - weighting function to be applied (Kaiser, Hamming)
-       nKernel        - kernel size for sinc function
+       sinc_points    - kernel size for sinc function (8 to 32)
 *******************************************************************/
 #include <assert.h>
 #include <math.h>
@@ -81,137 +82,348 @@ INPUT: interpolation  - interpolation method (nearest neighbor, bilinear, sinc)
 //  return inbuf[nSamples * jj + ii];
 //}
 
+// Samples to B-spline coefficients conversion (M. Unser, "Splines: a
+// perfect fit for signal and image processing", IEEE Signal Processing
+// Magazine, 1999), for cubic splines with mirror boundary conditions.
+// The recursive filter is applied along every line ('x') or every
+// column ('y') of the image, in place.
+#define SPLINE_TOLERANCE 1e-9
+
+static void spline_coefficients_1d(float *c, int n)
+{
+  double z = sqrt(3.0) - 2.0;
+  double lambda = (1.0 - z) * (1.0 - 1.0/z);
+  double sum, zn;
+  int ii, horizon;
+
+  if (n < 2)
+    return;
+
+  // Apply overall gain
+  for (ii=0; ii<n; ii++)
+    c[ii] *= lambda;
+
+  // Causal initialization: the influence of the mirrored samples decays
+  // as z^k, so only the first few samples matter
+  horizon = (int)ceil(log(SPLINE_TOLERANCE)/log(fabs(z)));
+  if (horizon > n)
+    horizon = n;
+  sum = c[0];
+  zn = z;
+  for (ii=1; ii<horizon; ii++) {
+    sum += zn * c[ii];
+    zn *= z;
+  }
+  c[0] = sum;
+
+  // Causal recursion
+  for (ii=1; ii<n; ii++)
+    c[ii] += z * c[ii-1];
+
+  // Anticausal initialization
+  c[n-1] = (z/(z*z - 1.0)) * (z*c[n-2] + c[n-1]);
+
+  // Anticausal recursion
+  for (ii=n-2; ii>=0; ii--)
+    c[ii] = z * (c[ii+1] - c[ii]);
+}
+
 void samples2coefficients(FloatImage *inbuf, char dimension)
 {
   int ii, kk;
-  float z = sqrt(3.0) - 2.0;
-  float lambda = (1.0 - z) * (1.0 - 1.0/z);
-  float value;
+  int nx = inbuf->size_x, ny = inbuf->size_y;
+  float *line;
 
-  // Apply overall gain
-  for (ii=0; ii<inbuf->size_x; ii++)
-    for (kk=0; kk<inbuf->size_y; kk++) {
-      value = GET_PIXEL(ii,kk) * lambda;
-      SET_PIXEL(ii,kk,value);
+  if (dimension == 'x') {
+    line = (float *) MALLOC(sizeof(float)*nx);
+    for (kk=0; kk<ny; kk++) {
+      for (ii=0; ii<nx; ii++)
+        line[ii] = GET_PIXEL(ii,kk);
+      spline_coefficients_1d(line, nx);
+      for (ii=0; ii<nx; ii++)
+        SET_PIXEL(ii,kk,line[ii]);
+    }
+  }
+  else {
+    line = (float *) MALLOC(sizeof(float)*ny);
+    for (ii=0; ii<nx; ii++) {
+      for (kk=0; kk<ny; kk++)
+        line[kk] = GET_PIXEL(ii,kk);
+      spline_coefficients_1d(line, ny);
+      for (kk=0; kk<ny; kk++)
+        SET_PIXEL(ii,kk,line[kk]);
     }
+  }
+  FREE(line);
+}
+
+// Sinc kernel tables:
+// Row k of the table holds the sinc_points weights for a point that
+// lies k/NUM_SINCS of the way between two samples, already multiplied
+// by the weighting window and normalized to unit sum.  Tables are built
+// on first use and kept for the life of the program; the first call
+// for each weighting/size pair should therefore not race with another
+// one (build them up front with sinc_kernel_get() if that matters).
+#define MIN_SINC_POINTS 8
+#define MAX_SINC_POINTS 32
+#define KAISER_BETA 6.0
 
-  for (kk=0; kk<inbuf->size_y; kk++) {
-    // Causal initialization (first pixel of line)
-    
+struct sinc_kernel_t {
+  weighting_type_t weighting;
+  int points;               // kernel length (even)
+  float *weights;           // [NUM_SINCS+1][points]
+};
+
+static sinc_kernel_t *sinc_kernels[LANCZOS+1][MAX_SINC_POINTS+1];
+
+static double sinc(double x)
+{
+  return x == 0 ? 1.0 : sin(M_PI*x)/(M_PI*x);
+}
+
+// Window value at distance x from the kernel center, half is the
+// kernel half-width
+static double sinc_window(weighting_type_t weighting, double x, double half)
+{
+  double r = x/half;
+  if (fabs(r) > 1.0)
+    return 0.0;
+  switch (weighting)
+    {
+    case HAMMING:
+      return 0.54 + 0.46*cos(M_PI*r);
+    case KAISER:
+      return gsl_sf_bessel_I0(KAISER_BETA*sqrt(1.0 - r*r)) /
+        gsl_sf_bessel_I0(KAISER_BETA);
+    case LANCZOS:
+      return sinc(r);
+    case NO_WEIGHT:
+    default:
+      return 1.0;
+    }
+}
+
+sinc_kernel_t *sinc_kernel_get(weighting_type_t weighting, int sinc_points)
+{
+  int ii, kk;
+
+  // Even kernel lengths within the supported range only
+  if (sinc_points < MIN_SINC_POINTS)
+    sinc_points = MIN_SINC_POINTS;
+  else if (sinc_points > MAX_SINC_POINTS)
+    sinc_points = MAX_SINC_POINTS;
+  sinc_points &= ~1;
+  if (weighting < NO_WEIGHT || weighting > LANCZOS)
+    weighting = NO_WEIGHT;
+
+  if (!sinc_kernels[weighting][sinc_points]) {
+    sinc_kernel_t *kernel = (sinc_kernel_t *) MALLOC(sizeof(sinc_kernel_t));
+    int half = sinc_points/2;
+    kernel->weighting = weighting;
+    kernel->points = sinc_points;
+    kernel->weights = (float *) MALLOC(sizeof(float)*(NUM_SINCS+1)*sinc_points);
+    for (kk=0; kk<=NUM_SINCS; kk++) {
+      double frac = (double)kk/NUM_SINCS, sum = 0.0, w[MAX_SINC_POINTS];
+      // Tap ii sits on sample (floor(x) - half + 1 + ii)
+      for (ii=0; ii<sinc_points; ii++) {
+        double d = (ii - half + 1) - frac;
+        w[ii] = sinc(d) * sinc_window(weighting, d, half);
+        sum += w[ii];
+      }
+      for (ii=0; ii<sinc_points; ii++)
+        kernel->weights[kk*sinc_points + ii] = w[ii]/sum;
+    }
+    sinc_kernels[weighting][sinc_points] = kernel;
   }
 
-  // Causal recursion
+  return sinc_kernels[weighting][sinc_points];
+}
+
+// Returns the kernel weights for a point at the given fraction [0,1]
+// of the way from one sample to the next
+const float *sinc_kernel_weights(const sinc_kernel_t *kernel, float frac)
+{
+  int kk = (int)(frac*NUM_SINCS + 0.5);
+  if (kk < 0) kk = 0;
+  if (kk > NUM_SINCS) kk = NUM_SINCS;
+  return &kernel->weights[kk*kernel->points];
+}
+
+static float interpolate_nearest(FloatImage *inbuf, float yLine, float xSample)
+{
+  int ix = (int) (xSample + 0.5);
+  int iy = (int) (yLine + 0.5);
+  return GET_PIXEL(ix,iy);
+}
+
+static float interpolate_bilinear(FloatImage *inbuf, float yLine, 
+				  float xSample)
+{
+  int ix, iy;
+  float a00, a10, a01, a11;
+
+  assert (xSample >= 0.0);
+  assert (yLine >= 0.0);
+  assert (xSample <= inbuf->size_x - 1);
+  assert (yLine <= inbuf->size_y - 1);
+  ix = floor(xSample);
+  iy = floor(yLine);
   
-  // Anticausal initialization
+  a00 = GET_PIXEL(ix,iy);
+  a10 = GET_PIXEL(ix+1,iy) - GET_PIXEL(ix,iy);
+  a01 = GET_PIXEL(ix,iy+1) - GET_PIXEL(ix,iy);
+  a11 = GET_PIXEL(ix,iy) - GET_PIXEL(ix+1,iy) - GET_PIXEL(ix,iy+1) 
+    + GET_PIXEL(ix+1,iy+1);
+  return (a00 + a10 * (xSample - ix) + a01 * (yLine - iy) 
+	  + a11 * (xSample - ix) * (yLine - iy));
+}
+
+static float interpolate_bicubic(FloatImage *inbuf, float yLine, 
+				 float xSample)
+{
+  int ix, iy, ii, kk;
+  float value, dx, dy, wx[4], wy[4];
+
+  assert (xSample >= 0.0);
+  assert (yLine >= 0.0);
+  assert (xSample <= inbuf->size_x - 1);
+  assert (yLine <= inbuf->size_y - 1);
+  ix = floor(xSample);
+  iy = floor(yLine);
+  dx = xSample - ix;
+  dy = yLine - iy;
   
-  // Anticausal recursion
+  // Calculating weights
+  for (ii=-1; ii<=2; ii++) {
+    wx[ii+1] = 1.0/6.0 * (CUBE(P(ii-dx+2)) - 4*CUBE(P(ii-dx+1)) 
+			  + 6*CUBE(P(ii-dx)) - 4*CUBE(P(ii-dx-1)));
+    wy[ii+1] = 1.0/6.0 * (CUBE(P(dy-ii+2)) - 4*CUBE(P(dy-ii+1)) 
+			  + 6*CUBE(P(dy-ii)) - 4*CUBE(P(dy-ii-1)));
+  }
   
+  // Get the interpolated pixel value
+  value = 0.0;
+  for (ii=-1; ii<=2; ii++)
+    for (kk=-1; kk<=2; kk++)
+      value += GET_PIXEL(ix+ii,iy+kk) * wx[ii+1] * wy[kk+1];
+  
+  return value;
+}
+
+// Cubic B-spline interpolation.  inbuf has to hold B-spline
+// coefficients, i.e. have been run through samples2coefficients() in
+// both dimensions first.
+static float interpolate_splines(FloatImage *inbuf, float yLine, 
+				 float xSample)
+{
+  int ii, kk, xI[4], yI[4];
+  int nx = inbuf->size_x, ny = inbuf->size_y;
+  float value, w, wx[4], wy[4];
+
+  // Calculate interpolation indices (mirrored at the image edges below)
+  for (ii=0; ii<=3; ii++) {
+    xI[ii] = (int)floor(xSample) - 1 + ii;
+    yI[ii] = (int)floor(yLine) - 1 + ii;
+  }
+
+  // Calculate interpolation weights
+  w = xSample - (float)xI[1];
+  wx[3] = (1.0/6.0)*CUBE(w);
+  wx[0] = (1.0/6.0) + (1.0/2.0)*w*(w-1.0) - wx[3];
+  wx[2] = w + wx[0] - 2.0*wx[3];
+  wx[1] = 1.0 - wx[0] - wx[2] - wx[3];
+  w = yLine - (float)yI[1];
+  wy[3] = (1.0/6.0)*CUBE(w);
+  wy[0] = (1.0/6.0) + (1.0/2.0)*w*(w-1.0) - wy[3];
+  wy[2] = w + wy[0] - 2.0*wy[3];
+  wy[1] = 1.0 - wy[0] - wy[2] - wy[3];
+
+  for (ii=0; ii<=3; ii++) {
+    if (xI[ii] < 0) xI[ii] = -xI[ii];
+    if (xI[ii] >= nx) xI[ii] = 2*nx - 2 - xI[ii];
+    if (yI[ii] < 0) yI[ii] = -yI[ii];
+    if (yI[ii] >= ny) yI[ii] = 2*ny - 2 - yI[ii];
+  }
+
+  // Get interpolation value
+  value = 0.0;
+  for (kk=0; kk<=3; kk++) {
+    w = 0.0;
+    for (ii=0; ii<=3; ii++)
+      w += wx[ii] * GET_PIXEL(xI[ii],yI[kk]);
+    value += wy[kk] * w;
+  }
+  return value;
+}
+
+// Separable windowed sinc interpolation from the kernel table.  Samples
+// beyond the image edges are replaced by the nearest edge sample.
+static float interpolate_sinc(FloatImage *inbuf, float yLine, float xSample,
+			      const sinc_kernel_t *kernel)
+{
+  int ii, kk, n = kernel->points, half = n/2;
+  int nx = inbuf->size_x, ny = inbuf->size_y;
+  int ix = floor(xSample);
+  int iy = floor(yLine);
+  const float *wx = sinc_kernel_weights(kernel, xSample - ix);
+  const float *wy = sinc_kernel_weights(kernel, yLine - iy);
+  int x0 = ix - half + 1, y0 = iy - half + 1;
+  float value = 0.0, row;
 
+  if (x0 >= 0 && x0 + n <= nx && y0 >= 0 && y0 + n <= ny) {
+    for (kk=0; kk<n; kk++) {
+      row = 0.0;
+      for (ii=0; ii<n; ii++)
+        row += wx[ii] * GET_PIXEL(x0+ii, y0+kk);
+      value += wy[kk] * row;
+    }
+  }
+  else {
+    for (kk=0; kk<n; kk++) {
+      int y = y0 + kk;
+      if (y < 0) y = 0;
+      if (y >= ny) y = ny - 1;
+      row = 0.0;
+      for (ii=0; ii<n; ii++) {
+        int x = x0 + ii;
+        if (x < 0) x = 0;
+        if (x >= nx) x = nx - 1;
+        row += wx[ii] * GET_PIXEL(x, y);
+      }
+      value += wy[kk] * row;
+    }
+  }
+  return value;
 }
 
 float interpolate(interpolate_type_t interpolation, FloatImage *inbuf, float yLine, 
 		  float xSample, weighting_type_t weighting, int sinc_points)
 {
-  int ix, iy, ii, kk, ll, xI[4], yI[4];
-  float a00, a10, a01, a11;
-  float value, dx, dy, wx[4], wy[4], w;
-             
-  /* Get closed pixel position to start from */
+  float value = 0.0;
 
   switch ( interpolation ) 
     {
     case NEAREST:
-      ix = (int) (xSample + 0.5);
-      iy = (int) (yLine + 0.5);
-      value = GET_PIXEL(ix,iy);
+      value = interpolate_nearest(inbuf, yLine, xSample);
       break;
-
     case BILINEAR:
-      assert (xSample >= 0.0);
-      assert (yLine >= 0.0);
-      assert (xSample <= inbuf->size_x - 1);
-      assert (yLine <= inbuf->size_y - 1);
-      ix = floor(xSample);
-      iy = floor(yLine);
-      
-      a00 = GET_PIXEL(ix,iy);
-      a10 = GET_PIXEL(ix+1,iy) - GET_PIXEL(ix,iy);
-      a01 = GET_PIXEL(ix,iy+1) - GET_PIXEL(ix,iy);
-      a11 = GET_PIXEL(ix,iy) - GET_PIXEL(ix+1,iy) - GET_PIXEL(ix,iy+1) 
-	+ GET_PIXEL(ix+1,iy+1);
-      value = (a00 + a10 * (xSample - ix) + a01 * (yLine - iy) 
-	       + a11 * (xSample - ix) * (yLine - iy));
+      value = interpolate_bilinear(inbuf, yLine, xSample);
       break;
-
     case BICUBIC:
-      assert (xSample >= 0.0);
-      assert (yLine >= 0.0);
-      assert (xSample <= inbuf->size_x - 1);
-      assert (yLine <= inbuf->size_y - 1);
-      ix = floor(xSample);
-      iy = floor(yLine);
-      dx = xSample - ix;
-      dy = yLine - iy;
-      
-      // Calculating weights
-      for (ii=-1; ii<=2; ii++) {
-	wx[ii+1] = 1.0/6.0 * (CUBE(P(ii-dx+2)) - 4*CUBE(P(ii-dx+1)) 
-			      + 6*CUBE(P(ii-dx)) - 4*CUBE(P(ii-dx-1)));
-	wy[ii+1] = 1.0/6.0 * (CUBE(P(dy-ii+2)) - 4*CUBE(P(dy-ii+1)) 
-			      + 6*CUBE(P(dy-ii)) - 4*CUBE(P(dy-ii-1)));
-      }
-      
-      // Get the interpolated pixel value
-      value = 0.0;
-      for (ii=-1; ii<=2; ii++)
-	for (kk=-1; kk<=2; kk++)
-	  value += GET_PIXEL(ix+ii,iy+kk) * wx[ii+1] * wy[kk+1];
-      
+      value = interpolate_bicubic(inbuf, yLine, xSample);
       break;
-      
     case SPLINES:
-      // Determine B-Spline coefficients.
-      // This is a essentially a pre-filtering applied to the entire image 
-      // that converts the image from a sample representation into a 
-      // representation based on B-spline coefficients. 
-      // Without this step the result would look blurry at the end.
-
-      // Convert samples to coefficients in x direction
-      samples2coefficients(inbuf, 'x');
-
-      // Convert samples to coefficients in y direction
-      samples2coefficients(inbuf, 'y');
-
-      // Calculate interpolation indices
-      ii = (int)floor(xSample) - 1;
-      kk = (int)floor(yLine) - 1;
-      for (ll=0; ll<=3; ll++) {
-	xI[ll] = ii++;
-	yI[ll] = kk++;
-      }
-
-      // Calculate interpolation weights
-      w = xSample - (float)xI[1];
-      wx[3] = (1.0/6.0)*CUBE(xSample);
-      wx[0] = (1.0/6.0) + (1.0/2.0)*w*(w-1.0) - wx[3];
-      wx[2] = w + wx[0] - 2.0*wx[3];
-      wx[1] = 1.0 - wx[0] - wx[2] - wx[3];
-      w = yLine - (float)yI[1];
-      wy[3] = (1.0/6.0)*CUBE(xSample);
-      wy[0] = (1.0/6.0) + (1.0/2.0)*w*(w-1.0) - wy[3];
-      wy[2] = w + wy[0] - 2.0*wy[3];
-      wy[1] = 1.0 - wy[0] - wy[2] - wy[3];
-
-      // Get interpolation value
-      value = 0.0;
-      for (kk=0; kk<=3; kk++) {
-	w = 0.0;
-	for (ii=0; ii<=3; ii++)
-	  w += wx[ii] * 1;
-	value += wy[kk] * w;
-      }
+      // The B-spline coefficients have to be determined first.  This is
+      // essentially a pre-filtering applied to the entire image that
+      // converts the image from a sample representation into a
+      // representation based on B-spline coefficients. Without this
+      // step the result would look blurry at the end.  As it covers the
+      // whole image, it is left to the caller: see samples2coefficients.
+      value = interpolate_splines(inbuf, yLine, xSample);
       break;
     case SINC:
+      value = interpolate_sinc(inbuf, yLine, xSample,
+			       sinc_kernel_get(weighting, sinc_points));
       break;
     default:
       assert (FALSE);
@@ -220,3 +432,42 @@ float interpolate(interpolate_type_t interpolation, FloatImage *inbuf, float yLi
 
   return value;
 }
+
+// Batched version of interpolate(): out[ii] is the value at
+// (yLine[ii], xSample[ii]), for ii in [0, n).  The method is picked,
+// and the sinc kernel looked up, once for the whole line.
+void interpolate_line(interpolate_type_t interpolation, FloatImage *inbuf,
+		      int n, const float *yLine, const float *xSample,
+		      weighting_type_t weighting, int sinc_points, float *out)
+{
+  int ii;
+  const sinc_kernel_t *kernel;
+
+  switch ( interpolation )
+    {
+    case NEAREST:
+      for (ii=0; ii<n; ii++)
+        out[ii] = interpolate_nearest(inbuf, yLine[ii], xSample[ii]);
+      break;
+    case BILINEAR:
+      for (ii=0; ii<n; ii++)
+        out[ii] = interpolate_bilinear(inbuf, yLine[ii], xSample[ii]);
+      break;
+    case BICUBIC:
+      for (ii=0; ii<n; ii++)
+        out[ii] = interpolate_bicubic(inbuf, yLine[ii], xSample[ii]);
+      break;
+    case SPLINES:
+      for (ii=0; ii<n; ii++)
+        out[ii] = interpolate_splines(inbuf, yLine[ii], xSample[ii]);
+      break;
+    case SINC:
+      kernel = sinc_kernel_get(weighting, sinc_points);
+      for (ii=0; ii<n; ii++)
+        out[ii] = interpolate_sinc(inbuf, yLine[ii], xSample[ii], kernel);
+      break;
+    default:
+      assert (FALSE);
+      break;
+  }
+}
@@ -33,6 +33,174 @@ int within_tol(double a, double b)
     return fabs(b) < tol ? fabs(a) < tol : fabs((a-b)/b) < tol;
 }
 
+int n_bad=0, n_ok=0;
+
+static void check(int ok, const char *name)
+{
+  if (ok)
+    ++n_ok;
+  else {
+    ++n_bad;
+    printf("Fail: %s\n", name);
+  }
+}
+
+// Smooth test pattern, well within the band limit of the sampling
+static double pattern(double x, double y)
+{
+  return cos(0.3*x + 0.1)*cos(0.2*y - 0.4) + 0.5*sin(0.7*x);
+}
+
+static FloatImage *pattern_image(int nx, int ny)
+{
+  FloatImage *img = float_image_new(nx, ny);
+  int ii, kk;
+  for (kk=0; kk<ny; kk++)
+    for (ii=0; ii<nx; ii++)
+      float_image_set_pixel(img, ii, kk, pattern(ii, kk));
+  return img;
+}
+
+// Every row of a sinc kernel table sums to one, and a point that falls
+// on a sample picks exactly that sample.  Kernel sizes are brought to an
+// even length between 8 and 32.
+void sinc_kernel_test(void)
+{
+  weighting_type_t weights[] = { NO_WEIGHT, KAISER, HAMMING, LANCZOS };
+  int ww, points, ii, kk;
+  char name[255];
+
+  for (ww=0; ww<4; ww++) {
+    for (points=8; points<=32; points+=8) {
+      sinc_kernel_t *kernel = sinc_kernel_get(weights[ww], points);
+      const float *w;
+      int ok = TRUE;
+      for (kk=0; kk<=64; kk++) {
+        double sum = 0.0;
+        w = sinc_kernel_weights(kernel, kk/64.0);
+        for (ii=0; ii<points; ii++)
+          sum += w[ii];
+        if (fabs(sum - 1.0) > 1e-5)
+          ok = FALSE;
+      }
+      sprintf(name, "sinc kernel (weighting %d, %d points) sums to one",
+              weights[ww], points);
+      check(ok, name);
+
+      // Tap points/2-1 sits on the sample at floor(x)
+      ok = TRUE;
+      w = sinc_kernel_weights(kernel, 0.0);
+      for (ii=0; ii<points; ii++)
+        if (fabs(w[ii] - (ii == points/2-1 ? 1.0 : 0.0)) > 1e-6)
+          ok = FALSE;
+      sprintf(name, "sinc kernel (weighting %d, %d points) on a sample",
+              weights[ww], points);
+      check(ok, name);
+    }
+  }
+
+  check(sinc_kernel_get(NO_WEIGHT, 9) == sinc_kernel_get(NO_WEIGHT, 8),
+        "odd sinc kernel size rounded down");
+  check(sinc_kernel_get(NO_WEIGHT, 2) == sinc_kernel_get(NO_WEIGHT, 8),
+        "sinc kernel size raised to 8");
+  check(sinc_kernel_get(NO_WEIGHT, 64) == sinc_kernel_get(NO_WEIGHT, 32),
+        "sinc kernel size limited to 32");
+}
+
+// Sinc interpolation between samples follows the pattern, also next to
+// the image edges, where the edge samples are repeated
+void sinc_test(void)
+{
+  int nx = 64, ny = 64, ii, points;
+  FloatImage *img = pattern_image(nx, ny);
+  char name[255];
+
+  for (points=8; points<=32; points+=8) {
+    double max_err = 0.0;
+    for (ii=0; ii<100; ii++) {
+      float x = 20 + ii*0.237, y = 30.3 + ii*0.05;
+      double err = fabs(interpolate(SINC, img, y, x, KAISER, points) -
+                        pattern(x, y));
+      if (err > max_err) max_err = err;
+    }
+    sprintf(name, "sinc interpolation (%d points) error %g", points, max_err);
+    check(max_err < 0.01, name);
+  }
+  check(within_tol(interpolate(SINC, img, 10, 12, HAMMING, 16),
+                   float_image_get_pixel(img, 12, 10)),
+        "sinc interpolation on a sample");
+  check(within_tol(interpolate(SINC, img, 0.5, nx - 1.5, HAMMING, 16),
+                   pattern(nx - 1.5, 0.5)),
+        "sinc interpolation at the image corner");
+  float_image_free(img);
+}
+
+// SPLINES expects B-spline coefficients, not samples: the caller has to
+// run samples2coefficients() over the image in both dimensions first.
+// With the coefficients the samples are reproduced; on the raw samples
+// SPLINES smooths the image just like BICUBIC.
+void splines_test(void)
+{
+  int nx = 64, ny = 48, ii, kk;
+  FloatImage *img = pattern_image(nx, ny);
+  FloatImage *coeff = float_image_copy(img);
+  double max_err = 0.0, max_raw_err = 0.0, max_bicubic_diff = 0.0;
+
+  samples2coefficients(coeff, 'x');
+  samples2coefficients(coeff, 'y');
+  for (kk=0; kk<ny; kk++) {
+    for (ii=0; ii<nx; ii++) {
+      double sample = float_image_get_pixel(img, ii, kk);
+      double err = fabs(interpolate(SPLINES, coeff, kk, ii, NO_WEIGHT, 0) -
+                        sample);
+      double raw_err = fabs(interpolate(SPLINES, img, kk, ii, NO_WEIGHT, 0) -
+                            sample);
+      if (err > max_err) max_err = err;
+      if (raw_err > max_raw_err) max_raw_err = raw_err;
+    }
+  }
+  check(max_err < 1e-4, "splines reproduce the samples");
+  check(max_raw_err > 0.01, "splines without samples2coefficients smooth");
+
+  for (ii=0; ii<100; ii++) {
+    float x = 2 + ii*0.5, y = 2 + ii*0.4;
+    double diff = fabs(interpolate(SPLINES, img, y, x, NO_WEIGHT, 0) -
+                       interpolate(BICUBIC, img, y, x, NO_WEIGHT, 0));
+    if (diff > max_bicubic_diff) max_bicubic_diff = diff;
+  }
+  check(max_bicubic_diff < 1e-4, "splines on samples match bicubic");
+
+  float_image_free(img);
+  float_image_free(coeff);
+}
+
+// interpolate_line() gives exactly what interpolate() gives point by point
+void interpolate_line_test(void)
+{
+  interpolate_type_t modes[] = { NEAREST, BILINEAR, BICUBIC, SPLINES, SINC };
+  int nx = 64, ny = 64, n = 200, mm, ii;
+  FloatImage *img = pattern_image(nx, ny);
+  float yLine[200], xSample[200], out[200];
+  char name[255];
+
+  for (ii=0; ii<n; ii++) {
+    xSample[ii] = 2 + fmod(ii*0.731, nx - 5);
+    yLine[ii] = 2 + fmod(ii*0.419, ny - 5);
+  }
+  for (mm=0; mm<5; mm++) {
+    int ok = TRUE;
+    interpolate_line(modes[mm], img, n, yLine, xSample, LANCZOS, 16, out);
+    for (ii=0; ii<n; ii++)
+      if (out[ii] != interpolate(modes[mm], img, yLine[ii], xSample[ii],
+                                 LANCZOS, 16))
+        ok = FALSE;
+    sprintf(name, "interpolate_line matches interpolate (mode %d)",
+            modes[mm]);
+    check(ok, name);
+  }
+  float_image_free(img);
+}
+
 
 
 void rotation_test(interpolate_type_t mode, weighting_type_t f)
@@ -169,6 +337,12 @@ int main(int argc, char * argv [])
   rotation_test(SINC, KAISER);
   rotation_test(SINC, LANCZOS);
   */
-  
-  return 0;
+
+  sinc_kernel_test();
+  sinc_test();
+  splines_test();
+  interpolate_line_test();
+
+  printf("%d tests: %d ok, %d failed\n", n_ok + n_bad, n_ok, n_bad);
+  return n_bad > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
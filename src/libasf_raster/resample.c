@@ -32,12 +32,14 @@ ALGORITHM DESCRIPTION:
     Establish kernel processing parameters
     copy input metadata to output metadata (with update)
     Open input and output files
-    for each output line
-       calculate file read position
-       read next kernel from input file
-       for each output pixel
-   apply kernel to input data at appropriate position to get output value
-       write output line to file
+    for each band (in parallel)
+       for each output line
+          read the input lines that enter the kernel, add them to
+            the column sums; remove the lines that leave it
+          form prefix sums of the column sums
+          for each output pixel
+             average the kernel at the appropriate position
+          write output line to file
     Close input and output files
 
 *******************************************************************/
@@ -45,54 +47,147 @@ ALGORITHM DESCRIPTION:
 #include "asf_endian.h"
 #include <asf_raster.h>
 
-static float filter(      /****************************************/
-    float *inbuf,         /* input image buffer                   */
-    int    nl,            /* number of lines for inbuf            */
-    int    ns,            /* number of samples per line for inbuf */
-    int    x,             /* sample in desired line               */
-    int    nsk,           /* number of samples in kernel          */
-    int    nn_flag)       /* true if we should just use nearest   */
-                          /* instead of interpolating b/w points  */
-{                         /****************************************/
-    float  kersum =0.0;                    /* sum of kernel       */
-    int    half   =(nsk-1)/2,              /* half size kernel    */
-           base   =(x-half),               /* index into inbuf    */
-           total  =0,                      /* valid kernel values */
-           i, j;                           /* loop counters       */
-                                           /***********************/
-                                           
-    if (nn_flag) {
-
-      if (base>=0 && base<nl*ns)
-        return inbuf[base];
-      else if (base<0)
-        return inbuf[0];
-      else if (base>=nl*ns)
-        return inbuf[ns*nl-1];
-      asfPrintError("Not reached.\n");
+// Everything the band workers need.  Each band gets its own input and
+// output file handles.
+typedef struct {
+    meta_parameters *metaIn, *metaOut;
+    FILE   **fpin, **fpout;
+    int      np, nl,                /* in number of pixels,lines      */
+             onp, onl,              /* out number of pixels,lines     */
+             xnsk, ynsk,            /* kernel size in samples/lines   */
+             xhalf, yhalf,          /* half of the kernel size        */
+             nn_flag,               /* nearest neighbor instead       */
+             show_meter;            /* only with a single band        */
+    float    xbase, ybase,          /* base sample/line               */
+             xrate, yrate;          /* # input pixels/output pixel    */
+} resample_params_t;
+
+static int is_db(meta_parameters *meta)
+{
+    return meta->general->radiometry >= r_SIGMA_DB &&
+           meta->general->radiometry <= r_GAMMA_DB;
+}
 
-    }
-    else {
-      for (i = 0; i < nl; i++)
-      {
-        for (j = x-half; j <= x+half; j++)
-        {
-          if (base>=0 && base<nl*ns && inbuf[base] != 0 && j < ns)
-          {
-            kersum += inbuf[base];
-            total++;
-          }
-          base++;
+// Reads input line "line" of band "band", converted to power scale for
+// dB data so that it can be averaged.
+static void read_resample_line(resample_params_t *p, int band, int line,
+                               float *buf)
+{
+    int l;
+    get_float_lines(p->fpin[band], p->metaIn, line + band*p->nl, 1, buf);
+    if (is_db(p->metaIn))
+        for (l=0; l<p->np; l++)
+            buf[l] = pow(10.0, buf[l]/10.0);
+}
+
+// Adds (sign 1) or removes (sign -1) an input line from the column sums.
+// Zeros are nodata, and are not counted.
+static void update_column_sums(const float *line, int np, int sign,
+                               double *colsum, int *colcnt)
+{
+    int j;
+    for (j=0; j<np; j++)
+        if (line[j] != 0) {
+            colsum[j] += sign*line[j];
+            colcnt[j] += sign;
         }
-        base += ns;
-        base -= nsk;
-      }
+}
 
-      if (total != 0)
-        kersum /= (float) total;
+// Output line i is the average of the nonzero input values in a kernel
+// of ynsk lines by xnsk samples around the input pixel closest to the
+// middle of the output pixel (clipped at the image edges; at the top
+// the kernel is shifted down instead).  Every input line is read once:
+// the lines in the current kernel are kept in a ring buffer, and their
+// per-column sums and counts are updated as the kernel moves down.
+// Prefix sums along the line then give the kernel sum for every output
+// sample in constant time.
+static void resample_band(int band, int thread, void *params)
+{
+    resample_params_t *p = (resample_params_t *)params;
+    int np = p->np, nl = p->nl, onp = p->onp, ynsk = p->ynsk;
+    int i, j, xi, yi, s_line, e_line, n_lines = ynsk;
+    int win_start = 0, win_end = 0;     // lines in the sums: [start, end)
+    float tmp;
+
+    float *ring = (float *) MALLOC(sizeof(float)*ynsk*np);
+    float *outbuf = (float *) MALLOC(sizeof(float)*onp);
+    double *colsum = (double *) CALLOC(np, sizeof(double));
+    int *colcnt = (int *) CALLOC(np, sizeof(int));
+    double *psum = (double *) MALLOC(sizeof(double)*(np+1));
+    int *pcnt = (int *) MALLOC(sizeof(int)*(np+1));
+
+    for (i = 0; i < p->onl; i++)
+    {
+        /*--------- Find the lines of the kernel --------------------*/
+        yi = i * p->yrate + p->ybase + 0.5;
+        s_line = yi - p->yhalf;
+        if (s_line < 0) s_line = 0;
+        if (nl < ynsk+s_line) n_lines = nl-s_line;
+        e_line = s_line + n_lines;
+
+        if (p->nn_flag) {
+            /*----- Nearest neighbor: top left of the kernel --------*/
+            read_resample_line(p, band, s_line, ring);
+            for (j = 0; j < onp; j++) {
+                xi = j * p->xrate + p->xbase + 0.5;
+                outbuf[j] = ring[xi - p->xhalf < 0 ? 0 : xi - p->xhalf];
+            }
+        }
+        else {
+            /*----- Move the kernel down to [s_line, e_line) --------*/
+            if (s_line >= win_end) {
+                // no overlap with the previous kernel
+                memset(colsum, 0, sizeof(double)*np);
+                memset(colcnt, 0, sizeof(int)*np);
+                win_start = win_end = s_line;
+            }
+            for (; win_start < s_line; win_start++)
+                update_column_sums(&ring[(win_start%ynsk)*np], np, -1,
+                                   colsum, colcnt);
+            for (; win_end < e_line; win_end++) {
+                float *line = &ring[(win_end%ynsk)*np];
+                read_resample_line(p, band, win_end, line);
+                update_column_sums(line, np, 1, colsum, colcnt);
+            }
 
-      return (kersum);
+            psum[0] = 0.0;
+            pcnt[0] = 0;
+            for (j = 0; j < np; j++) {
+                psum[j+1] = psum[j] + colsum[j];
+                pcnt[j+1] = pcnt[j] + colcnt[j];
+            }
+
+            /*----- Average over the kernel around each sample ------*/
+            for (j = 0; j < onp; j++) {
+                int lo, hi, total;
+                xi = j * p->xrate + p->xbase + 0.5;
+                lo = xi - p->xhalf;
+                hi = xi + p->xhalf;
+                if (lo < 0) lo = 0;
+                if (hi > np-1) hi = np-1;
+                total = pcnt[hi+1] - pcnt[lo];
+                outbuf[j] = total != 0 ?
+                  (float)((psum[hi+1] - psum[lo]) / total) : 0.0;
+            }
+        }
+
+        if (is_db(p->metaOut))
+            for (j = 0; j < onp; j++) {
+                tmp = outbuf[j];
+                outbuf[j] = 10.0 * log10(tmp);
+            }
+
+        put_band_float_line(p->fpout[band], p->metaOut, band, i, outbuf);
+        if (p->show_meter)
+            asfLineMeter(i, p->onl);
     }
+
+    FREE(ring);
+    FREE(outbuf);
+    FREE(colsum);
+    FREE(colcnt);
+    FREE(psum);
+    FREE(pcnt);
 }
 
 static int
@@ -100,25 +195,16 @@ resample_impl(const char *infile, const char *outfile,
               double xscalfact, double yscalfact, int update_meta,
               int nn_flag)
 {
-    FILE            *fpin, *fpout;  /* file pointer                   */
-    float           *inbuf,         /* stripped input buffer          */
-                    *outbuf;        /* stripped output buffer         */
+    FILE            *fpout;         /* file pointer                   */
     meta_parameters *metaIn, *metaOut;
+    resample_params_t params;
     int      np, nl,                /* in number of pixels,lines      */
              onp, onl,              /* out number of pixels,lines     */
              xnsk,                  /* kernel size in samples (x)     */
              ynsk,                  /* kernel size in samples (y)     */
-             xhalf,yhalf,           /* half of the kernel size        */
-             n_lines,               /* number of lines in this kernel */
-             s_line,                /* start line for input file      */
-             xi = 0,                /* inbuf int x sample #           */
-             yi = 0,                /* inbuf int y line #             */
-             i,j,k,l;               /* loop counters                  */
+             i,k;                   /* loop counters                  */
     float    xpixsiz,               /* range pixel size               */
-             ypixsiz,               /* azimuth pixel size             */
-             xbase,ybase,           /* base sample/line               */
-             xrate,yrate,           /* # input pixels/output pixel    */
-             tmp;
+             ypixsiz;               /* azimuth pixel size             */
 
     //asfPrintStatus("\n\n\nResample: Performing filtering and subsampling..\n\n");
     //asfPrintStatus("  Input image is %s\n",infile);
@@ -137,17 +223,22 @@ resample_impl(const char *infile, const char *outfile,
 
     onp = (int) (np * xscalfact);
     onl = (int) (nl * yscalfact);
-    xbase = 1.0 / (2.0 * xscalfact) - 0.5;
-    xrate = 1.0 / xscalfact;
-    xhalf = (xnsk-1)/2;
 
-    ybase = 1.0 / (2.0 * yscalfact) - 0.5;
-    yrate = 1.0 / yscalfact;
-    yhalf = (ynsk-1)/2;
-    n_lines = ynsk;
-
-    inbuf= (float *) MALLOC (ynsk*np*sizeof(float));
-    outbuf = (float *) MALLOC (onp*sizeof(float));
+    params.metaIn = metaIn;
+    params.metaOut = metaOut;
+    params.np = np;
+    params.nl = nl;
+    params.onp = onp;
+    params.onl = onl;
+    params.xnsk = xnsk;
+    params.ynsk = ynsk;
+    params.nn_flag = nn_flag;
+    params.xbase = 1.0 / (2.0 * xscalfact) - 0.5;
+    params.xrate = 1.0 / xscalfact;
+    params.xhalf = (xnsk-1)/2;
+    params.ybase = 1.0 / (2.0 * yscalfact) - 0.5;
+    params.yrate = 1.0 / yscalfact;
+    params.yhalf = (ynsk-1)/2;
 
    /*----------  Open the Input & Output Files ---------------------*/
     char *imgfile = MALLOC(sizeof(char) * (10 + strlen(outfile)));
@@ -162,9 +253,6 @@ resample_impl(const char *infile, const char *outfile,
     char *infile_img = MALLOC(sizeof(char) * (10 + strlen(infile)));
     strcpy(infile_img, infile);
     append_ext_if_needed(infile_img, ".img", NULL);
-    fpin=fopenImage(infile_img,"rb");
-    if (fpin == NULL)
-      asfPrintError("Cannot open input file for binary read:\n  %s\n", infile);
 
     metaOut->general->line_count = onl;
     metaOut->general->sample_count = onp;
@@ -208,51 +296,36 @@ resample_impl(const char *infile, const char *outfile,
     char *metafile = appendExt(outfile, ".meta");
     meta_write(metaOut, metafile);
 
-    for (k=0; k < metaIn->general->band_count; ++k)
+    // The bands are independent, so they are resampled concurrently.
+    // Every band gets its own file handles (opened here, as fopenImage
+    // is not thread safe), and writes its own part of the output file.
+    int band_count = metaIn->general->band_count;
+    params.show_meter = band_count == 1;
+    params.fpin = (FILE **) MALLOC(sizeof(FILE *)*band_count);
+    params.fpout = (FILE **) MALLOC(sizeof(FILE *)*band_count);
+    fpout = fopenImage(imgfile, "wb");
+    FCLOSE(fpout);
+    for (k=0; k < band_count; ++k)
     {
-        if (metaIn->general->band_count != 1)
+        if (band_count != 1)
             asfPrintStatus("Resampling band: %s\n", band_name[k]);
 
-        fpout=fopenImage(imgfile, k==0 ? "wb" : "ab");
-        n_lines = ynsk;
-        /*--------  Process inbuf to give outbuf ------------------------*/
-        for (i = 0; i < onl; i++)
-        {
-            /*--------- Read next set of lines for kernel ---------------*/
-            yi = i * yrate + ybase + 0.5;
-            s_line = yi-yhalf;
-            if (s_line < 0) s_line = 0;
-            if (nl < ynsk+s_line) n_lines = nl-s_line;
-
-            s_line += k*nl;
-            get_float_lines(fpin, metaIn, s_line, n_lines, inbuf);
-	    if (metaIn->general->radiometry >= r_SIGMA_DB &&
-		metaIn->general->radiometry <= r_GAMMA_DB) {
-	      for (l=0; l<(np*n_lines); l++) {
-		tmp = inbuf[l];
-		inbuf[l] = pow(10.0, tmp/10.0);
-	      }
-	    }
-	    
-
-            /*--------- Produce the output line and write to disk -------*/
-            for (j = 0; j < onp; j++)
-            {
-                xi = j * xrate + xbase + 0.5;
-                outbuf[j] = filter(inbuf,n_lines,np,xi,xnsk,nn_flag);
-		if (metaOut->general->radiometry >= r_SIGMA_DB &&
-		    metaOut->general->radiometry <= r_GAMMA_DB) {
-		  tmp = outbuf[j];
-		  outbuf[j] = 10.0 * log10(tmp);
-		}
-            }
+        params.fpin[k] = fopenImage(infile_img,"rb");
+        if (params.fpin[k] == NULL)
+          asfPrintError("Cannot open input file for binary read:\n  %s\n",
+                        infile);
+        params.fpout[k] = FOPEN(imgfile, "r+b");
+    }
 
-            put_float_line(fpout, metaOut, i, outbuf);
-            asfLineMeter(i, onl);
-        }
+    asf_parallel_for(band_count, resample_band, &params);
 
-        FCLOSE(fpout);
+    for (k=0; k < band_count; ++k)
+    {
+        FCLOSE(params.fpin[k]);
+        FCLOSE(params.fpout[k]);
     }
+    FREE(params.fpin);
+    FREE(params.fpout);
 
     for (i=0; i < metaIn->general->band_count; i++)
         FREE(band_name[i]);
@@ -261,11 +334,6 @@ resample_impl(const char *infile, const char *outfile,
     meta_free(metaOut);
     meta_free(metaIn);
 
-    FCLOSE(fpin);
-
-    FREE(inbuf);
-    FREE(outbuf);
-
     FREE(imgfile);
     FREE(metafile);
     FREE(infile_img);
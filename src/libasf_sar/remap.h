@@ -1,7 +1,5 @@
 #include "poly.h"
 
-typedef int pixelFetcher;
-
 typedef struct {
 	double x,y;
 } fPoint;
@@ -21,12 +19,6 @@ typedef struct {
     double loright[2];    
 } cornerCoords;
 
-/* From fetcher.c */
-float fetchPixelValue(pixelFetcher *inGetRec,int x, int y);
-pixelFetcher *createFetchRec(FILE *in,meta_parameters *meta);
-void killFetchRec(pixelFetcher *inGetRec);
-void set_background(float v);
-
 /* From remap.c */
 int remap_poly(poly_2d *fwX, poly_2d *fwY, poly_2d *bwX, poly_2d *bwY,
 	       int outWidth, int outHeight, char *infile, char *outfile,
@@ -3,6 +3,7 @@
 #include "matrix.h"
 #include "remap.h"
 #include <assert.h>
+#include <limits.h>
 
 static void poly_doMap(polyMapRec * map, fPoint  in, fPoint  *out)
 {
@@ -88,7 +89,118 @@ static int eq(double a, double b, double tol) {
   return fabs(a-b)<tol;
 }
 
-static float bilinear_doSamp(pixelFetcher *getRec,fPoint inPt,float mask)
+/***************Tiled remapping********************
+  The output image is processed in strips of TILE_SIZE lines, and each
+  strip is cut into TILE_SIZE x TILE_SIZE tiles that are remapped in
+  parallel.  For each tile we first find the input position of every
+  output pixel, then read the part of the input image covered by those
+  positions in one go, and then sample from that.
+
+  Along an output row the backward polynomials reduce to polynomials in
+  x alone, which we step through with forward differences instead of
+  evaluating every term of the 2D polynomial at every pixel.  The
+  differences are set up from the polynomial's coefficients rather than
+  by differencing values, so they don't lose precision, and they are
+  restarted at the start of every tile row.
+*/
+
+#define TILE_SIZE 256
+
+/*Largest polynomial degree handled by forward differences; anything
+  higher is evaluated term by term.*/
+#define MAX_FD_DEGREE 10
+
+/*Footprints larger than this (in pixels) are split up.*/
+#define MAX_FOOTPRINT (16*1024*1024)
+
+typedef struct {
+  int in_ns, in_nl;             /* input image size */
+  int out_ns;                   /* output image width */
+  int strip_line;               /* first output line in this strip */
+  int strip_lines;              /* number of lines in this strip */
+  float background;
+  meta_parameters *meta_in;
+  polyMapRec *map;
+  float *strip;                 /* strip_lines x out_ns output values */
+  FILE **in;                    /* per-thread input handles */
+  double **inX, **inY;          /* per-thread input positions for a tile */
+} remap_params_t;
+
+/*Evaluate the polynomial at (x0+i, y) for i in [0,n), into out.*/
+static void poly_eval_row(const poly_2d *c, double x0, double y, int n,
+                          double *out)
+{
+  int d = c->degree;
+  int i, j, k;
+
+  if (d > MAX_FD_DEGREE || n <= d + 1) {
+    for (i=0; i<n; i++)
+      out[i] = poly_eval(c, x0+i, y);
+    return;
+  }
+
+  /* Coefficients of the polynomial in x along this row:
+       a[k] = sum over the terms x^k*y^j of v*y^j
+     the terms of degree D are numbered D*(D+1)/2 + (power of y) */
+  double a[MAX_FD_DEGREE+1];
+  for (k=0; k<=d; k++) {
+    double yj = 1;
+    a[k] = 0;
+    for (j=0; j<=d-k; j++) {
+      int D = j + k;
+      a[k] += c->v[D*(D+1)/2 + j]*yj;
+      yj *= y;
+    }
+  }
+
+  /* Shift to u = x - x0 (repeated synthetic division) */
+  for (j=0; j<d; j++)
+    for (k=d-1; k>=j; k--)
+      a[k] += a[k+1]*x0;
+
+  /* Forward differences at u=0: diff[m] = m! * sum_k a[k]*S(k,m), with
+     S the Stirling numbers of the second kind */
+  double S[MAX_FD_DEGREE+1][MAX_FD_DEGREE+1];
+  double diff[MAX_FD_DEGREE+1];
+  memset(S, 0, sizeof(S));
+  S[0][0] = 1;
+  for (k=1; k<=d; k++)
+    for (j=1; j<=k; j++)
+      S[k][j] = j*S[k-1][j] + S[k-1][j-1];
+  double fact = 1;
+  for (j=0; j<=d; j++) {
+    if (j > 0) fact *= j;
+    diff[j] = 0;
+    for (k=j; k<=d; k++)
+      diff[j] += a[k]*S[k][j];
+    diff[j] *= fact;
+  }
+
+  for (i=0; i<n; i++) {
+    out[i] = diff[0];
+    for (k=0; k<d; k++)
+      diff[k] += diff[k+1];
+  }
+}
+
+/*Input window read in for a tile: pixels outside of the input image
+  are background.*/
+typedef struct {
+  int x0, y0, ns, nl;
+  float *buf;
+  float background;
+} footprint_t;
+
+static float footprint_pixel(footprint_t *fp, int x, int y)
+{
+  x -= fp->x0;
+  y -= fp->y0;
+  if (x < 0 || y < 0 || x >= fp->ns || y >= fp->nl)
+    return fp->background;
+  return fp->buf[y*fp->ns + x];
+}
+
+static float bilinear_doSamp(footprint_t *fp,fPoint inPt,float mask)
 {
   /*ix and iy used to be computed as floor(inPt); but this is 
     much faster and gives the same results for inPt>-9*/
@@ -97,13 +209,13 @@ static float bilinear_doSamp(pixelFetcher *getRec,fPoint inPt,float mask)
 
   /*if any of the 4 corner pixels is equal to the masked value,
     we'll return the masked value */
-  float tl=fetchPixelValue(getRec,ix,iy);
+  float tl=footprint_pixel(fp,ix,iy);
   if (eq(tl,mask,.0001)) return mask;
-  float tr=fetchPixelValue(getRec,ix+1,iy);
+  float tr=footprint_pixel(fp,ix+1,iy);
   if (eq(tr,mask,.0001)) return mask;
-  float bl=fetchPixelValue(getRec,ix,iy+1);
+  float bl=footprint_pixel(fp,ix,iy+1);
   if (eq(bl,mask,.0001)) return mask;
-  float br=fetchPixelValue(getRec,ix+1,iy+1);
+  float br=footprint_pixel(fp,ix+1,iy+1);
   if (eq(br,mask,.0001)) return mask;
 
   float tc=tl+(tr-tl)*dx;
@@ -112,54 +224,150 @@ static float bilinear_doSamp(pixelFetcher *getRec,fPoint inPt,float mask)
   return tc+(bc-tc)*dy;
 }
 
+/*Remap the given rectangle of the current strip.  Positions for the
+  rectangle have already been computed, with a row stride of TILE_SIZE.*/
+static void remap_rect(remap_params_t *p, int thread, double *inX,
+                       double *inY, int x0, int y0, int w, int h)
+{
+  int x, y;
+
+  /*Find the input pixels needed by this rectangle*/
+  int min_x=INT_MAX, max_x=INT_MIN, min_y=INT_MAX, max_y=INT_MIN;
+  for (y=0; y<h; y++) {
+    for (x=0; x<w; x++) {
+      double px=inX[y*TILE_SIZE+x], py=inY[y*TILE_SIZE+x];
+      /*Way outside of the image is all background; don't let it
+        inflate the footprint (or overflow an int)*/
+      if (px < -10 || py < -10 || px > p->in_ns+10 || py > p->in_nl+10)
+        continue;
+      int ix=(int)(px+10)-10, iy=(int)(py+10)-10;
+      if (ix<min_x) min_x=ix;
+      if (ix+1>max_x) max_x=ix+1;
+      if (iy<min_y) min_y=iy;
+      if (iy+1>max_y) max_y=iy+1;
+    }
+  }
+
+  footprint_t fp;
+  fp.background = p->background;
+  fp.x0 = min_x < 0 ? 0 : min_x;
+  fp.y0 = min_y < 0 ? 0 : min_y;
+  fp.ns = (max_x >= p->in_ns ? p->in_ns-1 : max_x) - fp.x0 + 1;
+  fp.nl = (max_y >= p->in_nl ? p->in_nl-1 : max_y) - fp.y0 + 1;
+  if (min_x > max_x || fp.ns < 0) fp.ns = 0;
+  if (min_y > max_y || fp.nl < 0) fp.nl = 0;
+
+  /*Very strong warps can need a lot of input for one tile: split the
+    rectangle until the footprint is a reasonable size*/
+  if ((double)fp.ns*fp.nl > MAX_FOOTPRINT && (w > 1 || h > 1)) {
+    if (h >= w) {
+      remap_rect(p, thread, inX, inY, x0, y0, w, h/2);
+      remap_rect(p, thread, inX + (h/2)*TILE_SIZE, inY + (h/2)*TILE_SIZE,
+                 x0, y0 + h/2, w, h - h/2);
+    }
+    else {
+      remap_rect(p, thread, inX, inY, x0, y0, w/2, h);
+      remap_rect(p, thread, inX + w/2, inY + w/2, x0 + w/2, y0, w - w/2, h);
+    }
+    return;
+  }
+
+  fp.buf = NULL;
+  if (fp.ns > 0 && fp.nl > 0) {
+    fp.buf = MALLOC(sizeof(float)*fp.ns*fp.nl);
+    get_partial_float_lines(p->in[thread], p->meta_in, fp.y0, fp.nl,
+                            fp.x0, fp.ns, fp.buf);
+  }
+  else {
+    fp.ns = fp.nl = 0;
+  }
+
+  for (y=0; y<h; y++) {
+    float *out = p->strip + (size_t)(y0 - p->strip_line + y)*p->out_ns + x0;
+    for (x=0; x<w; x++) {
+      fPoint inPt;
+      inPt.x = inX[y*TILE_SIZE+x];
+      inPt.y = inY[y*TILE_SIZE+x];
+      out[x] = bilinear_doSamp(&fp, inPt, p->background);
+    }
+  }
+
+  if (fp.buf)
+    FREE(fp.buf);
+}
+
+static void remap_tile(int tile, int thread, void *params)
+{
+  remap_params_t *p = (remap_params_t *)params;
+  int x0 = tile*TILE_SIZE;
+  int w = p->out_ns - x0 < TILE_SIZE ? p->out_ns - x0 : TILE_SIZE;
+  int h = p->strip_lines;
+  double *inX = p->inX[thread];
+  double *inY = p->inY[thread];
+  int y;
+
+  /*Compute the input position of each of the tile's pixels*/
+  for (y=0; y<h; y++) {
+    double outY = p->strip_line + y;
+    poly_eval_row(p->map->outToInX, x0, outY, w, &inX[y*TILE_SIZE]);
+    poly_eval_row(p->map->outToInY, x0, outY, w, &inY[y*TILE_SIZE]);
+  }
+
+  remap_rect(p, thread, inX, inY, x0, p->strip_line, w, h);
+}
+
 /***************Perform_mapping-- the most important call********************
   This is the function which does the file I/O and image manipulation.
-  There are a few caveats:
-    If complex-valued input is specified, the output DDR must also have a dtype of
-      either DTYPE_COMPLEXREAL or DTYPE_COMPLEXIMAG.
-      If either of these options are specified, the output file will be
-      created in a bizarre way-- only the correct fields of the input image
-      will be read in, and only those same fields will be written out.
-    Hence, to generate a correct Complex image, you have to call perform_mapping twice--
-      once to remap the real fields, and again to remap the imaginary fields.
+  Only the first band of the input image is remapped.
 */
-static void perform_mapping(FILE *in, meta_parameters *meta_in,
+static void perform_mapping(char *infile, meta_parameters *meta_in,
 			    FILE *out, meta_parameters *meta_out,
 			    polyMapRec *map, float background_value)
 {
-  int x,y;
-  int maxOutX,maxOutY;
-
-  maxOutX=meta_out->general->sample_count;
-  maxOutY=meta_out->general->line_count;
+  int ii, y;
+  int maxOutX=meta_out->general->sample_count;
+  int maxOutY=meta_out->general->line_count;
+  int n_threads=asf_get_num_threads();
+  int n_tiles=(maxOutX+TILE_SIZE-1)/TILE_SIZE;
+
+  remap_params_t params;
+  params.in_ns = meta_in->general->sample_count;
+  params.in_nl = meta_in->general->line_count;
+  params.out_ns = maxOutX;
+  params.background = background_value;
+  params.meta_in = meta_in;
+  params.map = map;
+  params.strip = (float *)MALLOC(sizeof(float)*TILE_SIZE*maxOutX);
+  params.in = (FILE **)MALLOC(sizeof(FILE *)*n_threads);
+  params.inX = (double **)MALLOC(sizeof(double *)*n_threads);
+  params.inY = (double **)MALLOC(sizeof(double *)*n_threads);
+  for (ii=0; ii<n_threads; ii++) {
+    params.in[ii] = fopenImage(infile, "rb");
+    params.inX[ii] = (double *)MALLOC(sizeof(double)*TILE_SIZE*TILE_SIZE);
+    params.inY[ii] = (double *)MALLOC(sizeof(double)*TILE_SIZE*TILE_SIZE);
+  }
 
-  float *thisLine=(float *)MALLOC(maxOutX*sizeof(float));
-  
-  pixelFetcher *getRec=createFetchRec(in, meta_in);
-  	
-/*Iterate over each pixel of the output image.*/
-  for (y=0;y<maxOutY;y++)
+  for (y=0; y<maxOutY; y+=TILE_SIZE)
   {
-    fPoint outPt,inPt;
-    outPt.y=y;
-    for (x=0;x<maxOutX;x++)
-    {
-      outPt.x=x;
-      /*Compute the pixel's position in input space...*/
-      map->doMap((void *)map,outPt,&inPt);
-			
-      /*Now read that pixel's value and put it in the "thisLine" array 
-	as a float...*/
-      thisLine[x]=bilinear_doSamp(getRec,inPt,background_value);
-    }
-	
-    put_float_line(out,meta_out,y,thisLine);
+    params.strip_line = y;
+    params.strip_lines = maxOutY-y < TILE_SIZE ? maxOutY-y : TILE_SIZE;
 
-    asfLineMeter(y,maxOutY);
+    asf_parallel_for(n_tiles, remap_tile, &params);
+
+    put_float_lines(out, meta_out, y, params.strip_lines, params.strip);
+
+    asfLineMeter(y+params.strip_lines-1, maxOutY);
   }
 
-  killFetchRec(getRec);
-  FREE(thisLine);
+  for (ii=0; ii<n_threads; ii++) {
+    FCLOSE(params.in[ii]);
+    FREE(params.inX[ii]);
+    FREE(params.inY[ii]);
+  }
+  FREE(params.in);
+  FREE(params.inX);
+  FREE(params.inY);
+  FREE(params.strip);
 }
 
 /*GetProjection:
@@ -265,15 +473,13 @@ int remap_poly(poly_2d *fwX, poly_2d *fwY, poly_2d *bwX, poly_2d *bwY,
 	       int outWidth, int outHeight, char *infile, char *outfile,
                float background_value)
 {
-  FILE *in,*out=NULL;
+  FILE *out=NULL;
   meta_parameters *meta_in, *meta_out;
   polyMapRec *map;
   int out_lines, out_samps;
 
-  set_background(background_value);
   map = createPolyMap(fwX, fwY, bwX, bwY);
 
-  in = fopenImage(infile,"rb");
   out = fopenImage(outfile,"wb"); FCLOSE(out); /*Create the image*/
 
   /*Re-Open for append (this lets us read & write).*/
@@ -290,8 +496,7 @@ int remap_poly(poly_2d *fwX, poly_2d *fwY, poly_2d *bwX, poly_2d *bwY,
   update_projection(meta_in, map, meta_out);
   meta_write(meta_out, outfile);
 
-  perform_mapping(in, meta_in, out, meta_out, map, background_value);
-  FCLOSE(in);
+  perform_mapping(infile, meta_in, out, meta_out, map, background_value);
   FCLOSE(out);
   meta_free(meta_in);
   meta_free(meta_out);
@@ -239,6 +239,7 @@ int asf_terrcorr(char *sarFile, char *demFile, char *userMaskFile,
   int use_gr_dem=FALSE;
   int save_ground_dem = FALSE;
   int save_incid_angles = FALSE;
+  int multiscale_matching = FALSE;
 
   return asf_terrcorr_ext(sarFile, demFile, userMaskFile, outFile, pixel_size,
       clean_files, do_resample, do_corner_matching,
@@ -248,7 +249,8 @@ int asf_terrcorr(char *sarFile, char *demFile, char *userMaskFile,
       update_original_metadata_with_offsets, mask_height_cutoff,
       doRadiometric, smooth_dem_holes, NULL,
       no_matching, range_offset, azimuth_offset, use_gr_dem, add_speckle,
-      if_coreg_fails_use_zero_offsets, save_ground_dem, save_incid_angles);
+      if_coreg_fails_use_zero_offsets, save_ground_dem, save_incid_angles,
+      multiscale_matching);
 }
 
 int refine_geolocation(char *sarFile, char *demFile, char *userMaskFile,
@@ -276,6 +278,7 @@ int refine_geolocation(char *sarFile, char *demFile, char *userMaskFile,
   int use_gr_dem = FALSE;
   int save_ground_dem = FALSE;
   int save_incid_angles = FALSE;
+  int multiscale_matching = FALSE;
 
   int ret =
       asf_terrcorr_ext(sarFile, demFile, userMaskFile, outFile, pixel_size,
@@ -287,7 +290,8 @@ int refine_geolocation(char *sarFile, char *demFile, char *userMaskFile,
                        other_files_to_update_with_offsets,
                        no_matching, range_offset, azimuth_offset, use_gr_dem,
                        add_speckle, if_coreg_fails_use_zero_offsets,
-                       save_ground_dem, save_incid_angles);
+                       save_ground_dem, save_incid_angles,
+                       multiscale_matching);
 
   if (ret==0)
   {
@@ -592,6 +596,7 @@ int match_dem(meta_parameters *metaSAR,
               int no_matching,
               int add_speckle,
 	      int if_coreg_fails_use_zero_offsets,
+              int multiscale_matching,
               double range_offset,
               double azimuth_offset,
               double *t_offset,
@@ -694,7 +699,14 @@ int match_dem(meta_parameters *metaSAR,
                 x_tl_list, y_tl_list, x_br_list, y_br_list, good_pct_list);
       FREE(mask);
 
-      if (err==0) {
+      if (err==0 && multiscale_matching) {
+          // match all of the seed regions at once, instead of one by one
+          if (!multiscale_match(srFile, demTrimSimSar, MASK_SEED_POINTS,
+                                x_tl_list, y_tl_list, x_br_list, y_br_list,
+                                good_pct_list, cert_cutoff, &dx, &dy, &cert))
+              err=1;
+      }
+      else if (err==0) {
           //int n_attempt = 0;
           do  // matches "while (cert < cert_cutoff)"
           {
@@ -795,7 +807,11 @@ int match_dem(meta_parameters *metaSAR,
     else if (!no_matching) {
       // This is the normal case -- no user mask, regular matching
       // Match the real and simulated SAR image to determine the offset.
-      fftMatchQ(srFile, demTrimSimSar, &dx, &dy, &cert);
+      if (multiscale_matching)
+        multiscale_match(srFile, demTrimSimSar, 0, NULL, NULL, NULL, NULL,
+                         NULL, cert_cutoff, &dx, &dy, &cert);
+      else
+        fftMatchQ(srFile, demTrimSimSar, &dx, &dy, &cert);
     }
     else {
       // User supplied the offsets, not calculated
@@ -934,7 +950,7 @@ int match_dem(meta_parameters *metaSAR,
 			   demGround, userMaskClipped, dem_grid_size,
 			   FALSE, FALSE, FALSE, do_trim_slant_range_dem,
                            apply_dem_padding,mask_dem_same_size_and_projection,
-			   clean_files, TRUE, TRUE, FALSE,
+			   clean_files, TRUE, TRUE, FALSE, multiscale_matching,
 			   0.0, 0.0, t_offset, x_offset);
 	}
 	else {
@@ -1036,7 +1052,7 @@ int asf_check_geolocation(char *sarFile, char *demFile, char *userMaskFile,
             simAmpFile, demSlant, NULL, userMaskClipped, dem_grid_size,
             do_corner_matching, do_fftMatch_verification,
             do_refine_geolocation, do_trim_slant_range_dem, apply_dem_padding,
-            madssap, clean_files, no_matching, add_speckle, FALSE,
+            madssap, clean_files, no_matching, add_speckle, FALSE, FALSE,
             range_offset, azimuth_offset, &t_offset, &x_offset);
 
   if (clean_files)
@@ -1058,7 +1074,7 @@ int asf_terrcorr_ext(char *sarFile_in, char *demFile_in, char *userMaskFile,
                      int no_matching, double range_offset,
                      double azimuth_offset, int use_gr_dem, int add_speckle,
                      int if_coreg_fails_use_zero_offsets, int save_ground_dem,
-                     int save_incid_angles)
+                     int save_incid_angles, int multiscale_matching)
 {
   char *resampleFile = NULL, *srFile = NULL, *resampleFile_2 = NULL;
   char *demTrimSimSar = NULL, *demTrimSlant = NULL, *demGround = NULL;
@@ -1413,7 +1429,7 @@ int asf_terrcorr_ext(char *sarFile_in, char *demFile_in, char *userMaskFile,
         demTrimSimSar, demTrimSlant, demGround, userMaskClipped, dem_grid_size,
         do_corner_matching, do_fftMatch_verification, FALSE,
         TRUE, TRUE, madssap, clean_files, no_matching, add_speckle,
-        if_coreg_fails_use_zero_offsets,
+        if_coreg_fails_use_zero_offsets, multiscale_matching,
         range_offset, azimuth_offset, &t_offset, &x_offset);
 
   if (update_original_metadata_with_offsets)
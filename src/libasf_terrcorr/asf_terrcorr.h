@@ -50,7 +50,7 @@ int asf_terrcorr_ext(char *sarFile, char *demFile, char *inMaskFile,
                      int no_matching, double range_offset,
                      double azimuth_offset, int use_gr_dem, int add_speckle,
                      int if_coreg_fails_use_zero_offsets, int save_ground_dem,
-                     int save_incid_angles);
+                     int save_incid_angles, int multiscale_matching);
 
 void
 clip_dem(meta_parameters *metaSAR, char *srFile, char *demFile,
@@ -68,6 +68,39 @@ int lay_seeds(int num_seeds, float *mask, long ns, long nl,
               int *x_br_list, int *y_br_list,
               float *good_pct_list);
 
+/* Prototypes from multiscale_match.c */
+int multiscale_match(char *srFile, char *simFile, int n_seeds,
+                     int *x_tl_list, int *y_tl_list,
+                     int *x_br_list, int *y_br_list, float *good_pct_list,
+                     float cert_cutoff, float *dx, float *dy, float *cert);
+
+/* Prototypes from dem_index.c */
+typedef struct {
+    char *file;                   // the DEM's .img file
+    int is_dem;                   // FALSE for other .img files
+    double lat[4], lon[4];        // footprint corners
+    double center_lon;
+    double lat_lo, lat_hi;        // bounding box of the footprint
+    double lon_lo, lon_hi;
+    long mtime, size;             // to tell when the file changed
+    int seen;                     // found on disk during the refresh
+} dem_index_entry;
+
+typedef struct {
+    char *dir;
+    int n_entries, max_entries, n_entries_sorted;
+    dem_index_entry *entries;
+    int lat0, lon0, n_lat, n_lon; // one-degree buckets
+    int *bucket_start, *bucket_entries;
+} dem_index;
+
+void dem_index_get_corners(meta_parameters *meta, double *lat, double *lon,
+                           double *center_lon);
+dem_index *dem_index_open(const char *dem_dir);
+int *dem_index_query(dem_index *idx, double lat_lo, double lat_hi,
+                     double lon_lo, double lon_hi, int *n_found);
+void dem_index_free(dem_index *idx);
+
 /* Prototypes from build_dem.c */
 char *build_dem(meta_parameters *meta, const char *dem_cla_arg,
                 const char *dir_for_tmp_dem);
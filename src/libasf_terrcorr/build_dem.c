@@ -93,29 +93,13 @@ int lineSegmentsIntersect(
   return TRUE;
 }
 
-// return TRUE if there is any overlap between the two scenes
-static int test_overlap(meta_parameters *meta1, meta_parameters *meta2)
+// return TRUE if there is any overlap between the two footprints, given
+// as corners (see dem_index_get_corners)
+static int test_overlap(double *lat1, double *lon1, double center_lon1,
+                        double *lat2, double *lon2, double center_lon2)
 {
-    if (!meta_is_valid_double(meta1->general->center_longitude)) {
-        int nl = meta1->general->line_count;
-        int ns = meta1->general->sample_count;
-
-        meta_get_latLon(meta1, nl/2, ns/2, 0,
-            &meta1->general->center_latitude,
-            &meta1->general->center_longitude);
-    }
-
-    if (!meta_is_valid_double(meta2->general->center_longitude)) {
-        int nl = meta2->general->line_count;
-        int ns = meta2->general->sample_count;
-
-        meta_get_latLon(meta2, nl/2, ns/2, 0,
-            &meta2->general->center_latitude,
-            &meta2->general->center_longitude);
-    }
-
-    int zone1 = utm_zone(meta1->general->center_longitude);
-    int zone2 = utm_zone(meta2->general->center_longitude);
+    int zone1 = utm_zone(center_lon1);
+    int zone2 = utm_zone(center_lon2);
 
     // if zone1 & zone2 differ by more than 1, we can stop now
     if (iabs(zone1-zone2) > 1) {
@@ -129,37 +113,12 @@ static int test_overlap(meta_parameters *meta1, meta_parameters *meta2)
     // Other possibility: meta1 is completely contained within meta2,
     // or the reverse.
 
+    int i, j;
+
     // corners of meta1.
     double xp_1[5], yp_1[5];
-
-    if (meta1->location) {
-        // use the location block if available
-        latLon2UTM_zone(meta1->location->lat_start_near_range,
-            meta1->location->lon_start_near_range, 0, zone1, &xp_1[0], &yp_1[0]);
-        latLon2UTM_zone(meta1->location->lat_start_far_range,
-            meta1->location->lon_start_far_range, 0, zone1, &xp_1[1], &yp_1[1]);
-        latLon2UTM_zone(meta1->location->lat_end_far_range,
-            meta1->location->lon_end_far_range, 0, zone1, &xp_1[2], &yp_1[2]);
-        latLon2UTM_zone(meta1->location->lat_end_near_range,
-            meta1->location->lon_end_near_range, 0, zone1, &xp_1[3], &yp_1[3]);
-    } else {
-        double lat, lon;
-        int nl1 = meta1->general->line_count;
-        int ns1 = meta1->general->sample_count;
-
-        // must call meta_get_latLon for each corner
-        meta_get_latLon(meta1, 0, 0, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_1[0], &yp_1[0]);
-
-        meta_get_latLon(meta1, nl1-1, 0, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_1[1], &yp_1[1]);
-
-        meta_get_latLon(meta1, nl1-1, ns1-1, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_1[2], &yp_1[2]);
-
-        meta_get_latLon(meta1, 0, ns1-1, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_1[3], &yp_1[3]);
-    }
+    for (i=0; i<4; ++i)
+        latLon2UTM_zone(lat1[i], lon1[i], 0, zone1, &xp_1[i], &yp_1[i]);
 
     // close the polygon
     xp_1[4] = xp_1[0];
@@ -167,42 +126,14 @@ static int test_overlap(meta_parameters *meta1, meta_parameters *meta2)
 
     // corners of meta2.
     double xp_2[5], yp_2[5];
-
-    if (meta2->location) {
-        // use the location block if available
-        latLon2UTM_zone(meta2->location->lat_start_near_range,
-            meta2->location->lon_start_near_range, 0, zone1, &xp_2[0], &yp_2[0]);
-        latLon2UTM_zone(meta2->location->lat_start_far_range,
-            meta2->location->lon_start_far_range, 0, zone1, &xp_2[1], &yp_2[1]);
-        latLon2UTM_zone(meta2->location->lat_end_far_range,
-            meta2->location->lon_end_far_range, 0, zone1, &xp_2[2], &yp_2[2]);
-        latLon2UTM_zone(meta2->location->lat_end_near_range,
-            meta2->location->lon_end_near_range, 0, zone1, &xp_2[3], &yp_2[3]);
-    } else {
-        double lat, lon;
-        int nl2 = meta2->general->line_count;
-        int ns2 = meta2->general->sample_count;
-
-        // must call meta_get_latLon for each corner
-        meta_get_latLon(meta2, 0, 0, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_2[0], &yp_2[0]);
-
-        meta_get_latLon(meta2, nl2-1, 0, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_2[1], &yp_2[1]);
-
-        meta_get_latLon(meta2, nl2-1, ns2-1, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_2[2], &yp_2[2]);
-
-        meta_get_latLon(meta2, 0, ns2-1, 0, &lat, &lon);
-        latLon2UTM_zone(lat, lon, 0, zone1, &xp_2[3], &yp_2[3]);
-    }
+    for (i=0; i<4; ++i)
+        latLon2UTM_zone(lat2[i], lon2[i], 0, zone1, &xp_2[i], &yp_2[i]);
 
     // close the polygon
     xp_2[4] = xp_2[0];
     yp_2[4] = yp_2[0];
 
     // loop over each pair of line segments, testing for intersection
-    int i, j;
     for (i = 0; i < 4; ++i) {
         for (j = 0; j < 4; ++j) {
             if (lineSegmentsIntersect(
@@ -242,155 +173,75 @@ static int test_overlap(meta_parameters *meta1, meta_parameters *meta2)
     return FALSE;
 }
 
-// this is just to make the recursive searching of directories look nice
-static char *spaces(int n)
-{
-    int i;
-    static char buf[256];
-    for (i=0; i<256; ++i)
-        buf[i] = i<n*3 ? ' ' : '\0';
-    return buf;
-}
-
-// forward declaration of the wrapper that calls process_dir or
-// process_file as appropriate
-static void process(const char *what, int level, int recursive,
-                    char *overlapping_dems[], int *next_dem_number,
-                    meta_parameters *meta, int *n_dems_total);
-
-// process all things in a directory.  Calls "process" to decide
-// if the "thing" is a dir (process_dir) or a file (process_file)
-static void process_dir(const char *dir, int top, int recursive,
-                        char *overlapping_dems[], int *next_dem_number,
-                        meta_parameters *meta, int *n_dems_total)
-{
-  char name[1024];
-  struct dirent *dp;
-  DIR *dfd;
-
-  if ((dfd = opendir(dir)) == NULL) {
-    asfPrintStatus("  Cannot open %s\n",dir);
-    return; // error
-  }
-  while ((dp = readdir(dfd)) != NULL) {
-    // skip current, parent dir entries
-    if (strcmp(dp->d_name, ".")==0 || strcmp(dp->d_name, "..")==0) {
-      continue;
-    }
-    if (strlen(dir)+strlen(dp->d_name)+2 > sizeof(name)) {
-      asfPrintWarning("dirwalk: name %s/%s exceeds buffersize.\n",
-                      dir, dp->d_name);
-      return; // error
-    }
-    else {
-      // process this entry
-      sprintf(name, "%s%c%s", dir, DIR_SEPARATOR, dp->d_name);
-      process(name, top, recursive, overlapping_dems, next_dem_number,
-          meta, n_dems_total);
-    }
-  }
-  closedir(dfd);
-}
-
-// if a file is a .img file, test it for overlap, otherwise do nothing
-static void process_file(const char *file, int level,
-                         char *overlapping_dems[], int *next_dem_number,
-                         meta_parameters *meta, int *n_dems_total)
+static void get_bounding_box_latlon(meta_parameters *meta,
+                                    double *lat_lo, double *lat_hi,
+                                    double *lon_lo, double *lon_hi);
+
+// Adds the DEMs in one directory (through its index) that overlap the
+// scene to the list, growing it as needed.  The list is kept NULL
+// terminated.
+static void add_overlapping_dems(meta_parameters *meta, const char *dem_dir,
+                                 char ***dems, int *n_dems, int *max_dems,
+                                 int *n_dems_total)
 {
-    char *base = get_filename(file);
-    char *ext = findExt(base);
-    if (ext && strcmp_case(ext, ".img") == 0)
-    {
-        char *does;
-        ++(*n_dems_total);
-
-        char *meta_filename = appendExt(file, ".meta");
-        meta_parameters *meta_dem = meta_read(meta_filename);
-
-        if (meta_dem->general->image_data_type != DEM) {
-            does = "Not a DEM";
-        } else if (test_overlap(meta, meta_dem)) {
-            // overlaps!
-            overlapping_dems[*next_dem_number] = STRDUP(file);
-            ++(*next_dem_number);
-            does = "Overlaps";
-        } else {
-            does = "No";
+    double lat[4], lon[4], center_lon;
+    double lat_lo, lat_hi, lon_lo, lon_hi;
+    int i, n_candidates;
+
+    dem_index_get_corners(meta, lat, lon, &center_lon);
+    get_bounding_box_latlon(meta, &lat_lo, &lat_hi, &lon_lo, &lon_hi);
+
+    dem_index *idx = dem_index_open(dem_dir);
+    for (i=0; i<idx->n_entries; ++i)
+        if (idx->entries[i].is_dem)
+            ++(*n_dems_total);
+
+    int *candidates = dem_index_query(idx, lat_lo, lat_hi, lon_lo, lon_hi,
+                                      &n_candidates);
+    for (i=0; i<n_candidates; ++i) {
+        dem_index_entry *e = &idx->entries[candidates[i]];
+        if (test_overlap(lat, lon, center_lon, e->lat, e->lon, e->center_lon))
+        {
+            if (*n_dems + 1 >= *max_dems) {
+                *max_dems *= 2;
+                *dems = realloc(*dems, sizeof(char*)*(*max_dems));
+                if (!*dems)
+                    asfPrintError("Out of memory!\n");
+            }
+            (*dems)[(*n_dems)++] = STRDUP(e->file);
+            (*dems)[*n_dems] = NULL;
         }
-
-        free(meta_filename);
-        meta_free(meta_dem);
-
-        asfPrintStatus("  %s%s - %s\n", spaces(level), base, does);
-    }
-    else if (ext && (strcmp_case(ext, ".meta") == 0 ||
-                     strcmp_case(ext, ".ddr") == 0)) {
-        // silently ignore the .meta, etc files -- they will be picked up
-        // when processing the corresponding .img file
-        ;
-    }
-    else {
-        // loudly ignore other stuff in the directory
-        asfPrintStatus("  %s%s (ignored)\n", spaces(level), base);
     }
-    FREE(base);
+
+    FREE(candidates);
+    dem_index_free(idx);
 }
 
-// calls either process_dir or process_file, above
-static void process(const char *what, int level, int recursive,
-                    char *overlapping_dems[], int *next_dem_number,
-                    meta_parameters *meta, int *n_dems_total)
+static char **new_dem_list(int *n_dems, int *max_dems)
 {
-  struct stat stbuf;
-
-  if (stat(what, &stbuf) == -1) {
-    asfPrintStatus("  Cannot access: %s\n", what);
-    return;
-  }
-
-  char *base = get_filename(what);
-
-  if ((stbuf.st_mode & S_IFMT) == S_IFDIR) {
-      if (level==0 || recursive) {
-          asfPrintStatus("  %s%s/\n", spaces(level), base);
-          process_dir(what, level+1, recursive, overlapping_dems,
-              next_dem_number, meta, n_dems_total);
-      }
-      else {
-          asfPrintStatus("  %s%s (skipped)\n", spaces(level), base);
-      }
-  }
-  else {
-      process_file(what, level, overlapping_dems, next_dem_number,
-          meta, n_dems_total);
-  }
-
-  FREE(base);
+    *n_dems = 0;
+    *max_dems = 16;
+    char **dems = MALLOC(sizeof(char*)*(*max_dems));
+    dems[0] = NULL;
+    return dems;
 }
 
-// in a given directory, find all overlapping dems.  Calls
-// "process" to do the real work
+// in a given directory, find all overlapping dems.  Returns a NULL
+// terminated list.
 static char **find_overlapping_dems_dir(meta_parameters *meta,
                                         const char *dem_dir,
                                         int *n_dems_total)
 {
-    int i,n=0;
-    const int recursive = TRUE;
-
-    // hard-coded limit of 100 dems
-    const int max_dems = 100;
-    char **overlapping_dems = MALLOC(sizeof(char*)*max_dems);
-    for (i=0; i<max_dems; ++i)
-        overlapping_dems[i] = NULL;
+    int i, n, max_dems;
+    char **overlapping_dems = new_dem_list(&n, &max_dems);
 
-    process(dem_dir, 0, recursive, overlapping_dems, &n, meta,
-        n_dems_total);
+    add_overlapping_dems(meta, dem_dir, &overlapping_dems, &n, &max_dems,
+                         n_dems_total);
 
     if (n > 0) {
         asfPrintStatus("Found %d overlapping dem%s:\n", n, n==1?"":"s");
-        for (i=0; i<max_dems; ++i)
-            if (overlapping_dems[i])
-                asfPrintStatus("  %s\n", overlapping_dems[i]);
+        for (i=0; i<n; ++i)
+            asfPrintStatus("  %s\n", overlapping_dems[i]);
 
         return overlapping_dems;
     } else {
@@ -410,14 +261,9 @@ static char **find_overlapping_dems(meta_parameters *meta,
                                     const char *file_with_dem_dirs,
                                     int *n_dems_found)
 {
-    // hard-coded limit of 100 dems
-    int i;
-    const int max_dems = 100;
-    char **overlapping_dems = MALLOC(sizeof(char*)*max_dems);
-    for (i=0; i<max_dems; ++i)
-        overlapping_dems[i] = NULL;
-
-    *n_dems_found = 0;
+    int i, max_dems;
+    char **overlapping_dems = new_dem_list(n_dems_found, &max_dems);
+
     int n_dirs_checked = 0;
     int n_dems_total = 0;
     char line[512];
@@ -428,23 +274,13 @@ static char **find_overlapping_dems(meta_parameters *meta,
     }
 
     while (NULL != fgets(line, 512, fp)) {
-        while (isspace(line[strlen(line)-1])) line[strlen(line)-1] = '\0';
+        while (strlen(line) > 0 && isspace(line[strlen(line)-1]))
+            line[strlen(line)-1] = '\0';
+        if (strlen(line) == 0)
+            continue;
         asfPrintStatus("Looking for DEMs in directory: %s\n", line);
-        char **dems = find_overlapping_dems_dir(meta, line, &n_dems_total);
-        if (dems) {
-            char **p = dems;
-            while (*p) {
-                if (*n_dems_found < 100) {
-                    overlapping_dems[*n_dems_found] = STRDUP(*p);
-                    ++(*n_dems_found);
-                } else {
-                    asfPrintWarning("Too many DEMS!");
-                }
-                free(*p);
-                ++(*p);
-            }
-            free(dems);
-        }
+        add_overlapping_dems(meta, line, &overlapping_dems, n_dems_found,
+                             &max_dems, &n_dems_total);
         ++n_dirs_checked;
     }
     fclose(fp);
@@ -455,9 +291,8 @@ static char **find_overlapping_dems(meta_parameters *meta,
     if (*n_dems_found > 0) {
         asfPrintStatus("Found %d overlapping dem%s:\n", *n_dems_found,
             *n_dems_found == 1 ? "" : "s");
-        for (i=0; i<max_dems; ++i)
-            if (overlapping_dems[i])
-                asfPrintStatus("    %s\n", overlapping_dems[i]);
+        for (i=0; i<*n_dems_found; ++i)
+            asfPrintStatus("    %s\n", overlapping_dems[i]);
 
         return overlapping_dems;
     } else {
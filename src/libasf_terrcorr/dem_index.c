@@ -0,0 +1,444 @@
+// On-disk catalog of the DEMs in a DEM library directory, for build_dem.
+//
+// Finding the DEMs that overlap a scene used to mean reading the
+// metadata of every DEM in the library, on every run.  Instead, we keep
+// the footprint of each DEM in an index file at the top of the library
+// directory (DEM_INDEX_NAME).  Opening the index walks the directory tree
+// as before, but only stat()s the files: metadata is read just for DEMs
+// that are new, or whose .img/.meta changed since they were indexed.
+// Entries for files that have gone away are dropped, and the index file
+// is rewritten if anything changed (if the directory isn't writable, the
+// refreshed index is only kept in memory).
+//
+// In memory, the entries are bucketed on a one-degree lat/lon grid, so a
+// query only looks at the DEMs near the requested box.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "asf.h"
+#include "asf_meta.h"
+#include "asf_terrcorr.h"
+
+#define DEM_INDEX_NAME ".asf_dem_index"
+#define DEM_INDEX_HEADER "ASF DEM INDEX 1"
+
+// Corners, in the order test_overlap() walks the footprint polygon, and
+// the center longitude (used for the UTM zone).
+void dem_index_get_corners(meta_parameters *meta, double *lat, double *lon,
+                           double *center_lon)
+{
+    if (!meta_is_valid_double(meta->general->center_longitude)) {
+        int nl = meta->general->line_count;
+        int ns = meta->general->sample_count;
+
+        meta_get_latLon(meta, nl/2, ns/2, 0,
+            &meta->general->center_latitude,
+            &meta->general->center_longitude);
+    }
+    *center_lon = meta->general->center_longitude;
+
+    if (meta->location) {
+        // use the location block if available
+        meta_location *ml = meta->location;
+        lat[0] = ml->lat_start_near_range; lon[0] = ml->lon_start_near_range;
+        lat[1] = ml->lat_start_far_range;  lon[1] = ml->lon_start_far_range;
+        lat[2] = ml->lat_end_far_range;    lon[2] = ml->lon_end_far_range;
+        lat[3] = ml->lat_end_near_range;   lon[3] = ml->lon_end_near_range;
+    } else {
+        int nl = meta->general->line_count;
+        int ns = meta->general->sample_count;
+
+        // must call meta_get_latLon for each corner
+        meta_get_latLon(meta, 0, 0, 0, &lat[0], &lon[0]);
+        meta_get_latLon(meta, nl-1, 0, 0, &lat[1], &lon[1]);
+        meta_get_latLon(meta, nl-1, ns-1, 0, &lat[2], &lon[2]);
+        meta_get_latLon(meta, 0, ns-1, 0, &lat[3], &lon[3]);
+    }
+}
+
+static void set_bounding_box(dem_index_entry *e)
+{
+    int i;
+    e->lat_lo = e->lat_hi = e->lat[0];
+    e->lon_lo = e->lon_hi = e->lon[0];
+    for (i=1; i<4; ++i) {
+        // keep the footprint together across the date line
+        double lon = e->lon[i];
+        if (lon - e->lon[0] > 180) lon -= 360;
+        if (lon - e->lon[0] < -180) lon += 360;
+        if (e->lat[i] < e->lat_lo) e->lat_lo = e->lat[i];
+        if (e->lat[i] > e->lat_hi) e->lat_hi = e->lat[i];
+        if (lon < e->lon_lo) e->lon_lo = lon;
+        if (lon > e->lon_hi) e->lon_hi = lon;
+    }
+}
+
+static dem_index_entry *add_entry(dem_index *idx)
+{
+    if (idx->n_entries == idx->max_entries) {
+        idx->max_entries = idx->max_entries ? 2*idx->max_entries : 256;
+        idx->entries = realloc(idx->entries,
+                               sizeof(dem_index_entry)*idx->max_entries);
+        if (!idx->entries)
+            asfPrintError("Out of memory growing the DEM index.\n");
+    }
+    dem_index_entry *e = &idx->entries[idx->n_entries++];
+    memset(e, 0, sizeof(dem_index_entry));
+    return e;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const dem_index_entry*)a)->file,
+                  ((const dem_index_entry*)b)->file);
+}
+
+static dem_index_entry *find_entry(dem_index *idx, const char *file)
+{
+    dem_index_entry key;
+    key.file = (char*)file;
+    return bsearch(&key, idx->entries, idx->n_entries_sorted,
+                   sizeof(dem_index_entry), compare_entries);
+}
+
+static void read_index(dem_index *idx, const char *index_file)
+{
+    char line[2048];
+    FILE *fp = fopen(index_file, "r");
+    if (!fp)
+        return;
+
+    if (!fgets(line, sizeof(line), fp) ||
+        strncmp(line, DEM_INDEX_HEADER, strlen(DEM_INDEX_HEADER)) != 0)
+    {
+        asfPrintWarning("Ignoring DEM index %s (unknown format).\n",
+                        index_file);
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        dem_index_entry e;
+        int n, len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+
+        // the file name comes last, and may contain spaces
+        if (sscanf(line, "%d %ld %ld %lf %lf %lf %lf %lf %lf %lf %lf %lf %n",
+                   &e.is_dem, &e.mtime, &e.size,
+                   &e.lat[0], &e.lon[0], &e.lat[1], &e.lon[1],
+                   &e.lat[2], &e.lon[2], &e.lat[3], &e.lon[3],
+                   &e.center_lon, &n) != 12 || line[n] == '\0')
+            continue;
+
+        dem_index_entry *p = add_entry(idx);
+        *p = e;
+        p->file = MALLOC(sizeof(char)*(strlen(idx->dir)+strlen(line+n)+2));
+        sprintf(p->file, "%s%c%s", idx->dir, DIR_SEPARATOR, line+n);
+        p->seen = FALSE;
+        set_bounding_box(p);
+    }
+
+    fclose(fp);
+}
+
+static void write_index(dem_index *idx, const char *index_file)
+{
+    int i;
+    // pid suffixed, so that two runs indexing the same directory don't
+    // write into each other's temporary file
+    char *tmp_file = MALLOC(sizeof(char)*(strlen(index_file)+32));
+    sprintf(tmp_file, "%s.%d", index_file, (int)getpid());
+
+    FILE *fp = fopen(tmp_file, "w");
+    if (!fp) {
+        asfPrintStatus("Can't write DEM index %s, not saving it.\n",
+                       index_file);
+        FREE(tmp_file);
+        return;
+    }
+
+    int len = strlen(idx->dir) + 1;
+    fprintf(fp, "%s\n", DEM_INDEX_HEADER);
+    for (i=0; i<idx->n_entries; ++i) {
+        dem_index_entry *e = &idx->entries[i];
+        fprintf(fp, "%d %ld %ld %.10f %.10f %.10f %.10f %.10f %.10f "
+                "%.10f %.10f %.10f %s\n",
+                e->is_dem, e->mtime, e->size,
+                e->lat[0], e->lon[0], e->lat[1], e->lon[1],
+                e->lat[2], e->lon[2], e->lat[3], e->lon[3],
+                e->center_lon, e->file + len);
+    }
+
+    // replace the old index in one step, in case someone else is reading it
+    if (fclose(fp) != 0 || rename(tmp_file, index_file) != 0) {
+        asfPrintStatus("Can't write DEM index %s, not saving it.\n",
+                       index_file);
+        remove(tmp_file);
+    }
+    FREE(tmp_file);
+}
+
+// Looks at one .img file: if the index doesn't have it, or it changed,
+// read its metadata
+static void refresh_file(dem_index *idx, const char *file, int *n_changed)
+{
+    struct stat img_st, meta_st;
+    char *meta_file = appendExt(file, ".meta");
+
+    if (stat(file, &img_st) != 0 || stat(meta_file, &meta_st) != 0) {
+        FREE(meta_file);
+        return;
+    }
+
+    long mtime = (long)(img_st.st_mtime > meta_st.st_mtime ?
+                        img_st.st_mtime : meta_st.st_mtime);
+    long size = (long)img_st.st_size;
+
+    dem_index_entry *e = find_entry(idx, file);
+    if (e && e->mtime == mtime && e->size == size) {
+        e->seen = TRUE;
+        FREE(meta_file);
+        return;
+    }
+
+    if (!e) {
+        e = add_entry(idx);
+        e->file = STRDUP(file);
+    }
+    e->seen = TRUE;
+    e->mtime = mtime;
+    e->size = size;
+
+    meta_parameters *meta = meta_read(meta_file);
+    e->is_dem = meta->general->image_data_type == DEM;
+    if (e->is_dem)
+        dem_index_get_corners(meta, e->lat, e->lon, &e->center_lon);
+    set_bounding_box(e);
+    meta_free(meta);
+
+    asfPrintStatus("  Indexed %s%s\n", file, e->is_dem ? "" : " (not a DEM)");
+    ++(*n_changed);
+    FREE(meta_file);
+}
+
+static void refresh_dir(dem_index *idx, const char *dir, int *n_changed)
+{
+    char name[1024];
+    struct dirent *dp;
+    struct stat st;
+    DIR *dfd;
+
+    if ((dfd = opendir(dir)) == NULL) {
+        asfPrintStatus("  Cannot open %s\n", dir);
+        return;
+    }
+    while ((dp = readdir(dfd)) != NULL) {
+        if (strcmp(dp->d_name, ".")==0 || strcmp(dp->d_name, "..")==0)
+            continue;
+        if (strlen(dir)+strlen(dp->d_name)+2 > sizeof(name)) {
+            asfPrintWarning("dirwalk: name %s/%s exceeds buffersize.\n",
+                            dir, dp->d_name);
+            continue;
+        }
+        sprintf(name, "%s%c%s", dir, DIR_SEPARATOR, dp->d_name);
+        if (stat(name, &st) == -1)
+            continue;
+        if ((st.st_mode & S_IFMT) == S_IFDIR) {
+            refresh_dir(idx, name, n_changed);
+        } else {
+            char *ext = findExt(dp->d_name);
+            if (ext && strcmp_case(ext, ".img") == 0)
+                refresh_file(idx, name, n_changed);
+        }
+    }
+    closedir(dfd);
+}
+
+static int lat_bucket(dem_index *idx, double lat)
+{
+    int i = (int)floor(lat) - idx->lat0;
+    return i < 0 ? 0 : (i >= idx->n_lat ? idx->n_lat-1 : i);
+}
+
+static int lon_bucket(dem_index *idx, double lon)
+{
+    int j = (int)floor(lon) - idx->lon0;
+    return j < 0 ? 0 : (j >= idx->n_lon ? idx->n_lon-1 : j);
+}
+
+// Sets up the one-degree buckets over the DEM footprints
+static void build_buckets(dem_index *idx)
+{
+    int i, j, k, pass, n_dems = 0;
+    double lat_lo=999, lat_hi=-999, lon_lo=999, lon_hi=-999;
+
+    for (k=0; k<idx->n_entries; ++k) {
+        dem_index_entry *e = &idx->entries[k];
+        if (!e->is_dem)
+            continue;
+        ++n_dems;
+        if (e->lat_lo < lat_lo) lat_lo = e->lat_lo;
+        if (e->lat_hi > lat_hi) lat_hi = e->lat_hi;
+        if (e->lon_lo < lon_lo) lon_lo = e->lon_lo;
+        if (e->lon_hi > lon_hi) lon_hi = e->lon_hi;
+    }
+
+    if (n_dems == 0) {
+        idx->n_lat = idx->n_lon = 0;
+        return;
+    }
+
+    idx->lat0 = (int)floor(lat_lo);
+    idx->lon0 = (int)floor(lon_lo);
+    idx->n_lat = (int)floor(lat_hi) - idx->lat0 + 1;
+    idx->n_lon = (int)floor(lon_hi) - idx->lon0 + 1;
+
+    int n_buckets = idx->n_lat*idx->n_lon;
+    int *count = CALLOC(n_buckets, sizeof(int));
+    idx->bucket_start = MALLOC(sizeof(int)*(n_buckets+1));
+
+    for (pass=0; pass<2; ++pass) {
+        for (k=0; k<idx->n_entries; ++k) {
+            dem_index_entry *e = &idx->entries[k];
+            if (!e->is_dem)
+                continue;
+            int i0 = lat_bucket(idx, e->lat_lo), i1 = lat_bucket(idx, e->lat_hi);
+            int j0 = lon_bucket(idx, e->lon_lo), j1 = lon_bucket(idx, e->lon_hi);
+            for (i=i0; i<=i1; ++i) {
+                for (j=j0; j<=j1; ++j) {
+                    int b = i*idx->n_lon + j;
+                    if (pass == 0)
+                        ++count[b];
+                    else
+                        idx->bucket_entries[idx->bucket_start[b]+count[b]++] = k;
+                }
+            }
+        }
+        if (pass == 0) {
+            idx->bucket_start[0] = 0;
+            for (k=0; k<n_buckets; ++k) {
+                idx->bucket_start[k+1] = idx->bucket_start[k] + count[k];
+                count[k] = 0;
+            }
+            idx->bucket_entries =
+                MALLOC(sizeof(int)*(idx->bucket_start[n_buckets]+1));
+        }
+    }
+
+    FREE(count);
+}
+
+dem_index *dem_index_open(const char *dem_dir)
+{
+    int i, n_changed = 0, n_removed = 0;
+    dem_index *idx = CALLOC(1, sizeof(dem_index));
+    idx->dir = STRDUP(dem_dir);
+
+    // no trailing separator, the file names are built from this
+    int len = strlen(idx->dir);
+    while (len > 1 && idx->dir[len-1] == DIR_SEPARATOR)
+        idx->dir[--len] = '\0';
+
+    char *index_file = MALLOC(sizeof(char)*(len+strlen(DEM_INDEX_NAME)+2));
+    sprintf(index_file, "%s%c%s", idx->dir, DIR_SEPARATOR, DEM_INDEX_NAME);
+
+    read_index(idx, index_file);
+    int n_read = idx->n_entries;
+
+    // entries added during the refresh go on the end, lookups only
+    // search the sorted ones that came from the file
+    qsort(idx->entries, idx->n_entries, sizeof(dem_index_entry),
+          compare_entries);
+    idx->n_entries_sorted = idx->n_entries;
+
+    refresh_dir(idx, idx->dir, &n_changed);
+
+    // drop what wasn't found on disk any more
+    int n = 0;
+    for (i=0; i<idx->n_entries; ++i) {
+        if (idx->entries[i].seen) {
+            idx->entries[n++] = idx->entries[i];
+        } else {
+            FREE(idx->entries[i].file);
+            ++n_removed;
+        }
+    }
+    idx->n_entries = n;
+    qsort(idx->entries, idx->n_entries, sizeof(dem_index_entry),
+          compare_entries);
+    idx->n_entries_sorted = idx->n_entries;
+
+    if (n_changed > 0 || n_removed > 0 || n_read == 0)
+        write_index(idx, index_file);
+
+    asfPrintStatus("DEM index for %s: %d files, %d new or changed, "
+                   "%d removed.\n", idx->dir, idx->n_entries, n_changed,
+                   n_removed);
+
+    build_buckets(idx);
+
+    FREE(index_file);
+    return idx;
+}
+
+// Returns the DEMs whose bounding box intersects the given lat/lon box,
+// as indices into idx->entries (caller frees).
+int *dem_index_query(dem_index *idx, double lat_lo, double lat_hi,
+                     double lon_lo, double lon_hi, int *n_found)
+{
+    int i, j, k, shift;
+    int *found = MALLOC(sizeof(int)*(idx->n_entries+1));
+    char *taken = CALLOC(idx->n_entries+1, sizeof(char));
+
+    *n_found = 0;
+    if (idx->n_lat == 0) {
+        FREE(taken);
+        return found;
+    }
+
+    // footprints may have been unwrapped past +/-180
+    for (shift=-360; shift<=360; shift+=360) {
+        double lo = lon_lo + shift, hi = lon_hi + shift;
+        if (hi < idx->lon0 || lo >= idx->lon0 + idx->n_lon ||
+            lat_hi < idx->lat0 || lat_lo >= idx->lat0 + idx->n_lat)
+            continue;
+
+        int i0 = lat_bucket(idx, lat_lo), i1 = lat_bucket(idx, lat_hi);
+        int j0 = lon_bucket(idx, lo), j1 = lon_bucket(idx, hi);
+        for (i=i0; i<=i1; ++i) {
+            for (j=j0; j<=j1; ++j) {
+                int b = i*idx->n_lon + j;
+                for (k=idx->bucket_start[b]; k<idx->bucket_start[b+1]; ++k) {
+                    int m = idx->bucket_entries[k];
+                    dem_index_entry *e = &idx->entries[m];
+                    if (taken[m] || e->lat_hi < lat_lo || e->lat_lo > lat_hi ||
+                        e->lon_hi < lo || e->lon_lo > hi)
+                        continue;
+                    taken[m] = TRUE;
+                    found[(*n_found)++] = m;
+                }
+            }
+        }
+    }
+
+    FREE(taken);
+    return found;
+}
+
+void dem_index_free(dem_index *idx)
+{
+    int i;
+    if (!idx)
+        return;
+    for (i=0; i<idx->n_entries; ++i)
+        FREE(idx->entries[i].file);
+    free(idx->entries);
+    FREE(idx->bucket_start);
+    FREE(idx->bucket_entries);
+    FREE(idx->dir);
+    FREE(idx);
+}
@@ -0,0 +1,390 @@
+/*
+   Coarse-to-fine matching of the SAR image with the simulated SAR image.
+
+   match_dem normally runs fftMatch on the whole scene (or on one seed
+   region at a time, when there is a mask), and when the offset turns out
+   to be large it re-clips the DEM and starts over.  Here we instead:
+
+    (1) correlate block-averaged copies of both images, which is cheap
+        and bounds the offset over the whole scene, then
+    (2) match a set of full resolution seed squares, with the simulated
+        image pre-shifted by the coarse offset, all at once in parallel,
+        then
+    (3) combine the seed squares that agree with each other.
+
+   Every seed square's result is reported, so it is easy to see which
+   parts of the scene did (or didn't) match.
+*/
+
+#include <math.h>
+
+#include <asf.h>
+#include <asf_meta.h>
+#include <asf_raster.h>
+
+#include <asf_terrcorr.h>
+
+// largest dimension of the decimated images used for the coarse match
+static const int COARSE_SIZE = 1024;
+
+// size of the full resolution seed squares
+static const int REGION_SIZE = 1024;
+
+// don't bother with seed squares (or decimated images) smaller than this
+static const int MIN_REGION_SIZE = 64;
+
+// at most this many squares in each direction when there is no mask
+static const int MAX_GRID = 4;
+
+// seed squares within this many pixels of the consensus are combined
+static const float AGREE_DIST = 1.5;
+
+typedef struct {
+    int x, y;           // top left corner in the SAR image
+    int w, h;           // size
+    int sx, sy;         // top left corner in the simulated SAR image
+    float dx, dy, cert; // result of the match
+} seed_region_t;
+
+typedef struct {
+    char *srFile, *simFile;
+    meta_parameters *srMeta, *simMeta;
+    seed_region_t *regions;
+} seed_match_params_t;
+
+static int clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static int mini(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+// Same as fftMatchQ in asf_terrcorr.c: if the match fails, try again
+// with the chip taken from the other image
+static void match_buffers(float *sr, int nl1, int ns1,
+                          float *sim, int nl2, int ns2,
+                          float *dx, float *dy, float *cert)
+{
+    fftMatch_buffers(sr, nl1, ns1, sim, nl2, ns2, dx, dy, cert);
+
+    if (!meta_is_valid_double(*dx) || !meta_is_valid_double(*dy) ||
+        *cert==0)
+    {
+        fftMatch_buffers(sim, nl2, ns2, sr, nl1, ns1, dx, dy, cert);
+
+        if (meta_is_valid_double(*dx))
+            *dx = -(*dx);
+        if (meta_is_valid_double(*dy))
+            *dy = -(*dy);
+    }
+}
+
+// Reads the image, averaging (f x f) blocks of valid pixels
+static float *read_decimated(char *file, meta_parameters *meta, int f,
+                             int *dnl, int *dns)
+{
+    int nl = meta->general->line_count;
+    int ns = meta->general->sample_count;
+    int i, j, k;
+
+    *dnl = nl/f;
+    *dns = ns/f;
+
+    float *out = MALLOC(sizeof(float) * (*dnl) * (*dns));
+    float *buf = MALLOC(sizeof(float) * ns * f);
+    double *sum = MALLOC(sizeof(double) * (*dns));
+    int *cnt = MALLOC(sizeof(int) * (*dns));
+
+    FILE *fp = fopenImage(file, "rb");
+    for (i=0; i<*dnl; ++i) {
+        get_float_lines(fp, meta, i*f, f, buf);
+        for (j=0; j<*dns; ++j) {
+            sum[j] = 0;
+            cnt[j] = 0;
+        }
+        for (k=0; k<ns*f; ++k) {
+            j = (k%ns)/f;
+            if (j < *dns && meta_is_valid_double(buf[k])) {
+                sum[j] += buf[k];
+                ++cnt[j];
+            }
+        }
+        for (j=0; j<*dns; ++j)
+            out[i*(*dns)+j] = cnt[j] > 0 ? sum[j]/cnt[j] : 0;
+    }
+    FCLOSE(fp);
+
+    FREE(buf);
+    FREE(sum);
+    FREE(cnt);
+    return out;
+}
+
+static float *read_region(char *file, meta_parameters *meta,
+                          int x, int y, int w, int h)
+{
+    float *buf = MALLOC(sizeof(float) * w * h);
+    FILE *fp = fopenImage(file, "rb");
+    get_partial_float_lines(fp, meta, y, h, x, w, buf);
+    FCLOSE(fp);
+    return buf;
+}
+
+// runs in a worker thread -- one seed square
+static void match_region(int i, int thread, void *p)
+{
+    seed_match_params_t *params = (seed_match_params_t*)p;
+    seed_region_t *r = &params->regions[i];
+
+    float *sr = read_region(params->srFile, params->srMeta,
+                            r->x, r->y, r->w, r->h);
+    float *sim = read_region(params->simFile, params->simMeta,
+                             r->sx, r->sy, r->w, r->h);
+
+    match_buffers(sr, r->h, r->w, sim, r->h, r->w, &r->dx, &r->dy, &r->cert);
+
+    // the simulated image was pre-shifted, add that back in
+    if (meta_is_valid_double(r->dx) && meta_is_valid_double(r->dy)) {
+        r->dx += r->x - r->sx;
+        r->dy += r->y - r->sy;
+    }
+
+    FREE(sr);
+    FREE(sim);
+}
+
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+static float median(float *v, int n)
+{
+    qsort(v, n, sizeof(float), compare_floats);
+    return n%2 ? v[n/2] : (v[n/2-1] + v[n/2])/2;
+}
+
+// Adds a seed square of (at most) REGION_SIZE pixels, centered on the
+// given region, to the list.  The simulated SAR square is shifted by the
+// coarse offset, but kept inside the simulated image.
+static void add_region(seed_region_t *regions, int *n, int xtl, int ytl,
+                       int xbr, int ybr, int cdx, int cdy,
+                       int sr_nl, int sr_ns, int sim_nl, int sim_ns)
+{
+    int w = xbr - xtl;
+    int h = ybr - ytl;
+    if (w > REGION_SIZE) w = REGION_SIZE;
+    if (h > REGION_SIZE) h = REGION_SIZE;
+    if (w > sim_ns) w = sim_ns;
+    if (h > sim_nl) h = sim_nl;
+    if (w < MIN_REGION_SIZE || h < MIN_REGION_SIZE)
+        return;
+
+    seed_region_t *r = &regions[*n];
+    r->x = clamp((xtl + xbr - w)/2, 0, sr_ns - w);
+    r->y = clamp((ytl + ybr - h)/2, 0, sr_nl - h);
+    r->sx = clamp(r->x - cdx, 0, sim_ns - w);
+    r->sy = clamp(r->y - cdy, 0, sim_nl - h);
+    r->w = w;
+    r->h = h;
+    r->dx = r->dy = r->cert = 0;
+    ++(*n);
+}
+
+// Finds the offset of simFile relative to srFile (same sense as fftMatch).
+// When n_seeds is nonzero, the seed squares are taken from the given
+// lists (as returned by lay_seeds, squares with no good pixels are
+// skipped), otherwise a grid of squares covering the scene is used.
+// Returns TRUE if at least one seed square matched with a certainty of
+// at least cert_cutoff, and the good squares agree on the offset.
+// Otherwise, the offset and certainty of the best
+// (or coarse) match are returned.
+int multiscale_match(char *srFile, char *simFile, int n_seeds,
+                     int *x_tl_list, int *y_tl_list,
+                     int *x_br_list, int *y_br_list, float *good_pct_list,
+                     float cert_cutoff, float *dx, float *dy, float *cert)
+{
+    meta_parameters *srMeta = meta_read(srFile);
+    meta_parameters *simMeta = meta_read(simFile);
+    int sr_nl = srMeta->general->line_count;
+    int sr_ns = srMeta->general->sample_count;
+    int sim_nl = simMeta->general->line_count;
+    int sim_ns = simMeta->general->sample_count;
+    int i, j, n;
+
+    // (1) Coarse match
+    int f = 1;
+    while ((sr_nl > sr_ns ? sr_nl : sr_ns)/f > COARSE_SIZE)
+        f *= 2;
+
+    float cdx = 0, cdy = 0, ccert = 0;
+    if (mini(sr_nl, sim_nl)/f >= MIN_REGION_SIZE &&
+        mini(sr_ns, sim_ns)/f >= MIN_REGION_SIZE)
+    {
+        int nl1, ns1, nl2, ns2;
+        float *sr_d = read_decimated(srFile, srMeta, f, &nl1, &ns1);
+        float *sim_d = read_decimated(simFile, simMeta, f, &nl2, &ns2);
+
+        fftMatch_buffers_init(nl1, ns1);
+        fftMatch_buffers_init(nl2, ns2);
+        match_buffers(sr_d, nl1, ns1, sim_d, nl2, ns2, &cdx, &cdy, &ccert);
+
+        FREE(sr_d);
+        FREE(sim_d);
+
+        if (meta_is_valid_double(cdx) && meta_is_valid_double(cdy)) {
+            cdx *= f;
+            cdy *= f;
+        } else {
+            cdx = cdy = ccert = 0;
+        }
+
+        asfPrintStatus("Coarse match (1/%d scale, cert=%5.2f%%): "
+                       "dx=%f, dy=%f.\n", f, 100*ccert, cdx, cdy);
+
+        if (ccert < cert_cutoff) {
+            asfPrintStatus("Coarse match is not certain enough, seed squares "
+                           "will not be pre-shifted.\n");
+            cdx = cdy = 0;
+        }
+    }
+
+    int icdx = (int)floor(cdx+.5);
+    int icdy = (int)floor(cdy+.5);
+
+    // (2) Seed squares, at full resolution
+    int max_regions = n_seeds > 0 ? n_seeds : MAX_GRID*MAX_GRID;
+    seed_region_t *regions = MALLOC(sizeof(seed_region_t)*max_regions);
+    n = 0;
+
+    if (n_seeds > 0) {
+        for (i=0; i<n_seeds; ++i) {
+            if (good_pct_list[i] > 0)
+                add_region(regions, &n, x_tl_list[i], y_tl_list[i],
+                           x_br_list[i], y_br_list[i], icdx, icdy,
+                           sr_nl, sr_ns, sim_nl, sim_ns);
+        }
+    } else {
+        int nx = clamp(sr_ns/REGION_SIZE, 1, MAX_GRID);
+        int ny = clamp(sr_nl/REGION_SIZE, 1, MAX_GRID);
+        for (i=0; i<ny; ++i)
+            for (j=0; j<nx; ++j)
+                add_region(regions, &n, j*sr_ns/nx, i*sr_nl/ny,
+                           (j+1)*sr_ns/nx, (i+1)*sr_nl/ny, icdx, icdy,
+                           sr_nl, sr_ns, sim_nl, sim_ns);
+    }
+
+    for (i=0; i<n; ++i)
+        fftMatch_buffers_init(regions[i].h, regions[i].w);
+
+    asfPrintStatus("Matching %d seed square%s using %d thread%s...\n",
+                   n, n==1 ? "" : "s", asf_get_num_threads(),
+                   asf_get_num_threads()==1 ? "" : "s");
+
+    seed_match_params_t params;
+    params.srFile = srFile;
+    params.simFile = simFile;
+    params.srMeta = srMeta;
+    params.simMeta = simMeta;
+    params.regions = regions;
+    asf_parallel_for(n, match_region, &params);
+
+    // (3) Combine the good ones
+    float *gx = MALLOC(sizeof(float)*(n+1));
+    float *gy = MALLOC(sizeof(float)*(n+1));
+    int n_good = 0;
+
+    asfPrintStatus("  Square  Lines         Samples         Cert     "
+                   "dx          dy\n");
+    for (i=0; i<n; ++i) {
+        seed_region_t *r = &regions[i];
+        int good = r->cert >= cert_cutoff &&
+            meta_is_valid_double(r->dx) && meta_is_valid_double(r->dy);
+        asfPrintStatus("  %4d    %5d-%-5d   %5d-%-5d   %6.2f%%  %10.4f  "
+                       "%10.4f%s\n", i+1, r->y, r->y+r->h, r->x, r->x+r->w,
+                       100*r->cert, r->dx, r->dy, good ? "" : "  (rejected)");
+        if (good) {
+            gx[n_good] = r->dx;
+            gy[n_good] = r->dy;
+            ++n_good;
+        }
+    }
+
+    int ok = n_good > 0;
+    if (ok) {
+        float mx = median(gx, n_good);
+        float my = median(gy, n_good);
+        double sx = 0, sy = 0, sw = 0;
+        float best = 0;
+        int n_agree = 0;
+
+        // certainty-weighted average of the squares that agree with the
+        // median offset
+        for (i=0; i<n; ++i) {
+            seed_region_t *r = &regions[i];
+            if (r->cert >= cert_cutoff &&
+                fabs(r->dx - mx) <= AGREE_DIST && fabs(r->dy - my) <= AGREE_DIST)
+            {
+                sx += r->cert * r->dx;
+                sy += r->cert * r->dy;
+                sw += r->cert;
+                if (r->cert > best) best = r->cert;
+                ++n_agree;
+            }
+        }
+
+        if (n_agree > 0 && sw > 0) {
+            *dx = sx/sw;
+            *dy = sy/sw;
+            *cert = best;
+
+            asfPrintStatus("%d of %d seed squares agree (%d above %.0f%% "
+                           "certainty).\n", n_agree, n, n_good,
+                           100*cert_cutoff);
+        }
+        else {
+            // The medians are taken separately in x and y, so it is
+            // possible for none of the good squares to be near both
+            asfPrintStatus("None of the %d good seed squares agree with "
+                           "their median offset.\n", n_good);
+            ok = FALSE;
+        }
+    }
+
+    if (!ok) {
+        // nothing good -- return the best we've got, let the caller decide
+        int best = -1;
+        for (i=0; i<n; ++i)
+            if (meta_is_valid_double(regions[i].dx) &&
+                meta_is_valid_double(regions[i].dy) &&
+                (best < 0 || regions[i].cert > regions[best].cert))
+                best = i;
+
+        if (best >= 0 && regions[best].cert > ccert) {
+            *dx = regions[best].dx;
+            *dy = regions[best].dy;
+            *cert = regions[best].cert;
+        } else {
+            *dx = cdx;
+            *dy = cdy;
+            *cert = ccert;
+        }
+
+        if (n_good == 0)
+            asfPrintStatus("None of the %d seed squares matched with at "
+                           "least %.0f%% certainty.\n", n, 100*cert_cutoff);
+    }
+
+    FREE(gx);
+    FREE(gy);
+    FREE(regions);
+    meta_free(srMeta);
+    meta_free(simMeta);
+
+    return ok;
+}
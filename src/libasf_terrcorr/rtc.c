@@ -26,118 +26,199 @@ static void geodetic_to_ecef(double lat, double lon, double h, Vector *v)
   v->z = (a*(1-e2)/f + h)*sin_lat;
 }
 
-static Vector get_satpos(meta_parameters *meta, int line)
+// Satellite position at the center of each image line, lines first to
+// last, propagated from the state vector closest in time.  This is not
+// meta_get_stVec()'s interpolation on purpose: RTC has always used the
+// propagated positions, and its output should not change with them.
+static void get_satpos(meta_parameters *meta, int first, int last,
+                       Vector *satpos)
 {
   int ns = meta->general->sample_count;
-  double t = meta_get_time(meta, line, ns/2);
-
-  // find the state vector closest to the specified time
-  int ii,closest_ii=0;
-  double closest_diff=9999999;
-  for (ii=0; ii<meta->state_vectors->vector_count; ++ii) {
-    double diff = fabs(meta->state_vectors->vecs[ii].time - t);
-    if (diff < closest_diff) {
-      closest_ii = ii;
-      closest_diff = diff;
+  int line, ii;
+
+  for (line=first; line<=last; ++line) {
+    double t = meta_get_time(meta, line, ns/2);
+
+    // find the state vector closest to the specified time
+    int closest_ii=0;
+    double closest_diff=9999999;
+    for (ii=0; ii<meta->state_vectors->vector_count; ++ii) {
+      double diff = fabs(meta->state_vectors->vecs[ii].time - t);
+      if (diff < closest_diff) {
+        closest_ii = ii;
+        closest_diff = diff;
+      }
     }
-  }
 
-  stateVector closest_vec = meta->state_vectors->vecs[closest_ii].vec;
-  double closest_time = meta->state_vectors->vecs[closest_ii].time;
+    stateVector closest_vec = meta->state_vectors->vecs[closest_ii].vec;
+    double closest_time = meta->state_vectors->vecs[closest_ii].time;
 
-  stateVector stVec = propagate(closest_vec, closest_time, t);
+    stateVector stVec = propagate(closest_vec, closest_time, t);
 
-  Vector satpos;
-  satpos.x = stVec.pos.x;
-  satpos.y = stVec.pos.y;
-  satpos.z = stVec.pos.z;
-  return satpos;
+    satpos[line].x = stVec.pos.x;
+    satpos[line].y = stVec.pos.y;
+    satpos[line].z = stVec.pos.z;
+  }
 }
 
-static void calculate_vectors_for_line(meta_parameters *meta_dem, meta_parameters *meta_img, int line, FILE *dem_fp, Vector **vectorLine, Vector *nextVectors)
+// Number of image lines handed to a worker at a time
+#define ROWS_PER_BLOCK 32
+
+// The correction for a line needs the surface positions (the DEM height
+// placed at each pixel's lat/lon) of the lines just above and below it,
+// so each block of lines is computed from its own DEM lines plus a halo
+// line on either side.  A batch of blocks is computed in parallel, and
+// the results are then written out in order.  The arithmetic is the same,
+// operation for operation, as the line-by-line version this replaced,
+// except for two fixes that do change the output:
+//   - That version set up DEM lines 0 and 1 with the image and DEM
+//     metadata swapped, so those lines were placed using the DEM's
+//     geolocation.  Image line 1 uses both lines and image line 2 uses
+//     line 1, so the corrections of lines 1 and 2 change wherever the two
+//     metadata files geolocate differently.  All DEM lines now use the
+//     image geolocation.
+//   - It cleared incidence angle [nl-1] instead of [ns-1], which left the
+//     last column of the saved incidence angles unset (and wrote past the
+//     end of the line when nl > ns).  That column is now 0.
+
+typedef struct {
+  int ns, nb;
+  int batch_start;          // first image line in the current batch
+  int batch_end;            // one past the last image line in the batch
+  int batch_lines;          // lines allocated per band in in/out/corr/incid
+  char **bands;
+  Vector *satpos;           // satellite position for each image line
+  float *dem;               // DEM lines batch_start-1 .. batch_end
+  float *in, *out;          // image lines, all bands
+  float *corr, *incid;      // correction and incidence angle per pixel
+  // per-thread
+  meta_parameters **meta;   // get_rad_cal_dn() changes the metadata
+  double **lat, **lon;
+  Vector **pos;
+} rtc_params_t;
+
+static Vector vector_diff(const Vector *a, const Vector *b)
 {
-  int jj;
-  double lat, lon;
-  int ns = meta_img->general->sample_count;
-  float demLine[ns];
-
-  get_float_line(dem_fp, meta_dem, line, demLine);
-
-  for(jj = 0; jj < ns; ++jj) {
-    Vector *v = MALLOC(sizeof(Vector));
-    meta_get_latLon(meta_img, line, jj, 0, &lat, &lon);
-    geodetic_to_ecef(lat, lon, demLine[jj], v);
-    vectorLine[jj] = v;
-
-    meta_get_latLon(meta_img, line+1, jj, 0, &lat, &lon);
-    geodetic_to_ecef(lat, lon, demLine[jj], &nextVectors[jj]);
-  }
+  Vector d;
+  d.x = a->x - b->x;
+  d.y = a->y - b->y;
+  d.z = a->z - b->z;
+  return d;
 }
 
-static void push_next_vector_line(Vector ***localVectors, Vector *nextVectors, meta_parameters *meta_dem, meta_parameters *meta_img, FILE *dem_fp, int line)
+static Vector vector_unit(Vector v)
 {
-  int ns = meta_img->general->sample_count;
-  Vector **vectorsLine = MALLOC(sizeof(Vector*)*ns);
-  calculate_vectors_for_line(meta_dem, meta_img, line, dem_fp, vectorsLine, nextVectors);
-
-  int i;
-  for(i = 0; i < ns; i++)
-    if(localVectors[0] != NULL)
-      vector_free(localVectors[0][i]);
-  FREE(localVectors[0]);
-
-  localVectors[0] = localVectors[1];
-  localVectors[1] = localVectors[2];
-  localVectors[2] = vectorsLine;
+  double f = 1./sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+  v.x *= f;
+  v.y *= f;
+  v.z *= f;
+  return v;
 }
 
-static Vector * calculate_normal(Vector ***localVectors, int sample)
+static Vector vector_cross_val(const Vector *a, const Vector *b)
 {
-  Vector *v1, *v2, *normal;
-
-  v1 = vector_copy(localVectors[0][sample]);
-  vector_subtract(v1, localVectors[2][sample]);
-
-  v2 = vector_copy(localVectors[1][sample-1]);
-  vector_subtract(v2, localVectors[1][sample+1]);
-
-  normal = vector_cross(v2, v1);
-  vector_multiply(normal, 1./vector_magnitude(normal));
+  Vector c;
+  c.x = a->y * b->z - a->z * b->y;
+  c.y = a->z * b->x - a->x * b->z;
+  c.z = a->x * b->y - a->y * b->x;
+  return c;
+}
 
-  vector_free(v1);
-  vector_free(v2);
-  
-  return normal;
+// Surface normal at a sample, from its neighbours in the lines above and
+// below and in the same line
+static Vector calculate_normal(const Vector *above, const Vector *here,
+                               const Vector *below, int sample)
+{
+  Vector v1 = vector_diff(&above[sample], &below[sample]);
+  Vector v2 = vector_diff(&here[sample-1], &here[sample+1]);
+  Vector normal = vector_cross_val(&v2, &v1);
+  return vector_unit(normal);
 }
 
 static float
-calculate_correction(meta_parameters *meta_in, int line, int samp,
-                     Vector *satpos, Vector *n, Vector *p, Vector *p_next, float incid_angle)
+calculate_correction(const Vector *satpos, const Vector *n, const Vector *p,
+                     const Vector *p_next, float incid_angle)
 {
   // R: vector from ground point (p) to satellite (satpos)
-  Vector *R = vector_copy(satpos);
-  vector_subtract(R, p);
-  vector_multiply(R, 1./vector_magnitude(R));
-
-  Vector *x = vector_copy(p);
-  vector_subtract(x, p_next);
-  vector_multiply(x, 1./vector_magnitude(x));
+  Vector R = vector_unit(vector_diff(satpos, p));
+  Vector x = vector_unit(vector_diff(p, p_next));
 
   // Rx: R cross x -- image plane normal
-  Vector *Rx = vector_cross(R,x);
+  Vector Rx = vector_cross_val(&R, &x);
 
   // cos(phi) is the correction factor we need
-  double cosphi = vector_dot(Rx,n);
+  double cosphi = Rx.x*n->x + Rx.y*n->y + Rx.z*n->z;
   if (cosphi < 0) cosphi = -cosphi;
 
-  vector_free(x);
-  vector_free(R);
-  vector_free(Rx);
-
   // need to remove old correction factor (sin of the incidence angle)
   return cosphi / sin(incid_angle);
 }
 
+static void rtc_block(int i, int thread, void *params)
+{
+  rtc_params_t *p = (rtc_params_t*)params;
+  int ns = p->ns;
+  int first = p->batch_start + i*ROWS_PER_BLOCK;
+  int last = first + ROWS_PER_BLOCK < p->batch_end ?
+    first + ROWS_PER_BLOCK : p->batch_end;
+  int n = last - first;
+  meta_parameters *meta = p->meta[thread];
+  double *lat = p->lat[thread];
+  double *lon = p->lon[thread];
+  Vector *pos = p->pos[thread];
+  int ii, jj, kk;
+
+  // Lat/lon for lines first-1 .. last+1: a line's own surface position
+  // uses its own DEM line, while the along-track neighbour of a pixel is
+  // placed two lines down, at the height of the next line.
+  for (ii=0; ii<n+3; ++ii)
+    for (jj=0; jj<ns; ++jj)
+      meta_get_latLon(meta, first-1+ii, jj, 0, &lat[ii*ns+jj], &lon[ii*ns+jj]);
+
+  // Surface positions for lines first-1 .. last
+  for (ii=0; ii<n+2; ++ii) {
+    float *dem = p->dem + (first-1+ii - (p->batch_start-1))*ns;
+    for (jj=0; jj<ns; ++jj)
+      geodetic_to_ecef(lat[ii*ns+jj], lon[ii*ns+jj], dem[jj], &pos[ii*ns+jj]);
+  }
+
+  for (ii=0; ii<n; ++ii) {
+    int line = first + ii;
+    int off = (line - p->batch_start)*ns;
+    Vector *above = &pos[ii*ns];
+    Vector *here = &pos[(ii+1)*ns];
+    Vector *below = &pos[(ii+2)*ns];
+    float *dem_below = p->dem + (line+1 - (p->batch_start-1))*ns;
+    double *lat2 = &lat[(ii+3)*ns];
+    double *lon2 = &lon[(ii+3)*ns];
+    float *corr = &p->corr[off];
+    float *incid = &p->incid[off];
+    Vector *satpos = &p->satpos[line];
+
+    corr[0] = corr[ns-1] = 1;
+    incid[0] = incid[ns-1] = 0;
+    for (jj=1; jj<ns-1; ++jj)
+      incid[jj] = meta_incid(meta, line, jj);
+
+    for (jj=1; jj<ns-1; ++jj) {
+      Vector next;
+      geodetic_to_ecef(lat2[jj], lon2[jj], dem_below[jj], &next);
+      Vector normal = calculate_normal(above, here, below, jj);
+      corr[jj] = calculate_correction(satpos, &normal, &here[jj], &next,
+                                      incid[jj]);
+    }
+
+    for (kk=0; kk<p->nb; ++kk) {
+      size_t band_off = (size_t)kk*p->batch_lines*ns + off;
+      float *bufIn = &p->in[band_off];
+      float *bufOut = &p->out[band_off];
+      for (jj=0; jj<ns; ++jj)
+        bufOut[jj] = get_rad_cal_dn(meta, line, jj, p->bands[kk],
+                                    bufIn[jj], corr[jj]);
+    }
+  }
+}
+
 int rtc(char *input_file, char *dem_file, int maskFlag, char *mask_file,
         char *output_file, int save_incid_angles)
 {
@@ -206,15 +287,11 @@ int rtc(char *input_file, char *dem_file, int maskFlag, char *mask_file,
   assert(ns == dns);
   assert(nl == dnl);
 
-  Vector **localVectors[3] = { NULL, NULL, NULL };
-  Vector nextVectors[ns];
-
   FILE *fpIn = FOPEN(inputImg, "rb");
   FILE *fpOut = FOPEN(outputImg, "wb");
   FILE *dem_fp = FOPEN(demImg, "rb");
 
   float corr[ns];
-  float incid_angles[ns];
   memset(corr, 0, sizeof(float)*ns);
   float bufIn[ns];
   float bufOut[ns];
@@ -222,11 +299,42 @@ int rtc(char *input_file, char *dem_file, int maskFlag, char *mask_file,
   asfPrintStatus("Applying radiometric correction...\n");
 
   int ii, jj, kk;
-  for(ii = 1; ii < 3; ++ii) {
-    localVectors[ii] = MALLOC(sizeof(Vector**)*ns);
-    calculate_vectors_for_line(meta_in, meta_dem, ii - 1, dem_fp, localVectors[ii], nextVectors);
+  int n_threads = asf_get_num_threads();
+  int batch_lines = n_threads*ROWS_PER_BLOCK;
+  if (batch_lines > nl) batch_lines = nl;
+
+  rtc_params_t params;
+  params.ns = ns;
+  params.nb = nb;
+  params.batch_lines = batch_lines;
+  params.bands = bands;
+  params.satpos = MALLOC(sizeof(Vector)*nl);
+  params.dem = MALLOC(sizeof(float)*(batch_lines+2)*ns);
+  params.in = MALLOC(sizeof(float)*nb*batch_lines*ns);
+  params.out = MALLOC(sizeof(float)*nb*batch_lines*ns);
+  params.corr = MALLOC(sizeof(float)*batch_lines*ns);
+  params.incid = MALLOC(sizeof(float)*batch_lines*ns);
+  params.meta = MALLOC(sizeof(meta_parameters*)*n_threads);
+  params.lat = MALLOC(sizeof(double*)*n_threads);
+  params.lon = MALLOC(sizeof(double*)*n_threads);
+  params.pos = MALLOC(sizeof(Vector*)*n_threads);
+  for (ii=0; ii<n_threads; ++ii) {
+    params.meta[ii] = meta_copy(meta_in);
+    params.lat[ii] = MALLOC(sizeof(double)*(ROWS_PER_BLOCK+3)*ns);
+    params.lon[ii] = MALLOC(sizeof(double)*(ROWS_PER_BLOCK+3)*ns);
+    params.pos[ii] = MALLOC(sizeof(Vector)*(ROWS_PER_BLOCK+2)*ns);
   }
 
+  // The satellite position only depends on the line.  Only the interior
+  // lines are corrected, so there is nothing to do for fewer than 3 lines.
+  if (nl > 2)
+    get_satpos(meta_in, 1, nl - 2, params.satpos);
+
+  // Some geolocation paths set up cached values on their first call, get
+  // that out of the way before starting the threads
+  double lat, lon;
+  meta_get_latLon(params.meta[0], 0, 0, 0, &lat, &lon);
+
   if(save_incid_angles) {
     put_band_float_line(fpSide, side_meta, 1, 0, corr);
     put_band_float_line(fpSide, side_meta, 1, nl - 1, corr);
@@ -240,48 +348,56 @@ int rtc(char *input_file, char *dem_file, int maskFlag, char *mask_file,
     put_band_float_line(fpOut, meta_out, kk, 0, bufOut);
   }
 
-  for(ii = 1; ii < nl - 1; ++ii) {
-    push_next_vector_line(localVectors, nextVectors, meta_dem, meta_in, dem_fp, ii + 1);
-    corr[0] = corr[ns-1] = 1;
-    Vector satpos = get_satpos(meta_in, ii);
-    incid_angles[0] = incid_angles[nl-1] = 0;
-    for(jj = 1; jj < ns - 1; ++jj) {
-      incid_angles[jj] = meta_incid(meta_in, ii, jj);
-      Vector * normal = calculate_normal(localVectors, jj);
-      corr[jj] = calculate_correction(meta_in, ii, jj, &satpos, normal, localVectors[1][jj], &nextVectors[jj], incid_angles[jj]);
-      vector_free(normal);
-    }
+  for(ii = 1; ii < nl - 1; ii += batch_lines) {
+    int n = nl - 1 - ii < batch_lines ? nl - 1 - ii : batch_lines;
+    params.batch_start = ii;
+    params.batch_end = ii + n;
+
+    // DEM lines ii-1 .. ii+n, the halo lines included
+    get_float_lines(dem_fp, meta_dem, ii - 1, n + 2, params.dem);
+    for (kk=0; kk<nb; ++kk)
+      get_band_float_lines(fpIn, meta_in, kk, ii, n,
+                           &params.in[(size_t)kk*batch_lines*ns]);
+
+    asf_parallel_for((n + ROWS_PER_BLOCK - 1)/ROWS_PER_BLOCK, rtc_block,
+                     &params);
 
     if(save_incid_angles) {
-      put_band_float_line(fpSide, side_meta, 0, ii, incid_angles);
-      put_band_float_line(fpSide, side_meta, 1, ii, corr);
+      put_band_float_lines(fpSide, side_meta, 0, ii, n, params.incid);
+      put_band_float_lines(fpSide, side_meta, 1, ii, n, params.corr);
     }
 
-    for (kk=0; kk<nb; ++kk) {
-      get_band_float_line(fpIn, meta_in, kk, ii, bufIn);
-      for (jj=0; jj<ns; ++jj)
-        bufOut[jj] = get_rad_cal_dn(meta_in, ii, jj, bands[kk], bufIn[jj], corr[jj]);
-      put_band_float_line(fpOut, meta_out, kk, ii, bufOut);
-    }
+    for (kk=0; kk<nb; ++kk)
+      put_band_float_lines(fpOut, meta_out, kk, ii, n,
+                           &params.out[(size_t)kk*batch_lines*ns]);
 
-    asfLineMeter(ii+1, nl);
+    asfLineMeter(ii + n, nl);
   }
 
-    // We aren't applying the correction to the edges of the image
+  // We aren't applying the correction to the edges of the image
   for(kk = 0; kk < nb; ++kk) {
     get_band_float_line(fpIn, meta_in, kk, nl-1, bufIn);
-    for (jj=0; jj<ns; ++jj)
-      bufOut[jj] = get_rad_cal_dn(meta_in, nl-1, jj, bands[kk], bufIn[jj], corr[jj]);
     put_band_float_line(fpOut, meta_out, kk, nl-1, bufIn);
   }
 
-  for(ii = 0; ii < 3; ++ii) {
-    for(jj = 0; jj < ns; ++jj) {
-      vector_free(localVectors[ii][jj]);
-    }
-    FREE(localVectors[ii]);
+  for (ii=0; ii<n_threads; ++ii) {
+    meta_free(params.meta[ii]);
+    FREE(params.lat[ii]);
+    FREE(params.lon[ii]);
+    FREE(params.pos[ii]);
   }
-
+  FREE(params.meta);
+  FREE(params.lat);
+  FREE(params.lon);
+  FREE(params.pos);
+  FREE(params.satpos);
+  FREE(params.dem);
+  FREE(params.in);
+  FREE(params.out);
+  FREE(params.corr);
+  FREE(params.incid);
+
+  FCLOSE(dem_fp);
   FCLOSE(fpOut);
   FCLOSE(fpIn);
   if (fpSide) FCLOSE(fpSide);